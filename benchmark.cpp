@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "benchmark.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <nvh/nvprint.hpp>
+
+namespace csfthreaded {
+
+void getBenchmarkThreads(uint32_t maxThreads, std::vector<uint32_t>& threads)
+{
+  threads.clear();
+  for(uint32_t numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+  {
+    threads.push_back(numThreads);
+  }
+  threads.push_back(maxThreads);
+}
+
+void benchmarkThreads(ThreadPool& pool, const char* label, const std::function<double(uint32_t numThreads)>& fn)
+{
+  std::vector<uint32_t> threads;
+  getBenchmarkThreads(pool.getNumThreads(), threads);
+
+  BenchmarkLine line;
+  line.append("%s", label);
+  for(uint32_t numThreads : threads)
+  {
+    double time = fn(numThreads);
+    line.append(" %d threads %7.3f", numThreads, time);
+  }
+  LOGI("%s\n", line.c_str());
+}
+
+void BenchmarkLine::append(const char* fmt, ...)
+{
+  if(m_used >= sizeof(m_line))
+    return;
+
+  va_list args;
+  va_start(args, fmt);
+  int written = vsnprintf(m_line + m_used, sizeof(m_line) - m_used, fmt, args);
+  va_end(args);
+
+  if(written > 0)
+  {
+    m_used += size_t(written);
+  }
+}
+
+void getBenchmarkViews(const CadScene& scene, std::vector<BenchmarkView>& views)
+{
+  glm::vec3 sceneMin  = glm::vec3(scene.m_bbox.min);
+  glm::vec3 sceneMax  = glm::vec3(scene.m_bbox.max);
+  glm::vec3 center    = (sceneMin + sceneMax) * 0.5f;
+  float     dimension = glm::length(sceneMax - sceneMin);
+
+  glm::mat4 projection = glm::perspective(glm::radians(BENCHMARK_FOV), BENCHMARK_ASPECT, dimension * 0.001f, dimension * 10.0f);
+
+  struct Eye
+  {
+    const char* name;
+    glm::vec3   eye;
+    glm::vec3   target;
+  };
+  Eye eyes[] = {
+      {"overview", center + (sceneMax - center) * 2.0f, center},
+      {"close-up", center + (sceneMax - center) * 0.25f, center},
+      {"inside", center, center + glm::vec3(1, 0, 0)},
+  };
+
+  views.clear();
+  for(const Eye& eye : eyes)
+  {
+    BenchmarkView view;
+    view.name           = eye.name;
+    view.viewMatrix     = glm::lookAt(eye.eye, eye.target, glm::vec3(0, 1, 0));
+    view.viewProjMatrix = projection * view.viewMatrix;
+    views.push_back(view);
+  }
+}
+
+}  // namespace csfthreaded
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include "cadscene.hpp"
+#include "threadpool.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace csfthreaded {
+
+// 1, 2, 4 ... and all threads, the thread counts the benchmarks measure
+void getBenchmarkThreads(uint32_t maxThreads, std::vector<uint32_t>& threads);
+
+// logs label followed by the time [ms] fn returns for every benchmark thread count of the pool
+void benchmarkThreads(ThreadPool& pool, const char* label, const std::function<double(uint32_t numThreads)>& fn);
+
+// one row of benchmark output, appends are dropped once the line is full
+class BenchmarkLine
+{
+public:
+  BenchmarkLine() { m_line[0] = 0; }
+
+  void append(const char* fmt, ...);
+
+  const char* c_str() const { return m_line; }
+
+private:
+  char   m_line[256];
+  size_t m_used = 0;
+};
+
+// the entire scene, a close-up of its center and looking out of its center,
+// seen with the BENCHMARK_FOV / BENCHMARK_ASPECT projection
+static const float BENCHMARK_FOV    = 45.0f;
+static const float BENCHMARK_ASPECT = 16.0f / 9.0f;
+
+struct BenchmarkView
+{
+  const char* name;
+  glm::mat4   viewMatrix;
+  glm::mat4   viewProjMatrix;
+};
+
+void getBenchmarkViews(const CadScene& scene, std::vector<BenchmarkView>& views);
+
+}  // namespace csfthreaded
@@ -106,6 +106,253 @@ inline glm::vec3 float32x3_to_octn_precise(glm::vec3 v, const int n)
   return bestRepresentation;
 }
 
+struct WireEdge
+{
+  uint64_t key;  // welded vertex pair
+  uint32_t a;
+  uint32_t b;
+  int      part;
+  int      face;  // -1 for csf wire
+};
+
+static bool WireEdge_compare(const WireEdge& a, const WireEdge& b)
+{
+  if(a.key != b.key)
+    return a.key < b.key;
+  if(a.part != b.part)
+    return a.part < b.part;
+  return a.face < b.face;
+}
+
+// builds per-part wire indices, either from the file or as deduplicated feature edges:
+// boundary edges, edges between different parts and edges whose faces exceed the crease angle
+static void buildWireIndices(const CSFGeometry*         csfgeom,
+                             CadScene::WireEdges        wireEdges,
+                             float                      creaseAngle,
+                             std::vector<unsigned int>& wireIndices,
+                             std::vector<int>&          partCounts)
+{
+  partCounts.assign(csfgeom->numParts, 0);
+
+  if(wireEdges == CadScene::WIRE_EDGES_CSF)
+  {
+    for(int p = 0; p < csfgeom->numParts; p++)
+    {
+      partCounts[p] = csfgeom->indexWire ? csfgeom->parts[p].numIndexWire : 0;
+    }
+    if(csfgeom->indexWire)
+    {
+      wireIndices.assign(csfgeom->indexWire, csfgeom->indexWire + csfgeom->numIndexWire);
+    }
+    return;
+  }
+
+  // weld vertices by position, exports split vertices along creases
+  std::vector<uint32_t> welded(csfgeom->numVertices);
+  {
+    std::vector<uint32_t> sorted(csfgeom->numVertices);
+    for(int i = 0; i < csfgeom->numVertices; i++)
+    {
+      sorted[i] = i;
+    }
+
+    const float* pos = csfgeom->vertex;
+    std::sort(sorted.begin(), sorted.end(), [pos](uint32_t a, uint32_t b) {
+      for(int c = 0; c < 3; c++)
+      {
+        if(pos[a * 3 + c] != pos[b * 3 + c])
+          return pos[a * 3 + c] < pos[b * 3 + c];
+      }
+      return a < b;
+    });
+
+    uint32_t first = 0;
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+      if(i == 0 || memcmp(&pos[sorted[i] * 3], &pos[first * 3], sizeof(float) * 3) != 0)
+      {
+        first = sorted[i];
+      }
+      welded[sorted[i]] = first;
+    }
+  }
+
+  std::vector<WireEdge>  edges;
+  std::vector<glm::vec3> faceNormals;
+  edges.reserve(csfgeom->numIndexSolid + (wireEdges == CadScene::WIRE_EDGES_COMBINED ? csfgeom->numIndexWire / 2 : 0));
+  faceNormals.reserve(csfgeom->numIndexSolid / 3);
+
+  auto addEdge = [&](uint32_t a, uint32_t b, int part, int face) {
+    uint32_t wa = welded[a];
+    uint32_t wb = welded[b];
+    if(wa == wb)
+      return;
+
+    WireEdge edge;
+    edge.key  = wa < wb ? (uint64_t(wa) << 32) | wb : (uint64_t(wb) << 32) | wa;
+    edge.a    = a;
+    edge.b    = b;
+    edge.part = part;
+    edge.face = face;
+    edges.push_back(edge);
+  };
+
+  size_t offsetSolid = 0;
+  size_t offsetWire  = 0;
+  for(int p = 0; p < csfgeom->numParts; p++)
+  {
+    const uint32_t* indices = csfgeom->indexSolid + offsetSolid;
+    for(int t = 0; t < csfgeom->parts[p].numIndexSolid / 3; t++)
+    {
+      uint32_t idx[3] = {indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2]};
+
+      glm::vec3 v[3];
+      for(int k = 0; k < 3; k++)
+      {
+        v[k] = glm::vec3(csfgeom->vertex[idx[k] * 3 + 0], csfgeom->vertex[idx[k] * 3 + 1], csfgeom->vertex[idx[k] * 3 + 2]);
+      }
+      glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+      float     len    = glm::length(normal);
+
+      int face = int(faceNormals.size());
+      faceNormals.push_back(len > 0 ? normal / len : glm::vec3(0));
+
+      addEdge(idx[0], idx[1], p, face);
+      addEdge(idx[1], idx[2], p, face);
+      addEdge(idx[2], idx[0], p, face);
+    }
+
+    if(wireEdges == CadScene::WIRE_EDGES_COMBINED && csfgeom->indexWire)
+    {
+      indices = csfgeom->indexWire + offsetWire;
+      for(int l = 0; l < csfgeom->parts[p].numIndexWire / 2; l++)
+      {
+        addEdge(indices[l * 2 + 0], indices[l * 2 + 1], p, -1);
+      }
+    }
+
+    offsetSolid += csfgeom->parts[p].numIndexSolid;
+    offsetWire += csfgeom->parts[p].numIndexWire;
+  }
+
+  std::sort(edges.begin(), edges.end(), WireEdge_compare);
+
+  // keep one edge per welded vertex pair, owned by the lowest part
+  float                 creaseCos = cosf(glm::radians(creaseAngle));
+  std::vector<WireEdge> features;
+  for(size_t begin = 0; begin < edges.size();)
+  {
+    size_t end = begin + 1;
+    while(end < edges.size() && edges[end].key == edges[begin].key)
+    {
+      end++;
+    }
+
+    // boundary, non-manifold, part boundary or csf wire edges are always kept
+    bool feature = true;
+    if(end - begin == 2 && edges[begin].face >= 0 && edges[begin].part == edges[begin + 1].part)
+    {
+      const glm::vec3& n0 = faceNormals[edges[begin].face];
+      const glm::vec3& n1 = faceNormals[edges[begin + 1].face];
+      // degenerate faces don't form creases
+      feature = glm::dot(n0, n0) > 0 && glm::dot(n1, n1) > 0 && glm::dot(n0, n1) < creaseCos;
+    }
+
+    if(feature)
+    {
+      features.push_back(edges[begin]);
+      partCounts[edges[begin].part] += 2;
+    }
+
+    begin = end;
+  }
+
+  std::vector<size_t> partOffsets(csfgeom->numParts);
+  size_t              offset = 0;
+  for(int p = 0; p < csfgeom->numParts; p++)
+  {
+    partOffsets[p] = offset;
+    offset += partCounts[p];
+  }
+
+  wireIndices.resize(offset);
+  for(size_t i = 0; i < features.size(); i++)
+  {
+    size_t& partOffset           = partOffsets[features[i].part];
+    wireIndices[partOffset + 0] = features[i].a;
+    wireIndices[partOffset + 1] = features[i].b;
+    partOffset += 2;
+  }
+}
+
+static void loadGeometryData(CadScene::Geometry&  geom,
+                             const CSFGeometry*   csfgeom,
+                             CadScene::BBox&      bbox,
+                             CadScene::WireEdges  wireEdges,
+                             float                creaseAngle)
+{
+  CadScene::Vertex* vertices = new CadScene::Vertex[csfgeom->numVertices];
+  for(int i = 0; i < csfgeom->numVertices; i++)
+  {
+    vertices[i].position[0] = csfgeom->vertex[3 * i + 0];
+    vertices[i].position[1] = csfgeom->vertex[3 * i + 1];
+    vertices[i].position[2] = csfgeom->vertex[3 * i + 2];
+
+    glm::vec3 normal;
+    if(csfgeom->normal)
+    {
+      normal.x = csfgeom->normal[3 * i + 0];
+      normal.y = csfgeom->normal[3 * i + 1];
+      normal.z = csfgeom->normal[3 * i + 2];
+    }
+    else
+    {
+      normal = normalize(glm::vec3(vertices[i].position));
+    }
+
+    glm::vec3 packed       = float32x3_to_octn_precise(normal, 16);
+    vertices[i].normalOctX = std::min(32767, std::max(-32767, int32_t(packed.x * 32767.0f)));
+    vertices[i].normalOctY = std::min(32767, std::max(-32767, int32_t(packed.y * 32767.0f)));
+
+    bbox.merge(glm::vec4(vertices[i].position, 1.f));
+  }
+
+  geom.vboData = vertices;
+  geom.vboSize = sizeof(CadScene::Vertex) * csfgeom->numVertices;
+
+  std::vector<unsigned int> wireIndices;
+  std::vector<int>          wireCounts;
+  buildWireIndices(csfgeom, wireEdges, creaseAngle, wireIndices, wireCounts);
+
+  geom.numIndexWire = int(wireIndices.size());
+
+  unsigned int* indices = new unsigned int[csfgeom->numIndexSolid + wireIndices.size()];
+  memcpy(&indices[0], csfgeom->indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
+  if(!wireIndices.empty())
+  {
+    memcpy(&indices[csfgeom->numIndexSolid], wireIndices.data(), sizeof(unsigned int) * wireIndices.size());
+  }
+
+  geom.iboData = indices;
+  geom.iboSize = sizeof(unsigned int) * (csfgeom->numIndexSolid + wireIndices.size());
+
+  geom.parts.resize(csfgeom->numParts);
+
+  size_t offsetSolid = 0;
+  size_t offsetWire  = csfgeom->numIndexSolid * sizeof(unsigned int);
+  for(int i = 0; i < csfgeom->numParts; i++)
+  {
+    geom.parts[i].indexWire.count  = wireCounts[i];
+    geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
+
+    geom.parts[i].indexWire.offset  = offsetWire;
+    geom.parts[i].indexSolid.offset = offsetSolid;
+
+    offsetWire += wireCounts[i] * sizeof(unsigned int);
+    offsetSolid += csfgeom->parts[i].numIndexSolid * sizeof(unsigned int);
+  }
+}
+
 bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 {
   CSFile*         csf;
@@ -120,6 +367,12 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 
   CSFile_transform(csf);
 
+  m_filename         = filename;
+  m_clones           = clones;
+  m_cloneaxis        = cloneaxis;
+  m_geometryReleased = false;
+  m_numIndexWireCSF  = 0;
+
   srand(234525);
 
 
@@ -152,64 +405,10 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 
     geom.numVertices   = csfgeom->numVertices;
     geom.numIndexSolid = csfgeom->numIndexSolid;
-    geom.numIndexWire  = csfgeom->numIndexWire;
-
-    Vertex* vertices = new Vertex[csfgeom->numVertices];
-    for(int i = 0; i < csfgeom->numVertices; i++)
-    {
-      vertices[i].position[0] = csfgeom->vertex[3 * i + 0];
-      vertices[i].position[1] = csfgeom->vertex[3 * i + 1];
-      vertices[i].position[2] = csfgeom->vertex[3 * i + 2];
-
-      glm::vec3 normal;
-      if(csfgeom->normal)
-      {
-        normal.x = csfgeom->normal[3 * i + 0];
-        normal.y = csfgeom->normal[3 * i + 1];
-        normal.z = csfgeom->normal[3 * i + 2];
-      }
-      else
-      {
-        normal = normalize(glm::vec3(vertices[i].position));
-      }
-
-      glm::vec3 packed       = float32x3_to_octn_precise(normal, 16);
-      vertices[i].normalOctX = std::min(32767, std::max(-32767, int32_t(packed.x * 32767.0f)));
-      vertices[i].normalOctY = std::min(32767, std::max(-32767, int32_t(packed.y * 32767.0f)));
-
-      m_geometryBboxes[n].merge(glm::vec4(vertices[i].position, 1.f));
-    }
-
-    geom.vboData = vertices;
-    geom.vboSize = sizeof(Vertex) * csfgeom->numVertices;
-
-
-    unsigned int* indices = new unsigned int[csfgeom->numIndexSolid + csfgeom->numIndexWire];
-    memcpy(&indices[0], csfgeom->indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
-    if(csfgeom->indexWire)
-    {
-      memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(unsigned int) * csfgeom->numIndexWire);
-    }
 
-    geom.iboData = indices;
-    geom.iboSize = sizeof(unsigned int) * (csfgeom->numIndexSolid + csfgeom->numIndexWire);
+    loadGeometryData(geom, csfgeom, m_geometryBboxes[n], m_wireEdges, m_creaseAngle);
 
-
-    geom.parts.resize(csfgeom->numParts);
-
-    size_t offsetSolid = 0;
-    size_t offsetWire  = csfgeom->numIndexSolid * sizeof(unsigned int);
-    for(int i = 0; i < csfgeom->numParts; i++)
-    {
-      geom.parts[i].indexWire.count  = csfgeom->parts[i].numIndexWire;
-      geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
-
-      geom.parts[i].indexWire.offset  = offsetWire;
-      geom.parts[i].indexSolid.offset = offsetSolid;
-
-      offsetWire += csfgeom->parts[i].numIndexWire * sizeof(unsigned int);
-      offsetSolid += csfgeom->parts[i].numIndexSolid * sizeof(unsigned int);
-    }
+    m_numIndexWireCSF += csfgeom->indexWire ? csfgeom->numIndexWire : 0;
   }
   for(int c = 1; c <= clones; c++)
   {
@@ -269,12 +468,14 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     for(int i = 0; i < csfnode->numParts; i++)
     {
       object.parts[i].active        = 1;
+      object.parts[i].translucent   = 0;
       object.parts[i].matrixIndex   = csfnode->parts[i].nodeIDX < 0 ? object.matrixIndex : csfnode->parts[i].nodeIDX;
       object.parts[i].materialIndex = csfnode->parts[i].materialIDX;
 #if 1
       if(csf->materials[csfnode->parts[i].materialIDX].color[3] < 0.9f)
       {
-        object.parts[i].active = 0;
+        object.parts[i].active      = 0;
+        object.parts[i].translucent = 1;
       }
 #endif
     }
@@ -428,6 +629,7 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
   }
 
   CSFileMemory_delete(mem);
+  m_version++;
   return true;
 }
 
@@ -550,6 +752,109 @@ void CadScene::updateObjectDrawCache(Object& object)
   fillCache(object.cacheWire, listWire);
 }
 
+size_t CadScene::getNumIndexWire() const
+{
+  size_t num = 0;
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    if(m_geometry[i].cloneIdx < 0)
+    {
+      num += m_geometry[i].numIndexWire;
+    }
+  }
+  return num;
+}
+
+size_t CadScene::releaseGeometry()
+{
+  size_t released = 0;
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    Geometry& geom = m_geometry[i];
+    if(geom.cloneIdx < 0 && geom.vboData)
+    {
+      delete[] geom.vboData;
+      delete[] geom.iboData;
+      released += geom.vboSize + geom.iboSize;
+    }
+    geom.vboData = nullptr;
+    geom.iboData = nullptr;
+  }
+
+  m_geometryReleased = true;
+  return released;
+}
+
+bool CadScene::rehydrateGeometry()
+{
+  if(!m_geometryReleased)
+    return true;
+
+  CSFile*         csf;
+  CSFileMemoryPTR mem = CSFileMemory_new();
+  if(CSFile_loadExt(&csf, m_filename.c_str(), mem) != CADSCENEFILE_NOERROR
+     || size_t(csf->numGeometries * (m_clones + 1)) != m_geometry.size())
+  {
+    CSFileMemory_delete(mem);
+    return false;
+  }
+
+  CSFile_transform(csf);
+
+  int numGeoms = csf->numGeometries;
+  for(int n = 0; n < numGeoms; n++)
+  {
+    BBox bbox;
+    loadGeometryData(m_geometry[n], &csf->geometries[n], bbox, m_wireEdges, m_creaseAngle);
+  }
+  for(size_t i = numGeoms; i < m_geometry.size(); i++)
+  {
+    Geometry& geom = m_geometry[i];
+    geom.vboData   = m_geometry[geom.cloneIdx].vboData;
+    geom.iboData   = m_geometry[geom.cloneIdx].iboData;
+  }
+
+  CSFileMemory_delete(mem);
+
+  m_geometryReleased = false;
+  return true;
+}
+
+void CadScene::appendMemoryStats(MemoryStats& stats) const
+{
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const Geometry& geom = m_geometry[i];
+    if(geom.cloneIdx < 0 && geom.vboData)
+    {
+      stats.cpu[MemoryStats::GEOMETRY] += geom.vboSize + geom.iboSize;
+    }
+    stats.cpu[MemoryStats::GEOMETRY] += geom.parts.capacity() * sizeof(GeometryPart);
+  }
+  stats.cpu[MemoryStats::GEOMETRY] += m_geometry.capacity() * sizeof(Geometry);
+  stats.cpu[MemoryStats::GEOMETRY] += m_geometryBboxes.capacity() * sizeof(BBox);
+
+  stats.cpu[MemoryStats::MATRICES] += m_matrices.capacity() * sizeof(MatrixNode);
+  stats.cpu[MemoryStats::MATERIALS] += m_materials.capacity() * sizeof(Material);
+
+  for(size_t i = 0; i < m_objects.size(); i++)
+  {
+    const Object&         object    = m_objects[i];
+    const DrawRangeCache* caches[2] = {&object.cacheSolid, &object.cacheWire};
+
+    for(int c = 0; c < 2; c++)
+    {
+      stats.cpu[MemoryStats::DRAWCACHES] += caches[c]->state.capacity() * sizeof(DrawStateInfo);
+      stats.cpu[MemoryStats::DRAWCACHES] += caches[c]->stateCount.capacity() * sizeof(int);
+      stats.cpu[MemoryStats::DRAWCACHES] += caches[c]->offsets.capacity() * sizeof(size_t);
+      stats.cpu[MemoryStats::DRAWCACHES] += caches[c]->counts.capacity() * sizeof(int);
+    }
+    stats.cpu[MemoryStats::DRAWCACHES] += object.parts.capacity() * sizeof(ObjectPart);
+  }
+  stats.cpu[MemoryStats::DRAWCACHES] += m_objects.capacity() * sizeof(Object);
+  stats.cpu[MemoryStats::DRAWCACHES] += m_objectAssigns.capacity() * sizeof(glm::ivec2);
+}
+
 void CadScene::unload()
 {
   if(m_geometry.empty())
@@ -571,4 +876,16 @@ void CadScene::unload()
   m_objectAssigns.clear();
   m_objects.clear();
   m_geometryBboxes.clear();
+
+  m_geometryReleased = false;
+  m_version++;
+}
+
+void CadScene::getPositions(const Geometry& geom, glm::vec3* positions)
+{
+  const Vertex* vertices = geom.vboData;
+  for(int i = 0; i < geom.numVertices; i++)
+  {
+    positions[i] = vertices[i].position;
+  }
 }
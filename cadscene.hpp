@@ -26,9 +26,12 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <string>
 #include <cstdint>
 #include <cstring>
 
+#include "memorystats.hpp"
+
 class CadScene
 {
 
@@ -188,6 +191,7 @@ public:
   struct ObjectPart
   {
     int active;
+    int translucent;  // material alpha below 0.9, not active, drawn by the translucent pass
     int materialIndex;
     int matrixIndex;
   };
@@ -203,6 +207,14 @@ public:
     DrawRangeCache cacheWire;
   };
 
+  enum WireEdges
+  {
+    WIRE_EDGES_CSF,       // wire indices as stored in the file
+    WIRE_EDGES_FEATURE,   // generated from crease angle and part boundaries
+    WIRE_EDGES_COMBINED,  // file wire plus generated edges, duplicates removed
+    NUM_WIRE_EDGES,
+  };
+
   std::vector<Material>   m_materials;
   std::vector<BBox>       m_geometryBboxes;
   std::vector<Geometry>   m_geometry;
@@ -213,11 +225,40 @@ public:
 
   BBox m_bbox;
 
+  std::string m_filename;
+  int         m_clones           = 0;
+  int         m_cloneaxis        = 3;
+  bool        m_geometryReleased = false;
+
+  // wire generation, applied at loadCSF
+  WireEdges m_wireEdges   = WIRE_EDGES_CSF;
+  float     m_creaseAngle = 30.0f;
+  // wire indices the file provided for the unique geometries
+  size_t m_numIndexWireCSF = 0;
+
+  // changes with every loadCSF and unload, so derived data can tell scenes apart
+  uint32_t m_version = 0;
+
 
   void updateObjectDrawCache(Object& object);
 
   bool loadCSF(const char* filename, int clones = 0, int cloneaxis = 3);
   void unload();
+
+  // frees vboData/iboData once uploaded, returns the amount of bytes released
+  size_t releaseGeometry();
+  // reloads vboData/iboData from m_filename
+  bool rehydrateGeometry();
+  bool isGeometryReleased() const { return m_geometryReleased; }
+
+  // de-interleaves vertex positions, positions must hold geom.numVertices
+  static void getPositions(const Geometry& geom, glm::vec3* positions);
+
+  // wire indices of the unique geometries
+  size_t getNumIndexWire() const;
+
+  // adds host-side scene data
+  void appendMemoryStats(MemoryStats& stats) const;
 };
 
 
@@ -37,12 +37,16 @@ static size_t alignedSize(size_t sz, size_t align)
 
 //////////////////////////////////////////////////////////////////////////
 
-void GeometryMemoryGL::alloc(size_t vboSize, size_t iboSize, GeometryMemoryGL::Allocation& allocation)
+void GeometryMemoryGL::alloc(size_t vboSize, size_t iboSize, size_t iboWireSize, size_t posSize, GeometryMemoryGL::Allocation& allocation)
 {
-  vboSize = alignedSize(vboSize, m_vboAlignment);
-  iboSize = alignedSize(iboSize, m_alignment);
-
-  if(m_chunks.empty() || getActiveChunk().vboSize + vboSize > m_maxVboChunk || getActiveChunk().iboSize + iboSize > m_maxIboChunk)
+  vboSize     = alignedSize(vboSize, m_vboAlignment);
+  iboSize     = alignedSize(iboSize, m_alignment);
+  iboWireSize = alignedSize(iboWireSize, m_alignment);
+  posSize     = alignedSize(posSize, m_posAlignment);
+
+  if(m_chunks.empty() || getActiveChunk().vboSize + vboSize > m_maxVboChunk
+     || getActiveChunk().iboSize + getActiveChunk().iboWireSize + iboSize + iboWireSize > m_maxIboChunk
+     || getActiveChunk().posSize + posSize > m_maxPosChunk)
   {
     finalize();
     Chunk chunk = {};
@@ -51,12 +55,16 @@ void GeometryMemoryGL::alloc(size_t vboSize, size_t iboSize, GeometryMemoryGL::A
 
   Chunk& chunk = getActiveChunk();
 
-  allocation.chunkIndex = getActiveIndex();
-  allocation.vboOffset  = chunk.vboSize;
-  allocation.iboOffset  = chunk.iboSize;
+  allocation.chunkIndex    = getActiveIndex();
+  allocation.vboOffset     = chunk.vboSize;
+  allocation.iboOffset     = chunk.iboSize;
+  allocation.iboWireOffset = chunk.iboWireSize;
+  allocation.posOffset     = chunk.posSize;
 
   chunk.vboSize += vboSize;
   chunk.iboSize += iboSize;
+  chunk.iboWireSize += iboWireSize;
+  chunk.posSize += posSize;
 }
 
 void GeometryMemoryGL::finalize()
@@ -67,12 +75,21 @@ void GeometryMemoryGL::finalize()
   }
 
   Chunk& chunk = getActiveChunk();
+
+  chunk.iboWireBase = chunk.iboSize;
+  chunk.iboSize += chunk.iboWireSize;
+
   glCreateBuffers(1, &chunk.vboGL);
   glNamedBufferStorage(chunk.vboGL, chunk.vboSize, 0, GL_DYNAMIC_STORAGE_BIT);
 
   glCreateBuffers(1, &chunk.iboGL);
   glNamedBufferStorage(chunk.iboGL, chunk.iboSize, 0, GL_DYNAMIC_STORAGE_BIT);
 
+  if(chunk.posSize)
+  {
+    glCreateBuffers(1, &chunk.posGL);
+    glNamedBufferStorage(chunk.posGL, chunk.posSize, 0, GL_DYNAMIC_STORAGE_BIT);
+  }
 
   if(m_bindless)
   {
@@ -81,16 +98,24 @@ void GeometryMemoryGL::finalize()
 
     glGetNamedBufferParameterui64vNV(chunk.iboGL, GL_BUFFER_GPU_ADDRESS_NV, &chunk.iboADDR);
     glMakeNamedBufferResidentNV(chunk.iboGL, GL_READ_ONLY);
+
+    if(chunk.posGL)
+    {
+      glGetNamedBufferParameterui64vNV(chunk.posGL, GL_BUFFER_GPU_ADDRESS_NV, &chunk.posADDR);
+      glMakeNamedBufferResidentNV(chunk.posGL, GL_READ_ONLY);
+    }
   }
 }
 
-void GeometryMemoryGL::init(size_t vboStride, size_t maxChunk, bool bindless)
+void GeometryMemoryGL::init(size_t vboStride, size_t maxChunk, bool bindless, bool contiguous)
 {
-  m_alignment    = 16;
-  m_vboAlignment = 16;
+  m_alignment    = contiguous ? sizeof(GLuint) : 16;
+  m_vboAlignment = contiguous ? vboStride : 16;
+  m_posAlignment = contiguous ? sizeof(glm::vec3) : 16;
 
   m_maxVboChunk = maxChunk;
   m_maxIboChunk = maxChunk;
+  m_maxPosChunk = maxChunk;
 
   m_maxChunk = maxChunk;
   m_bindless = bindless;
@@ -104,10 +129,18 @@ void GeometryMemoryGL::deinit()
     {
       glMakeNamedBufferNonResidentNV(m_chunks[i].vboGL);
       glMakeNamedBufferNonResidentNV(m_chunks[i].iboGL);
+      if(m_chunks[i].posGL)
+      {
+        glMakeNamedBufferNonResidentNV(m_chunks[i].posGL);
+      }
     }
 
     glDeleteBuffers(1, &m_chunks[i].vboGL);
     glDeleteBuffers(1, &m_chunks[i].iboGL);
+    if(m_chunks[i].posGL)
+    {
+      glDeleteBuffers(1, &m_chunks[i].posGL);
+    }
   }
 
   m_chunks.clear();
@@ -115,29 +148,49 @@ void GeometryMemoryGL::deinit()
 
 //////////////////////////////////////////////////////////////////////////
 
-void CadSceneGL::init(const CadScene& cadscene)
+void CadSceneGL::init(const CadScene& cadscene, bool positionStream, bool contiguous)
 {
   m_geometry.resize(cadscene.m_geometry.size());
+  m_positionStream = positionStream;
+  m_contiguous     = contiguous;
 
   {
-    m_geometryMem.init(sizeof(CadScene::Vertex), 128 * 1024 * 1024, has_GL_NV_vertex_buffer_unified_memory != 0);
+    m_geometryMem.init(sizeof(CadScene::Vertex), 128 * 1024 * 1024, has_GL_NV_vertex_buffer_unified_memory != 0, contiguous);
 
     for(size_t i = 0; i < cadscene.m_geometry.size(); i++)
     {
       const CadScene::Geometry& cadgeom = cadscene.m_geometry[i];
       Geometry&                 geom    = m_geometry[i];
 
-      m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize, geom.mem);
+      size_t posSize = positionStream ? sizeof(glm::vec3) * cadgeom.numVertices : 0;
+
+      if(contiguous)
+      {
+        size_t iboWireSize = sizeof(GLuint) * cadgeom.numIndexWire;
+        m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize - iboWireSize, iboWireSize, posSize, geom.mem);
+      }
+      else
+      {
+        m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize, 0, posSize, geom.mem);
+      }
     }
 
     m_geometryMem.finalize();
 
     LOGI("Size of vertex data: %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize()));
     LOGI("Size of index data:  %11" PRId64 "\n", uint64_t(m_geometryMem.getIndexSize()));
-    LOGI("Size of data:        %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize()));
+    if(positionStream)
+    {
+      LOGI("Size of pos data:    %11" PRId64 "\n", uint64_t(m_geometryMem.getPositionSize()));
+    }
+    LOGI("Size of data:        %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize()
+                                                         + m_geometryMem.getPositionSize()));
     LOGI("Chunks:              %11d\n", uint32_t(m_geometryMem.getChunkCount()));
   }
 
+  std::vector<glm::vec3> positions;
+  std::vector<GLuint>    indices;
+
   for(size_t i = 0; i < cadscene.m_geometry.size(); i++)
   {
     const CadScene::Geometry& cadgeom = cadscene.m_geometry[i];
@@ -146,10 +199,50 @@ void CadSceneGL::init(const CadScene& cadscene)
     const GeometryMemoryGL::Chunk& chunk = m_geometryMem.getChunk(geom.mem);
 
     glNamedBufferSubData(chunk.vboGL, geom.mem.vboOffset, cadgeom.vboSize, cadgeom.vboData);
-    glNamedBufferSubData(chunk.iboGL, geom.mem.iboOffset, cadgeom.iboSize, cadgeom.iboData);
+    if(contiguous)
+    {
+      // indices address the chunk's vertices directly, so ranges of neighboring geometries can be drawn at once
+      GLuint vertexBase = GLuint(geom.mem.vboOffset / sizeof(CadScene::Vertex));
+      size_t numIndices = cadgeom.numIndexSolid + cadgeom.numIndexWire;
+      indices.resize(numIndices);
+      for(size_t n = 0; n < numIndices; n++)
+      {
+        indices[n] = cadgeom.iboData[n] + vertexBase;
+      }
+      glNamedBufferSubData(chunk.iboGL, geom.mem.iboOffset, sizeof(GLuint) * cadgeom.numIndexSolid, indices.data());
+      glNamedBufferSubData(chunk.iboGL, chunk.iboWireBase + geom.mem.iboWireOffset, sizeof(GLuint) * cadgeom.numIndexWire,
+                           indices.data() + cadgeom.numIndexSolid);
+    }
+    else
+    {
+      glNamedBufferSubData(chunk.iboGL, geom.mem.iboOffset, cadgeom.iboSize, cadgeom.iboData);
+    }
 
     geom.vbo = nvgl::BufferBinding(chunk.vboGL, geom.mem.vboOffset, cadgeom.vboSize, chunk.vboADDR);
     geom.ibo = nvgl::BufferBinding(chunk.iboGL, geom.mem.iboOffset, cadgeom.iboSize, chunk.iboADDR);
+
+    if(positionStream)
+    {
+      size_t posSize = sizeof(glm::vec3) * cadgeom.numVertices;
+
+      positions.resize(cadgeom.numVertices);
+      CadScene::getPositions(cadgeom, positions.data());
+      glNamedBufferSubData(chunk.posGL, geom.mem.posOffset, posSize, positions.data());
+
+      geom.vboPos = nvgl::BufferBinding(chunk.posGL, geom.mem.posOffset, posSize, chunk.posADDR);
+    }
+    else
+    {
+      geom.vboPos = geom.vbo;
+    }
+
+    if(contiguous)
+    {
+      // all geometries of a chunk share the same bindings
+      geom.vbo    = nvgl::BufferBinding(chunk.vboGL, 0, chunk.vboSize, chunk.vboADDR);
+      geom.ibo    = nvgl::BufferBinding(chunk.iboGL, 0, chunk.iboSize, chunk.iboADDR);
+      geom.vboPos = positionStream ? nvgl::BufferBinding(chunk.posGL, 0, chunk.posSize, chunk.posADDR) : geom.vbo;
+    }
   }
 
   m_buffers.materials.create(sizeof(CadScene::Material) * cadscene.m_materials.size(), cadscene.m_materials.data(), 0, 0);
@@ -169,4 +262,19 @@ void CadSceneGL::deinit()
   m_geometryMem.deinit();
 
   m_geometry.clear();
+  m_positionStream = false;
+  m_contiguous     = false;
+}
+
+void CadSceneGL::appendMemoryStats(MemoryStats& stats) const
+{
+  if(m_geometry.empty())
+    return;
+
+  stats.cpu[MemoryStats::GEOMETRY] += m_geometry.capacity() * sizeof(Geometry);
+
+  // uploads go through glNamedBufferSubData, no staging memory owned by us
+  stats.gpu[MemoryStats::GEOMETRY] += m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize() + m_geometryMem.getPositionSize();
+  stats.gpu[MemoryStats::MATRICES] += m_buffers.matrices.size + m_buffers.matricesOrig.size;
+  stats.gpu[MemoryStats::MATERIALS] += m_buffers.materials.size;
 }
@@ -35,23 +35,34 @@ public:
     Index  chunkIndex;
     size_t vboOffset;
     size_t iboOffset;
+    size_t iboWireOffset;  // relative to Chunk::iboWireBase
+    size_t posOffset;
   };
 
   struct Chunk
   {
     GLuint vboGL;
     GLuint iboGL;
+    GLuint posGL;
 
     size_t vboSize;
     size_t iboSize;
+    size_t posSize;
+
+    // wire indices of all geometries follow the solid ones
+    size_t iboWireBase;
+    size_t iboWireSize;
 
     uint64_t vboADDR;
     uint64_t iboADDR;
+    uint64_t posADDR;
   };
 
-  void init(size_t vboStride, size_t maxChunk, bool bindless);
+  // contiguous: no padding between geometries, so vertices and indices of a chunk
+  // form one range each (positions mirror the vertex order)
+  void init(size_t vboStride, size_t maxChunk, bool bindless, bool contiguous = false);
   void deinit();
-  void alloc(size_t vboSize, size_t iboSize, Allocation& allocation);
+  void alloc(size_t vboSize, size_t iboSize, size_t iboWireSize, size_t posSize, Allocation& allocation);
   void finalize();
 
   size_t getVertexSize() const
@@ -74,6 +85,16 @@ public:
     return size;
   }
 
+  size_t getPositionSize() const
+  {
+    size_t size = 0;
+    for(size_t i = 0; i < m_chunks.size(); i++)
+    {
+      size += m_chunks[i].posSize;
+    }
+    return size;
+  }
+
   const Chunk& getChunk(const Allocation& allocation) const { return m_chunks[allocation.chunkIndex]; }
 
   const Chunk& getChunk(Index index) const { return m_chunks[index]; }
@@ -83,9 +104,11 @@ public:
 private:
   size_t m_alignment;
   size_t m_vboAlignment;
+  size_t m_posAlignment;
   size_t m_maxChunk;
   size_t m_maxVboChunk;
   size_t m_maxIboChunk;
+  size_t m_maxPosChunk;
   bool   m_bindless;
 
   std::vector<Chunk> m_chunks;
@@ -108,6 +131,8 @@ public:
 
     nvgl::BufferBinding vbo;
     nvgl::BufferBinding ibo;
+    // position-only stream, same as vbo when not enabled
+    nvgl::BufferBinding vboPos;
   };
 
   struct Buffers
@@ -120,8 +145,17 @@ public:
   Buffers               m_buffers;
   std::vector<Geometry> m_geometry;
   GeometryMemoryGL      m_geometryMem;
+  bool                  m_positionStream = false;
+  bool                  m_contiguous     = false;
 
 
-  void init(const CadScene& cadscene);
+  void init(const CadScene& cadscene, bool positionStream, bool contiguous);
   void deinit();
+
+  GLsizei getPositionStride() const
+  {
+    return m_positionStream ? GLsizei(sizeof(glm::vec3)) : GLsizei(sizeof(CadScene::Vertex));
+  }
+
+  void appendMemoryStats(MemoryStats& stats) const;
 };
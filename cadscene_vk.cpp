@@ -35,15 +35,18 @@ void GeometryMemoryVK::init(VkDevice                     device,
                             VkPhysicalDevice             physicalDevice,
                             nvvk::DeviceMemoryAllocator* memoryAllocator,
                             VkDeviceSize                 vboStride,
-                            VkDeviceSize                 maxChunk)
+                            VkDeviceSize                 maxChunk,
+                            bool                         contiguous)
 {
   m_device          = device;
   m_memoryAllocator = memoryAllocator;
-  m_alignment       = 16;
-  m_vboAlignment    = 16;
+  m_alignment       = contiguous ? sizeof(uint32_t) : 16;
+  m_vboAlignment    = contiguous ? vboStride : 16;
+  m_posAlignment    = contiguous ? sizeof(glm::vec3) : 16;
 
   m_maxVboChunk = maxChunk;
   m_maxIboChunk = maxChunk;
+  m_maxPosChunk = maxChunk;
 }
 
 void GeometryMemoryVK::deinit()
@@ -56,18 +59,28 @@ void GeometryMemoryVK::deinit()
 
     m_memoryAllocator->free(chunk.vboAID);
     m_memoryAllocator->free(chunk.iboAID);
+
+    if(chunk.pos)
+    {
+      vkDestroyBuffer(m_device, chunk.pos, nullptr);
+      m_memoryAllocator->free(chunk.posAID);
+    }
   }
   m_chunks          = std::vector<Chunk>();
   m_device          = nullptr;
   m_memoryAllocator = nullptr;
 }
 
-void GeometryMemoryVK::alloc(VkDeviceSize vboSize, VkDeviceSize iboSize, Allocation& allocation)
+void GeometryMemoryVK::alloc(VkDeviceSize vboSize, VkDeviceSize iboSize, VkDeviceSize iboWireSize, VkDeviceSize posSize, Allocation& allocation)
 {
-  vboSize = alignedSize(vboSize, m_vboAlignment);
-  iboSize = alignedSize(iboSize, m_alignment);
-
-  if(m_chunks.empty() || getActiveChunk().vboSize + vboSize > m_maxVboChunk || getActiveChunk().iboSize + iboSize > m_maxIboChunk)
+  vboSize     = alignedSize(vboSize, m_vboAlignment);
+  iboSize     = alignedSize(iboSize, m_alignment);
+  iboWireSize = alignedSize(iboWireSize, m_alignment);
+  posSize     = alignedSize(posSize, m_posAlignment);
+
+  if(m_chunks.empty() || getActiveChunk().vboSize + vboSize > m_maxVboChunk
+     || getActiveChunk().iboSize + getActiveChunk().iboWireSize + iboSize + iboWireSize > m_maxIboChunk
+     || getActiveChunk().posSize + posSize > m_maxPosChunk)
   {
     finalize();
     Chunk chunk = {};
@@ -76,12 +89,16 @@ void GeometryMemoryVK::alloc(VkDeviceSize vboSize, VkDeviceSize iboSize, Allocat
 
   Chunk& chunk = getActiveChunk();
 
-  allocation.chunkIndex = getActiveIndex();
-  allocation.vboOffset  = chunk.vboSize;
-  allocation.iboOffset  = chunk.iboSize;
+  allocation.chunkIndex    = getActiveIndex();
+  allocation.vboOffset     = chunk.vboSize;
+  allocation.iboOffset     = chunk.iboSize;
+  allocation.iboWireOffset = chunk.iboWireSize;
+  allocation.posOffset     = chunk.posSize;
 
   chunk.vboSize += vboSize;
   chunk.iboSize += iboSize;
+  chunk.iboWireSize += iboWireSize;
+  chunk.posSize += posSize;
 }
 
 void GeometryMemoryVK::finalize()
@@ -93,14 +110,29 @@ void GeometryMemoryVK::finalize()
 
   Chunk& chunk = getActiveChunk();
 
+  chunk.iboWireBase = chunk.iboSize;
+  chunk.iboSize += chunk.iboWireSize;
+
   VkBufferUsageFlags flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
   chunk.vbo = m_memoryAllocator->createBuffer(chunk.vboSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | flags, chunk.vboAID);
   chunk.ibo = m_memoryAllocator->createBuffer(chunk.iboSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | flags, chunk.iboAID);
+  if(chunk.posSize)
+  {
+    chunk.pos = m_memoryAllocator->createBuffer(chunk.posSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | flags, chunk.posAID);
+  }
 }
 
-void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex)
+void CadSceneVK::init(const CadScene& cadscene,
+                      VkDevice        device,
+                      VkPhysicalDevice physicalDevice,
+                      VkQueue          queue,
+                      uint32_t         queueFamilyIndex,
+                      bool             positionStream,
+                      bool             contiguous)
 {
-  m_device = device;
+  m_device         = device;
+  m_positionStream = positionStream;
+  m_contiguous     = contiguous;
 
   m_memAllocator.init(m_device, physicalDevice, 1024 * 1024 * 256);
 
@@ -111,21 +143,36 @@ void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevic
 
   {
     // allocation phase
-    m_geometryMem.init(device, physicalDevice, &m_memAllocator, sizeof(CadScene::Vertex), 512 * 1024 * 1024);
+    m_geometryMem.init(device, physicalDevice, &m_memAllocator, sizeof(CadScene::Vertex), 512 * 1024 * 1024, contiguous);
 
     for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
     {
       const CadScene::Geometry& cadgeom = cadscene.m_geometry[g];
       Geometry&                 geom    = m_geometry[g];
 
-      m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize, geom.allocation);
+      VkDeviceSize posSize = positionStream ? sizeof(glm::vec3) * cadgeom.numVertices : 0;
+
+      if(contiguous)
+      {
+        VkDeviceSize iboWireSize = sizeof(uint32_t) * cadgeom.numIndexWire;
+        m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize - iboWireSize, iboWireSize, posSize, geom.allocation);
+      }
+      else
+      {
+        m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize, 0, posSize, geom.allocation);
+      }
     }
 
     m_geometryMem.finalize();
 
     LOGI("Size of vertex data: %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize()));
     LOGI("Size of index data:  %11" PRId64 "\n", uint64_t(m_geometryMem.getIndexSize()));
-    LOGI("Size of data:        %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize()));
+    if(positionStream)
+    {
+      LOGI("Size of pos data:    %11" PRId64 "\n", uint64_t(m_geometryMem.getPositionSize()));
+    }
+    LOGI("Size of data:        %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize()
+                                                         + m_geometryMem.getPositionSize()));
     LOGI("Chunks:              %11d\n", uint32_t(m_geometryMem.getChunkCount()));
   }
 
@@ -137,6 +184,9 @@ void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevic
 
   ScopeStaging staging(&m_memAllocator, queue, queueFamilyIndex);
 
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t>  indices;
+
   for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
   {
     const CadScene::Geometry&      cadgeom = cadscene.m_geometry[g];
@@ -152,7 +202,50 @@ void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevic
     geom.ibo.buffer = chunk.ibo;
     geom.ibo.offset = geom.allocation.iboOffset;
     geom.ibo.range  = cadgeom.iboSize;
-    staging.upload(geom.ibo, cadgeom.iboData);
+    if(contiguous)
+    {
+      // indices address the chunk's vertices directly, so ranges of neighboring geometries can be drawn at once
+      uint32_t vertexBase = uint32_t(geom.allocation.vboOffset / sizeof(CadScene::Vertex));
+      size_t   numIndices = cadgeom.numIndexSolid + cadgeom.numIndexWire;
+      indices.resize(numIndices);
+      for(size_t n = 0; n < numIndices; n++)
+      {
+        indices[n] = cadgeom.iboData[n] + vertexBase;
+      }
+
+      VkDescriptorBufferInfo iboSolid = {chunk.ibo, geom.allocation.iboOffset, sizeof(uint32_t) * cadgeom.numIndexSolid};
+      VkDescriptorBufferInfo iboWire  = {chunk.ibo, chunk.iboWireBase + geom.allocation.iboWireOffset,
+                                        sizeof(uint32_t) * cadgeom.numIndexWire};
+      staging.upload(iboSolid, indices.data());
+      staging.upload(iboWire, indices.data() + cadgeom.numIndexSolid);
+    }
+    else
+    {
+      staging.upload(geom.ibo, cadgeom.iboData);
+    }
+
+    if(positionStream)
+    {
+      positions.resize(cadgeom.numVertices);
+      CadScene::getPositions(cadgeom, positions.data());
+
+      geom.vboPos.buffer = chunk.pos;
+      geom.vboPos.offset = geom.allocation.posOffset;
+      geom.vboPos.range  = sizeof(glm::vec3) * cadgeom.numVertices;
+      staging.upload(geom.vboPos, positions.data());
+    }
+    else
+    {
+      geom.vboPos = geom.vbo;
+    }
+
+    if(contiguous)
+    {
+      // all geometries of a chunk share the same bindings
+      geom.vbo    = {chunk.vbo, 0, chunk.vboSize};
+      geom.ibo    = {chunk.ibo, 0, chunk.iboSize};
+      geom.vboPos = positionStream ? VkDescriptorBufferInfo{chunk.pos, 0, chunk.posSize} : geom.vbo;
+    }
   }
 
   VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
@@ -174,6 +267,13 @@ void CadSceneVK::init(const CadScene& cadscene, VkDevice device, VkPhysicalDevic
   staging.upload(m_infos.matrices, cadscene.m_matrices.data());
   staging.upload(m_infos.matricesOrig, cadscene.m_matrices.data());
 
+  {
+    // unused staging space is kept until the end of the scope, allocated size represents the peak
+    VkDeviceSize allocatedSize, usedSize;
+    staging.staging.getUtilization(allocatedSize, usedSize);
+    m_stagingSize = allocatedSize;
+  }
+
   staging.upload({}, nullptr);
 }
 
@@ -189,4 +289,20 @@ void CadSceneVK::deinit()
   m_geometry.clear();
   m_geometryMem.deinit();
   m_memAllocator.deinit();
+  m_stagingSize    = 0;
+  m_positionStream = false;
+  m_contiguous     = false;
+}
+
+void CadSceneVK::appendMemoryStats(MemoryStats& stats) const
+{
+  if(m_geometry.empty())
+    return;
+
+  stats.cpu[MemoryStats::GEOMETRY] += m_geometry.capacity() * sizeof(Geometry);
+
+  stats.gpu[MemoryStats::GEOMETRY] += m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize() + m_geometryMem.getPositionSize();
+  stats.gpu[MemoryStats::MATRICES] += m_infos.matrices.range + m_infos.matricesOrig.range;
+  stats.gpu[MemoryStats::MATERIALS] += m_infos.materials.range;
+  stats.gpu[MemoryStats::STAGING] += m_stagingSize;
 }
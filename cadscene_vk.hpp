@@ -90,18 +90,27 @@ struct GeometryMemoryVK
     Index        chunkIndex;
     VkDeviceSize vboOffset;
     VkDeviceSize iboOffset;
+    VkDeviceSize iboWireOffset;  // relative to Chunk::iboWireBase
+    VkDeviceSize posOffset;
   };
 
   struct Chunk
   {
     VkBuffer vbo;
     VkBuffer ibo;
+    VkBuffer pos;
 
     VkDeviceSize vboSize;
     VkDeviceSize iboSize;
+    VkDeviceSize posSize;
+
+    // wire indices of all geometries follow the solid ones
+    VkDeviceSize iboWireBase;
+    VkDeviceSize iboWireSize;
 
     nvvk::AllocationID vboAID;
     nvvk::AllocationID iboAID;
+    nvvk::AllocationID posAID;
   };
 
 
@@ -109,9 +118,16 @@ struct GeometryMemoryVK
   nvvk::DeviceMemoryAllocator* m_memoryAllocator;
   std::vector<Chunk>           m_chunks;
 
-  void init(VkDevice device, VkPhysicalDevice physicalDevice, nvvk::DeviceMemoryAllocator* deviceAllocator, VkDeviceSize vboStride, VkDeviceSize maxChunk);
+  // contiguous: no padding between geometries, so vertices and indices of a chunk
+  // form one range each (positions mirror the vertex order)
+  void init(VkDevice                     device,
+            VkPhysicalDevice             physicalDevice,
+            nvvk::DeviceMemoryAllocator* deviceAllocator,
+            VkDeviceSize                 vboStride,
+            VkDeviceSize                 maxChunk,
+            bool                         contiguous = false);
   void deinit();
-  void alloc(VkDeviceSize vboSize, VkDeviceSize iboSize, Allocation& allocation);
+  void alloc(VkDeviceSize vboSize, VkDeviceSize iboSize, VkDeviceSize iboWireSize, VkDeviceSize posSize, Allocation& allocation);
   void finalize();
 
   const Chunk& getChunk(const Allocation& allocation) const { return m_chunks[allocation.chunkIndex]; }
@@ -138,13 +154,25 @@ struct GeometryMemoryVK
     return size;
   }
 
+  VkDeviceSize getPositionSize() const
+  {
+    VkDeviceSize size = 0;
+    for(size_t i = 0; i < m_chunks.size(); i++)
+    {
+      size += m_chunks[i].posSize;
+    }
+    return size;
+  }
+
   VkDeviceSize getChunkCount() const { return m_chunks.size(); }
 
 private:
   VkDeviceSize m_alignment;
   VkDeviceSize m_vboAlignment;
+  VkDeviceSize m_posAlignment;
   VkDeviceSize m_maxVboChunk;
   VkDeviceSize m_maxIboChunk;
+  VkDeviceSize m_maxPosChunk;
 
   Index getActiveIndex() { return (m_chunks.size() - 1); }
 
@@ -165,6 +193,8 @@ public:
 
     VkDescriptorBufferInfo vbo;
     VkDescriptorBufferInfo ibo;
+    // position-only stream, same as vbo when not enabled
+    VkDescriptorBufferInfo vboPos;
   };
 
   struct Buffers
@@ -197,7 +227,26 @@ public:
   std::vector<Geometry> m_geometry;
   GeometryMemoryVK      m_geometryMem;
 
+  // peak staging memory used during upload
+  VkDeviceSize m_stagingSize = 0;
+
+  bool m_positionStream = false;
+  bool m_contiguous     = false;
 
-  void init(const CadScene& cadscene, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex);
+
+  void init(const CadScene& cadscene,
+            VkDevice        device,
+            VkPhysicalDevice physicalDevice,
+            VkQueue          queue,
+            uint32_t         queueFamilyIndex,
+            bool             positionStream,
+            bool             contiguous);
   void deinit();
+
+  static uint32_t getPositionStride(bool positionStream)
+  {
+    return positionStream ? uint32_t(sizeof(glm::vec3)) : uint32_t(sizeof(CadScene::Vertex));
+  }
+
+  void appendMemoryStats(MemoryStats& stats) const;
 };
@@ -23,6 +23,8 @@
 #define CSFTHREADED_COMMON_H
 
 #define VERTEX_POS_OCTNORMAL      0
+#define VERTEX_POS                1
+#define VERTEX_MATRIXINDEX        2
 
 // changing these orders may break a lot of things ;)
 #define DRAW_UBO_SCENE     0
@@ -35,10 +37,19 @@
 
 #define ANIMATION_WORKGROUPSIZE 256
 
+// user clipping planes of SceneData, one per gl_ClipDistance
+#define MAX_CLIPPLANES 3
+
 #ifndef WIREMODE
 #define WIREMODE 0
 #endif
 
+// instanced drawing, matrix index is a per-instance attribute
+// and the matrices come from a storage buffer bound at DRAW_UBO_MATRIX
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 
 // see resources_vk.hpp
@@ -76,7 +87,9 @@ namespace csfthreaded
 #endif
 
 struct SceneData {
+  // with stereo, a frustum containing both eyes' for culling, the shaders use eyeViewProjMatrix
   mat4  viewProjMatrix;
+  mat4  eyeViewProjMatrix[2];
   mat4  viewMatrix;
   mat4  viewMatrixIT;
 
@@ -84,9 +97,13 @@ struct SceneData {
   vec4  viewDir;
   
   vec4  wLightPos;
+
+  // world space, geometry with dot(plane, vec4(wPos,1)) < 0 is cut away
+  vec4  wClipPlanes[MAX_CLIPPLANES];
   
   ivec2 viewport;
-  ivec2 _pad;
+  int   numClipPlanes;
+  int   stereo;  // multiview pass, gl_ViewIndex picks the eye
 };
 
 // keep compatible to cadscene!
@@ -41,7 +41,11 @@
 #include <nvh/fileoperations.hpp>
 #include <nvh/geometry.hpp>
 
+#include "benchmark.hpp"
+#include "objectbvh.hpp"
+#include "occlusionbuffer.hpp"
 #include "renderer.hpp"
+#include "scenepicker.hpp"
 #include "glm/gtc/matrix_access.hpp"
 
 
@@ -73,26 +77,50 @@ class Sample
     GUI_RENDERER,
     GUI_STRATEGY,
     GUI_MSAA,
+    GUI_WIREEDGES,
+    GUI_FRONTTOBACK,
   };
 
 public:
   struct Tweak
   {
-    int       renderer      = 0;
-    ShadeType shade         = SHADE_SOLID;
-    Strategy  strategy      = STRATEGY_GROUPS;
-    int       msaa          = 0;
-    int       copies        = 1;
-    int       threads       = 1;
-    int       workingSet    = 4096;
-    bool      batchedSubmit = true;
-    bool      sorted        = false;
-    bool      animation     = false;
-    bool      animationSpin = false;
-    int       cloneaxisX    = 1;
-    int       cloneaxisY    = 1;
-    int       cloneaxisZ    = 1;
-    float     percent       = 1.001f;
+    int         renderer        = 0;
+    ShadeType   shade           = SHADE_SOLID;
+    Strategy    strategy        = STRATEGY_GROUPS;
+    int         msaa            = 0;
+    int         copies          = 1;
+    int         threads         = 1;
+    int         workingSet      = 4096;
+    bool        batchedSubmit   = true;
+    bool        sorted          = false;
+    bool        optimized       = false;
+    FrontToBack frontToBack     = FRONTTOBACK_OFF;
+    bool        translucency    = true;
+    bool        frustumCulling  = false;
+    bool        occlusion       = false;
+    float       minPixels       = 0.0f;
+    bool        coherentCulling = false;
+    int         coherentBudget  = 4096;
+    bool        sectionX        = false;
+    bool        sectionY        = false;
+    bool        sectionZ        = false;
+    float       sectionPosition = 0.5f;
+    int         shadowCascades  = 0;
+    int         shadowSize      = 2048;
+    bool        stereo          = false;
+    float       eyeSeparation   = 0.02f;  // relative to the scene dimension
+    bool        animation       = false;
+    bool        animationSpin   = false;
+    bool        animationBVH    = false;
+    bool        picking         = false;
+    int         cloneaxisX      = 1;
+    int         cloneaxisY      = 1;
+    int         cloneaxisZ      = 1;
+    float       percent         = 1.001f;
+    bool        releaseGeometry = false;
+    bool        positionStream  = false;
+    int         wireEdges       = CadScene::WIRE_EDGES_CSF;
+    float       creaseAngle     = 30.0f;
   };
 
 
@@ -106,6 +134,10 @@ public:
   bool  m_lastVsync;
 
   CadScene                  m_scene;
+  ObjectBVH                 m_bvh;
+  OcclusionBuffer           m_occlusion;
+  ScenePicker               m_picker;
+  std::vector<glm::mat4>    m_bvhMatrices;
   std::vector<unsigned int> m_renderersSorted;
   std::string               m_rendererName;
 
@@ -122,14 +154,54 @@ public:
   double m_statsFrameTime = 0;
   double m_statsCpuTime   = 0;
   double m_statsGpuTime   = 0;
+  // seconds the last m_renderer->draw took on the main thread
+  double m_lastDrawTime = 0;
+
+  // under the mouse, updated every frame while picking
+  ScenePicker::Hit m_pickHit;
+  double           m_pickTime = 0;
+
+  // weights >= 0 replace the renderer's defaults for the draw order optimizer
+  StateCost m_stateCostOverride = {-1.0f, -1.0f, -1.0f, -1.0f, -1.0f};
+  // averaging windows until measured times are logged next to the predicted draw order cost
+  int m_orderCostReport = 0;
+  // last averaged gpu time of the scene per front to back mode, 0 if not measured
+  double m_depthSortGpu[NUM_FRONTTOBACK] = {};
+
+  MemoryStats m_memoryStats;
+  std::string m_memoryReportFilename;
+  bool        m_sortBenchmark        = false;
+  bool        m_translucentBenchmark = false;
+  bool        m_bvhBenchmark         = false;
+  bool        m_occlusionBenchmark   = false;
+  bool        m_cullBenchmark        = false;
+  bool        m_pickBenchmark        = false;
+
+  // -viewbenchmark steps through worker threads and shadow views, averaging the draw time of each setting
+  bool                  m_viewBenchmark      = false;
+  int                   m_viewBenchmarkStep  = -1;
+  int                   m_viewBenchmarkFrame = 0;
+  double                m_viewBenchmarkTime  = 0;
+  std::vector<uint32_t> m_viewBenchmarkThreads;
+  std::vector<double>   m_viewBenchmarkResults;
 
   bool initProgram();
   bool initScene(const char* filename, int clones, int cloneaxis);
   bool initFramebuffers(int width, int height);
   void initRenderer(int type, Strategy strategy, int threads, bool sorted, float percent, double uiTime = -1.0);
+
+  uint32_t getVisibleObjects() const { return uint32_t(double(m_scene.m_objects.size()) * double(m_tweak.percent)); }
   void deinitRenderer();
+  void updateMemoryStats();
+  // false if the released geometry could not be read again
+  bool updateSceneGeometry(bool keep);
+  // allocated only while the renderer draws shadow views
+  void updateShadowMaps();
+  void updateViewBenchmark();
 
   void setupConfigParameters();
+  // enums set through m_parameterList are not range checked
+  void clampParameters();
   void setRendererFromName();
 
   Sample()
@@ -222,6 +294,8 @@ bool Sample::initScene(const char* filename, int clones, int cloneaxis)
   }
 
   m_scene.unload();
+  m_scene.m_wireEdges   = CadScene::WireEdges(m_tweak.wireEdges);
+  m_scene.m_creaseAngle = m_tweak.creaseAngle;
 
   bool status = m_scene.loadCSF(modelFilename.c_str(), clones, cloneaxis);
   if(status)
@@ -231,10 +305,26 @@ bool Sample::initScene(const char* filename, int clones, int cloneaxis)
     LOGI("materials:  %6d\n", uint32_t(m_scene.m_materials.size()));
     LOGI("nodes:      %6d\n", uint32_t(m_scene.m_matrices.size()));
     LOGI("objects:    %6d\n", uint32_t(m_scene.m_objects.size()));
+    size_t wireIndices = m_scene.getNumIndexWire();
+    LOGI("wire indices: %9d (file: %9d, %+.1f%%)\n", uint32_t(wireIndices), uint32_t(m_scene.m_numIndexWireCSF),
+         m_scene.m_numIndexWireCSF ? (double(wireIndices) / double(m_scene.m_numIndexWireCSF) - 1.0) * 100.0 : 0.0);
     LOGI("\n");
+
+    // initScene always runs without a renderer, so all threads are free
+    m_bvh.build(m_scene, Renderer::s_threadpool, Renderer::s_threadpool.getNumThreads());
+    LOGI("object bvh: %d nodes, %.2f ms\n", uint32_t(m_bvh.m_nodes.size()), m_bvh.m_buildTime);
+    m_picker.build(m_scene, Renderer::s_threadpool, Renderer::s_threadpool.getNumThreads());
+    LOGI("picking:    %d triangles, %.2f ms\n", uint32_t(m_picker.m_numTriangles), m_picker.m_buildTime);
+
+    // before the cpu geometry may get released
+    m_occlusion.init(m_scene);
+    LOGI("occluders:  %6d\n\n", m_occlusion.m_numOccluders);
   }
   else
   {
+    m_bvh.deinit();
+    m_picker.deinit();
+    m_occlusion.deinit();
     LOGW("\ncould not load model %s\n", modelFilename.c_str());
   }
 
@@ -263,6 +353,16 @@ void Sample::initRenderer(int typesort, Strategy strategy, int threads, bool sor
 {
   int type = m_renderersSorted[typesort];
 
+  // new resources need to upload the scene geometry again, get it back before the current upload is dropped
+  if(Renderer::getRegistry()[type]->resources() != m_resources && !updateSceneGeometry(true))
+  {
+    // the file may have moved, keep drawing from the gpu copy of the current resources
+    LOGE("cannot switch to renderer: %s\n", Renderer::getRegistry()[type]->name());
+    typesort         = m_lastTweak.renderer;
+    type             = m_renderersSorted[typesort];
+    m_tweak.renderer = typesort;
+  }
+
   deinitRenderer();
 
   if(Renderer::getRegistry()[type]->resources() != m_resources)
@@ -281,6 +381,10 @@ void Sample::initRenderer(int typesort, Strategy strategy, int threads, bool sor
       }
     }
     m_resources = Renderer::getRegistry()[type]->resources();
+    m_resources->m_positionStream     = m_tweak.positionStream;
+    m_resources->m_contiguousGeometry = strategy == STRATEGY_MERGED;
+    m_resources->m_stereo             = m_tweak.stereo;
+
 #if HAS_OPENGL
     bool valid = m_resources->init(&m_contextWindow, &m_profiler);
 #else
@@ -291,6 +395,8 @@ void Sample::initRenderer(int typesort, Strategy strategy, int threads, bool sor
     valid                = valid && m_resources->initScene(m_scene);
     m_resources->m_frame = 0;
 
+    updateSceneGeometry(!m_tweak.releaseGeometry);
+
     if(!valid)
     {
       LOGE("resource initialization failed for renderer: %s\n", Renderer::getRegistry()[type]->name());
@@ -308,15 +414,90 @@ void Sample::initRenderer(int typesort, Strategy strategy, int threads, bool sor
   }
 
   Renderer::Config config;
-  config.objectFrom = 0;
-  config.objectNum  = uint32_t(double(m_scene.m_objects.size()) * double(m_tweak.percent));
-  config.strategy   = strategy;
-  config.threads    = threads;
-  config.sorted     = sorted;
+  config.objectFrom   = 0;
+  config.objectNum    = getVisibleObjects();
+  config.strategy     = strategy;
+  config.threads      = threads;
+  config.sorted       = sorted;
+  config.optimized    = m_tweak.optimized;
+  config.frontToBack  = m_tweak.frontToBack;
+  config.translucency = m_tweak.translucency;
+  config.stateCost    = Renderer::getRegistry()[type]->stateCost();
+
+  if(m_stateCostOverride.pipeline >= 0)
+    config.stateCost.pipeline = m_stateCostOverride.pipeline;
+  if(m_stateCostOverride.geometry >= 0)
+    config.stateCost.geometry = m_stateCostOverride.geometry;
+  if(m_stateCostOverride.material >= 0)
+    config.stateCost.material = m_stateCostOverride.material;
+  if(m_stateCostOverride.matrix >= 0)
+    config.stateCost.matrix = m_stateCostOverride.matrix;
+  if(m_stateCostOverride.draw >= 0)
+    config.stateCost.draw = m_stateCostOverride.draw;
 
   LOGI("renderer: %s\n", Renderer::getRegistry()[type]->name());
   m_renderer = Renderer::getRegistry()[type]->create();
+
+  double timeInit = NVPSystem::getTime();
   m_renderer->init(&m_scene, m_resources, config);
+  LOGI("renderer init: %.2f ms\n", (NVPSystem::getTime() - timeInit) * 1000.0);
+
+  updateShadowMaps();
+
+  // first window still averages the previous renderer
+  m_orderCostReport = sorted ? 2 : 0;
+
+  updateMemoryStats();
+  m_memoryStats.print();
+  if(!m_memoryReportFilename.empty())
+  {
+    m_memoryStats.saveJSON(m_memoryReportFilename.c_str());
+  }
+}
+
+bool Sample::updateSceneGeometry(bool keep)
+{
+  if(keep && m_scene.isGeometryReleased())
+  {
+    double begin = NVPSystem::getTime();
+    if(!m_scene.rehydrateGeometry())
+    {
+      LOGE("could not rehydrate geometry from %s\n", m_scene.m_filename.c_str());
+      return false;
+    }
+    LOGI("rehydrated cpu geometry: %.2f ms\n", (NVPSystem::getTime() - begin) * 1000.0);
+  }
+  else if(!keep && !m_scene.isGeometryReleased())
+  {
+    size_t released = m_scene.releaseGeometry();
+    LOGI("released cpu geometry: %d KB\n", uint32_t(released / 1024));
+  }
+  return true;
+}
+
+void Sample::updateShadowMaps()
+{
+  uint32_t numLayers = m_renderer && m_renderer->supportsShadowViews() ? uint32_t(m_tweak.shadowCascades) : 0;
+  if(!m_resources->initShadowMaps(m_tweak.shadowSize, numLayers))
+  {
+    LOGW("shadow maps could not be allocated, drawing without shadow views\n");
+    m_resources->initShadowMaps(m_tweak.shadowSize, 0);
+  }
+}
+
+void Sample::updateMemoryStats()
+{
+  m_memoryStats.clear();
+  m_scene.appendMemoryStats(m_memoryStats);
+  Renderer::s_drawLists.appendMemoryStats(m_memoryStats);
+  if(m_resources)
+  {
+    m_resources->appendMemoryStats(m_memoryStats);
+  }
+  if(m_renderer)
+  {
+    m_renderer->appendMemoryStats(m_memoryStats);
+  }
 }
 
 
@@ -347,6 +528,11 @@ bool Sample::begin()
 
   Renderer::s_threadpool.init(maxthreads);
 
+  if(m_sortBenchmark)
+  {
+    Renderer::benchmarkSortDrawItems();
+  }
+
   ImGuiH::Init(m_windowState.m_winSize[0], m_windowState.m_winSize[1], this);
 
 #if HAS_OPENGL
@@ -369,6 +555,27 @@ bool Sample::begin()
               && initScene(m_modelFilename.c_str(), m_tweak.copies - 1,
                            (m_tweak.cloneaxisX << 0) | (m_tweak.cloneaxisY << 1) | (m_tweak.cloneaxisZ << 2));
 
+  if(validated && m_translucentBenchmark)
+  {
+    Renderer::benchmarkDepthSort(&m_scene);
+  }
+  if(validated && m_bvhBenchmark)
+  {
+    ObjectBVH::benchmark(m_scene, Renderer::s_threadpool);
+  }
+  if(validated && m_occlusionBenchmark)
+  {
+    OcclusionBuffer::benchmark(m_scene, Renderer::s_threadpool);
+  }
+  if(validated && m_cullBenchmark)
+  {
+    Renderer::benchmarkCulling(&m_scene);
+  }
+  if(validated && m_pickBenchmark)
+  {
+    ScenePicker::benchmark(m_scene, m_bvh, Renderer::s_threadpool);
+  }
+
   const Renderer::Registry registry = Renderer::getRegistry();
   for(size_t i = 0; i < registry.size(); i++)
   {
@@ -412,6 +619,8 @@ bool Sample::begin()
 
     m_ui.enumAdd(GUI_STRATEGY, STRATEGY_INDIVIDUAL, "drawcall individual");
     m_ui.enumAdd(GUI_STRATEGY, STRATEGY_GROUPS, "material groups");
+    m_ui.enumAdd(GUI_STRATEGY, STRATEGY_INSTANCED, "instanced");
+    m_ui.enumAdd(GUI_STRATEGY, STRATEGY_MERGED, "merged across objects");
 
     m_ui.enumAdd(GUI_SHADE, SHADE_SOLID, toString(SHADE_SOLID));
     m_ui.enumAdd(GUI_SHADE, SHADE_SOLIDWIRE, toString(SHADE_SOLIDWIRE));
@@ -420,6 +629,14 @@ bool Sample::begin()
     m_ui.enumAdd(GUI_MSAA, 2, "2x");
     m_ui.enumAdd(GUI_MSAA, 4, "4x");
     m_ui.enumAdd(GUI_MSAA, 8, "8x");
+
+    m_ui.enumAdd(GUI_WIREEDGES, CadScene::WIRE_EDGES_CSF, "file");
+    m_ui.enumAdd(GUI_WIREEDGES, CadScene::WIRE_EDGES_FEATURE, "feature edges");
+    m_ui.enumAdd(GUI_WIREEDGES, CadScene::WIRE_EDGES_COMBINED, "file + feature edges");
+
+    m_ui.enumAdd(GUI_FRONTTOBACK, FRONTTOBACK_OFF, "off");
+    m_ui.enumAdd(GUI_FRONTTOBACK, FRONTTOBACK_DRAWITEMS, "drawitems");
+    m_ui.enumAdd(GUI_FRONTTOBACK, FRONTTOBACK_MATERIALS, "within materials");
   }
 
   m_control.m_sceneOrbit     = glm::vec3(m_scene.m_bbox.max + m_scene.m_bbox.min) * 0.5f;
@@ -466,15 +683,46 @@ void Sample::processUI(int width, int height, double time)
     m_ui.enumCombobox(GUI_STRATEGY, "strategy", &m_tweak.strategy);
     m_ui.enumCombobox(GUI_SHADE, "shademode", &m_tweak.shade);
     m_ui.enumCombobox(GUI_MSAA, "msaa", &m_tweak.msaa);
+    m_ui.enumCombobox(GUI_WIREEDGES, "wire edges", &m_tweak.wireEdges);
     //guiRegistry.enumCombobox(GUI_SUPERSAMPLE, "supersample", &tweak.supersample);
     ImGui::SliderFloat("pct visible", &m_tweak.percent, 0.0f, 1.001f);
     ImGui::PushItemWidth(ImGuiH::dpiScaled(100));
     ImGuiH::InputIntClamped("copies", &m_tweak.copies, 1, 16, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::InputFloat("crease angle", &m_tweak.creaseAngle, 5.0f, 15.0f, "%.1f", ImGuiInputTextFlags_EnterReturnsTrue);
     ImGuiH::InputIntClamped("threaded: worker threads", &m_tweak.threads, 1, Renderer::s_threadpool.getNumThreads());
     ImGuiH::InputIntClamped("threaded: workingset", &m_tweak.workingSet, 128, 16 * 1024, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::Checkbox("threaded: batched submit", &m_tweak.batchedSubmit);
     ImGui::Checkbox("sorted", &m_tweak.sorted);
+    ImGui::Checkbox("sorted: cost optimized", &m_tweak.optimized);
+    m_ui.enumCombobox(GUI_FRONTTOBACK, "threaded: front to back", &m_tweak.frontToBack);
+    ImGui::Checkbox("threaded: translucent parts", &m_tweak.translucency);
+    ImGui::Checkbox("threaded: frustum culling", &m_tweak.frustumCulling);
+    ImGui::Checkbox("threaded: occlusion culling", &m_tweak.occlusion);
+    ImGui::SliderFloat("threaded: min pixels", &m_tweak.minPixels, 0.0f, 16.0f, "%.1f");
+    ImGui::Checkbox("threaded: coherent culling", &m_tweak.coherentCulling);
+    ImGuiH::InputIntClamped("threaded: coherent budget", &m_tweak.coherentBudget, 1, 1024 * 1024, 256, 4096,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
+    if(m_resources->supportsClipPlanes())
+    {
+      ImGui::Checkbox("section: x", &m_tweak.sectionX);
+      ImGui::Checkbox("section: y", &m_tweak.sectionY);
+      ImGui::Checkbox("section: z", &m_tweak.sectionZ);
+      ImGui::SliderFloat("section: position", &m_tweak.sectionPosition, 0.0f, 1.0f);
+    }
+    ImGui::SliderInt("threaded: shadow cascades", &m_tweak.shadowCascades, 0, int(Resources::MAX_SHADOWVIEWS));
+    ImGuiH::InputIntClamped("threaded: shadow map size", &m_tweak.shadowSize, 256, 8192, 256, 1024,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
+    if(m_resources->supportsStereo())
+    {
+      ImGui::Checkbox("stereo", &m_tweak.stereo);
+      ImGui::SliderFloat("stereo: eye separation", &m_tweak.eyeSeparation, 0.0f, 0.1f);
+    }
+    ImGui::Checkbox("share cached drawlists", &Renderer::s_drawLists.m_enabled);
     ImGui::Checkbox("animation", &m_tweak.animation);
+    ImGui::Checkbox("animation: refit bvh", &m_tweak.animationBVH);
+    ImGui::Checkbox("picking", &m_tweak.picking);
+    ImGui::Checkbox("release cpu geometry", &m_tweak.releaseGeometry);
+    ImGui::Checkbox("position-only wire stream", &m_tweak.positionStream);
     ImGui::PopItemWidth();
     ImGui::Separator();
 
@@ -499,6 +747,15 @@ void Sample::processUI(int width, int height, double time)
       if(m_profiler.getTotalFrames() % avg == avg - 1)
       {
         m_profiler.getAveragedValues("Render", m_statsCpuTime, m_statsGpuTime);
+        if(m_orderCostReport && --m_orderCostReport == 0 && m_renderer)
+        {
+          LOGI("draw order: predicted cost %.0f, fixed sort %.0f, measured cpu %.3f ms gpu %.3f ms\n",
+               m_renderer->m_orderCost, m_renderer->m_orderCostFixed, m_statsCpuTime / 1000.0, m_statsGpuTime / 1000.0);
+        }
+        if(m_renderer && m_renderer->supportsFrontToBack())
+        {
+          m_depthSortGpu[m_tweak.frontToBack] = m_statsGpuTime;
+        }
         m_statsFrameTime = (time - m_lastFrameTime) / m_frames;
         m_lastFrameTime  = time;
         m_frames         = -1;
@@ -515,16 +772,314 @@ void Sample::processUI(int width, int height, double time)
       ImGui::ProgressBar(gpuTimeF / maxTimeF, ImVec2(0.0f, 0.0f));
       ImGui::Text("Scene CPU [ms]: %2.3f", cpuTimeF / 1000.0f);
       ImGui::ProgressBar(cpuTimeF / maxTimeF, ImVec2(0.0f, 0.0f));
+      if(m_renderer && m_tweak.sorted)
+      {
+        ImGui::Text("Order cost    : %.0f", m_renderer->m_orderCost);
+        ImGui::Text("  fixed sort  : %.0f", m_renderer->m_orderCostFixed);
+      }
+      if(m_renderer && m_renderer->supportsFrontToBack() && m_tweak.frontToBack != FRONTTOBACK_OFF)
+      {
+        // gpu gain of early-z against the cpu time spent sorting
+        ImGui::Text("Depth sort[ms]: %2.3f", m_renderer->m_depthSortTime);
+        const char* names[NUM_FRONTTOBACK] = {"off", "drawitems", "materials"};
+        for(int i = 0; i < NUM_FRONTTOBACK; i++)
+        {
+          if(m_depthSortGpu[i] > 0 && m_depthSortGpu[FRONTTOBACK_OFF] > 0)
+          {
+            ImGui::Text("  %-9s gpu: %2.3f (%+2.3f)", names[i], m_depthSortGpu[i] / 1000.0,
+                        (m_depthSortGpu[i] - m_depthSortGpu[FRONTTOBACK_OFF]) / 1000.0);
+          }
+          else if(m_depthSortGpu[i] > 0)
+          {
+            ImGui::Text("  %-9s gpu: %2.3f", names[i], m_depthSortGpu[i] / 1000.0);
+          }
+        }
+      }
+      if(m_renderer && m_renderer->supportsTranslucency() && m_tweak.translucency)
+      {
+        ImGui::Text("Translucent   : %d", uint32_t(m_renderer->m_numTranslucentDrawn));
+        ImGui::Text("  sort   [ms] : %2.3f", m_renderer->m_translucentSortTime);
+      }
+      if(m_renderer && m_renderer->supportsFrustumCulling() && m_shared.frustumCulling)
+      {
+        ImGui::Text("Culled        : %d / %d", uint32_t(m_renderer->m_cullCulled), uint32_t(m_renderer->m_cullTested));
+        ImGui::Text("  cpu    [ms] : %2.3f", m_renderer->m_cullTime);
+        ImGui::Text("  per item[ns]: %2.1f",
+                    m_renderer->m_cullTested ? m_renderer->m_cullTime * 1000000.0 / double(m_renderer->m_cullTested) : 0.0);
+        if(m_shared.coherentBudget)
+        {
+          ImGui::Text("  coherent    : %d", uint32_t(m_renderer->m_cullCoherent));
+        }
+        if(m_shared.occlusion)
+        {
+          // rate of the drawitems that reach the occlusion test, each one is a draw call
+          size_t inside = m_renderer->m_cullTested - (m_renderer->m_cullCulled - m_renderer->m_cullOccluded);
+          ImGui::Text("Occluded      : %d (%.1f%%)", uint32_t(m_renderer->m_cullOccluded),
+                      inside ? double(m_renderer->m_cullOccluded) * 100.0 / double(inside) : 0.0);
+          ImGui::Text("  raster [ms] : %2.3f", m_renderer->m_occlusionTime);
+          ImGui::Text("  draws saved : %d", uint32_t(m_renderer->m_cullCulled));
+        }
+        if(m_shared.sceneUbo.numClipPlanes)
+        {
+          ImGui::Text("Clipped       : %d", uint32_t(m_renderer->m_cullClipped));
+        }
+        if(m_shared.minPixels > 0)
+        {
+          ImGui::Text("Small         : %d", uint32_t(m_renderer->m_cullSmall));
+          ImGui::Text("  saved  [ms] : %2.3f", m_renderer->m_cullSmallSaved);
+        }
+      }
+      if(m_renderer && m_renderer->m_shadowViews)
+      {
+        // culling and recording of all shadow views, summed over the threads
+        ImGui::Text("Shadow views  : %d", m_renderer->m_shadowViews);
+        ImGui::Text("  drawitems   : %d", uint32_t(m_renderer->m_shadowDrawn));
+        ImGui::Text("  cpu    [ms] : %2.3f", m_renderer->m_shadowTime);
+      }
+      if(m_tweak.animation && m_tweak.animationBVH)
+      {
+        ImGui::Text("BVH refit [ms]: %2.3f", m_bvh.m_refitTime);
+      }
+      if(m_tweak.picking)
+      {
+        ImGui::Text("Pick     [ms] : %2.3f", m_pickTime);
+        if(m_pickHit.valid())
+        {
+          ImGui::Text("  object      : %d", m_pickHit.object);
+          ImGui::Text("  part        : %d", m_pickHit.part);
+        }
+        else
+        {
+          ImGui::Text("  object      : -");
+        }
+      }
+    }
+
+    if(ImGui::CollapsingHeader("memory"))
+    {
+      // per-frame command buffer counts change, so refresh while visible
+      updateMemoryStats();
+
+      ImGui::Text("%-12s %10s %10s", "[KB]", "cpu", "gpu");
+      for(int i = 0; i < MemoryStats::NUM_CATEGORIES; i++)
+      {
+        ImGui::Text("%-12s %10d %10d", MemoryStats::toString(MemoryStats::Category(i)),
+                    uint32_t(m_memoryStats.cpu[i] / 1024), uint32_t(m_memoryStats.gpu[i] / 1024));
+      }
+      ImGui::Text("%-12s %10d %10d", "total", uint32_t(m_memoryStats.getTotalCPU() / 1024),
+                  uint32_t(m_memoryStats.getTotalGPU() / 1024));
+      ImGui::Text("command buffers: %d", m_memoryStats.numCommandBuffers);
+      if(!m_memoryReportFilename.empty() && ImGui::Button("save report"))
+      {
+        m_memoryStats.saveJSON(m_memoryReportFilename.c_str());
+      }
     }
   }
   ImGui::End();
 }
 
+// cpu copy of animation.comp.glsl, the gpu results are never read back
+static void AnimateMatrices(const AnimationData& anim, const CadScene& scene, std::vector<glm::mat4>& matrices)
+{
+  matrices.resize(scene.m_matrices.size());
+  for(uint32_t self = 0; self < uint32_t(matrices.size()); self++)
+  {
+    float s        = 1 - (float(self) / float(anim.numMatrices));
+    float movement = 4;
+    float sequence = movement * 2 + 3;
+
+    float timeS = glm::fract(anim.time / sequence) * sequence;
+    float time  = glm::clamp(timeS - s * movement, 0.0f, 1.0f)
+                 - glm::clamp(timeS - (1 - s) * movement - sequence * 0.5f, 0.0f, 1.0f);
+    float scale = glm::smoothstep(0.0f, 1.0f, time);
+
+    glm::mat4 matrix = scene.m_matrices[self].worldMatrix;
+    glm::vec3 pos    = glm::vec3(matrix[3]);
+    glm::vec3 away   = pos - anim.sceneCenter;
+
+    glm::vec3 delta = glm::vec3(0);
+    delta[self % 3] = (self % 6) < 3 ? 1.0f : -1.0f;
+    delta *= glm::sign(glm::dot(away, delta));
+
+    // the shader normalizes a zero vector here, keep such matrices in place
+    if(delta != glm::vec3(0))
+    {
+      pos += delta * scale * anim.sceneDimension;
+    }
+
+    matrix[3]      = glm::vec4(pos, 1);
+    matrices[self] = matrix;
+  }
+}
+
+// parallel eyes around view, eye 0 is the left one, drawn into the left half of the window
+static glm::mat4 EyeViewMatrix(const glm::mat4& view, float separation, int eye)
+{
+  glm::vec3 offset = glm::vec3(eye ? -0.5f * separation : 0.5f * separation, 0, 0);
+  return glm::translate(glm::mat4(1), offset) * view;
+}
+
+// orthographic views of a directional light, each one covers a slice of the camera's depth range.
+// slices follow the practical split scheme, their depth spans the entire scene so all casters are kept
+static void ComputeShadowCascades(const Resources*      resources,
+                                  const SceneData&      sceneUbo,
+                                  float                 fovy,
+                                  float                 aspect,
+                                  float                 nearPlane,
+                                  float                 farPlane,
+                                  const CadScene::BBox& bbox,
+                                  const glm::vec3&      lightDir,
+                                  uint32_t              numCascades,
+                                  int                   size,
+                                  SceneData*            cascades)
+{
+  glm::vec3 corners[8];
+  for(int i = 0; i < 8; i++)
+  {
+    corners[i] = glm::vec3((i & 1) ? bbox.max.x : bbox.min.x, (i & 2) ? bbox.max.y : bbox.min.y,
+                           (i & 4) ? bbox.max.z : bbox.min.z);
+  }
+
+  // no slices beyond the scene
+  float sceneDepth = nearPlane;
+  for(int i = 0; i < 8; i++)
+  {
+    sceneDepth = std::max(sceneDepth, -(sceneUbo.viewMatrix * glm::vec4(corners[i], 1)).z);
+  }
+  farPlane = std::max(std::min(farPlane, sceneDepth), nearPlane * 2.0f);
+
+  glm::vec3 up        = fabsf(lightDir.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+  glm::mat4 lightView = glm::lookAt(glm::vec3(0), lightDir, up);
+
+  float lightNear = FLT_MAX;
+  float lightFar  = -FLT_MAX;
+  for(int i = 0; i < 8; i++)
+  {
+    float z   = (lightView * glm::vec4(corners[i], 1)).z;
+    lightNear = std::min(lightNear, -z);
+    lightFar  = std::max(lightFar, -z);
+  }
+
+  glm::mat4 viewInverse = glm::inverse(sceneUbo.viewMatrix);
+  float     tanY        = tanf(glm::radians(fovy) * 0.5f);
+  float     tanX        = tanY * aspect;
+
+  for(uint32_t c = 0; c < numCascades; c++)
+  {
+    float slice[2];
+    for(uint32_t s = 0; s < 2; s++)
+    {
+      float t           = float(c + s) / float(numCascades);
+      float uniform     = nearPlane + (farPlane - nearPlane) * t;
+      float logarithmic = nearPlane * powf(farPlane / nearPlane, t);
+      slice[s]          = glm::mix(uniform, logarithmic, 0.75f);
+    }
+
+    glm::vec2 lightMin = glm::vec2(FLT_MAX);
+    glm::vec2 lightMax = glm::vec2(-FLT_MAX);
+    for(int i = 0; i < 8; i++)
+    {
+      float     depth    = slice[i >> 2];
+      glm::vec4 viewPos  = glm::vec4((i & 1 ? tanX : -tanX) * depth, (i & 2 ? tanY : -tanY) * depth, -depth, 1);
+      glm::vec4 lightPos = lightView * (viewInverse * viewPos);
+      lightMin           = glm::min(lightMin, glm::vec2(lightPos.x, lightPos.y));
+      lightMax           = glm::max(lightMax, glm::vec2(lightPos.x, lightPos.y));
+    }
+
+    glm::mat4 projection =
+        resources->orthographicProjection(lightMin.x, lightMax.x, lightMin.y, lightMax.y, lightNear, lightFar);
+
+    // clipping planes and light stay those of the main view
+    SceneData& cascade     = cascades[c];
+    cascade                = sceneUbo;
+    cascade.stereo         = 0;
+    cascade.viewProjMatrix = projection * lightView;
+    cascade.viewMatrix     = lightView;
+    cascade.viewMatrixIT   = glm::transpose(glm::inverse(lightView));
+    cascade.viewPos        = glm::row(cascade.viewMatrixIT, 3);
+    cascade.viewDir        = glm::vec4(lightDir, 0);
+    cascade.viewport       = glm::ivec2(size, size);
+  }
+}
+
+void Sample::updateViewBenchmark()
+{
+  const int numViews      = int(Resources::MAX_SHADOWVIEWS) + 1;
+  const int skipFrames    = 16;  // renderer init and the first frames after it
+  const int measureFrames = 64;
+
+  if(m_viewBenchmarkStep < 0)
+  {
+    getBenchmarkThreads(Renderer::s_threadpool.getNumThreads(), m_viewBenchmarkThreads);
+    m_viewBenchmarkResults.clear();
+
+    m_viewBenchmarkStep  = 0;
+    m_viewBenchmarkFrame = 0;
+    m_viewBenchmarkTime  = 0;
+  }
+  else
+  {
+    if(m_viewBenchmarkFrame++ >= skipFrames)
+    {
+      m_viewBenchmarkTime += m_lastDrawTime;
+    }
+    if(m_viewBenchmarkFrame == skipFrames + measureFrames)
+    {
+      m_viewBenchmarkResults.push_back(m_viewBenchmarkTime * 1000.0 / double(measureFrames));
+      m_viewBenchmarkStep++;
+      m_viewBenchmarkFrame = 0;
+      m_viewBenchmarkTime  = 0;
+    }
+  }
+
+  if(m_viewBenchmarkStep == int(m_viewBenchmarkThreads.size()) * numViews)
+  {
+    const Renderer::Registry registry = Renderer::getRegistry();
+    LOGI("view benchmark, %s\n", registry[m_renderersSorted[m_tweak.renderer]]->name());
+    if(!m_renderer->supportsShadowViews())
+    {
+      LOGI("renderer draws no shadow views\n");
+    }
+
+    // rows are threads, columns draw cpu [ms] per number of shadow views, last the cost of one more view
+    BenchmarkLine header;
+    header.append("threads");
+    for(int v = 0; v < numViews; v++)
+    {
+      header.append(" %d views", v);
+    }
+    LOGI("%s  per view\n", header.c_str());
+
+    for(size_t t = 0; t < m_viewBenchmarkThreads.size(); t++)
+    {
+      const double* times = &m_viewBenchmarkResults[t * numViews];
+      BenchmarkLine line;
+      line.append("%7d", m_viewBenchmarkThreads[t]);
+      for(int v = 0; v < numViews; v++)
+      {
+        line.append(" %7.3f", times[v]);
+      }
+      LOGI("%s  %8.3f\n", line.c_str(), (times[numViews - 1] - times[0]) / double(numViews - 1));
+    }
+    LOGI("\n");
+
+    m_viewBenchmark     = false;
+    m_viewBenchmarkStep = -1;
+    return;
+  }
+
+  m_tweak.threads        = int(m_viewBenchmarkThreads[m_viewBenchmarkStep / numViews]);
+  m_tweak.shadowCascades = m_viewBenchmarkStep % numViews;
+}
+
 void Sample::think(double time)
 {
   int width  = m_windowState.m_swapSize[0];
   int height = m_windowState.m_swapSize[1];
 
+  // benchmark sequences may set parameters between frames
+  clampParameters();
+
   if(m_useUI)
   {
     processUI(width, height, time);
@@ -540,15 +1095,30 @@ void Sample::think(double time)
     m_resources->reloadPrograms(std::string());
   }
 
-  if(m_tweak.msaa != m_lastTweak.msaa || getVsync() != m_lastVsync)
+  if(m_viewBenchmark)
   {
-    m_lastVsync = getVsync();
+    updateViewBenchmark();
+  }
+
+  if(m_tweak.msaa != m_lastTweak.msaa || getVsync() != m_lastVsync || m_tweak.stereo != m_lastTweak.stereo)
+  {
+    m_lastVsync           = getVsync();
+    m_resources->m_stereo = m_tweak.stereo;
     m_resources->initFramebuffer(width, height, m_tweak.msaa, getVsync());
   }
 
-  bool sceneChanged = false;
+  if(m_tweak.shadowCascades != m_lastTweak.shadowCascades || m_tweak.shadowSize != m_lastTweak.shadowSize)
+  {
+    updateShadowMaps();
+  }
+
+  bool sceneChanged    = false;
+  bool gpuSceneChanged = m_tweak.positionStream != m_lastTweak.positionStream
+                         || (m_tweak.strategy == STRATEGY_MERGED) != m_resources->m_contiguousGeometry;
   if(m_tweak.copies != m_lastTweak.copies || m_tweak.cloneaxisX != m_lastTweak.cloneaxisX
-     || m_tweak.cloneaxisY != m_lastTweak.cloneaxisY || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ)
+     || m_tweak.cloneaxisY != m_lastTweak.cloneaxisY || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ
+     || m_tweak.wireEdges != m_lastTweak.wireEdges
+     || (m_tweak.creaseAngle != m_lastTweak.creaseAngle && m_tweak.wireEdges != CadScene::WIRE_EDGES_CSF))
   {
     sceneChanged = true;
     m_resources->synchronize();
@@ -557,11 +1127,50 @@ void Sample::think(double time)
     initScene(m_modelFilename.c_str(), m_tweak.copies - 1,
               (m_tweak.cloneaxisX << 0) | (m_tweak.cloneaxisY << 1) | (m_tweak.cloneaxisZ << 2));
     m_resources->initScene(m_scene);
+    updateSceneGeometry(!m_tweak.releaseGeometry);
+  }
+  else if(gpuSceneChanged && !updateSceneGeometry(true))
+  {
+    // the file may have moved, keep drawing from the gpu copy
+    LOGE("cannot rebuild the gpu scene, keeping the vertex streams and strategy\n");
+    m_tweak.positionStream = m_lastTweak.positionStream;
+    m_tweak.strategy       = m_lastTweak.strategy;
+  }
+  else if(gpuSceneChanged)
+  {
+    // only the gpu side of the scene changes, the geometry was rehydrated above
+    sceneChanged = true;
+    m_resources->synchronize();
+    deinitRenderer();
+    m_resources->deinitScene();
+    // chunk placement of the drawitems is rebuilt
+    Renderer::s_drawLists.clear();
+    m_resources->m_positionStream     = m_tweak.positionStream;
+    m_resources->m_contiguousGeometry = m_tweak.strategy == STRATEGY_MERGED;
+    m_resources->initScene(m_scene);
+    updateSceneGeometry(!m_tweak.releaseGeometry);
+  }
+  else if(m_tweak.releaseGeometry != m_lastTweak.releaseGeometry)
+  {
+    if(!updateSceneGeometry(!m_tweak.releaseGeometry))
+    {
+      // the file may have moved, keep drawing from the gpu copy
+      m_tweak.releaseGeometry = true;
+    }
+    updateMemoryStats();
   }
 
   if(sceneChanged || m_tweak.renderer != m_lastTweak.renderer || m_tweak.strategy != m_lastTweak.strategy
-     || m_tweak.threads != m_lastTweak.threads || m_tweak.sorted != m_lastTweak.sorted || m_tweak.percent != m_lastTweak.percent)
+     || m_tweak.threads != m_lastTweak.threads || m_tweak.sorted != m_lastTweak.sorted
+     || m_tweak.optimized != m_lastTweak.optimized || m_tweak.frontToBack != m_lastTweak.frontToBack
+     || m_tweak.translucency != m_lastTweak.translucency
+     || (m_tweak.percent != m_lastTweak.percent && !(m_renderer && m_renderer->hasObjectCutoff())))
   {
+    if(m_tweak.frontToBack == m_lastTweak.frontToBack)
+    {
+      // gpu times per front to back mode are only comparable within the same setup
+      std::fill(m_depthSortGpu, m_depthSortGpu + NUM_FRONTTOBACK, 0.0);
+    }
     m_resources->synchronize();
     initRenderer(m_tweak.renderer, m_tweak.strategy, m_tweak.threads, m_tweak.sorted, m_tweak.percent, time);
   }
@@ -575,6 +1184,11 @@ void Sample::think(double time)
 
     m_animBeginTime = time;
   }
+  if(!m_tweak.animation && m_lastTweak.animation && m_lastTweak.animationBVH)
+  {
+    // back to the original matrices
+    m_bvh.refit(m_scene, nullptr);
+  }
 
   {
     m_shared.winWidth  = width;
@@ -582,12 +1196,18 @@ void Sample::think(double time)
 
     SceneData& sceneUbo = m_shared.sceneUbo;
 
-    sceneUbo.viewport = ivec2(width, height);
+    // each eye gets half the window
+    bool  stereo    = m_tweak.stereo && m_resources->supportsStereo();
+    int   eyeWidth  = stereo ? std::max(width / 2, 1) : width;
+    float aspect    = float(eyeWidth) / float(height);
+    float nearPlane = m_control.m_sceneDimension * 0.001f;
+    float farPlane  = m_control.m_sceneDimension * 10.0f;
 
-    glm::mat4 projection =
-        m_resources->perspectiveProjection((45.f), float(width) / float(height), m_control.m_sceneDimension * 0.001f,
-                                           m_control.m_sceneDimension * 10.0f);
-    glm::mat4 view = m_control.m_viewMatrix;
+    sceneUbo.viewport = ivec2(eyeWidth, height);
+    sceneUbo.stereo   = stereo ? 1 : 0;
+
+    glm::mat4 projection = m_resources->perspectiveProjection((45.f), aspect, nearPlane, farPlane);
+    glm::mat4 view       = m_control.m_viewMatrix;
 
     if(m_tweak.animation && m_tweak.animationSpin)
     {
@@ -601,14 +1221,65 @@ void Sample::think(double time)
     sceneUbo.viewMatrix     = view;
     sceneUbo.viewMatrixIT   = glm::transpose(glm::inverse(view));
 
+    if(stereo)
+    {
+      // same symmetric frustum for each eye
+      float separation = m_control.m_sceneDimension * m_tweak.eyeSeparation;
+      for(int eye = 0; eye < 2; eye++)
+      {
+        sceneUbo.eyeViewProjMatrix[eye] = projection * EyeViewMatrix(view, separation, eye);
+      }
+
+      // culling and sorting see one frustum containing both eyes', its apex moved back until
+      // the side planes pass through the eyes. the depth range starts at the eyes' near plane
+      float     tanX     = tanf(glm::radians(45.f) * 0.5f) * aspect;
+      float     back     = 0.5f * separation / tanX;
+      glm::mat4 combined = m_resources->perspectiveProjection((45.f), aspect, nearPlane + back, farPlane + back);
+
+      sceneUbo.viewProjMatrix = combined * glm::translate(glm::mat4(1), glm::vec3(0, 0, -back)) * view;
+    }
+
     sceneUbo.viewPos = glm::row(sceneUbo.viewMatrixIT, 3);
     sceneUbo.viewDir = -glm::row(view,2);
 
     sceneUbo.wLightPos   = glm::row(sceneUbo.viewMatrixIT,3);
     sceneUbo.wLightPos.w = 1.0;
 
-    m_shared.workingSet    = m_tweak.workingSet;
-    m_shared.batchedSubmit = m_tweak.batchedSubmit;
+    // section view, keeps the scene below sectionPosition of its extent along every enabled axis
+    bool section[3]        = {m_tweak.sectionX, m_tweak.sectionY, m_tweak.sectionZ};
+    sceneUbo.numClipPlanes = 0;
+    for(int axis = 0; axis < 3 && m_resources->supportsClipPlanes(); axis++)
+    {
+      if(!section[axis])
+        continue;
+
+      glm::vec4 plane = glm::vec4(0);
+      plane[axis]     = -1.0f;
+      plane.w = m_scene.m_bbox.min[axis] + (m_scene.m_bbox.max[axis] - m_scene.m_bbox.min[axis]) * m_tweak.sectionPosition;
+      sceneUbo.wClipPlanes[sceneUbo.numClipPlanes++] = plane;
+    }
+
+    m_shared.workingSet     = m_tweak.workingSet;
+    m_shared.batchedSubmit  = m_tweak.batchedSubmit;
+    m_shared.visibleObjects = getVisibleObjects();
+    // the cpu side bounds don't follow the animated matrices
+    m_shared.frustumCulling =
+        (m_tweak.frustumCulling || m_tweak.occlusion || m_tweak.minPixels > 0 || sceneUbo.numClipPlanes > 0)
+        && !m_tweak.animation;
+    m_shared.minPixels      = m_tweak.minPixels;
+    m_shared.coherentBudget = m_tweak.coherentCulling ? uint32_t(m_tweak.coherentBudget) : 0;
+    // an occluder in front of the combined frustum's apex may not cover the same from either eye
+    m_shared.occlusion =
+        m_shared.frustumCulling && m_tweak.occlusion && !m_occlusion.empty() && !stereo ? &m_occlusion : nullptr;
+
+    // sun from above, the cascades split the camera's depth range
+    m_shared.numShadowViews = m_renderer->supportsShadowViews() ? uint32_t(m_tweak.shadowCascades) : 0;
+    if(m_shared.numShadowViews)
+    {
+      ComputeShadowCascades(m_resources, sceneUbo, 45.f, aspect, nearPlane, farPlane, m_scene.m_bbox,
+                            glm::normalize(glm::vec3(0.3f, -1.0f, 0.5f)), m_shared.numShadowViews, m_tweak.shadowSize,
+                            m_shared.shadowUbos);
+    }
   }
 
   if(m_tweak.animation)
@@ -617,10 +1288,44 @@ void Sample::think(double time)
     animUbo.time           = float(time - m_animBeginTime);
 
     m_resources->animation(m_shared);
+
+    if(m_tweak.animationBVH && !m_bvh.empty())
+    {
+      AnimateMatrices(animUbo, m_scene, m_bvhMatrices);
+      m_bvh.refit(m_scene, m_bvhMatrices.data());
+    }
+  }
+
+  m_pickHit = ScenePicker::Hit();
+  // the bvh only follows the animation when it is refit
+  if(m_tweak.picking && !m_picker.empty() && (!m_tweak.animation || m_tweak.animationBVH))
+  {
+    double pickBegin = NVPSystem::getTime();
+
+    glm::mat4 view     = m_shared.sceneUbo.viewMatrix;
+    glm::vec2 pixel    = glm::vec2(m_windowState.m_mouseCurrent[0], m_windowState.m_mouseCurrent[1]);
+    glm::vec2 viewport = glm::vec2(m_windowState.m_winSize[0], m_windowState.m_winSize[1]);
+    if(m_shared.sceneUbo.stereo)
+    {
+      // the ray of the eye whose half the mouse is in
+      viewport.x = std::max(floorf(viewport.x * 0.5f), 1.0f);
+      int eye    = pixel.x < viewport.x ? 0 : 1;
+      pixel.x -= eye ? viewport.x : 0.0f;
+      view       = EyeViewMatrix(view, m_control.m_sceneDimension * m_tweak.eyeSeparation, eye);
+    }
+
+    glm::vec3 origin;
+    glm::vec3 direction;
+    ScenePicker::getPixelRay(view, 45.0f, pixel, viewport, origin, direction);
+    m_pickHit = m_picker.pick(m_scene, m_bvh, m_tweak.animation ? m_bvhMatrices.data() : nullptr, origin, direction);
+
+    m_pickTime = (NVPSystem::getTime() - pickBegin) * 1000.0;
   }
 
   {
+    double drawBegin = NVPSystem::getTime();
     m_renderer->draw(m_tweak.shade, m_resources, m_shared);
+    m_lastDrawTime = NVPSystem::getTime() - drawBegin;
   }
 
   {
@@ -689,7 +1394,43 @@ void Sample::setupConfigParameters()
   m_parameterList.add("animation", &m_tweak.animation);
   m_parameterList.add("animationspin", &m_tweak.animationSpin);
   m_parameterList.add("minstatechanges", &m_tweak.sorted);
+  m_parameterList.add("optimizedorder", &m_tweak.optimized);
+  m_parameterList.add("fronttoback", (uint32_t*)&m_tweak.frontToBack);
+  m_parameterList.add("translucency", &m_tweak.translucency);
+  m_parameterList.add("translucentbenchmark", &m_translucentBenchmark);
+  m_parameterList.add("frustumculling", &m_tweak.frustumCulling);
+  m_parameterList.add("animationbvh", &m_tweak.animationBVH);
+  m_parameterList.add("bvhbenchmark", &m_bvhBenchmark);
+  m_parameterList.add("occlusionculling", &m_tweak.occlusion);
+  m_parameterList.add("minpixels", &m_tweak.minPixels);
+  m_parameterList.add("occlusionbenchmark", &m_occlusionBenchmark);
+  m_parameterList.add("coherentculling", &m_tweak.coherentCulling);
+  m_parameterList.add("coherentbudget", &m_tweak.coherentBudget);
+  m_parameterList.add("cullbenchmark", &m_cullBenchmark);
+  m_parameterList.add("picking", &m_tweak.picking);
+  m_parameterList.add("pickbenchmark", &m_pickBenchmark);
+  m_parameterList.add("sectionx", &m_tweak.sectionX);
+  m_parameterList.add("sectiony", &m_tweak.sectionY);
+  m_parameterList.add("sectionz", &m_tweak.sectionZ);
+  m_parameterList.add("sectionposition", &m_tweak.sectionPosition);
+  m_parameterList.add("shadowcascades", &m_tweak.shadowCascades);
+  m_parameterList.add("shadowsize", &m_tweak.shadowSize);
+  m_parameterList.add("viewbenchmark", &m_viewBenchmark);
+  m_parameterList.add("stereo", &m_tweak.stereo);
+  m_parameterList.add("eyeseparation", &m_tweak.eyeSeparation);
+  m_parameterList.add("costpipeline", &m_stateCostOverride.pipeline);
+  m_parameterList.add("costgeometry", &m_stateCostOverride.geometry);
+  m_parameterList.add("costmaterial", &m_stateCostOverride.material);
+  m_parameterList.add("costmatrix", &m_stateCostOverride.matrix);
+  m_parameterList.add("costdraw", &m_stateCostOverride.draw);
+  m_parameterList.add("drawlistcache", &Renderer::s_drawLists.m_enabled);
   m_parameterList.add("workingset", &m_tweak.workingSet);
+  m_parameterList.add("memoryreport", &m_memoryReportFilename);
+  m_parameterList.add("releasegeometry", &m_tweak.releaseGeometry);
+  m_parameterList.add("positionstream", &m_tweak.positionStream);
+  m_parameterList.add("wireedges", &m_tweak.wireEdges);
+  m_parameterList.add("creaseangle", &m_tweak.creaseAngle);
+  m_parameterList.add("sortbenchmark", &m_sortBenchmark);
 }
 
 bool Sample::validateConfig()
@@ -701,9 +1442,20 @@ bool Sample::validateConfig()
     m_parameterList.print();
     return false;
   }
+  clampParameters();
   return true;
 }
 
+void Sample::clampParameters()
+{
+  // indexes arrays of NUM_FRONTTOBACK
+  if(uint32_t(m_tweak.frontToBack) >= NUM_FRONTTOBACK)
+  {
+    LOGW("fronttoback %d out of range, using %d\n", uint32_t(m_tweak.frontToBack), NUM_FRONTTOBACK - 1);
+    m_tweak.frontToBack = FrontToBack(NUM_FRONTTOBACK - 1);
+  }
+}
+
 }  // namespace csfthreaded
 
 using namespace csfthreaded;
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "memorystats.hpp"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <nvh/nvprint.hpp>
+
+
+const char* MemoryStats::toString(Category category)
+{
+  switch(category)
+  {
+    case GEOMETRY:
+      return "geometry";
+    case MATRICES:
+      return "matrices";
+    case MATERIALS:
+      return "materials";
+    case DRAWCACHES:
+      return "drawcaches";
+    case DRAWITEMS:
+      return "drawitems";
+    case DRAWLISTS:
+      return "drawlists";
+    case COMMANDS:
+      return "commands";
+    case STAGING:
+      return "staging";
+  }
+
+  return NULL;
+}
+
+void MemoryStats::print() const
+{
+  LOGI("memory          cpu [KB]    gpu [KB]\n");
+  for(int i = 0; i < NUM_CATEGORIES; i++)
+  {
+    LOGI("%-12s %11" PRIu64 " %11" PRIu64 "\n", toString(Category(i)), uint64_t(cpu[i] / 1024), uint64_t(gpu[i] / 1024));
+  }
+  LOGI("%-12s %11" PRIu64 " %11" PRIu64 "\n", "total", uint64_t(getTotalCPU() / 1024), uint64_t(getTotalGPU() / 1024));
+  LOGI("command buffers: %7d\n\n", numCommandBuffers);
+}
+
+bool MemoryStats::saveJSON(const char* filename) const
+{
+  FILE* file = fopen(filename, "wt");
+  if(!file)
+  {
+    LOGW("could not write memory report %s\n", filename);
+    return false;
+  }
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"categories\": {\n");
+  for(int i = 0; i < NUM_CATEGORIES; i++)
+  {
+    fprintf(file, "    \"%s\": { \"cpu\": %" PRIu64 ", \"gpu\": %" PRIu64 " }%s\n", toString(Category(i)),
+            uint64_t(cpu[i]), uint64_t(gpu[i]), i + 1 < NUM_CATEGORIES ? "," : "");
+  }
+  fprintf(file, "  },\n");
+  fprintf(file, "  \"total\": { \"cpu\": %" PRIu64 ", \"gpu\": %" PRIu64 " },\n", uint64_t(getTotalCPU()),
+          uint64_t(getTotalGPU()));
+  fprintf(file, "  \"commandBuffers\": %d\n", numCommandBuffers);
+  fprintf(file, "}\n");
+  fclose(file);
+
+  return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// MemoryStats accumulates the memory footprint of scene, resources and renderer.
+// "cpu" is regular application memory, "gpu" is anything allocated through
+// the graphics api (device-local or host-visible, like staging or persistent mapped buffers).
+// Driver-internal allocations (command pools etc.) cannot be queried, for those
+// only the number of objects is tracked.
+
+struct MemoryStats
+{
+  enum Category
+  {
+    GEOMETRY,
+    MATRICES,
+    MATERIALS,
+    DRAWCACHES,
+    DRAWITEMS,
+    DRAWLISTS,
+    COMMANDS,
+    STAGING,
+    NUM_CATEGORIES,
+  };
+
+  size_t   cpu[NUM_CATEGORIES];
+  size_t   gpu[NUM_CATEGORIES];
+  uint32_t numCommandBuffers;
+
+  MemoryStats() { clear(); }
+
+  void clear()
+  {
+    for(int i = 0; i < NUM_CATEGORIES; i++)
+    {
+      cpu[i] = 0;
+      gpu[i] = 0;
+    }
+    numCommandBuffers = 0;
+  }
+
+  size_t getTotalCPU() const
+  {
+    size_t size = 0;
+    for(int i = 0; i < NUM_CATEGORIES; i++)
+    {
+      size += cpu[i];
+    }
+    return size;
+  }
+
+  size_t getTotalGPU() const
+  {
+    size_t size = 0;
+    for(int i = 0; i < NUM_CATEGORIES; i++)
+    {
+      size += gpu[i];
+    }
+    return size;
+  }
+
+  static const char* toString(Category category);
+
+  void print() const;
+  bool saveJSON(const char* filename) const;
+};
@@ -0,0 +1,845 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "objectbvh.hpp"
+#include "benchmark.hpp"
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <nvh/nvprint.hpp>
+#include <nvpwindow.hpp>
+
+
+namespace csfthreaded {
+
+// top level nodes with at least this many objects are binned by all threads
+static const uint32_t BVH_PARALLEL_BINNING = 1 << 14;
+
+typedef ObjectBVH::Bounds BVHBounds;
+
+static inline void BoundsInit(BVHBounds& bounds)
+{
+  bounds.min = glm::vec3(FLT_MAX);
+  bounds.max = glm::vec3(-FLT_MAX);
+}
+
+static inline void BoundsMerge(BVHBounds& bounds, const BVHBounds& other)
+{
+  bounds.min = glm::min(bounds.min, other.min);
+  bounds.max = glm::max(bounds.max, other.max);
+}
+
+static inline void BoundsMerge(BVHBounds& bounds, const glm::vec3& point)
+{
+  bounds.min = glm::min(bounds.min, point);
+  bounds.max = glm::max(bounds.max, point);
+}
+
+// half the surface area, 0 for empty bounds
+static inline float BoundsArea(const BVHBounds& bounds)
+{
+  glm::vec3 extent = bounds.max - bounds.min;
+  if(extent.x < 0)
+    return 0;
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+struct BVHBin
+{
+  BVHBounds bounds;
+  BVHBounds centroids;
+  uint32_t  count;
+};
+
+// objects [begin, end) of m_leafObjects that become node
+struct BVHTask
+{
+  uint32_t  node;
+  uint32_t  begin;
+  uint32_t  end;
+  BVHBounds bounds;
+  BVHBounds centroids;
+};
+
+struct BVHBuildShared
+{
+  const BVHBounds* objectBounds;
+  const glm::vec3* objectCentroids;
+  uint32_t*        objects;  // partitioned in place
+};
+
+typedef BVHBin BVHBins[3][ObjectBVH::BINS];
+
+static inline glm::vec3 BinScale(const BVHTask& task)
+{
+  glm::vec3 extent = task.centroids.max - task.centroids.min;
+  glm::vec3 scale;
+  for(int axis = 0; axis < 3; axis++)
+  {
+    scale[axis] = extent[axis] > 0 ? float(ObjectBVH::BINS) * 0.999f / extent[axis] : 0.0f;
+  }
+  return scale;
+}
+
+static inline uint32_t BinIndex(const glm::vec3& centroid, const BVHTask& task, const glm::vec3& scale, int axis)
+{
+  int bin = int((centroid[axis] - task.centroids.min[axis]) * scale[axis]);
+  return uint32_t(std::min(std::max(bin, 0), int(ObjectBVH::BINS - 1)));
+}
+
+static void BinsInit(BVHBins& bins)
+{
+  for(int axis = 0; axis < 3; axis++)
+  {
+    for(uint32_t b = 0; b < ObjectBVH::BINS; b++)
+    {
+      BoundsInit(bins[axis][b].bounds);
+      BoundsInit(bins[axis][b].centroids);
+      bins[axis][b].count = 0;
+    }
+  }
+}
+
+static void BinObjects(const BVHBuildShared& shared, const BVHTask& task, uint32_t begin, uint32_t end, BVHBins& bins)
+{
+  glm::vec3 scale = BinScale(task);
+
+  BinsInit(bins);
+  for(uint32_t i = begin; i < end; i++)
+  {
+    uint32_t         obj      = shared.objects[i];
+    const glm::vec3& centroid = shared.objectCentroids[obj];
+    for(int axis = 0; axis < 3; axis++)
+    {
+      BVHBin& bin = bins[axis][BinIndex(centroid, task, scale, axis)];
+      BoundsMerge(bin.bounds, shared.objectBounds[obj]);
+      BoundsMerge(bin.centroids, centroid);
+      bin.count++;
+    }
+  }
+}
+
+static void RangeBounds(const BVHBuildShared& shared, BVHTask& task)
+{
+  BoundsInit(task.bounds);
+  BoundsInit(task.centroids);
+  for(uint32_t i = task.begin; i < task.end; i++)
+  {
+    uint32_t obj = shared.objects[i];
+    BoundsMerge(task.bounds, shared.objectBounds[obj]);
+    BoundsMerge(task.centroids, shared.objectCentroids[obj]);
+  }
+}
+
+// cheapest split between two bins by surface area, false if the centroids cannot be separated
+static bool FindSplit(const BVHBins& bins, const BVHTask& task, int& bestAxis, uint32_t& bestBin, float& bestCost)
+{
+  bestAxis = -1;
+  bestCost = FLT_MAX;
+
+  for(int axis = 0; axis < 3; axis++)
+  {
+    if(task.centroids.max[axis] <= task.centroids.min[axis])
+      continue;
+
+    float     rightArea[ObjectBVH::BINS];
+    uint32_t  rightCount[ObjectBVH::BINS];
+    BVHBounds accum;
+    uint32_t  count = 0;
+    BoundsInit(accum);
+    for(uint32_t b = ObjectBVH::BINS - 1; b > 0; b--)
+    {
+      BoundsMerge(accum, bins[axis][b].bounds);
+      count += bins[axis][b].count;
+      rightArea[b]  = BoundsArea(accum);
+      rightCount[b] = count;
+    }
+
+    BoundsInit(accum);
+    count = 0;
+    for(uint32_t b = 0; b < ObjectBVH::BINS - 1; b++)
+    {
+      BoundsMerge(accum, bins[axis][b].bounds);
+      count += bins[axis][b].count;
+      if(!count || !rightCount[b + 1])
+        continue;
+
+      float cost = BoundsArea(accum) * float(count) + rightArea[b + 1] * float(rightCount[b + 1]);
+      if(cost < bestCost)
+      {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin  = b;
+      }
+    }
+  }
+
+  return bestAxis >= 0;
+}
+
+// fills the node of task, either a leaf or an inner node whose two children are appended to nodes.
+// bins must hold the objects of task unless it has a single one. Returns true with the child tasks
+static bool SplitTask(const BVHBuildShared& shared, const BVHTask& task, const BVHBins& bins, std::vector<ObjectBVH::Node>& nodes, BVHTask children[2])
+{
+  uint32_t count = task.end - task.begin;
+
+  nodes[task.node].bounds = task.bounds;
+  nodes[task.node].first  = task.begin;
+  nodes[task.node].count  = count;
+  if(count == 1)
+  {
+    return false;
+  }
+
+  int      axis;
+  uint32_t bin;
+  float    cost;
+  bool     binned = FindSplit(bins, task, axis, bin, cost);
+
+  // traversing the node costs about as much as testing one object
+  float area = BoundsArea(task.bounds);
+  if(count <= ObjectBVH::MAX_LEAF_COUNT && (!binned || cost + area >= area * float(count)))
+  {
+    return false;
+  }
+
+  children[0]       = task;
+  children[1]       = task;
+  children[0].node  = uint32_t(nodes.size());
+  children[1].node  = uint32_t(nodes.size() + 1);
+  nodes[task.node].first = children[0].node;
+  nodes[task.node].count = 0;
+  nodes.resize(nodes.size() + 2);
+
+  if(binned)
+  {
+    glm::vec3 scale = BinScale(task);
+    uint32_t* mid   = std::partition(shared.objects + task.begin, shared.objects + task.end, [&](uint32_t obj) {
+      return BinIndex(shared.objectCentroids[obj], task, scale, axis) <= bin;
+    });
+
+    children[0].end   = uint32_t(mid - shared.objects);
+    children[1].begin = children[0].end;
+
+    BoundsInit(children[0].bounds);
+    BoundsInit(children[0].centroids);
+    BoundsInit(children[1].bounds);
+    BoundsInit(children[1].centroids);
+    for(uint32_t b = 0; b < ObjectBVH::BINS; b++)
+    {
+      BVHTask& child = children[b <= bin ? 0 : 1];
+      BoundsMerge(child.bounds, bins[axis][b].bounds);
+      BoundsMerge(child.centroids, bins[axis][b].centroids);
+    }
+  }
+  else
+  {
+    // all centroids are equal, split in the middle
+    children[0].end   = task.begin + count / 2;
+    children[1].begin = children[0].end;
+    RangeBounds(shared, children[0]);
+    RangeBounds(shared, children[1]);
+  }
+
+  return true;
+}
+
+// subtree of root in its own node array, root becomes nodes[0]
+static void BuildSubtree(const BVHBuildShared& shared, const BVHTask& root, std::vector<ObjectBVH::Node>& nodes)
+{
+  nodes.clear();
+  nodes.resize(1);
+
+  std::vector<BVHTask> stack;
+  stack.push_back(root);
+  stack.back().node = 0;
+
+  BVHBins bins;
+  while(!stack.empty())
+  {
+    BVHTask task = stack.back();
+    stack.pop_back();
+
+    if(task.end - task.begin > 1)
+    {
+      BinObjects(shared, task, task.begin, task.end, bins);
+    }
+
+    BVHTask children[2];
+    if(SplitTask(shared, task, bins, nodes, children))
+    {
+      stack.push_back(children[1]);
+      stack.push_back(children[0]);
+    }
+  }
+}
+
+struct BVHBinJob
+{
+  const BVHBuildShared* shared;
+  const BVHTask*        task;
+  uint32_t              begin;
+  uint32_t              end;
+  BVHBins               bins;
+};
+
+static void BVHBinThread(void* arg)
+{
+  BVHBinJob* job = (BVHBinJob*)arg;
+  BinObjects(*job->shared, *job->task, job->begin, job->end, job->bins);
+}
+
+struct BVHSubtreeJob
+{
+  const BVHBuildShared*                      shared;
+  const std::vector<BVHTask>*                tasks;
+  std::vector<std::vector<ObjectBVH::Node>>* subtrees;
+  std::atomic<size_t>*                       next;
+};
+
+static void BVHSubtreeThread(void* arg)
+{
+  BVHSubtreeJob* job = (BVHSubtreeJob*)arg;
+
+  size_t t;
+  while((t = (*job->next)++) < job->tasks->size())
+  {
+    BuildSubtree(*job->shared, (*job->tasks)[t], (*job->subtrees)[t]);
+  }
+}
+
+template <class T>
+static void RunJobs(ThreadPool& pool, uint32_t numThreads, ThreadPool::WorkerFunc fn, T* jobs)
+{
+  if(numThreads == 1)
+  {
+    fn(&jobs[0]);
+    return;
+  }
+
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    pool.activateJob(t, fn, &jobs[t]);
+  }
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    pool.waitJob(t);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ObjectBVH::updateObjectBounds(const CadScene& scene, const glm::mat4* matrices, uint32_t obj)
+{
+  const CadScene::Object& object = scene.m_objects[obj];
+  const CadScene::BBox&   bbox   = scene.m_geometryBboxes[object.geometryIndex];
+  glm::vec4               center = glm::vec4(glm::vec3((bbox.min + bbox.max) * 0.5f), 1.0f);
+  glm::vec3               extent = glm::vec3((bbox.max - bbox.min) * 0.5f);
+
+  Bounds& bounds = m_objectBounds[obj];
+  BoundsInit(bounds);
+
+  // parts may be placed by other matrices than the object
+  size_t numParts   = std::max(object.parts.size(), size_t(1));
+  int    lastMatrix = -1;
+  for(size_t p = 0; p < numParts; p++)
+  {
+    int matrixIndex = object.parts.empty() ? object.matrixIndex : object.parts[p].matrixIndex;
+    if(matrixIndex == lastMatrix)
+      continue;
+    lastMatrix = matrixIndex;
+
+    const glm::mat4& world = matrices ? matrices[matrixIndex] : scene.m_matrices[matrixIndex].worldMatrix;
+
+    // world axis aligned extent of the transformed box
+    glm::vec3 worldCenter = glm::vec3(world * center);
+    glm::vec3 worldExtent = glm::abs(glm::vec3(world[0])) * extent.x + glm::abs(glm::vec3(world[1])) * extent.y
+                            + glm::abs(glm::vec3(world[2])) * extent.z;
+    BoundsMerge(bounds, worldCenter - worldExtent);
+    BoundsMerge(bounds, worldCenter + worldExtent);
+  }
+}
+
+void ObjectBVH::updateNodeBounds(uint32_t n)
+{
+  Node& node = m_nodes[n];
+  if(node.count)
+  {
+    BoundsInit(node.bounds);
+    for(uint32_t i = node.first; i < node.first + node.count; i++)
+    {
+      BoundsMerge(node.bounds, m_objectBounds[m_leafObjects[i]]);
+    }
+  }
+  else
+  {
+    node.bounds = m_nodes[node.first].bounds;
+    BoundsMerge(node.bounds, m_nodes[node.first + 1].bounds);
+  }
+}
+
+void ObjectBVH::build(const CadScene& scene, ThreadPool& pool, uint32_t numThreads)
+{
+  double timeBegin = NVPSystem::getTime();
+
+  deinit();
+
+  uint32_t numObjects = uint32_t(scene.m_objects.size());
+  if(!numObjects)
+    return;
+
+  numThreads = std::max(1u, numThreads);
+
+  std::vector<glm::vec3> centroids(numObjects);
+  m_objectBounds.resize(numObjects);
+  m_leafObjects.resize(numObjects);
+  for(uint32_t obj = 0; obj < numObjects; obj++)
+  {
+    updateObjectBounds(scene, nullptr, obj);
+    centroids[obj]     = (m_objectBounds[obj].min + m_objectBounds[obj].max) * 0.5f;
+    m_leafObjects[obj] = obj;
+  }
+
+  BVHBuildShared shared;
+  shared.objectBounds    = m_objectBounds.data();
+  shared.objectCentroids = centroids.data();
+  shared.objects         = m_leafObjects.data();
+
+  BVHTask root;
+  root.node  = 0;
+  root.begin = 0;
+  root.end   = numObjects;
+  RangeBounds(shared, root);
+
+  m_nodes.resize(1);
+
+  // split the largest tasks here, until there are enough subtrees to balance them over the threads
+  std::vector<BVHTask>   tasks(1, root);
+  std::vector<BVHBinJob> binJobs(numThreads);
+  uint32_t               subtreeSize = std::max(numObjects / (numThreads * 4), MAX_LEAF_COUNT);
+  while(numThreads > 1)
+  {
+    auto largest = std::max_element(tasks.begin(), tasks.end(), [](const BVHTask& a, const BVHTask& b) {
+      return a.end - a.begin < b.end - b.begin;
+    });
+    if(largest->end - largest->begin <= subtreeSize)
+      break;
+
+    BVHTask task = *largest;
+    tasks.erase(largest);
+
+    uint32_t count      = task.end - task.begin;
+    uint32_t binThreads = count >= BVH_PARALLEL_BINNING ? numThreads : 1;
+    for(uint32_t t = 0; t < binThreads; t++)
+    {
+      binJobs[t].shared = &shared;
+      binJobs[t].task   = &task;
+      binJobs[t].begin  = task.begin + uint32_t((uint64_t(count) * t) / binThreads);
+      binJobs[t].end    = task.begin + uint32_t((uint64_t(count) * (t + 1)) / binThreads);
+    }
+    RunJobs(pool, binThreads, BVHBinThread, binJobs.data());
+
+    BVHBins& bins = binJobs[0].bins;
+    for(uint32_t t = 1; t < binThreads; t++)
+    {
+      for(int axis = 0; axis < 3; axis++)
+      {
+        for(uint32_t b = 0; b < BINS; b++)
+        {
+          BoundsMerge(bins[axis][b].bounds, binJobs[t].bins[axis][b].bounds);
+          BoundsMerge(bins[axis][b].centroids, binJobs[t].bins[axis][b].centroids);
+          bins[axis][b].count += binJobs[t].bins[axis][b].count;
+        }
+      }
+    }
+
+    BVHTask children[2];
+    if(SplitTask(shared, task, bins, m_nodes, children))
+    {
+      tasks.push_back(children[0]);
+      tasks.push_back(children[1]);
+    }
+  }
+
+  // leaves created above are final, everything else is built as a subtree
+  std::vector<std::vector<Node>> subtrees(tasks.size());
+  std::atomic<size_t>            next(0);
+  std::vector<BVHSubtreeJob>     subtreeJobs(numThreads);
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    subtreeJobs[t].shared   = &shared;
+    subtreeJobs[t].tasks    = &tasks;
+    subtreeJobs[t].subtrees = &subtrees;
+    subtreeJobs[t].next     = &next;
+  }
+  RunJobs(pool, std::min(numThreads, uint32_t(tasks.size())), BVHSubtreeThread, subtreeJobs.data());
+
+  // subtree roots take the place of their task, the rest is appended, so children still follow their parents
+  for(size_t t = 0; t < tasks.size(); t++)
+  {
+    const std::vector<Node>& subtree = subtrees[t];
+    uint32_t                 base    = uint32_t(m_nodes.size()) - 1;
+    for(size_t n = 0; n < subtree.size(); n++)
+    {
+      Node node = subtree[n];
+      if(!node.count)
+      {
+        node.first += base;
+      }
+
+      if(n == 0)
+      {
+        m_nodes[tasks[t].node] = node;
+      }
+      else
+      {
+        m_nodes.push_back(node);
+      }
+    }
+  }
+
+  m_parents.assign(m_nodes.size(), ~0u);
+  m_objectLeaves.resize(numObjects);
+  for(uint32_t n = 0; n < uint32_t(m_nodes.size()); n++)
+  {
+    const Node& node = m_nodes[n];
+    if(node.count)
+    {
+      for(uint32_t i = node.first; i < node.first + node.count; i++)
+      {
+        m_objectLeaves[m_leafObjects[i]] = n;
+      }
+    }
+    else
+    {
+      m_parents[node.first]     = n;
+      m_parents[node.first + 1] = n;
+    }
+  }
+  m_refitStamps.assign(m_nodes.size(), 0);
+  m_refitStamp = 0;
+
+  m_buildTime = (NVPSystem::getTime() - timeBegin) * 1000.0;
+}
+
+void ObjectBVH::buildNodes(const Bounds* bounds, const glm::vec3* centroids, uint32_t* primitives, uint32_t num, std::vector<Node>& nodes)
+{
+  nodes.clear();
+  if(!num)
+    return;
+
+  BVHBuildShared shared;
+  shared.objectBounds    = bounds;
+  shared.objectCentroids = centroids;
+  shared.objects         = primitives;
+
+  BVHTask root;
+  root.node  = 0;
+  root.begin = 0;
+  root.end   = num;
+  RangeBounds(shared, root);
+
+  BuildSubtree(shared, root, nodes);
+}
+
+void ObjectBVH::deinit()
+{
+  m_nodes.clear();
+  m_nodes.shrink_to_fit();
+  m_leafObjects.clear();
+  m_leafObjects.shrink_to_fit();
+  m_objectBounds.clear();
+  m_objectBounds.shrink_to_fit();
+  m_objectLeaves.clear();
+  m_objectLeaves.shrink_to_fit();
+  m_parents.clear();
+  m_parents.shrink_to_fit();
+  m_refitStamps.clear();
+  m_refitStamps.shrink_to_fit();
+}
+
+size_t ObjectBVH::getMemoryUsage() const
+{
+  return m_nodes.capacity() * sizeof(Node) + m_objectBounds.capacity() * sizeof(Bounds)
+         + (m_leafObjects.capacity() + m_objectLeaves.capacity() + m_parents.capacity() + m_refitStamps.capacity()) * sizeof(uint32_t);
+}
+
+void ObjectBVH::refit(const CadScene& scene, const glm::mat4* matrices)
+{
+  double timeBegin = NVPSystem::getTime();
+
+  for(uint32_t obj = 0; obj < uint32_t(m_objectBounds.size()); obj++)
+  {
+    updateObjectBounds(scene, matrices, obj);
+  }
+
+  // children are stored after their parents
+  for(size_t n = m_nodes.size(); n-- > 0;)
+  {
+    updateNodeBounds(uint32_t(n));
+  }
+
+  m_refitTime = (NVPSystem::getTime() - timeBegin) * 1000.0;
+}
+
+void ObjectBVH::refit(const CadScene& scene, const glm::mat4* matrices, const uint32_t* objects, size_t numObjects)
+{
+  double timeBegin = NVPSystem::getTime();
+
+  // every node on the way to the root once, stopping where another object got there first
+  std::vector<uint32_t> dirty;
+  m_refitStamp++;
+  for(size_t i = 0; i < numObjects; i++)
+  {
+    updateObjectBounds(scene, matrices, objects[i]);
+    for(uint32_t n = m_objectLeaves[objects[i]]; n != ~0u && m_refitStamps[n] != m_refitStamp; n = m_parents[n])
+    {
+      m_refitStamps[n] = m_refitStamp;
+      dirty.push_back(n);
+    }
+  }
+
+  std::sort(dirty.begin(), dirty.end(), std::greater<uint32_t>());
+  for(uint32_t n : dirty)
+  {
+    updateNodeBounds(n);
+  }
+
+  m_refitTime = (NVPSystem::getTime() - timeBegin) * 1000.0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+enum BoundsTest
+{
+  BOUNDS_OUTSIDE,
+  BOUNDS_INTERSECTING,
+  BOUNDS_INSIDE,
+};
+
+// -w <= x,y,z <= w in clip space, also conservative for a [0,1] depth range
+static void FrustumPlanes(const glm::mat4& viewProjMatrix, glm::vec4 planes[6])
+{
+  glm::vec4 rows[4];
+  for(int r = 0; r < 4; r++)
+  {
+    rows[r] = glm::vec4(viewProjMatrix[0][r], viewProjMatrix[1][r], viewProjMatrix[2][r], viewProjMatrix[3][r]);
+  }
+  for(int p = 0; p < 6; p++)
+  {
+    planes[p] = p & 1 ? rows[3] - rows[p / 2] : rows[3] + rows[p / 2];
+  }
+}
+
+static inline BoundsTest TestBounds(const glm::vec4 planes[6], const BVHBounds& bounds)
+{
+  BoundsTest result = BOUNDS_INSIDE;
+  for(int p = 0; p < 6; p++)
+  {
+    const glm::vec4& plane = planes[p];
+
+    // corners furthest along and against the plane normal
+    glm::vec3 furthest = glm::vec3(plane.x > 0 ? bounds.max.x : bounds.min.x, plane.y > 0 ? bounds.max.y : bounds.min.y,
+                                   plane.z > 0 ? bounds.max.z : bounds.min.z);
+    glm::vec3 nearest  = glm::vec3(plane.x > 0 ? bounds.min.x : bounds.max.x, plane.y > 0 ? bounds.min.y : bounds.max.y,
+                                  plane.z > 0 ? bounds.min.z : bounds.max.z);
+    if(glm::dot(glm::vec3(plane), furthest) + plane.w < 0)
+      return BOUNDS_OUTSIDE;
+    if(glm::dot(glm::vec3(plane), nearest) + plane.w < 0)
+      result = BOUNDS_INTERSECTING;
+  }
+  return result;
+}
+
+size_t ObjectBVH::cullFrustum(const glm::mat4& viewProjMatrix, std::vector<uint32_t>& visible) const
+{
+  visible.clear();
+  if(m_nodes.empty())
+    return 0;
+
+  glm::vec4 planes[6];
+  FrustumPlanes(viewProjMatrix, planes);
+
+  size_t                tested = 0;
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+  while(!stack.empty())
+  {
+    const Node& node = m_nodes[stack.back()];
+    stack.pop_back();
+
+    tested++;
+    BoundsTest test = TestBounds(planes, node.bounds);
+    if(test == BOUNDS_OUTSIDE)
+      continue;
+
+    if(test == BOUNDS_INSIDE)
+    {
+      // the objects of a subtree are contiguous, from its leftmost to its rightmost leaf
+      const Node* left  = &node;
+      const Node* right = &node;
+      while(!left->count)
+        left = &m_nodes[left->first];
+      while(!right->count)
+        right = &m_nodes[right->first + 1];
+      visible.insert(visible.end(), m_leafObjects.begin() + left->first, m_leafObjects.begin() + right->first + right->count);
+    }
+    else if(node.count)
+    {
+      for(uint32_t i = node.first; i < node.first + node.count; i++)
+      {
+        tested++;
+        if(TestBounds(planes, m_objectBounds[m_leafObjects[i]]) != BOUNDS_OUTSIDE)
+        {
+          visible.push_back(m_leafObjects[i]);
+        }
+      }
+    }
+    else
+    {
+      stack.push_back(node.first + 1);
+      stack.push_back(node.first);
+    }
+  }
+
+  return tested;
+}
+
+size_t ObjectBVH::cullFrustumFlat(const glm::mat4& viewProjMatrix, std::vector<uint32_t>& visible) const
+{
+  visible.clear();
+
+  glm::vec4 planes[6];
+  FrustumPlanes(viewProjMatrix, planes);
+
+  for(uint32_t obj = 0; obj < uint32_t(m_objectBounds.size()); obj++)
+  {
+    if(TestBounds(planes, m_objectBounds[obj]) != BOUNDS_OUTSIDE)
+    {
+      visible.push_back(obj);
+    }
+  }
+
+  return m_objectBounds.size();
+}
+
+void ObjectBVH::benchmark(const CadScene& scene, ThreadPool& pool)
+{
+  static const uint32_t REPEATS = 16;
+
+  if(scene.m_objects.empty())
+    return;
+
+  uint32_t  numObjects = uint32_t(scene.m_objects.size());
+  ObjectBVH bvh;
+
+  LOGI("object bvh benchmark, %d objects, average of %d runs [ms]\n", numObjects, REPEATS);
+  {
+    benchmarkThreads(pool, "build:", [&](uint32_t numThreads) {
+      double timeSum = 0;
+      for(uint32_t r = 0; r < REPEATS; r++)
+      {
+        bvh.build(scene, pool, numThreads);
+        timeSum += bvh.m_buildTime;
+      }
+      return timeSum / double(REPEATS);
+    });
+    LOGI("nodes: %d, memory: %d KB\n", uint32_t(bvh.m_nodes.size()), uint32_t(bvh.getMemoryUsage() / 1024));
+  }
+
+  float dimension = glm::length(glm::vec3(scene.m_bbox.max) - glm::vec3(scene.m_bbox.min));
+
+  {
+    // every matrix moved a little, like the animation does
+    std::vector<glm::mat4> matrices(scene.m_matrices.size());
+    for(size_t m = 0; m < matrices.size(); m++)
+    {
+      matrices[m]    = scene.m_matrices[m].worldMatrix;
+      matrices[m][3] += glm::vec4(float(m % 3 == 0), float(m % 3 == 1), float(m % 3 == 2), 0.0f) * dimension * 0.01f;
+    }
+
+    double timeFull = 0;
+    for(uint32_t r = 0; r < REPEATS; r++)
+    {
+      bvh.refit(scene, (r & 1) ? nullptr : matrices.data());
+      timeFull += bvh.m_refitTime;
+    }
+
+    BenchmarkLine line;
+    line.append("refit: all %7.3f", timeFull / double(REPEATS));
+    for(uint32_t step : {100, 10})
+    {
+      std::vector<uint32_t> objects;
+      for(uint32_t obj = 0; obj < numObjects; obj += step)
+      {
+        objects.push_back(obj);
+      }
+
+      double timeSum = 0;
+      for(uint32_t r = 0; r < REPEATS; r++)
+      {
+        bvh.refit(scene, (r & 1) ? nullptr : matrices.data(), objects.data(), objects.size());
+        timeSum += bvh.m_refitTime;
+      }
+      line.append(", %d%% incremental %7.3f", 100 / step, timeSum / double(REPEATS));
+    }
+    LOGI("%s\n", line.c_str());
+    bvh.refit(scene, nullptr);
+  }
+
+  std::vector<BenchmarkView> views;
+  getBenchmarkViews(scene, views);
+
+  std::vector<uint32_t> visible;
+  std::vector<uint32_t> visibleFlat;
+  for(const BenchmarkView& view : views)
+  {
+    const glm::mat4& viewProjMatrix = view.viewProjMatrix;
+
+    size_t tested     = 0;
+    size_t testedFlat = 0;
+    double time       = -NVPSystem::getTime();
+    for(uint32_t r = 0; r < REPEATS; r++)
+    {
+      tested = bvh.cullFrustum(viewProjMatrix, visible);
+    }
+    time += NVPSystem::getTime();
+
+    double timeFlat = -NVPSystem::getTime();
+    for(uint32_t r = 0; r < REPEATS; r++)
+    {
+      testedFlat = bvh.cullFrustumFlat(viewProjMatrix, visibleFlat);
+    }
+    timeFlat += NVPSystem::getTime();
+
+    std::sort(visible.begin(), visible.end());
+    LOGI("cull %-8s: %7d visible, bvh %7.3f (%7d tests), flat %7.3f (%7d tests), %s\n", view.name,
+         uint32_t(visible.size()), time * 1000.0 / double(REPEATS), uint32_t(tested), timeFlat * 1000.0 / double(REPEATS),
+         uint32_t(testedFlat), visible == visibleFlat ? "same" : "DIFFERENT");
+  }
+  LOGI("\n");
+}
+
+}  // namespace csfthreaded
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include "cadscene.hpp"
+#include "threadpool.hpp"
+
+#include <vector>
+
+namespace csfthreaded {
+
+// bounding volume hierarchy over the objects of a CadScene in world space.
+// Built top-down with binned SAH: the top levels bin in parallel, the subtrees
+// below them are built as independent tasks. Moving matrices only refit the
+// node bounds, the tree itself is kept.
+class ObjectBVH
+{
+public:
+  struct Bounds
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+
+  // the children of an inner node are stored next to each other after their parent
+  struct Node
+  {
+    Bounds   bounds;
+    uint32_t first;  // inner: left child, right child is first + 1. leaf: first of m_leafObjects
+    uint32_t count;  // objects of a leaf, 0 for inner nodes
+  };
+
+  static const uint32_t BINS           = 16;
+  static const uint32_t MAX_LEAF_COUNT = 8;  // larger leaves are always split
+
+  // numThreads of pool, which must not be occupied by a renderer
+  void build(const CadScene& scene, ThreadPool& pool, uint32_t numThreads);
+  void deinit();
+
+  // matrices are indexed like CadScene::m_matrices, nullptr uses the scene's own.
+  // all objects, single bottom-up pass over the nodes
+  void refit(const CadScene& scene, const glm::mat4* matrices);
+  // only the given objects and the nodes above them
+  void refit(const CadScene& scene, const glm::mat4* matrices, const uint32_t* objects, size_t numObjects);
+
+  // objects whose bounds intersect the view frustum, in leaf order. Returns the number of bounds tested
+  size_t cullFrustum(const glm::mat4& viewProjMatrix, std::vector<uint32_t>& visible) const;
+  // same objects in object order, every one tested on its own
+  size_t cullFrustumFlat(const glm::mat4& viewProjMatrix, std::vector<uint32_t>& visible) const;
+
+  // build and refit times for 1 to all threads, hierarchical against flat culling
+  static void benchmark(const CadScene& scene, ThreadPool& pool);
+
+  // same binned SAH on the calling thread over any primitives, e.g. triangles. primitives holds
+  // num indices into bounds and centroids, it is reordered so leaves refer to ranges of it
+  static void buildNodes(const Bounds* bounds, const glm::vec3* centroids, uint32_t* primitives, uint32_t num, std::vector<Node>& nodes);
+
+  size_t getMemoryUsage() const;
+  bool   empty() const { return m_nodes.empty(); }
+
+  std::vector<Node>     m_nodes;         // root first
+  std::vector<uint32_t> m_leafObjects;   // objects ordered by leaf
+  std::vector<Bounds>   m_objectBounds;  // world space per object
+  std::vector<uint32_t> m_objectLeaves;  // leaf node of every object
+  std::vector<uint32_t> m_parents;       // per node, the root has ~0
+
+  // milliseconds of the last build and refit
+  double m_buildTime = 0;
+  double m_refitTime = 0;
+
+private:
+  std::vector<uint32_t> m_refitStamps;  // per node, last incremental refit that updated it
+  uint32_t              m_refitStamp = 0;
+
+  void updateObjectBounds(const CadScene& scene, const glm::mat4* matrices, uint32_t obj);
+  void updateNodeBounds(uint32_t node);
+};
+}  // namespace csfthreaded
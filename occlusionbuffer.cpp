@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "occlusionbuffer.hpp"
+#include "benchmark.hpp"
+#include <algorithm>
+#include <float.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <nvh/nvprint.hpp>
+#include <nvpwindow.hpp>
+
+// four pixels of a row at once with SSE, otherwise one at a time
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define USE_SSE_OCCLUSION 1
+#include <xmmintrin.h>
+#else
+#define USE_SSE_OCCLUSION 0
+#endif
+
+
+namespace csfthreaded {
+
+void OcclusionBuffer::init(const CadScene& scene)
+{
+  deinit();
+
+  if(scene.isGeometryReleased())
+  {
+    LOGW("occlusion buffer: cpu geometry was released, no occluders\n");
+    return;
+  }
+
+  struct Candidate
+  {
+    float    area;
+    uint32_t obj;
+    uint32_t numTriangles;
+  };
+
+  // the largest objects by world space bounds that aren't too detailed
+  std::vector<Candidate> candidates;
+  for(uint32_t obj = 0; obj < uint32_t(scene.m_objects.size()); obj++)
+  {
+    const CadScene::Object&   object = scene.m_objects[obj];
+    const CadScene::Geometry& geom   = scene.m_geometry[object.geometryIndex];
+
+    uint32_t numTriangles = 0;
+    for(size_t p = 0; p < object.parts.size(); p++)
+    {
+      numTriangles += object.parts[p].active ? uint32_t(geom.parts[p].indexSolid.count / 3) : 0;
+    }
+    if(!numTriangles || numTriangles > MAX_OCCLUDER_TRIANGLES)
+      continue;
+
+    CadScene::BBox bbox =
+        CadScene::BBox(scene.m_geometryBboxes[object.geometryIndex]).transformed(scene.m_matrices[object.matrixIndex].worldMatrix);
+    glm::vec3 extent = glm::vec3(bbox.max - bbox.min);
+
+    Candidate candidate;
+    candidate.area         = extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    candidate.obj          = obj;
+    candidate.numTriangles = numTriangles;
+    candidates.push_back(candidate);
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.area > b.area; });
+
+  std::vector<uint32_t> remap;
+  size_t                numTriangles = 0;
+  for(const Candidate& candidate : candidates)
+  {
+    // smaller ones may still fit
+    if(numTriangles + candidate.numTriangles > MAX_TRIANGLES)
+      continue;
+    numTriangles += candidate.numTriangles;
+
+    const CadScene::Object&   object = scene.m_objects[candidate.obj];
+    const CadScene::Geometry& geom   = scene.m_geometry[object.geometryIndex];
+    for(size_t p = 0; p < object.parts.size(); p++)
+    {
+      const CadScene::ObjectPart& part = object.parts[p];
+      if(!part.active)
+        continue;
+
+      // vertices are shared within a part, which has a single matrix
+      const glm::mat4&    worldMatrix = scene.m_matrices[part.matrixIndex].worldMatrix;
+      const unsigned int* indices     = geom.iboData + geom.parts[p].indexSolid.offset / sizeof(unsigned int);
+      remap.assign(geom.numVertices, ~0u);
+      for(int i = 0; i < geom.parts[p].indexSolid.count; i++)
+      {
+        uint32_t vertex = indices[i];
+        if(remap[vertex] == ~0u)
+        {
+          remap[vertex] = uint32_t(m_positions.size());
+          m_positions.push_back(glm::vec3(worldMatrix * glm::vec4(geom.vboData[vertex].position, 1.0f)));
+        }
+        m_triangles.push_back(remap[vertex]);
+      }
+    }
+    m_numOccluders++;
+  }
+}
+
+void OcclusionBuffer::deinit()
+{
+  m_positions.clear();
+  m_positions.shrink_to_fit();
+  m_triangles.clear();
+  m_triangles.shrink_to_fit();
+  m_screen.clear();
+  m_screen.shrink_to_fit();
+  m_depth.clear();
+  m_depth.shrink_to_fit();
+  m_numOccluders = 0;
+}
+
+size_t OcclusionBuffer::getMemoryUsage() const
+{
+  return (m_positions.capacity() + m_screen.capacity()) * sizeof(glm::vec3) + m_triangles.capacity() * sizeof(uint32_t)
+         + m_depth.capacity() * sizeof(float);
+}
+
+double OcclusionBuffer::getRasterTime() const
+{
+  double time = 0;
+  for(double threadTime : m_threadTimes)
+  {
+    time += threadTime;
+  }
+  return time;
+}
+
+void OcclusionBuffer::begin(const glm::mat4& viewProjMatrix,
+                            float            aspect,
+                            uint32_t         numThreads,
+                            const glm::vec4* clipPlanes,
+                            uint32_t         numClipPlanes)
+{
+  m_viewProjMatrix = viewProjMatrix;
+  m_clipPlanes.assign(clipPlanes, clipPlanes + (clipPlanes ? numClipPlanes : 0));
+  m_numThreads     = std::max(numThreads, 1u);
+  m_height         = aspect > 0 ? std::min(std::max(uint32_t(float(WIDTH) / aspect + 0.5f), 4u), WIDTH * 4) : WIDTH;
+
+  m_depth.resize(size_t(WIDTH) * m_height);
+  m_screen.resize(m_positions.size());
+  m_threadTimes.assign(m_numThreads, 0.0);
+}
+
+void OcclusionBuffer::barrier()
+{
+  if(m_numThreads == 1)
+    return;
+
+  std::unique_lock<std::mutex> lock(m_barrierMutex);
+  uint32_t                     generation = m_barrierGeneration;
+  if(++m_barrierCount == m_numThreads)
+  {
+    m_barrierCount = 0;
+    m_barrierGeneration++;
+    m_barrierCond.notify_all();
+  }
+  else
+  {
+    while(generation == m_barrierGeneration)
+    {
+      m_barrierCond.wait(lock);
+    }
+  }
+}
+
+void OcclusionBuffer::rasterizeThread(uint32_t tid)
+{
+  double timeBegin = NVPSystem::getTime();
+
+  size_t numPositions = m_positions.size();
+  size_t begin        = (numPositions * tid) / m_numThreads;
+  size_t end          = (numPositions * (tid + 1)) / m_numThreads;
+  for(size_t i = begin; i < end; i++)
+  {
+    glm::vec4 pos  = glm::vec4(m_positions[i], 1.0f);
+    glm::vec4 clip = m_viewProjMatrix * pos;
+    bool      cut  = false;
+    for(const glm::vec4& plane : m_clipPlanes)
+    {
+      cut = cut || glm::dot(plane, pos) < 0;
+    }
+    // before the near plane of either depth range or cut away, triangles using it are not rasterized
+    if(clip.w <= 0 || clip.z < 0 || cut)
+    {
+      m_screen[i] = glm::vec3(0, 0, -1.0f);
+      continue;
+    }
+    float invW  = 1.0f / clip.w;
+    m_screen[i] = glm::vec3((clip.x * invW * 0.5f + 0.5f) * float(WIDTH), (clip.y * invW * 0.5f + 0.5f) * float(m_height), invW);
+  }
+
+  double time = NVPSystem::getTime() - timeBegin;
+
+  barrier();
+
+  timeBegin = NVPSystem::getTime();
+
+  // every thread owns a band of rows and looks at all triangles
+  int rowBegin = int((m_height * tid) / m_numThreads);
+  int rowEnd   = int((m_height * (tid + 1)) / m_numThreads);
+  std::fill(m_depth.begin() + size_t(rowBegin) * WIDTH, m_depth.begin() + size_t(rowEnd) * WIDTH, 0.0f);
+
+  const glm::vec3* screen = m_screen.data();
+  for(size_t t = 0; t + 2 < m_triangles.size(); t += 3)
+  {
+    const glm::vec3& a = screen[m_triangles[t + 0]];
+    const glm::vec3& b = screen[m_triangles[t + 1]];
+    const glm::vec3& c = screen[m_triangles[t + 2]];
+    if(a.z < 0 || b.z < 0 || c.z < 0)
+      continue;
+    if(std::max(std::max(a.y, b.y), c.y) < float(rowBegin) || std::min(std::min(a.y, b.y), c.y) >= float(rowEnd))
+      continue;
+
+    rasterizeTriangle(a, b, c, rowBegin, rowEnd);
+  }
+
+  time += NVPSystem::getTime() - timeBegin;
+  m_threadTimes[tid] = time * 1000.0;
+
+  barrier();
+}
+
+void OcclusionBuffer::rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int rowBegin, int rowEnd)
+{
+  float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+  if(area == 0)
+    return;
+
+  // both facings are occluders
+  const glm::vec3& v0 = a;
+  const glm::vec3& v1 = area > 0 ? b : c;
+  const glm::vec3& v2 = area > 0 ? c : b;
+  area                = std::abs(area);
+
+  int x0 = std::max(int(floorf(std::min(std::min(v0.x, v1.x), v2.x))), 0);
+  int x1 = std::min(int(ceilf(std::max(std::max(v0.x, v1.x), v2.x))), int(WIDTH));
+  int y0 = std::max(int(floorf(std::min(std::min(v0.y, v1.y), v2.y))), rowBegin);
+  int y1 = std::min(int(ceilf(std::max(std::max(v0.y, v1.y), v2.y))), rowEnd);
+  if(x0 >= x1 || y0 >= y1)
+    return;
+
+  // edge functions are >= 0 inside, the one opposite a vertex is its barycentric weight times area
+  glm::vec3 edges[3];
+  const glm::vec3* verts[3] = {&v1, &v2, &v0};
+  for(int e = 0; e < 3; e++)
+  {
+    const glm::vec3& p = *verts[e];
+    const glm::vec3& q = *verts[(e + 1) % 3];
+    edges[e]           = glm::vec3(p.y - q.y, q.x - p.x, 0);
+    edges[e].z         = -(edges[e].x * p.x + edges[e].y * p.y);
+  }
+  // 1/w is linear in screen space
+  glm::vec3 depth = (edges[0] * v0.z + edges[1] * v1.z + edges[2] * v2.z) / area;
+
+  x0 &= ~3;
+  for(int y = y0; y < y1; y++)
+  {
+    float  py  = float(y) + 0.5f;
+    float* row = m_depth.data() + size_t(y) * WIDTH;
+#if USE_SSE_OCCLUSION
+    __m128 rowEdges[3];
+    __m128 stepEdges[3];
+    __m128 px = _mm_add_ps(_mm_set1_ps(float(x0) + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+    for(int e = 0; e < 3; e++)
+    {
+      rowEdges[e]  = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[e].x), px), _mm_set1_ps(edges[e].y * py + edges[e].z));
+      stepEdges[e] = _mm_set1_ps(edges[e].x * 4.0f);
+    }
+    __m128 rowDepth  = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depth.x), px), _mm_set1_ps(depth.y * py + depth.z));
+    __m128 stepDepth = _mm_set1_ps(depth.x * 4.0f);
+    __m128 zero      = _mm_setzero_ps();
+
+    for(int x = x0; x < x1; x += 4)
+    {
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(rowEdges[0], zero), _mm_cmpge_ps(rowEdges[1], zero)),
+                                 _mm_cmpge_ps(rowEdges[2], zero));
+      _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), _mm_and_ps(inside, rowDepth)));
+
+      for(int e = 0; e < 3; e++)
+      {
+        rowEdges[e] = _mm_add_ps(rowEdges[e], stepEdges[e]);
+      }
+      rowDepth = _mm_add_ps(rowDepth, stepDepth);
+    }
+#else
+    for(int x = x0; x < x1; x++)
+    {
+      float px = float(x) + 0.5f;
+      if(edges[0].x * px + edges[0].y * py + edges[0].z >= 0 && edges[1].x * px + edges[1].y * py + edges[1].z >= 0
+         && edges[2].x * px + edges[2].y * py + edges[2].z >= 0)
+      {
+        row[x] = std::max(row[x], depth.x * px + depth.y * py + depth.z);
+      }
+    }
+#endif
+  }
+}
+
+bool OcclusionBuffer::testBounds(const glm::vec3& min, const glm::vec3& max) const
+{
+  // the corners are sums of one scaled column per axis
+  const glm::mat4& matrix = m_viewProjMatrix;
+  glm::vec4        columnsX[2] = {matrix[0] * min.x, matrix[0] * max.x};
+  glm::vec4        columnsY[2] = {matrix[1] * min.y, matrix[1] * max.y};
+  glm::vec4        columnsZ[2] = {matrix[2] * min.z + matrix[3], matrix[2] * max.z + matrix[3]};
+
+  glm::vec2 rectMin = glm::vec2(FLT_MAX);
+  glm::vec2 rectMax = glm::vec2(-FLT_MAX);
+  float     nearest = 0;
+  for(int c = 0; c < 8; c++)
+  {
+    glm::vec4 clip = columnsX[c & 1] + columnsY[(c >> 1) & 1] + columnsZ[(c >> 2) & 1];
+    // reaches behind the eye
+    if(clip.w <= 0)
+      return true;
+
+    float     invW = 1.0f / clip.w;
+    glm::vec2 pos  = glm::vec2(clip.x, clip.y) * invW;
+    rectMin        = glm::min(rectMin, pos);
+    rectMax        = glm::max(rectMax, pos);
+    nearest        = std::max(nearest, invW);
+  }
+
+  int x0 = std::max(int(floorf((rectMin.x * 0.5f + 0.5f) * float(WIDTH))), 0);
+  int x1 = std::min(int(ceilf((rectMax.x * 0.5f + 0.5f) * float(WIDTH))), int(WIDTH));
+  int y0 = std::max(int(floorf((rectMin.y * 0.5f + 0.5f) * float(m_height))), 0);
+  int y1 = std::min(int(ceilf((rectMax.y * 0.5f + 0.5f) * float(m_height))), int(m_height));
+  if(x0 >= x1 || y0 >= y1)
+    return true;
+
+  // visible as soon as one pixel has no occluder in front of the nearest corner,
+  // testing the pixels up to the next multiple of 4 as well is conservative
+  x0 &= ~3;
+  for(int y = y0; y < y1; y++)
+  {
+    const float* row = m_depth.data() + size_t(y) * WIDTH;
+#if USE_SSE_OCCLUSION
+    __m128 depth = _mm_set1_ps(nearest);
+    for(int x = x0; x < x1; x += 4)
+    {
+      if(_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + x), depth)))
+        return true;
+    }
+#else
+    for(int x = x0; x < x1; x++)
+    {
+      if(row[x] < nearest)
+        return true;
+    }
+#endif
+  }
+
+  return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+struct OcclusionJob
+{
+  OcclusionBuffer* buffer;
+  uint32_t         tid;
+};
+
+static void OcclusionRasterThread(void* arg)
+{
+  OcclusionJob* job = (OcclusionJob*)arg;
+  job->buffer->rasterizeThread(job->tid);
+}
+
+void OcclusionBuffer::benchmark(const CadScene& scene, ThreadPool& pool)
+{
+  static const uint32_t REPEATS = 16;
+
+  OcclusionBuffer buffer;
+  buffer.init(scene);
+  if(buffer.empty())
+    return;
+
+  uint32_t numObjects = uint32_t(scene.m_objects.size());
+
+  std::vector<CadScene::BBox> objectBounds(numObjects);
+  for(uint32_t obj = 0; obj < numObjects; obj++)
+  {
+    const CadScene::Object& object = scene.m_objects[obj];
+    objectBounds[obj] =
+        CadScene::BBox(scene.m_geometryBboxes[object.geometryIndex]).transformed(scene.m_matrices[object.matrixIndex].worldMatrix);
+  }
+
+  LOGI("occlusion buffer benchmark, %d occluders, %d triangles, %d objects, average of %d runs [ms]\n", buffer.m_numOccluders,
+       uint32_t(buffer.m_triangles.size() / 3), numObjects, REPEATS);
+
+  std::vector<BenchmarkView> views;
+  getBenchmarkViews(scene, views);
+
+  std::vector<OcclusionJob> jobs(pool.getNumThreads());
+  for(const BenchmarkView& view : views)
+  {
+    const glm::mat4& viewProjMatrix = view.viewProjMatrix;
+
+    char label[32];
+    snprintf(label, sizeof(label), "%-8s raster:", view.name);
+    benchmarkThreads(pool, label, [&](uint32_t numThreads) {
+      double time = -NVPSystem::getTime();
+      for(uint32_t r = 0; r < REPEATS; r++)
+      {
+        buffer.begin(viewProjMatrix, BENCHMARK_ASPECT, numThreads);
+        for(uint32_t t = 0; t < numThreads; t++)
+        {
+          jobs[t].buffer = &buffer;
+          jobs[t].tid    = t;
+          pool.activateJob(t, OcclusionRasterThread, &jobs[t]);
+        }
+        for(uint32_t t = 0; t < numThreads; t++)
+        {
+          pool.waitJob(t);
+        }
+      }
+      time += NVPSystem::getTime();
+      return time * 1000.0 / double(REPEATS);
+    });
+
+    // only objects within the frustum are tested, like the renderers do
+    uint32_t numInside   = 0;
+    uint32_t numOccluded = 0;
+    double   time        = -NVPSystem::getTime();
+    for(uint32_t obj = 0; obj < numObjects; obj++)
+    {
+      glm::vec3 min = glm::vec3(objectBounds[obj].min);
+      glm::vec3 max = glm::vec3(objectBounds[obj].max);
+
+      uint32_t outside = 0x3f;
+      for(int c = 0; c < 8; c++)
+      {
+        glm::vec4 clip = viewProjMatrix * glm::vec4(c & 1 ? max.x : min.x, c & 2 ? max.y : min.y, c & 4 ? max.z : min.z, 1.0f);
+        outside &= (clip.x < -clip.w ? 1 : 0) | (clip.x > clip.w ? 2 : 0) | (clip.y < -clip.w ? 4 : 0)
+                   | (clip.y > clip.w ? 8 : 0) | (clip.z < -clip.w ? 16 : 0) | (clip.z > clip.w ? 32 : 0);
+      }
+      if(outside)
+        continue;
+
+      numInside++;
+      numOccluded += buffer.testBounds(min, max) ? 0 : 1;
+    }
+    time += NVPSystem::getTime();
+
+    LOGI("         %d in frustum, %d occluded (%.1f%%), test %.3f (%.1f ns per object)\n", numInside, numOccluded,
+         numInside ? double(numOccluded) * 100.0 / double(numInside) : 0.0, time * 1000.0,
+         numInside ? time * 1000000000.0 / double(numInside) : 0.0);
+  }
+  LOGI("\n");
+}
+
+}  // namespace csfthreaded
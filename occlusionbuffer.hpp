@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include "cadscene.hpp"
+#include "threadpool.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace csfthreaded {
+
+// low resolution depth buffer of the largest solid objects, rasterized on the cpu.
+// The occluder triangles are copied to world space at load time, so they stay available
+// when the cpu geometry is released. begin is called by the main thread, then every one
+// of numThreads workers calls rasterizeThread, which returns once the buffer is complete.
+// Depth is stored as 1/w, 0 where nothing was rasterized.
+class OcclusionBuffer
+{
+public:
+  static const uint32_t WIDTH                  = 256;      // multiple of 4, the height follows the aspect ratio
+  static const uint32_t MAX_TRIANGLES          = 1 << 16;  // of all occluders together
+  static const uint32_t MAX_OCCLUDER_TRIANGLES = 4096;     // objects with more are never occluders
+
+  // picks the occluders, needs the cpu geometry
+  void init(const CadScene& scene);
+  void deinit();
+
+  // occluder triangles reaching behind one of the clipPlanes are left out, as the shaders cut them
+  void begin(const glm::mat4& viewProjMatrix, float aspect, uint32_t numThreads, const glm::vec4* clipPlanes = nullptr,
+             uint32_t numClipPlanes = 0);
+  void rasterizeThread(uint32_t tid);
+
+  // world space bounds, false if they are entirely behind the occluders
+  bool testBounds(const glm::vec3& min, const glm::vec3& max) const;
+
+  // rasterization for 1 to all threads and the objects occluded, from a few views
+  static void benchmark(const CadScene& scene, ThreadPool& pool);
+
+  size_t getMemoryUsage() const;
+  bool   empty() const { return m_triangles.empty(); }
+
+  uint32_t     getWidth() const { return WIDTH; }
+  uint32_t     getHeight() const { return m_height; }
+  const float* getDepth() const { return m_depth.data(); }
+
+  // cpu milliseconds of the last rasterization, summed over all threads
+  double getRasterTime() const;
+
+  uint32_t m_numOccluders = 0;
+
+private:
+  std::vector<glm::vec3> m_positions;  // world space
+  std::vector<uint32_t>  m_triangles;
+
+  // screen space per position, z is 1/w and negative where it can't be projected
+  std::vector<glm::vec3> m_screen;
+  std::vector<float>     m_depth;
+  std::vector<double>    m_threadTimes;
+  std::vector<glm::vec4> m_clipPlanes;
+
+  glm::mat4 m_viewProjMatrix;
+  uint32_t  m_height     = 0;
+  uint32_t  m_numThreads = 1;
+
+  std::mutex              m_barrierMutex;
+  std::condition_variable m_barrierCond;
+  uint32_t                m_barrierCount      = 0;
+  uint32_t                m_barrierGeneration = 0;
+
+  void barrier();
+  void rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int rowBegin, int rowEnd);
+};
+}  // namespace csfthreaded
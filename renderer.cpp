@@ -20,12 +20,25 @@
 
 
 #include "renderer.hpp"
+#include "benchmark.hpp"
+#include "occlusionbuffer.hpp"
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <string.h>
+#include <mutex>
 #include <nvpwindow.hpp>
 
 #include "common.h"
 
+// test four drawitems per frustum plane with SSE, otherwise one at a time
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define USE_SSE_CULLING 1
+#include <xmmintrin.h>
+#else
+#define USE_SSE_CULLING 0
+#endif
+
 #pragma pack(1)
 
 
@@ -49,15 +62,37 @@ const char* toString(enum ShadeType st)
   return NULL;
 }
 
-static void AddItem(std::vector<Renderer::DrawItem>& drawItems, const Renderer::Config& config, const Renderer::DrawItem& di)
+static inline void SetRange(Renderer::DrawItem& di, const CadScene::DrawRange& range)
+{
+  di.firstIndex = uint32_t(range.offset / sizeof(uint32_t));
+  di.count      = uint32_t(range.count);
+}
+
+// counts drawitems when no output is given, otherwise writes them from "count" on
+struct DrawItemWriter
 {
-  if(di.range.count)
+  Renderer::DrawItem* NV_RESTRICT items   = nullptr;
+  uint32_t* NV_RESTRICT           objects = nullptr;
+  size_t                          count   = 0;
+
+  void add(const Renderer::DrawItem& di, int objectIndex)
   {
-    drawItems.push_back(di);
+    if(!di.count)
+      return;
+
+    if(items)
+    {
+      items[count] = di;
+      if(objects)
+      {
+        objects[count] = uint32_t(objectIndex);
+      }
+    }
+    count++;
   }
-}
+};
 
-static void FillCache(std::vector<Renderer::DrawItem>& drawItems,
+static void FillCache(DrawItemWriter&                  writer,
                       const Renderer::Config&          config,
                       const CadScene::Object&          obj,
                       const CadScene::Geometry&        geo,
@@ -77,19 +112,18 @@ static void FillCache(std::vector<Renderer::DrawItem>& drawItems,
       di.geometryIndex = obj.geometryIndex;
       di.matrixIndex   = state.matrixIndex;
       di.materialIndex = state.materialIndex;
-      di.objectIndex   = objectIndex;
 
-      di.solid        = solid;
-      di.range.offset = cache.offsets[begin + d];
-      di.range.count  = cache.counts[begin + d];
+      di.solid      = solid;
+      di.firstIndex = uint32_t(cache.offsets[begin + d] / sizeof(uint32_t));
+      di.count      = uint32_t(cache.counts[begin + d]);
 
-      AddItem(drawItems, config, di);
+      writer.add(di, objectIndex);
     }
     begin += cache.stateCount[s];
   }
 }
 
-static void FillJoin(std::vector<Renderer::DrawItem>& drawItems,
+static void FillJoin(DrawItemWriter&                  writer,
                      const Renderer::Config&          config,
                      const CadScene::Object&          obj,
                      const CadScene::Geometry&        geo,
@@ -119,12 +153,11 @@ static void FillJoin(std::vector<Renderer::DrawItem>& drawItems,
         di.geometryIndex = obj.geometryIndex;
         di.matrixIndex   = lastMatrix;
         di.materialIndex = lastMaterial;
-        di.objectIndex   = objectIndex;
 
         di.solid = solid;
-        di.range = range;
+        SetRange(di, range);
 
-        AddItem(drawItems, config, di);
+        writer.add(di, objectIndex);
       }
 
       range = CadScene::DrawRange();
@@ -141,20 +174,22 @@ static void FillJoin(std::vector<Renderer::DrawItem>& drawItems,
     range.count += solid ? mesh.indexSolid.count : mesh.indexWire.count;
   }
 
+  if(!range.count)
+    return;
+
   // evict
   Renderer::DrawItem di;
   di.geometryIndex = obj.geometryIndex;
   di.matrixIndex   = lastMatrix;
   di.materialIndex = lastMaterial;
-  di.objectIndex   = objectIndex;
 
   di.solid = solid;
-  di.range = range;
+  SetRange(di, range);
 
-  AddItem(drawItems, config, di);
+  writer.add(di, objectIndex);
 }
 
-static void FillIndividual(std::vector<Renderer::DrawItem>& drawItems,
+static void FillIndividual(DrawItemWriter&                  writer,
                            const Renderer::Config&          config,
                            const CadScene::Object&          obj,
                            const CadScene::Geometry&        geo,
@@ -173,25 +208,23 @@ static void FillIndividual(std::vector<Renderer::DrawItem>& drawItems,
     di.geometryIndex = obj.geometryIndex;
     di.matrixIndex   = part.matrixIndex;
     di.materialIndex = part.materialIndex;
-    di.objectIndex   = objectIndex;
 
     di.solid = solid;
-    di.range = mesh.indexSolid;
+    SetRange(di, mesh.indexSolid);
 
-    AddItem(drawItems, config, di);
+    writer.add(di, objectIndex);
   }
 }
 
-void Renderer::fillDrawItems(std::vector<DrawItem>& drawItems, const Config& config, bool solid, bool wire)
+static void FillObjects(DrawItemWriter&         writer,
+                        const CadScene*         scene,
+                        const Renderer::Config& config,
+                        size_t                  from,
+                        size_t                  to,
+                        bool                    solid,
+                        bool                    wire)
 {
-  const CadScene* NV_RESTRICT scene = m_scene;
-  m_config                          = config;
-
-  size_t maxObjects = scene->m_objects.size();
-  size_t from       = std::min(maxObjects - 1, size_t(config.objectFrom));
-  maxObjects        = std::min(maxObjects, from + size_t(config.objectNum));
-
-  for(size_t i = from; i < maxObjects; i++)
+  for(size_t i = from; i < to; i++)
   {
     const CadScene::Object&   obj = scene->m_objects[i];
     const CadScene::Geometry& geo = scene->m_geometry[obj.geometryIndex];
@@ -199,34 +232,2170 @@ void Renderer::fillDrawItems(std::vector<DrawItem>& drawItems, const Config& con
     if(config.strategy == STRATEGY_GROUPS)
     {
       if(solid)
-        FillCache(drawItems, config, obj, geo, true, int(i));
+        FillCache(writer, config, obj, geo, true, int(i));
       if(wire)
-        FillCache(drawItems, config, obj, geo, false, int(i));
+        FillCache(writer, config, obj, geo, false, int(i));
     }
-    else if(config.strategy == STRATEGY_JOIN)
+    else if(config.strategy == STRATEGY_JOIN || config.strategy == STRATEGY_INSTANCED || config.strategy == STRATEGY_MERGED)
     {
       if(solid)
-        FillJoin(drawItems, config, obj, geo, true, int(i));
+        FillJoin(writer, config, obj, geo, true, int(i));
       if(wire)
-        FillJoin(drawItems, config, obj, geo, false, int(i));
+        FillJoin(writer, config, obj, geo, false, int(i));
     }
     else if(config.strategy == STRATEGY_INDIVIDUAL)
     {
       if(solid)
-        FillIndividual(drawItems, config, obj, geo, true, int(i));
+        FillIndividual(writer, config, obj, geo, true, int(i));
       if(wire)
-        FillIndividual(drawItems, config, obj, geo, false, int(i));
+        FillIndividual(writer, config, obj, geo, false, int(i));
+    }
+  }
+}
+
+// below this many objects filling stays on the calling thread
+static const size_t FILL_MIN_PARALLEL = 1024;
+
+// indices beyond the packed drawitem fields would wrap and draw with the wrong state
+static bool FitsDrawItems(const CadScene* scene)
+{
+  if(scene->m_materials.size() > Renderer::DRAWITEM_MAX_MATERIALS
+     || scene->m_geometry.size() > Renderer::DRAWITEM_MAX_GEOMETRIES
+     || scene->m_matrices.size() > Renderer::DRAWITEM_MAX_MATRICES)
+  {
+    LOGE("scene exceeds the drawitem limits, nothing is drawn: %d materials (max %d), %d geometries (max %d), "
+         "%d matrices (max %d)\n",
+         uint32_t(scene->m_materials.size()), Renderer::DRAWITEM_MAX_MATERIALS, uint32_t(scene->m_geometry.size()),
+         Renderer::DRAWITEM_MAX_GEOMETRIES, uint32_t(scene->m_matrices.size()), Renderer::DRAWITEM_MAX_MATRICES);
+    return false;
+  }
+  return true;
+}
+
+struct FillJob
+{
+  const CadScene*         scene;
+  const Renderer::Config* config;
+  size_t                  from;
+  size_t                  to;
+  bool                    solid;
+  bool                    wire;
+  DrawItemWriter          writer;
+};
+
+static void FillThread(void* arg)
+{
+  FillJob* job = (FillJob*)arg;
+  FillObjects(job->writer, job->scene, *job->config, job->from, job->to, job->solid, job->wire);
+}
+
+void Renderer::fillDrawItems(std::vector<DrawItem>& drawItems, const Config& config, bool solid, bool wire, std::vector<uint32_t>* drawObjects)
+{
+  const CadScene* NV_RESTRICT scene = m_scene;
+  m_config                          = config;
+
+  if(!FitsDrawItems(scene))
+  {
+    drawItems.clear();
+    if(drawObjects)
+    {
+      drawObjects->clear();
+    }
+    return;
+  }
+
+  double timeBegin = NVPSystem::getTime();
+
+  size_t maxObjects = scene->m_objects.size();
+  size_t from       = std::min(maxObjects - 1, size_t(config.objectFrom));
+  maxObjects        = std::min(maxObjects, from + size_t(config.objectNum));
+
+  size_t   numObjects = maxObjects > from ? maxObjects - from : 0;
+  uint32_t numThreads = numObjects < FILL_MIN_PARALLEL ? 1 : std::max(1u, s_threadpool.getNumThreads());
+
+  // every thread gets a contiguous object range, first pass counts its drawitems,
+  // the prefix sum over the counts gives each range its output offset,
+  // second pass writes in place. Same order as filling serially.
+  std::vector<FillJob> jobs(numThreads);
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    FillJob& job = jobs[t];
+    job.scene    = scene;
+    job.config   = &config;
+    job.from     = from + (numObjects * t) / numThreads;
+    job.to       = from + (numObjects * (t + 1)) / numThreads;
+    job.solid    = solid;
+    job.wire     = wire;
+  }
+
+  for(int pass = 0; pass < 2; pass++)
+  {
+    if(pass == 1)
+    {
+      size_t offset = drawItems.size();
+      for(uint32_t t = 0; t < numThreads; t++)
+      {
+        size_t count         = jobs[t].writer.count;
+        jobs[t].writer.count = offset;
+        offset += count;
+      }
+
+      drawItems.resize(offset);
+      if(drawObjects)
+      {
+        drawObjects->resize(offset);
+      }
+
+      for(uint32_t t = 0; t < numThreads; t++)
+      {
+        jobs[t].writer.items   = drawItems.data();
+        jobs[t].writer.objects = drawObjects ? drawObjects->data() : nullptr;
+      }
+    }
+
+    if(numThreads == 1)
+    {
+      FillThread(&jobs[0]);
+    }
+    else
+    {
+      for(uint32_t t = 0; t < numThreads; t++)
+      {
+        s_threadpool.activateJob(t, FillThread, &jobs[t]);
+      }
+      for(uint32_t t = 0; t < numThreads; t++)
+      {
+        s_threadpool.waitJob(t);
+      }
     }
   }
 
+  if(config.strategy == STRATEGY_INSTANCED)
+  {
+    buildInstanceGroups(drawItems, drawObjects);
+  }
+
+  double timeFill = NVPSystem::getTime() - timeBegin;
+
   uint32_t sumTriangles = 0;
   for(size_t i = 0; i < drawItems.size(); i++)
   {
-    sumTriangles += drawItems[i].range.count / 3;
+    uint32_t numInstances = config.strategy == STRATEGY_INSTANCED ? m_instanceGroups[drawItems[i].matrixIndex].numInstances : 1;
+    sumTriangles += (drawItems[i].count / 3) * numInstances;
   }
   LOGI("draw calls:      %9d\n", uint32_t(drawItems.size()));
   LOGI("triangles total: %9d\n", sumTriangles);
+  LOGI("fill time:       %9.2f ms (%d threads)\n", timeFill * 1000.0, numThreads);
+}
+
+void Renderer::buildInstanceGroups(std::vector<DrawItem>& drawItems, std::vector<uint32_t>* drawObjects)
+{
+  size_t numItems = drawItems.size();
+
+  m_instanceGroups.clear();
+  m_instanceMatrices.clear();
+  m_instanceMatrices.reserve(numItems);
+
+  // bring identical draws next to each other, first occurrence leads
+  std::vector<uint32_t> order(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    order[i] = uint32_t(i);
+  }
+
+  // clones draw the same indices as the geometry they were copied from
+  const CadScene* NV_RESTRICT scene    = m_scene;
+  auto                        geometry = [&](const DrawItem& di) {
+    int cloneIdx = scene->m_geometry[di.geometryIndex].cloneIdx;
+    return cloneIdx >= 0 ? uint32_t(cloneIdx) : uint32_t(di.geometryIndex);
+  };
+
+  auto isSameDraw = [&](const DrawItem& a, const DrawItem& b) {
+    return a.solid == b.solid && a.materialIndex == b.materialIndex && geometry(a) == geometry(b)
+           && a.firstIndex == b.firstIndex && a.count == b.count;
+  };
+
+  std::sort(order.begin(), order.end(), [&](uint32_t ia, uint32_t ib) {
+    const DrawItem& a = drawItems[ia];
+    const DrawItem& b = drawItems[ib];
+    if(a.solid != b.solid)
+      return bool(a.solid);
+    if(a.materialIndex != b.materialIndex)
+      return a.materialIndex < b.materialIndex;
+    if(geometry(a) != geometry(b))
+      return geometry(a) < geometry(b);
+    if(a.firstIndex != b.firstIndex)
+      return a.firstIndex < b.firstIndex;
+    if(a.count != b.count)
+      return a.count < b.count;
+    return ia < ib;
+  });
+
+  // runs of identical draws, kept in order of their first drawitem
+  struct Run
+  {
+    uint32_t begin;
+    uint32_t end;
+  };
+  std::vector<Run> runs;
+  for(size_t i = 0; i < numItems;)
+  {
+    size_t end = i + 1;
+    while(end < numItems && isSameDraw(drawItems[order[i]], drawItems[order[end]]))
+    {
+      end++;
+    }
+    runs.push_back({uint32_t(i), uint32_t(end)});
+    i = end;
+  }
+
+  std::sort(runs.begin(), runs.end(), [&](const Run& a, const Run& b) { return order[a.begin] < order[b.begin]; });
+
+  // the group index is stored as matrix index
+  if(runs.size() > DRAWITEM_MAX_MATRICES)
+  {
+    LOGE("instanced: %d groups exceed the drawitem limit of %d, nothing is drawn\n", uint32_t(runs.size()),
+         DRAWITEM_MAX_MATRICES);
+    drawItems.clear();
+    if(drawObjects)
+    {
+      drawObjects->clear();
+    }
+    return;
+  }
+
+  std::vector<DrawItem> groupItems(runs.size());
+  std::vector<uint32_t> groupObjects(drawObjects ? runs.size() : 0);
+  m_instanceGroups.resize(runs.size());
+
+  for(size_t r = 0; r < runs.size(); r++)
+  {
+    const Run&     run   = runs[r];
+    DrawItem       di    = drawItems[order[run.begin]];
+    InstanceGroup& group = m_instanceGroups[r];
+    group.firstInstance  = uint32_t(m_instanceMatrices.size());
+    group.numInstances   = run.end - run.begin;
+
+    for(uint32_t i = run.begin; i < run.end; i++)
+    {
+      m_instanceMatrices.push_back(drawItems[order[i]].matrixIndex);
+    }
+
+    di.matrixIndex   = uint32_t(r);
+    di.geometryIndex = geometry(di);
+    groupItems[r]    = di;
+    if(drawObjects)
+    {
+      groupObjects[r] = (*drawObjects)[order[run.begin]];
+    }
+  }
+
+  LOGI("instanced:       %9d drawitems -> %d instanced draws\n", uint32_t(numItems), uint32_t(runs.size()));
+
+  drawItems.swap(groupItems);
+  if(drawObjects)
+  {
+    drawObjects->swap(groupObjects);
+  }
+}
+
+void Renderer::fillTranslucentDrawItems(std::vector<DrawItem>& drawItems, std::vector<uint32_t>& drawObjects, const Config& config, const Resources* resources)
+{
+  const CadScene* NV_RESTRICT                      scene      = m_scene;
+  const std::vector<Resources::GeometryPlacement>& placements = resources->m_geometryPlacement;
+
+  size_t maxObjects = scene->m_objects.size();
+  size_t from       = std::min(maxObjects, size_t(config.objectFrom));
+  maxObjects        = std::min(maxObjects, from + size_t(config.objectNum));
+
+  drawItems.clear();
+  drawObjects.clear();
+
+  if(!FitsDrawItems(scene))
+    return;
+
+  for(size_t i = from; i < maxObjects; i++)
+  {
+    const CadScene::Object&   obj = scene->m_objects[i];
+    const CadScene::Geometry& geo = scene->m_geometry[obj.geometryIndex];
+
+    for(size_t p = 0; p < obj.parts.size(); p++)
+    {
+      const CadScene::ObjectPart&   part = obj.parts[p];
+      const CadScene::GeometryPart& mesh = geo.parts[p];
+
+      if(!part.translucent || !mesh.indexSolid.count)
+        continue;
+
+      DrawItem di;
+      di.geometryIndex = obj.geometryIndex;
+      di.matrixIndex   = part.matrixIndex;
+      di.materialIndex = part.materialIndex;
+      di.solid         = 1;
+      SetRange(di, mesh.indexSolid);
+
+      if(!placements.empty())
+      {
+        // contiguous geometry shares the chunk's bindings, so only the range moves.
+        // The geometry stays for the depth sort, it needs the bbox
+        di.firstIndex += placements[di.geometryIndex].firstSolid;
+      }
+
+      if(config.strategy == STRATEGY_INSTANCED)
+      {
+        // single instance each, they are ordered one by one
+        InstanceGroup group;
+        group.firstInstance = uint32_t(m_instanceMatrices.size());
+        group.numInstances  = 1;
+        m_instanceMatrices.push_back(di.matrixIndex);
+        di.matrixIndex = m_instanceGroups.size();
+        m_instanceGroups.push_back(group);
+      }
+
+      drawItems.push_back(di);
+      drawObjects.push_back(uint32_t(i));
+    }
+  }
+}
+
+void Renderer::mergeDrawItems(std::vector<DrawItem>& drawItems, const Resources* resources, std::vector<uint32_t>* drawObjects)
+{
+  const std::vector<Resources::GeometryPlacement>& placements = resources->m_geometryPlacement;
+
+  if(placements.empty())
+  {
+    if(m_config.strategy == STRATEGY_MERGED)
+    {
+      LOGW("merged: geometry is not contiguous, drawitems are not merged\n");
+    }
+    return;
+  }
+
+  bool   merge    = m_config.strategy == STRATEGY_MERGED;
+  size_t numItems = drawItems.size();
+  size_t numOut   = 0;
+
+  for(size_t i = 0; i < numItems; i++)
+  {
+    DrawItem                            di        = drawItems[i];
+    const Resources::GeometryPlacement& placement = placements[di.geometryIndex];
+
+    di.firstIndex += di.solid ? placement.firstSolid : placement.firstWire;
+    di.geometryIndex = placement.chunkGeometry;
+
+    if(merge && numOut)
+    {
+      DrawItem& last = drawItems[numOut - 1];
+      if(last.solid == di.solid && last.materialIndex == di.materialIndex && last.matrixIndex == di.matrixIndex
+         && last.geometryIndex == di.geometryIndex && last.firstIndex + last.count == di.firstIndex
+         && (!drawObjects || (*drawObjects)[numOut - 1] == (*drawObjects)[i]))
+      {
+        last.count += di.count;
+        continue;
+      }
+    }
+
+    if(drawObjects)
+    {
+      (*drawObjects)[numOut] = (*drawObjects)[i];
+    }
+    drawItems[numOut++] = di;
+  }
+
+  drawItems.resize(numOut);
+  if(drawObjects)
+  {
+    drawObjects->resize(numOut);
+  }
+
+  if(merge)
+  {
+    LOGI("merged:          %9d drawitems -> %d (%d draw calls saved)\n", uint32_t(numItems), uint32_t(numOut),
+         uint32_t(numItems - numOut));
+  }
+}
+
+static inline uint8_t DrawBinds(const Renderer::DrawItem& last, const Renderer::DrawItem& di)
+{
+  return (last.solid != di.solid ? Renderer::DRAWBIND_PIPELINE : 0)
+         | (last.geometryIndex != di.geometryIndex ? Renderer::DRAWBIND_GEOMETRY : 0)
+         | (last.materialIndex != di.materialIndex ? Renderer::DRAWBIND_MATERIAL : 0)
+         | (last.matrixIndex != di.matrixIndex ? Renderer::DRAWBIND_MATRIX : 0);
+}
+
+static inline uint32_t CountDrawBinds(const uint8_t* binds, size_t num)
+{
+  uint32_t count = 0;
+  for(size_t i = 0; i < num; i++)
+  {
+    for(uint8_t bits = binds[i]; bits; bits &= bits - 1)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+void Renderer::annotateDrawBinds(std::vector<uint8_t>& binds, const DrawItem* drawItems, size_t num, bool solidOnly)
+{
+  binds.resize(num);
+
+  const DrawItem* last = nullptr;
+  for(size_t i = 0; i < num; i++)
+  {
+    const DrawItem& di = drawItems[i];
+    if(solidOnly && !di.solid)
+    {
+      binds[i] = 0;
+      continue;
+    }
+
+    binds[i] = last ? DrawBinds(*last, di) : uint8_t(DRAWBIND_ALL);
+    last     = &di;
+  }
+}
+
+void Renderer::peepholeDrawItems(std::vector<DrawItem>& drawItems, std::vector<uint32_t>* drawObjects)
+{
+  size_t numItems = drawItems.size();
+  size_t numOut   = 0;
+
+  std::vector<uint8_t> binds;
+  annotateDrawBinds(binds, drawItems.data(), numItems, false);
+  uint32_t numBinds = CountDrawBinds(binds.data(), numItems);
+
+  for(size_t i = 0; i < numItems; i++)
+  {
+    const DrawItem& di = drawItems[i];
+    if(!di.count)
+      continue;
+
+    if(numOut)
+    {
+      DrawItem& last = drawItems[numOut - 1];
+      if(!DrawBinds(last, di) && last.firstIndex + last.count == di.firstIndex
+         && (!drawObjects || (*drawObjects)[numOut - 1] == (*drawObjects)[i]))
+      {
+        last.count += di.count;
+        continue;
+      }
+    }
+
+    if(drawObjects)
+    {
+      (*drawObjects)[numOut] = (*drawObjects)[i];
+    }
+    drawItems[numOut++] = di;
+  }
+
+  drawItems.resize(numOut);
+  if(drawObjects)
+  {
+    drawObjects->resize(numOut);
+  }
+
+  annotateDrawBinds(binds, drawItems.data(), numOut, false);
+  LOGI("peephole:        %9d drawitems -> %d, %d binds -> %d\n", uint32_t(numItems), uint32_t(numOut), numBinds,
+       CountDrawBinds(binds.data(), numOut));
+}
+
+void Renderer::partitionShadeDrawItems(ShadeDrawItems         shades[NUM_SHADES],
+                                       std::vector<DrawItem>& solidItems,
+                                       std::vector<uint32_t>& solidObjects,
+                                       std::vector<uint8_t>   binds[NUM_SHADES],
+                                       const DrawList&        drawList,
+                                       bool                   sorted)
+{
+  const std::vector<DrawItem>& drawItems = drawList.drawItems;
+  const uint32_t*              objects   = drawList.objectOrdered ? drawList.drawObjects.data() : nullptr;
+
+  solidItems.clear();
+  solidObjects.clear();
+
+  annotateDrawBinds(binds[SHADE_SOLIDWIRE], drawItems.data(), drawItems.size(), false);
+
+  shades[SHADE_SOLIDWIRE].items   = drawItems.data();
+  shades[SHADE_SOLIDWIRE].binds   = binds[SHADE_SOLIDWIRE].data();
+  shades[SHADE_SOLIDWIRE].objects = objects;
+  shades[SHADE_SOLIDWIRE].num     = drawItems.size();
+
+  if(sorted)
+  {
+    size_t numSolid = 0;
+    while(numSolid < drawItems.size() && drawItems[numSolid].solid)
+    {
+      numSolid++;
+    }
+    // transitions within the solid front are the same
+    binds[SHADE_SOLID].clear();
+    shades[SHADE_SOLID].items   = drawItems.data();
+    shades[SHADE_SOLID].binds   = binds[SHADE_SOLIDWIRE].data();
+    shades[SHADE_SOLID].objects = objects;
+    shades[SHADE_SOLID].num     = numSolid;
+  }
+  else
+  {
+    for(size_t i = 0; i < drawItems.size(); i++)
+    {
+      if(drawItems[i].solid)
+      {
+        solidItems.push_back(drawItems[i]);
+        if(objects)
+        {
+          solidObjects.push_back(objects[i]);
+        }
+      }
+    }
+    solidItems.shrink_to_fit();
+    solidObjects.shrink_to_fit();
+    annotateDrawBinds(binds[SHADE_SOLID], solidItems.data(), solidItems.size(), false);
+    shades[SHADE_SOLID].items   = solidItems.data();
+    shades[SHADE_SOLID].binds   = binds[SHADE_SOLID].data();
+    shades[SHADE_SOLID].objects = objects ? solidObjects.data() : nullptr;
+    shades[SHADE_SOLID].num     = solidItems.size();
+  }
+}
+
+size_t Renderer::findObjectCutoff(const uint32_t* objects, size_t num, uint32_t visibleObjects)
+{
+  if(!objects)
+  {
+    return num;
+  }
+  return size_t(std::lower_bound(objects, objects + num, visibleObjects) - objects);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// LSD radix sort over DrawItem_sortKey, 8 bits per pass.
+// Every thread owns a contiguous slice of the input, histograms are kept
+// per thread so the scatter stays stable without any atomics.
+// The key fields can be shifted around, so the order optimizer can sort by
+// other priorities, solid always remains the top bit.
+
+static const uint32_t RADIX_BITS    = 8;
+static const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+static const uint32_t RADIX_PASSES  = 64 / RADIX_BITS;
+// below this the threads cost more than they save
+static const size_t RADIX_MIN_PARALLEL = 1 << 16;
+
+struct SortKeyShifts
+{
+  uint32_t material;
+  uint32_t geometry;
+  uint32_t matrix;
+};
+
+// same as DrawItem_sortKey
+static const SortKeyShifts SORTKEY_DEFAULT = {48, 24, 0};
+
+static inline uint64_t DrawItem_shiftedKey(const Renderer::DrawItem& di, const SortKeyShifts& shifts)
+{
+  return (uint64_t(di.solid ? 0 : 1) << 63) | (uint64_t(di.materialIndex) << shifts.material)
+         | (uint64_t(di.geometryIndex) << shifts.geometry) | (uint64_t(di.matrixIndex) << shifts.matrix);
+}
+
+struct RadixSortShared
+{
+  uint32_t              numThreads;
+  size_t                numItems;
+  SortKeyShifts         shifts;
+  Renderer::DrawItem*   buffers[2];
+  std::vector<size_t>   histograms;  // [thread][bucket]
+  uint32_t              resultBuffer;
+
+  std::mutex              barrierMutex;
+  std::condition_variable barrierCond;
+  uint32_t                barrierCount;
+  uint32_t                barrierGeneration;
+
+  void barrier()
+  {
+    if(numThreads == 1)
+      return;
+
+    std::unique_lock<std::mutex> lock(barrierMutex);
+    uint32_t                     generation = barrierGeneration;
+    if(++barrierCount == numThreads)
+    {
+      barrierCount = 0;
+      barrierGeneration++;
+      barrierCond.notify_all();
+    }
+    else
+    {
+      while(generation == barrierGeneration)
+      {
+        barrierCond.wait(lock);
+      }
+    }
+  }
+};
+
+struct RadixSortJob
+{
+  RadixSortShared* shared;
+  uint32_t         index;
+};
+
+static void RadixSortThread(void* arg)
+{
+  RadixSortJob*    job    = (RadixSortJob*)arg;
+  RadixSortShared* shared = job->shared;
+
+  uint32_t numThreads = shared->numThreads;
+  size_t   numItems   = shared->numItems;
+  size_t   begin      = (numItems * job->index) / numThreads;
+  size_t   end        = (numItems * (job->index + 1)) / numThreads;
+
+  size_t*              histogram = &shared->histograms[job->index * RADIX_BUCKETS];
+  const SortKeyShifts& shifts    = shared->shifts;
+
+  uint32_t src = 0;
+  for(uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+  {
+    uint32_t shift = pass * RADIX_BITS;
+
+    const Renderer::DrawItem* NV_RESTRICT input  = shared->buffers[src];
+    Renderer::DrawItem* NV_RESTRICT       output = shared->buffers[src ^ 1];
+
+    memset(histogram, 0, sizeof(size_t) * RADIX_BUCKETS);
+    for(size_t i = begin; i < end; i++)
+    {
+      histogram[(DrawItem_shiftedKey(input[i], shifts) >> shift) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    shared->barrier();
+
+    // every thread derives the same decision and its own scatter offsets
+    size_t offsets[RADIX_BUCKETS];
+    size_t sum  = 0;
+    bool   skip = false;
+    for(uint32_t b = 0; b < RADIX_BUCKETS; b++)
+    {
+      size_t bucketTotal = 0;
+      for(uint32_t t = 0; t < numThreads; t++)
+      {
+        size_t count = shared->histograms[t * RADIX_BUCKETS + b];
+        if(t == job->index)
+        {
+          offsets[b] = sum + bucketTotal;
+        }
+        bucketTotal += count;
+      }
+      // all keys share this digit, pass would be an identity copy
+      skip = skip || (bucketTotal == numItems);
+      sum += bucketTotal;
+    }
+
+    if(!skip)
+    {
+      for(size_t i = begin; i < end; i++)
+      {
+        const Renderer::DrawItem& di = input[i];
+        output[offsets[(DrawItem_shiftedKey(di, shifts) >> shift) & (RADIX_BUCKETS - 1)]++] = di;
+      }
+      src ^= 1;
+    }
+
+    // histograms get reused and output becomes input
+    shared->barrier();
+  }
+
+  if(job->index == 0)
+  {
+    shared->resultBuffer = src;
+  }
+}
+
+static void RadixSortDrawItems(std::vector<Renderer::DrawItem>& drawItems, const SortKeyShifts& shifts)
+{
+  size_t numItems = drawItems.size();
+  if(numItems < 2)
+    return;
+
+  uint32_t numThreads = numItems < RADIX_MIN_PARALLEL ? 1 : std::max(1u, Renderer::s_threadpool.getNumThreads());
+
+  std::vector<Renderer::DrawItem> temp(numItems);
+
+  RadixSortShared shared;
+  shared.numThreads        = numThreads;
+  shared.numItems          = numItems;
+  shared.shifts            = shifts;
+  shared.buffers[0]        = drawItems.data();
+  shared.buffers[1]        = temp.data();
+  shared.resultBuffer      = 0;
+  shared.barrierCount      = 0;
+  shared.barrierGeneration = 0;
+  shared.histograms.resize(size_t(numThreads) * RADIX_BUCKETS);
+
+  std::vector<RadixSortJob> jobs(numThreads);
+  for(uint32_t t = 0; t < numThreads; t++)
+  {
+    jobs[t].shared = &shared;
+    jobs[t].index  = t;
+  }
+
+  if(numThreads == 1)
+  {
+    RadixSortThread(&jobs[0]);
+  }
+  else
+  {
+    for(uint32_t t = 0; t < numThreads; t++)
+    {
+      Renderer::s_threadpool.activateJob(t, RadixSortThread, &jobs[t]);
+    }
+    for(uint32_t t = 0; t < numThreads; t++)
+    {
+      Renderer::s_threadpool.waitJob(t);
+    }
+  }
+
+  if(shared.resultBuffer)
+  {
+    drawItems.swap(temp);
+  }
+}
+
+void Renderer::sortDrawItems(std::vector<DrawItem>& drawItems)
+{
+  RadixSortDrawItems(drawItems, SORTKEY_DEFAULT);
+}
+
+static void GenerateBenchmarkItems(std::vector<Renderer::DrawItem>& drawItems, size_t numItems)
+{
+  // roughly cad-like: few materials, many geometries, one matrix per object
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  drawItems.resize(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    Renderer::DrawItem& di = drawItems[i];
+    di.firstIndex          = uint32_t(state);
+    di.count               = uint32_t(state >> 32) & 0xFFFF;
+    di.solid               = (state >> 63) & 1;
+    di.materialIndex       = (state >> 20) % 512;
+    di.geometryIndex       = (state >> 30) % (Renderer::DRAWITEM_MAX_GEOMETRIES / 16);
+    di.matrixIndex         = uint32_t(i / 8) % Renderer::DRAWITEM_MAX_MATRICES;
+  }
+}
+
+void Renderer::benchmarkSortDrawItems()
+{
+  static const size_t sizes[] = {1000000, 10000000, 50000000};
+
+  LOGI("drawitem sort benchmark, %d threads\n", s_threadpool.getNumThreads());
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    size_t numItems = sizes[s];
+
+    std::vector<DrawItem> reference;
+    std::vector<DrawItem> items;
+
+    GenerateBenchmarkItems(reference, numItems);
+    double timeStd = -NVPSystem::getTime();
+    std::sort(reference.begin(), reference.end(), DrawItem_compare_groups);
+    timeStd += NVPSystem::getTime();
+
+    GenerateBenchmarkItems(items, numItems);
+    double timeRadix = -NVPSystem::getTime();
+    sortDrawItems(items);
+    timeRadix += NVPSystem::getTime();
+
+    // std::sort leaves equal keys unordered, so compare keys against it
+    bool sameKeys = true;
+    for(size_t i = 0; i < numItems && sameKeys; i++)
+    {
+      sameKeys = DrawItem_sortKey(items[i]) == DrawItem_sortKey(reference[i]);
+    }
+
+    // and complete items against the stable order
+    GenerateBenchmarkItems(reference, numItems);
+    std::stable_sort(reference.begin(), reference.end(), DrawItem_compare_groups);
+    bool sameItems = memcmp(items.data(), reference.data(), sizeof(DrawItem) * numItems) == 0;
+
+    LOGI("%9zu items: std::sort %9.2f ms, radix %9.2f ms, speedup %5.2fx, %s\n", numItems, timeStd * 1000.0,
+         timeRadix * 1000.0, timeStd / timeRadix, sameKeys && sameItems ? "identical" : "MISMATCH");
+  }
+  LOGI("\n");
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// every priority of material, geometry and matrix for the greedy clustering,
+// as {material, geometry, matrix} shifts of the 15, 24 and 24 bit fields
+static const SortKeyShifts SORTKEY_PRIORITIES[] = {
+    {48, 24, 0},   // material, geometry, matrix (DrawItem_compare_groups)
+    {48, 0, 24},   // material, matrix, geometry
+    {24, 39, 0},   // geometry, material, matrix
+    {0, 39, 15},   // geometry, matrix, material
+    {24, 0, 39},   // matrix, material, geometry
+    {0, 15, 39},   // matrix, geometry, material
+};
+
+// local search gives up after this many passes without reaching a minimum
+static const uint32_t ORDER_MAX_PASSES = 8;
+
+static inline double TransitionCost(const Renderer::DrawItem& a, const Renderer::DrawItem& b, const StateCost& cost)
+{
+  return (a.solid != b.solid ? cost.pipeline : 0.0) + (a.geometryIndex != b.geometryIndex ? cost.geometry : 0.0)
+         + (a.materialIndex != b.materialIndex ? cost.material : 0.0) + (a.matrixIndex != b.matrixIndex ? cost.matrix : 0.0);
+}
+
+double Renderer::computeStateCost(const std::vector<DrawItem>& drawItems, const StateCost& cost)
+{
+  if(drawItems.empty())
+    return 0;
+
+  // first drawcall sets up everything
+  double total = double(cost.pipeline) + double(cost.geometry) + double(cost.material) + double(cost.matrix);
+  total += double(cost.draw) * double(drawItems.size());
+  for(size_t i = 1; i < drawItems.size(); i++)
+  {
+    total += TransitionCost(drawItems[i - 1], drawItems[i], cost);
+  }
+
+  return total;
+}
+
+// run of drawitems sharing solid and the primary key, reversing it keeps
+// its internal cost as transitions are symmetric
+struct OrderCluster
+{
+  size_t begin;
+  size_t end;
+  bool   reversed;
+  bool   solid;
+};
+
+void Renderer::optimizeDrawItems(std::vector<DrawItem>& drawItems, const StateCost& cost)
+{
+  size_t numItems = drawItems.size();
+  if(numItems < 2)
+    return;
+
+  // greedy clustering, the cheapest priority wins
+  std::vector<DrawItem> best;
+  std::vector<DrawItem> candidate;
+  double                bestCost = 0;
+  uint32_t              bestPrio = 0;
+  for(uint32_t p = 0; p < sizeof(SORTKEY_PRIORITIES) / sizeof(SORTKEY_PRIORITIES[0]); p++)
+  {
+    candidate = drawItems;
+    RadixSortDrawItems(candidate, SORTKEY_PRIORITIES[p]);
+    double candidateCost = computeStateCost(candidate, cost);
+    if(p == 0 || candidateCost < bestCost)
+    {
+      best.swap(candidate);
+      bestCost = candidateCost;
+      bestPrio = p;
+    }
+  }
+  candidate.clear();
+  candidate.shrink_to_fit();
+
+  const SortKeyShifts& shifts = SORTKEY_PRIORITIES[bestPrio];
+  uint32_t             primaryShift = std::max(std::max(shifts.material, shifts.geometry), shifts.matrix);
+
+  std::vector<OrderCluster> clusters;
+  {
+    OrderCluster cluster = {0, 0, false, best[0].solid != 0};
+    uint64_t     key     = DrawItem_shiftedKey(best[0], shifts) >> primaryShift;
+    for(size_t i = 1; i < numItems; i++)
+    {
+      uint64_t itemKey = DrawItem_shiftedKey(best[i], shifts) >> primaryShift;
+      if(itemKey != key)
+      {
+        cluster.end = i;
+        clusters.push_back(cluster);
+        cluster.begin = i;
+        cluster.solid = best[i].solid != 0;
+        key           = itemKey;
+      }
+    }
+    cluster.end = numItems;
+    clusters.push_back(cluster);
+  }
+
+  auto clusterFirst = [&](const OrderCluster& c) -> const DrawItem& { return c.reversed ? best[c.end - 1] : best[c.begin]; };
+  auto clusterLast = [&](const OrderCluster& c) -> const DrawItem& { return c.reversed ? best[c.begin] : best[c.end - 1]; };
+
+  // local search, only accepts strict improvements of the affected boundaries
+  size_t numClusters = clusters.size();
+  for(uint32_t pass = 0; pass < ORDER_MAX_PASSES && numClusters > 1; pass++)
+  {
+    bool improved = false;
+
+    // flip clusters
+    for(size_t c = 0; c < numClusters; c++)
+    {
+      OrderCluster& cluster = clusters[c];
+      if(cluster.end - cluster.begin < 2)
+        continue;
+
+      double before = 0;
+      double after  = 0;
+      if(c > 0)
+      {
+        const DrawItem& prev = clusterLast(clusters[c - 1]);
+        before += TransitionCost(prev, clusterFirst(cluster), cost);
+        after += TransitionCost(prev, clusterLast(cluster), cost);
+      }
+      if(c + 1 < numClusters)
+      {
+        const DrawItem& next = clusterFirst(clusters[c + 1]);
+        before += TransitionCost(clusterLast(cluster), next, cost);
+        after += TransitionCost(clusterFirst(cluster), next, cost);
+      }
+      if(after < before)
+      {
+        cluster.reversed = !cluster.reversed;
+        improved         = true;
+      }
+    }
+
+    // swap neighbouring clusters, solid ones stay in front
+    for(size_t c = 0; c + 1 < numClusters; c++)
+    {
+      OrderCluster& a = clusters[c];
+      OrderCluster& b = clusters[c + 1];
+      if(a.solid != b.solid)
+        continue;
+
+      double before = TransitionCost(clusterLast(a), clusterFirst(b), cost);
+      double after  = TransitionCost(clusterLast(b), clusterFirst(a), cost);
+      if(c > 0)
+      {
+        const DrawItem& prev = clusterLast(clusters[c - 1]);
+        before += TransitionCost(prev, clusterFirst(a), cost);
+        after += TransitionCost(prev, clusterFirst(b), cost);
+      }
+      if(c + 2 < numClusters)
+      {
+        const DrawItem& next = clusterFirst(clusters[c + 2]);
+        before += TransitionCost(clusterLast(b), next, cost);
+        after += TransitionCost(clusterLast(a), next, cost);
+      }
+      if(after < before)
+      {
+        std::swap(a, b);
+        improved = true;
+      }
+    }
+
+    if(!improved)
+      break;
+  }
+
+  size_t out = 0;
+  for(size_t c = 0; c < numClusters; c++)
+  {
+    const OrderCluster& cluster = clusters[c];
+    if(cluster.reversed)
+    {
+      for(size_t i = cluster.end; i > cluster.begin; i--)
+      {
+        drawItems[out++] = best[i - 1];
+      }
+    }
+    else
+    {
+      for(size_t i = cluster.begin; i < cluster.end; i++)
+      {
+        drawItems[out++] = best[i];
+      }
+    }
+  }
+}
+
+void Renderer::orderDrawItems(std::vector<DrawItem>& drawItems)
+{
+  StateCost cost = m_config.stateCost;
+  if(m_config.strategy == STRATEGY_INSTANCED)
+  {
+    // matrixIndex is the instance group, matrices come per instance
+    cost.matrix = 0;
+  }
+
+  if(!m_config.optimized)
+  {
+    sortDrawItems(drawItems);
+    m_orderCostFixed = computeStateCost(drawItems, cost);
+    m_orderCost      = m_orderCostFixed;
+    return;
+  }
+
+  {
+    std::vector<DrawItem> fixedItems = drawItems;
+    sortDrawItems(fixedItems);
+    m_orderCostFixed = computeStateCost(fixedItems, cost);
+  }
+
+  double timeBegin = NVPSystem::getTime();
+  optimizeDrawItems(drawItems, cost);
+  double timeOptimize = NVPSystem::getTime() - timeBegin;
+
+  m_orderCost = computeStateCost(drawItems, cost);
+  LOGI("draw order: predicted cost %.0f, fixed sort %.0f (%.1f%%), optimized in %.2f ms\n", m_orderCost,
+       m_orderCostFixed, m_orderCostFixed > 0 ? 100.0 * (m_orderCost - m_orderCostFixed) / m_orderCostFixed : 0.0,
+       timeOptimize * 1000.0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// keeps a few configurations, enough to cycle renderers of two strategies
+static const size_t DRAWLIST_CACHE_MAX_ENTRIES = 8;
+
+size_t Renderer::DrawList::getMemoryUsage() const
+{
+  return drawItems.capacity() * sizeof(DrawItem) + drawObjects.capacity() * sizeof(uint32_t)
+         + instanceGroups.capacity() * sizeof(InstanceGroup) + instanceMatrices.capacity() * sizeof(uint32_t)
+         + translucentItems.capacity() * sizeof(DrawItem) + translucentObjects.capacity() * sizeof(uint32_t);
+}
+
+bool Renderer::DrawListKey::operator==(const DrawListKey& other) const
+{
+  return strategy == other.strategy && objectFrom == other.objectFrom && objectNum == other.objectNum
+         && sorted == other.sorted && optimized == other.optimized && perObject == other.perObject
+         && memcmp(&stateCost, &other.stateCost, sizeof(StateCost)) == 0 && placement == other.placement;
+}
+
+std::shared_ptr<const Renderer::DrawList> Renderer::DrawListCache::find(const DrawListKey& key, uint32_t sceneVersion)
+{
+  if(sceneVersion != m_sceneVersion)
+  {
+    clear();
+    m_sceneVersion = sceneVersion;
+  }
+
+  for(size_t i = 0; i < m_entries.size(); i++)
+  {
+    if(m_entries[i].key == key)
+    {
+      Entry entry = m_entries[i];
+      m_entries.erase(m_entries.begin() + i);
+      m_entries.push_back(entry);
+      return entry.list;
+    }
+  }
+
+  return nullptr;
+}
+
+void Renderer::DrawListCache::add(const DrawListKey& key, uint32_t sceneVersion, const std::shared_ptr<const DrawList>& list)
+{
+  if(sceneVersion != m_sceneVersion)
+  {
+    clear();
+    m_sceneVersion = sceneVersion;
+  }
+
+  if(m_entries.size() >= DRAWLIST_CACHE_MAX_ENTRIES)
+  {
+    // renderers still using it keep their reference
+    m_entries.erase(m_entries.begin());
+  }
+
+  Entry entry;
+  entry.key  = key;
+  entry.list = list;
+  m_entries.push_back(entry);
+}
+
+void Renderer::DrawListCache::clear()
+{
+  m_entries.clear();
+}
+
+void Renderer::DrawListCache::appendMemoryStats(MemoryStats& stats) const
+{
+  for(size_t i = 0; i < m_entries.size(); i++)
+  {
+    stats.cpu[MemoryStats::DRAWLISTS] += m_entries[i].list->getMemoryUsage();
+  }
+}
+
+void Renderer::acquireDrawList(const Resources* resources, const Config& config, bool perObject)
+{
+  m_config = config;
+
+  DrawListKey key;
+  memset(&key, 0, sizeof(key));
+  key.strategy   = config.strategy;
+  key.objectFrom = config.objectFrom;
+  key.objectNum  = config.objectNum;
+  key.perObject  = perObject;
+  key.sorted     = config.sorted && !perObject;
+  key.optimized  = key.sorted && config.optimized;
+  key.placement  = resources->m_geometryPlacement.empty() ? nullptr : resources;
+
+  // in fill order the visible objects are the front of the list, so one list for all objects
+  // serves every percentage. Instancing and merging across objects mix the objects
+  bool objectOrdered = config.objectFrom == 0 && !key.sorted && config.strategy != STRATEGY_INSTANCED
+                       && (config.strategy != STRATEGY_MERGED || perObject);
+  if(objectOrdered)
+  {
+    key.objectNum = uint32_t(m_scene->m_objects.size());
+  }
+  if(key.optimized)
+  {
+    key.stateCost = config.stateCost;
+  }
+
+  uint32_t sceneVersion = m_scene->m_version;
+
+  m_drawListShared = s_drawLists.m_enabled;
+  if(!m_drawListShared)
+  {
+    s_drawLists.clear();
+  }
+
+  m_drawList = m_drawListShared ? s_drawLists.find(key, sceneVersion) : nullptr;
+  if(m_drawList)
+  {
+    m_orderCostFixed = m_drawList->orderCostFixed;
+    m_orderCost      = m_drawList->orderCost;
+    LOGI("drawlist:        %9d drawitems, %d translucent, cached\n", uint32_t(m_drawList->drawItems.size()),
+         uint32_t(m_drawList->translucentItems.size()));
+    return;
+  }
+
+  double timeBegin = NVPSystem::getTime();
+
+  m_orderCostFixed = 0;
+  m_orderCost      = 0;
+
+  std::shared_ptr<DrawList> list        = std::make_shared<DrawList>();
+  std::vector<uint32_t>*    drawObjects = perObject || objectOrdered ? &list->drawObjects : nullptr;
+
+  Config fillConfig    = config;
+  fillConfig.objectNum = key.objectNum;
+
+  fillDrawItems(list->drawItems, fillConfig, true, true, drawObjects);
+  if(key.sorted)
+  {
+    orderDrawItems(list->drawItems);
+  }
+  mergeDrawItems(list->drawItems, resources, drawObjects);
+  peepholeDrawItems(list->drawItems, drawObjects);
+  fillTranslucentDrawItems(list->translucentItems, list->translucentObjects, fillConfig, resources);
+
+  list->instanceGroups.swap(m_instanceGroups);
+  list->instanceMatrices.swap(m_instanceMatrices);
+  list->orderCostFixed = m_orderCostFixed;
+  list->orderCost      = m_orderCost;
+  list->objectOrdered  = objectOrdered;
+
+  m_config   = config;
+  m_drawList = list;
+  if(m_drawListShared)
+  {
+    s_drawLists.add(key, sceneVersion, m_drawList);
+  }
+
+  LOGI("drawlist:        %9d drawitems, %d translucent, built in %.2f ms\n", uint32_t(list->drawItems.size()),
+       uint32_t(list->translucentItems.size()), (NVPSystem::getTime() - timeBegin) * 1000.0);
+}
+
+size_t Renderer::getDrawItemCutoff(uint32_t visibleObjects) const
+{
+  const DrawList& list = *m_drawList;
+  return findObjectCutoff(list.objectOrdered ? list.drawObjects.data() : nullptr, list.drawItems.size(), visibleObjects);
+}
+
+void Renderer::appendDrawListMemoryStats(MemoryStats& stats) const
+{
+  if(m_drawList && !m_drawListShared)
+  {
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawList->getMemoryUsage();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// below this runs use insertion sort instead of clearing a histogram
+static const size_t DEPTHSORT_SMALL_RUN = 32;
+
+// index range of a geometry within its chunk, see Resources::m_contiguousGeometry
+struct ChunkRange
+{
+  uint32_t chunkGeometry;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t geometry;
+
+  bool operator<(const ChunkRange& other) const
+  {
+    return chunkGeometry < other.chunkGeometry || (chunkGeometry == other.chunkGeometry && begin < other.begin);
+  }
+};
+
+// geometries covered by the index range of a drawitem. Merged drawitems may span several geometries
+// of their chunk and carry the chunk's first geometry, see Resources::m_contiguousGeometry
+class ChunkGeometries
+{
+public:
+  ChunkGeometries(const CadScene* NV_RESTRICT scene, const Resources* resources)
+  {
+    if(!resources)
+      return;
+
+    m_placements = &resources->m_geometryPlacement;
+
+    // [0] solid and [1] wire ranges
+    for(size_t g = 0; g < m_placements->size(); g++)
+    {
+      const Resources::GeometryPlacement& placement = (*m_placements)[g];
+      const CadScene::Geometry&           geo       = scene->m_geometry[g];
+      uint32_t                            firstWire = placement.firstWire + geo.numIndexSolid;
+      if(geo.numIndexSolid)
+      {
+        m_ranges[0].push_back({placement.chunkGeometry, placement.firstSolid, placement.firstSolid + geo.numIndexSolid, uint32_t(g)});
+      }
+      if(geo.numIndexWire)
+      {
+        m_ranges[1].push_back({placement.chunkGeometry, firstWire, firstWire + geo.numIndexWire, uint32_t(g)});
+      }
+    }
+    std::sort(m_ranges[0].begin(), m_ranges[0].end());
+    std::sort(m_ranges[1].begin(), m_ranges[1].end());
+  }
+
+  // just the drawitem's geometry without contiguous geometry
+  void find(const Renderer::DrawItem& di, std::vector<uint32_t>& geometries) const
+  {
+    geometries.clear();
+    if(m_placements && !m_placements->empty())
+    {
+      const std::vector<ChunkRange>& chunkRanges = m_ranges[di.solid ? 0 : 1];
+      ChunkRange                     key         = {(*m_placements)[di.geometryIndex].chunkGeometry, di.firstIndex, 0, 0};
+
+      // ranges don't overlap, start at the last one that begins at or before the drawitem
+      auto it = std::upper_bound(chunkRanges.begin(), chunkRanges.end(), key);
+      if(it != chunkRanges.begin() && (it - 1)->chunkGeometry == key.chunkGeometry)
+      {
+        --it;
+      }
+      for(; it != chunkRanges.end() && it->chunkGeometry == key.chunkGeometry && it->begin < di.firstIndex + di.count; ++it)
+      {
+        if(it->end > di.firstIndex)
+        {
+          geometries.push_back(it->geometry);
+        }
+      }
+    }
+    if(geometries.empty())
+    {
+      geometries.push_back(di.geometryIndex);
+    }
+  }
+
+private:
+  const std::vector<Resources::GeometryPlacement>* m_placements = nullptr;
+  std::vector<ChunkRange>                          m_ranges[2];
+};
+
+void Renderer::DepthSorter::init(const CadScene* NV_RESTRICT scene,
+                                 const DrawList*             drawList,
+                                 const Resources*            resources,
+                                 const ShadeDrawItems&       shade)
+{
+  m_scene     = scene;
+  m_drawList  = drawList;
+  m_resources = resources;
+  m_shade     = shade;
+  m_sortTime  = 0;
+}
+
+void Renderer::DepthSorter::deinit()
+{
+  m_centers.clear();
+  m_centers.shrink_to_fit();
+  m_runs.clear();
+  m_runs.shrink_to_fit();
+  m_items.clear();
+  m_items.shrink_to_fit();
+  m_binds.clear();
+  m_binds.shrink_to_fit();
+  m_indices.clear();
+  m_indices.shrink_to_fit();
+  m_keys.clear();
+  m_keys.shrink_to_fit();
+  m_histograms.clear();
+  m_histograms.shrink_to_fit();
+}
+
+size_t Renderer::DepthSorter::getMemoryUsage() const
+{
+  return m_centers.capacity() * sizeof(glm::vec3) + m_runs.capacity() * sizeof(uint32_t)
+         + m_items.capacity() * sizeof(DrawItem) + m_binds.capacity() + m_indices.capacity() * sizeof(uint32_t) + m_keys.capacity()
+         + m_histograms.capacity() * sizeof(size_t);
+}
+
+void Renderer::DepthSorter::updateCenters()
+{
+  const CadScene* NV_RESTRICT scene     = m_scene;
+  bool                        instanced = !m_drawList->instanceGroups.empty();
+  ChunkGeometries             chunkGeometries(scene, m_resources);
+
+  m_centers.resize(m_shade.num);
+  m_runs.clear();
+
+  std::vector<uint32_t> geometries;
+  for(size_t i = 0; i < m_shade.num; i++)
+  {
+    const DrawItem& di = m_shade.items[i];
+
+    // instanced draws use their first instance
+    uint32_t matrixIndex = instanced ? m_drawList->instanceMatrices[m_drawList->instanceGroups[di.matrixIndex].firstInstance] :
+                                       uint32_t(di.matrixIndex);
+
+    // center of all geometries the index range covers, they share the matrix
+    chunkGeometries.find(di, geometries);
+    glm::vec3 bmin = glm::vec3(FLT_MAX);
+    glm::vec3 bmax = glm::vec3(-FLT_MAX);
+    for(uint32_t g : geometries)
+    {
+      const CadScene::BBox& bbox = scene->m_geometryBboxes[g];
+      bmin                       = glm::min(bmin, glm::vec3(bbox.min));
+      bmax                       = glm::max(bmax, glm::vec3(bbox.max));
+    }
+    glm::vec4 center = glm::vec4((bmin + bmax) * 0.5f, 1.0f);
+    m_centers[i]     = glm::vec3(scene->m_matrices[matrixIndex].worldMatrix * center);
+
+    if(i == 0 || di.solid != m_shade.items[i - 1].solid || di.materialIndex != m_shade.items[i - 1].materialIndex)
+    {
+      m_runs.push_back(uint32_t(i));
+    }
+  }
+  m_runs.push_back(uint32_t(m_shade.num));
+}
+
+const Renderer::ShadeDrawItems& Renderer::DepthSorter::begin(const glm::mat4& viewMatrix,
+                                                              size_t           num,
+                                                              uint32_t         numThreads,
+                                                              bool             keepMaterials,
+                                                              bool             backToFront)
+{
+  m_timeBegin = NVPSystem::getTime();
+
+  if(m_centers.size() != m_shade.num)
+  {
+    updateCenters();
+    m_items.resize(m_shade.num);
+    m_binds.resize(m_shade.num);
+    m_indices.resize(m_shade.num);
+    m_keys.resize(m_shade.num);
+  }
+  m_histograms.resize(size_t(numThreads) * BUCKETS);
+
+  // distance along the view direction, the scene bounds give the bucket range.
+  // back to front sorts by the negated distance instead
+  m_depthPlane = glm::vec4(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2], viewMatrix[3][2]);
+  if(!backToFront)
+  {
+    m_depthPlane = -m_depthPlane;
+  }
+
+  const CadScene::BBox& bbox     = m_scene->m_bbox;
+  float                 depthMin = FLT_MAX;
+  float                 depthMax = -FLT_MAX;
+  for(int c = 0; c < 8; c++)
+  {
+    glm::vec4 corner = glm::vec4(c & 1 ? bbox.max.x : bbox.min.x, c & 2 ? bbox.max.y : bbox.min.y,
+                                 c & 4 ? bbox.max.z : bbox.min.z, 1.0f);
+    float     depth  = glm::dot(m_depthPlane, corner);
+    depthMin         = std::min(depthMin, depth);
+    depthMax         = std::max(depthMax, depth);
+  }
+
+  m_depthMin      = depthMin;
+  m_depthScale    = float(BUCKETS) / std::max(depthMax - depthMin, FLT_MIN);
+  m_num           = std::min(num, m_shade.num);
+  m_numThreads    = numThreads;
+  m_keepMaterials = keepMaterials;
+
+  m_sorted.items   = m_items.data();
+  m_sorted.binds   = m_binds.data();
+  m_sorted.objects = nullptr;
+  m_sorted.num     = m_num;
+
+  return m_sorted;
+}
+
+void Renderer::DepthSorter::barrier()
+{
+  if(m_numThreads == 1)
+    return;
+
+  std::unique_lock<std::mutex> lock(m_barrierMutex);
+  uint32_t                     generation = m_barrierGeneration;
+  if(++m_barrierCount == m_numThreads)
+  {
+    m_barrierCount = 0;
+    m_barrierGeneration++;
+    m_barrierCond.notify_all();
+  }
+  else
+  {
+    while(generation == m_barrierGeneration)
+    {
+      m_barrierCond.wait(lock);
+    }
+  }
+}
+
+inline uint32_t Renderer::DepthSorter::getKey(size_t i) const
+{
+  float key = (glm::dot(m_depthPlane, glm::vec4(m_centers[i], 1.0f)) - m_depthMin) * m_depthScale;
+  return uint32_t(std::min(std::max(key, 0.0f), float(BUCKETS - 1)));
+}
+
+void Renderer::DepthSorter::sortRun(size_t begin, size_t end, size_t* histogram)
+{
+  const DrawItem* NV_RESTRICT input = m_shade.items;
+
+  if(end - begin < DEPTHSORT_SMALL_RUN)
+  {
+    // stable insertion sort
+    for(size_t i = begin; i < end; i++)
+    {
+      uint8_t  key = uint8_t(getKey(i));
+      DrawItem di  = input[i];
+      size_t   j   = i;
+      while(j > begin && m_keys[j - 1] > key)
+      {
+        m_keys[j]    = m_keys[j - 1];
+        m_items[j]   = m_items[j - 1];
+        m_indices[j] = m_indices[j - 1];
+        j--;
+      }
+      m_keys[j]    = key;
+      m_items[j]   = di;
+      m_indices[j] = uint32_t(i);
+    }
+    return;
+  }
+
+  memset(histogram, 0, sizeof(size_t) * BUCKETS);
+  for(size_t i = begin; i < end; i++)
+  {
+    m_keys[i] = uint8_t(getKey(i));
+    histogram[m_keys[i]]++;
+  }
+
+  size_t offset = begin;
+  for(uint32_t b = 0; b < BUCKETS; b++)
+  {
+    size_t count  = histogram[b];
+    histogram[b]  = offset;
+    offset       += count;
+  }
+
+  for(size_t i = begin; i < end; i++)
+  {
+    size_t out     = histogram[m_keys[i]]++;
+    m_items[out]   = input[i];
+    m_indices[out] = uint32_t(i);
+  }
+}
+
+void Renderer::DepthSorter::sortThread(uint32_t tid)
+{
+  const DrawItem* NV_RESTRICT input = m_shade.items;
+
+  size_t  numItems  = m_num;
+  size_t  begin     = (numItems * tid) / m_numThreads;
+  size_t  end       = (numItems * (tid + 1)) / m_numThreads;
+  size_t* histogram = &m_histograms[size_t(tid) * BUCKETS];
+
+  if(m_keepMaterials)
+  {
+    // every run that starts within our slice
+    size_t run    = std::lower_bound(m_runs.begin(), m_runs.end(), uint32_t(begin)) - m_runs.begin();
+    size_t runEnd = std::lower_bound(m_runs.begin(), m_runs.end(), uint32_t(end)) - m_runs.begin();
+    for(; run < runEnd; run++)
+    {
+      sortRun(m_runs[run], std::min(size_t(m_runs[run + 1]), numItems), histogram);
+    }
+  }
+  else
+  {
+    memset(histogram, 0, sizeof(size_t) * BUCKETS);
+    for(size_t i = begin; i < end; i++)
+    {
+      m_keys[i] = uint8_t(getKey(i));
+      histogram[m_keys[i]]++;
+    }
+
+    barrier();
+
+    // like the radix sort every thread derives its own scatter offsets
+    size_t offsets[BUCKETS];
+    size_t sum = 0;
+    for(uint32_t b = 0; b < BUCKETS; b++)
+    {
+      for(uint32_t t = 0; t < m_numThreads; t++)
+      {
+        if(t == tid)
+        {
+          offsets[b] = sum;
+        }
+        sum += m_histograms[t * BUCKETS + b];
+      }
+    }
+
+    for(size_t i = begin; i < end; i++)
+    {
+      size_t out     = offsets[m_keys[i]]++;
+      m_items[out]   = input[i];
+      m_indices[out] = uint32_t(i);
+    }
+  }
+
+  barrier();
+
+  for(size_t i = begin; i < end; i++)
+  {
+    m_binds[i] = i ? DrawBinds(m_items[i - 1], m_items[i]) : uint8_t(DRAWBIND_ALL);
+  }
+
+  // chunks may come from any slice
+  barrier();
+
+  if(tid == 0)
+  {
+    m_sortTime = (NVPSystem::getTime() - m_timeBegin) * 1000.0;
+  }
+}
+
+struct DepthSortJob
+{
+  Renderer::DepthSorter* sorter;
+  uint32_t               tid;
+};
+
+static void DepthSortThread(void* arg)
+{
+  DepthSortJob* job = (DepthSortJob*)arg;
+  job->sorter->sortThread(job->tid);
+}
+
+void Renderer::benchmarkDepthSort(const CadScene* NV_RESTRICT scene)
+{
+  static const size_t   sizes[] = {1000, 10000, 100000, 1000000};
+  static const uint32_t REPEATS = 16;
+
+  if(scene->m_objects.empty())
+    return;
+
+  // looking at the scene center from one of its corners
+  glm::vec3 center     = glm::vec3((scene->m_bbox.min + scene->m_bbox.max) * 0.5f);
+  glm::mat4 viewMatrix = glm::lookAt(glm::vec3(scene->m_bbox.max), center, glm::vec3(0, 1, 0));
+
+  LOGI("back to front sort benchmark, average of %d sorts [ms]\n", REPEATS);
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    size_t numItems = sizes[s];
+
+    // the scene's objects repeated, one drawitem each
+    DrawList list;
+    list.drawItems.resize(numItems);
+    for(size_t i = 0; i < numItems; i++)
+    {
+      const CadScene::Object& obj = scene->m_objects[i % scene->m_objects.size()];
+
+      DrawItem& di     = list.drawItems[i];
+      di.firstIndex    = 0;
+      di.count         = 3;
+      di.solid         = 1;
+      di.materialIndex = 0;
+      di.geometryIndex = obj.geometryIndex;
+      di.matrixIndex   = obj.matrixIndex;
+    }
+
+    ShadeDrawItems shade;
+    shade.items   = list.drawItems.data();
+    shade.binds   = nullptr;
+    shade.objects = nullptr;
+    shade.num     = numItems;
+
+    DepthSorter sorter;
+    sorter.init(scene, &list, nullptr, shade);
+
+    char label[32];
+    snprintf(label, sizeof(label), "%9zu items:", numItems);
+    benchmarkThreads(s_threadpool, label, [&](uint32_t numThreads) {
+      std::vector<DepthSortJob> jobs(numThreads);
+      double                    timeSum = 0;
+      for(uint32_t r = 0; r < REPEATS; r++)
+      {
+        sorter.begin(viewMatrix, numItems, numThreads, false, true);
+        for(uint32_t t = 0; t < numThreads; t++)
+        {
+          jobs[t].sorter = &sorter;
+          jobs[t].tid    = t;
+          s_threadpool.activateJob(t, DepthSortThread, &jobs[t]);
+        }
+        for(uint32_t t = 0; t < numThreads; t++)
+        {
+          s_threadpool.waitJob(t);
+        }
+        timeSum += sorter.m_sortTime;
+      }
+      return timeSum / double(REPEATS);
+    });
+
+    sorter.deinit();
+  }
+  LOGI("\n");
+}
+
+void Renderer::benchmarkCulling(const CadScene* NV_RESTRICT scene)
+{
+  static const uint32_t FRAMES = 360;
+  static const size_t   CHUNK  = 4096;
+
+  if(scene->m_objects.empty())
+    return;
+
+  // one drawitem per object
+  size_t   numItems = scene->m_objects.size();
+  DrawList list;
+  list.drawItems.resize(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    const CadScene::Object& obj = scene->m_objects[i];
+
+    DrawItem& di     = list.drawItems[i];
+    di.firstIndex    = 0;
+    di.count         = 3;
+    di.solid         = 1;
+    di.materialIndex = 0;
+    di.geometryIndex = obj.geometryIndex;
+    di.matrixIndex   = obj.matrixIndex;
+  }
+  std::vector<uint8_t> binds(numItems, uint8_t(DRAWBIND_ALL));
+
+  ShadeDrawItems shade;
+  shade.items   = list.drawItems.data();
+  shade.binds   = binds.data();
+  shade.objects = nullptr;
+  shade.num     = numItems;
+
+  glm::vec3 sceneMin   = glm::vec3(scene->m_bbox.min);
+  glm::vec3 sceneMax   = glm::vec3(scene->m_bbox.max);
+  glm::vec3 center     = (sceneMin + sceneMax) * 0.5f;
+  float     dimension  = glm::length(sceneMax - sceneMin);
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, dimension * 0.001f, dimension * 10.0f);
+
+  // 0 tests every drawitem each frame
+  size_t budgets[] = {0, std::max(numItems / 4, size_t(1)), std::max(numItems / 16, size_t(1))};
+
+  LOGI("frustum culling benchmark, %d drawitems, %d frames per camera path\n", uint32_t(numItems), FRAMES);
+  LOGI("per frame: cpu [ms], frustum tests, drawitems drawn beyond the exact result\n");
+  for(int path = 0; path < 2; path++)
+  {
+    std::vector<glm::mat4> viewProjMatrices(FRAMES);
+    for(uint32_t f = 0; f < FRAMES; f++)
+    {
+      float     t = float(f) / float(FRAMES);
+      glm::mat4 viewMatrix;
+      if(path == 0)
+      {
+        // once around the scene center
+        float     angle = t * 2.0f * glm::pi<float>();
+        glm::vec3 eye   = center + glm::vec3(cosf(angle), 0.5f, sinf(angle)) * dimension * 0.5f;
+        viewMatrix      = glm::lookAt(eye, center, glm::vec3(0, 1, 0));
+      }
+      else
+      {
+        // diagonally through the scene, looking ahead
+        glm::vec3 eye = sceneMin + (sceneMax - sceneMin) * t;
+        viewMatrix    = glm::lookAt(eye, eye + (sceneMax - sceneMin), glm::vec3(0, 1, 0));
+      }
+      viewProjMatrices[f] = projection * viewMatrix;
+    }
+
+    std::vector<size_t> exactVisible(FRAMES);
+
+    BenchmarkLine line;
+    line.append("%-12s", path == 0 ? "orbit" : "fly-through");
+    for(size_t budget : budgets)
+    {
+      FrustumCuller culler;
+      culler.init(scene, &list, nullptr, shade);
+
+      FrustumCuller::ThreadOutput output;
+      double                      extra = 0;
+      for(uint32_t f = 0; f < FRAMES; f++)
+      {
+        culler.begin(viewProjMatrices[f], nullptr, 0, glm::vec2(0), budget);
+
+        size_t visible = 0;
+        for(size_t begin = 0; begin < numItems; begin += CHUNK)
+        {
+          visible += culler.cull(shade, nullptr, begin, std::min(CHUNK, numItems - begin), output).num;
+        }
+        if(budget)
+        {
+          extra += double(visible) - double(exactVisible[f]);
+        }
+        else
+        {
+          exactVisible[f] = visible;
+        }
+      }
+      culler.deinit();
+
+      double time  = output.time * 1000.0 / double(FRAMES);
+      size_t tests = (output.numTested - output.numCoherent) / FRAMES;
+      if(budget)
+      {
+        line.append(" | budget %7zu %7.3f %7zu %7.1f", budget, time, tests, extra / double(FRAMES));
+      }
+      else
+      {
+        line.append(" | every item %7.3f %7zu", time, tests);
+      }
+    }
+    LOGI("%s\n", line.c_str());
+  }
+  LOGI("\n");
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void Renderer::FrustumCuller::init(const CadScene* NV_RESTRICT scene,
+                                   const DrawList*             drawList,
+                                   const Resources*            resources,
+                                   const ShadeDrawItems&       shade)
+{
+  m_scene     = scene;
+  m_drawList  = drawList;
+  m_resources = resources;
+  m_shade     = shade;
+}
+
+void Renderer::FrustumCuller::deinit()
+{
+  for(int c = 0; c < NUM_BOUNDS; c++)
+  {
+    m_bounds[c].clear();
+    m_bounds[c].shrink_to_fit();
+  }
+  m_coherentStates.clear();
+  m_coherentStates.shrink_to_fit();
+  m_coherentUntil.clear();
+  m_coherentUntil.shrink_to_fit();
+  m_boundsReach.clear();
+  m_boundsReach.shrink_to_fit();
+  m_coherentBudget = 0;
+}
+
+size_t Renderer::FrustumCuller::getMemoryUsage() const
+{
+  return m_bounds[0].capacity() * sizeof(float) * NUM_BOUNDS + m_boundsReach.capacity() * sizeof(float)
+         + m_coherentStates.capacity() * sizeof(uint8_t) + m_coherentUntil.capacity() * sizeof(double);
+}
+
+void Renderer::FrustumCuller::updateBounds()
+{
+  const CadScene* NV_RESTRICT scene     = m_scene;
+  bool                        instanced = !m_drawList->instanceGroups.empty();
+  ChunkGeometries             chunkGeometries(scene, m_resources);
+
+  // padded, so the SSE loop may load four at once
+  size_t numPadded = alignedSize(m_shade.num, 4);
+  for(int c = 0; c < NUM_BOUNDS; c++)
+  {
+    m_bounds[c].resize(numPadded, 0.0f);
+  }
+
+  glm::vec3 sceneMin = glm::vec3(FLT_MAX);
+  glm::vec3 sceneMax = glm::vec3(-FLT_MAX);
+
+  std::vector<uint32_t> geometries;
+  for(size_t i = 0; i < m_shade.num; i++)
+  {
+    const DrawItem& di = m_shade.items[i];
+
+    chunkGeometries.find(di, geometries);
+
+    // instanced draws cover all their instances
+    uint32_t        matrixIndex = uint32_t(di.matrixIndex);
+    const uint32_t* matrices    = &matrixIndex;
+    uint32_t        numMatrices = 1;
+    if(instanced)
+    {
+      const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+      matrices                   = m_drawList->instanceMatrices.data() + group.firstInstance;
+      numMatrices                = group.numInstances;
+    }
+
+    glm::vec3 bmin = glm::vec3(FLT_MAX);
+    glm::vec3 bmax = glm::vec3(-FLT_MAX);
+    for(uint32_t m = 0; m < numMatrices; m++)
+    {
+      const glm::mat4& world = scene->m_matrices[matrices[m]].worldMatrix;
+      for(uint32_t g : geometries)
+      {
+        const CadScene::BBox& bbox   = scene->m_geometryBboxes[g];
+        glm::vec3             center = glm::vec3(world * glm::vec4(glm::vec3((bbox.min + bbox.max) * 0.5f), 1.0f));
+        glm::vec3             extent = glm::vec3((bbox.max - bbox.min) * 0.5f);
+
+        // world axis aligned extent of the transformed box
+        extent = glm::abs(glm::vec3(world[0])) * extent.x + glm::abs(glm::vec3(world[1])) * extent.y
+                 + glm::abs(glm::vec3(world[2])) * extent.z;
+        bmin = glm::min(bmin, center - extent);
+        bmax = glm::max(bmax, center + extent);
+      }
+    }
+
+    m_bounds[BOUNDS_MINX][i] = bmin.x;
+    m_bounds[BOUNDS_MINY][i] = bmin.y;
+    m_bounds[BOUNDS_MINZ][i] = bmin.z;
+    m_bounds[BOUNDS_MAXX][i] = bmax.x;
+    m_bounds[BOUNDS_MAXY][i] = bmax.y;
+    m_bounds[BOUNDS_MAXZ][i] = bmax.z;
+    sceneMin                 = glm::min(sceneMin, bmin);
+    sceneMax                 = glm::max(sceneMax, bmax);
+  }
+
+  m_boundsCenter = m_shade.num ? (sceneMin + sceneMax) * 0.5f : glm::vec3(0);
+  m_boundsReach.resize(m_shade.num);
+  for(size_t i = 0; i < m_shade.num; i++)
+  {
+    glm::vec3 bmin   = glm::vec3(m_bounds[BOUNDS_MINX][i], m_bounds[BOUNDS_MINY][i], m_bounds[BOUNDS_MINZ][i]);
+    glm::vec3 bmax   = glm::vec3(m_bounds[BOUNDS_MAXX][i], m_bounds[BOUNDS_MAXY][i], m_bounds[BOUNDS_MAXZ][i]);
+    m_boundsReach[i] = glm::length(glm::max(glm::abs(bmin - m_boundsCenter), glm::abs(bmax - m_boundsCenter)));
+  }
+
+  // new bounds, no history applies anymore
+  m_coherentStates.clear();
+  m_coherentUntil.clear();
+}
+
+void Renderer::FrustumCuller::begin(const glm::mat4&       viewProjMatrix,
+                                     const OcclusionBuffer* occlusion,
+                                     float                  minPixels,
+                                     const glm::vec2&       viewport,
+                                     size_t                 coherentBudget,
+                                     const glm::vec4*       clipPlanes,
+                                     uint32_t               numClipPlanes)
+{
+  m_viewProjMatrix = viewProjMatrix;
+  m_occlusion      = occlusion;
+  m_minPixels      = minPixels;
+  m_pixelScale     = viewport * 0.5f;
+  m_numClipPlanes  = clipPlanes ? std::min(numClipPlanes, uint32_t(MAX_CLIPPLANES)) : 0;
+  for(uint32_t p = 0; p < m_numClipPlanes; p++)
+  {
+    m_clipPlanes[p] = clipPlanes[p];
+  }
+
+  if(m_bounds[0].size() != alignedSize(m_shade.num, 4))
+  {
+    updateBounds();
+  }
+
+  // -w <= x,y,z <= w in clip space, also conservative for a [0,1] depth range.
+  // normalized, so the plane distances are in world units
+  glm::vec4 rows[4];
+  for(int r = 0; r < 4; r++)
+  {
+    rows[r] = glm::vec4(viewProjMatrix[0][r], viewProjMatrix[1][r], viewProjMatrix[2][r], viewProjMatrix[3][r]);
+  }
+  glm::vec4 planes[6];
+  for(int p = 0; p < 6; p++)
+  {
+    planes[p]    = p & 1 ? rows[3] - rows[p / 2] : rows[3] + rows[p / 2];
+    float length = glm::length(glm::vec3(planes[p]));
+    planes[p] /= length > 0 ? length : 1.0f;
+  }
+
+  if(coherentBudget && m_coherentBudget && m_coherentStates.size() == m_shade.num)
+  {
+    // a plane's distance to a point changes by at most |delta normal| * the point's
+    // distance to the center plus the change at the center
+    float turn  = 0;
+    float shift = 0;
+    for(int p = 0; p < 6; p++)
+    {
+      glm::vec4 delta = planes[p] - m_planes[p];
+      turn            = std::max(turn, glm::length(glm::vec3(delta)));
+      shift           = std::max(shift, fabsf(glm::dot(glm::vec3(delta), m_boundsCenter) + delta.w));
+    }
+    m_coherentTurn += double(turn);
+    m_coherentShift += double(shift);
+  }
+  else if(coherentBudget)
+  {
+    m_coherentStates.assign(m_shade.num, COHERENT_UNKNOWN);
+    m_coherentUntil.assign(m_shade.num, 0.0);
+    m_coherentTurn  = 0;
+    m_coherentShift = 0;
+  }
+  m_coherentBudget = coherentBudget;
+
+  for(int p = 0; p < 6; p++)
+  {
+    m_planes[p] = planes[p];
+  }
+}
+
+Renderer::FrustumCuller::CoherentState Renderer::FrustumCuller::classify(size_t idx, float& distance) const
+{
+  // outside if the corner furthest along any normal is behind its plane,
+  // inside if the nearest corners are in front of all of them
+  float outside = 0;
+  float inside  = FLT_MAX;
+  for(int p = 0; p < 6; p++)
+  {
+    const glm::vec4& plane = m_planes[p];
+    int              x     = plane.x > 0 ? BOUNDS_MAXX : BOUNDS_MINX;
+    int              y     = plane.y > 0 ? BOUNDS_MAXY : BOUNDS_MINY;
+    int              z     = plane.z > 0 ? BOUNDS_MAXZ : BOUNDS_MINZ;
+    // the opposite corner is the nearest
+    float furthest = m_bounds[x][idx] * plane.x + m_bounds[y][idx] * plane.y + m_bounds[z][idx] * plane.z + plane.w;
+    float nearest  = m_bounds[(x + 3) % NUM_BOUNDS][idx] * plane.x + m_bounds[(y + 3) % NUM_BOUNDS][idx] * plane.y
+                    + m_bounds[(z + 3) % NUM_BOUNDS][idx] * plane.z + plane.w;
+    outside = std::max(outside, -furthest);
+    inside  = std::min(inside, nearest);
+  }
+
+  if(outside > 0)
+  {
+    distance = outside;
+    return COHERENT_OUTSIDE;
+  }
+  if(inside > 0)
+  {
+    distance = inside;
+    return COHERENT_INSIDE;
+  }
+  distance = 0;
+  return COHERENT_BOUNDARY;
+}
+
+bool Renderer::FrustumCuller::isClipped(size_t idx) const
+{
+  for(uint32_t p = 0; p < m_numClipPlanes; p++)
+  {
+    // the corner furthest along the normal is cut away as well
+    const glm::vec4& plane = m_clipPlanes[p];
+    int              x     = plane.x > 0 ? BOUNDS_MAXX : BOUNDS_MINX;
+    int              y     = plane.y > 0 ? BOUNDS_MAXY : BOUNDS_MINY;
+    int              z     = plane.z > 0 ? BOUNDS_MAXZ : BOUNDS_MINZ;
+    if(m_bounds[x][idx] * plane.x + m_bounds[y][idx] * plane.y + m_bounds[z][idx] * plane.z + plane.w < 0)
+      return true;
+  }
+  return false;
+}
+
+bool Renderer::FrustumCuller::isSmall(size_t idx) const
+{
+  // the corners are sums of one scaled column per axis
+  const glm::mat4& matrix      = m_viewProjMatrix;
+  glm::vec4        columnsX[2] = {matrix[0] * m_bounds[BOUNDS_MINX][idx], matrix[0] * m_bounds[BOUNDS_MAXX][idx]};
+  glm::vec4        columnsY[2] = {matrix[1] * m_bounds[BOUNDS_MINY][idx], matrix[1] * m_bounds[BOUNDS_MAXY][idx]};
+  glm::vec4        columnsZ[2] = {matrix[2] * m_bounds[BOUNDS_MINZ][idx] + matrix[3],
+                                  matrix[2] * m_bounds[BOUNDS_MAXZ][idx] + matrix[3]};
+
+  glm::vec2 rectMin = glm::vec2(FLT_MAX);
+  glm::vec2 rectMax = glm::vec2(-FLT_MAX);
+  for(int c = 0; c < 8; c++)
+  {
+    glm::vec4 clip = columnsX[c & 1] + columnsY[(c >> 1) & 1] + columnsZ[(c >> 2) & 1];
+    // reaches behind the eye, can be any size
+    if(clip.w <= 0)
+      return false;
+
+    glm::vec2 pos = glm::vec2(clip.x, clip.y) / clip.w;
+    rectMin       = glm::min(rectMin, pos);
+    rectMax       = glm::max(rectMax, pos);
+  }
+
+  glm::vec2 size = (rectMax - rectMin) * m_pixelScale;
+  return std::max(size.x, size.y) < m_minPixels;
+}
+
+Renderer::ShadeDrawItems Renderer::FrustumCuller::cull(const ShadeDrawItems& list,
+                                                       const uint32_t*       indices,
+                                                       size_t                begin,
+                                                       size_t                num,
+                                                       ThreadOutput&         output) const
+{
+  double timeBegin = NVPSystem::getTime();
+
+  if(output.items.size() < num)
+  {
+    output.items.resize(num);
+    output.binds.resize(num);
+  }
+
+  const DrawItem* NV_RESTRICT items    = list.items + begin;
+  const uint8_t* NV_RESTRICT  binds    = list.binds + begin;
+  DrawItem* NV_RESTRICT       outItems = output.items.data();
+  uint8_t* NV_RESTRICT        outBinds = output.binds.data();
+
+  size_t  numOut      = 0;
+  size_t  numOccluded = 0;
+  size_t  numSmall    = 0;
+  size_t  numClipped  = 0;
+  uint8_t carried     = 0;
+
+  // without branches, culled drawitems are overwritten by the next one. The next visible
+  // drawitem has to bind what the culled ones would have
+  auto emit = [&](size_t i, bool visible) {
+    if(m_numClipPlanes && visible)
+    {
+      visible = !isClipped(indices ? indices[begin + i] : begin + i);
+      numClipped += visible ? 0 : 1;
+    }
+    if(m_minPixels > 0 && visible)
+    {
+      visible = !isSmall(indices ? indices[begin + i] : begin + i);
+      numSmall += visible ? 0 : 1;
+    }
+    if(m_occlusion && visible)
+    {
+      size_t    idx = indices ? indices[begin + i] : begin + i;
+      glm::vec3 min = glm::vec3(m_bounds[BOUNDS_MINX][idx], m_bounds[BOUNDS_MINY][idx], m_bounds[BOUNDS_MINZ][idx]);
+      glm::vec3 max = glm::vec3(m_bounds[BOUNDS_MAXX][idx], m_bounds[BOUNDS_MAXY][idx], m_bounds[BOUNDS_MAXZ][idx]);
+      visible       = m_occlusion->testBounds(min, max);
+      numOccluded += visible ? 0 : 1;
+    }
+
+    uint8_t bind     = binds[i] | carried;
+    outItems[numOut] = items[i];
+    outBinds[numOut] = bind;
+    carried          = bind & uint8_t(uint8_t(visible) - 1);
+    numOut += size_t(visible);
+  };
+
+  // the corner furthest along each plane normal decides
+  int maxX[6];
+  int maxY[6];
+  int maxZ[6];
+  for(int p = 0; p < 6; p++)
+  {
+    maxX[p] = m_planes[p].x > 0 ? BOUNDS_MAXX : BOUNDS_MINX;
+    maxY[p] = m_planes[p].y > 0 ? BOUNDS_MAXY : BOUNDS_MINY;
+    maxZ[p] = m_planes[p].z > 0 ? BOUNDS_MAXZ : BOUNDS_MINZ;
+  }
+
+  size_t i = 0;
+  if(m_coherentBudget)
+  {
+    // the chunk's share of the budget, boundary drawitems don't count
+    size_t budget      = (num * m_coherentBudget + m_shade.num - 1) / std::max(m_shade.num, size_t(1));
+    size_t numCoherent = 0;
+    for(; i < num; i++)
+    {
+      size_t  idx     = indices ? indices[begin + i] : begin + i;
+      uint8_t state   = m_coherentStates[idx];
+      double  moved   = m_coherentTurn * double(m_boundsReach[idx]) + m_coherentShift;
+      bool    visible = true;
+      if(state != COHERENT_BOUNDARY && moved < m_coherentUntil[idx])
+      {
+        visible = state == COHERENT_INSIDE;
+        numCoherent++;
+      }
+      else if(state == COHERENT_BOUNDARY || budget)
+      {
+        budget -= state == COHERENT_BOUNDARY ? 0 : 1;
+
+        float distance;
+        state                 = classify(idx, distance);
+        m_coherentStates[idx] = state;
+        m_coherentUntil[idx]  = moved + double(distance);
+        visible               = state != COHERENT_OUTSIDE;
+      }
+      // expired ones beyond the budget stay visible until a later frame tests them
+      emit(i, visible);
+    }
+    output.numCoherent += numCoherent;
+  }
+
+#if USE_SSE_CULLING
+  __m128 planes[6][4];
+  for(int p = 0; p < 6; p++)
+  {
+    for(int c = 0; c < 4; c++)
+    {
+      planes[p][c] = _mm_set1_ps(m_planes[p][c]);
+    }
+  }
+
+  for(; i + 4 <= num; i += 4)
+  {
+    __m128 bounds[NUM_BOUNDS];
+    if(indices)
+    {
+      const uint32_t* idx = indices + begin + i;
+      for(int c = 0; c < NUM_BOUNDS; c++)
+      {
+        const float* comp = m_bounds[c].data();
+        bounds[c]         = _mm_setr_ps(comp[idx[0]], comp[idx[1]], comp[idx[2]], comp[idx[3]]);
+      }
+    }
+    else
+    {
+      for(int c = 0; c < NUM_BOUNDS; c++)
+      {
+        bounds[c] = _mm_loadu_ps(m_bounds[c].data() + begin + i);
+      }
+    }
+
+    __m128 outside = _mm_setzero_ps();
+    for(int p = 0; p < 6; p++)
+    {
+      __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bounds[maxX[p]], planes[p][0]), _mm_mul_ps(bounds[maxY[p]], planes[p][1])),
+                               _mm_add_ps(_mm_mul_ps(bounds[maxZ[p]], planes[p][2]), planes[p][3]));
+      outside     = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+    }
+
+    int mask = _mm_movemask_ps(outside);
+    for(int k = 0; k < 4; k++)
+    {
+      emit(i + k, !(mask & (1 << k)));
+    }
+  }
+#endif
+
+  for(; i < num; i++)
+  {
+    size_t idx     = indices ? indices[begin + i] : begin + i;
+    bool   outside = false;
+    for(int p = 0; p < 6; p++)
+    {
+      const glm::vec4& plane = m_planes[p];
+      float dist = m_bounds[maxX[p]][idx] * plane.x + m_bounds[maxY[p]][idx] * plane.y + m_bounds[maxZ[p]][idx] * plane.z + plane.w;
+      outside = outside || dist < 0;
+    }
+    emit(i, !outside);
+  }
+
+  output.numTested += num;
+  output.numCulled += num - numOut;
+  output.numOccluded += numOccluded;
+  output.numSmall += numSmall;
+  output.numClipped += numClipped;
+  output.time += NVPSystem::getTime() - timeBegin;
+
+  ShadeDrawItems visible;
+  visible.items   = outItems;
+  visible.binds   = outBinds;
+  visible.objects = nullptr;
+  visible.num     = numOut;
+  return visible;
 }
 
-ThreadPool Renderer::s_threadpool;
+ThreadPool             Renderer::s_threadpool;
+Renderer::DrawListCache Renderer::s_drawLists;
 }  // namespace csfthreaded
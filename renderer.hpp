@@ -33,6 +33,8 @@
 
 #include "threadpool.hpp"
 
+#include <memory>
+
 
 // disable state filtering for buffer binds
 #define USE_NOFILTER 0
@@ -46,6 +48,17 @@ enum Strategy
   STRATEGY_GROUPS,      // sorted and combined parts by material
   STRATEGY_INDIVIDUAL,  // keep all parts individual
   STRATEGY_JOIN,        // combine drawcalls if same material and next to each other
+  STRATEGY_INSTANCED,   // like join, then identical ranges across objects become one instanced drawcall
+  STRATEGY_MERGED,      // like join, then touching ranges across objects are combined (contiguous geometry)
+};
+
+// per-frame drawitem order of the threaded renderers, coarse front to back
+enum FrontToBack
+{
+  FRONTTOBACK_OFF,
+  FRONTTOBACK_DRAWITEMS,  // all drawitems by view depth
+  FRONTTOBACK_MATERIALS,  // by view depth within runs of the same material, keeps the state changes
+  NUM_FRONTTOBACK,
 };
 
 const char* toString(enum ShadeType st);
@@ -55,34 +68,352 @@ class Renderer
 public:
   struct Config
   {
-    Strategy strategy;
-    uint32_t objectFrom;
-    uint32_t objectNum;
-    bool     sorted;
-    int      threads;
+    Strategy    strategy;
+    uint32_t    objectFrom;
+    uint32_t    objectNum;
+    bool        sorted;
+    bool        optimized;  // with sorted, order by stateCost rather than DrawItem_compare_groups
+    int         threads;
+    StateCost   stateCost;
+    FrontToBack frontToBack;   // per frame, only if supportsFrontToBack
+    bool        translucency;  // sorted translucent pass after the opaque one, only if supportsTranslucency
   };
 
+  // packed into 16 bytes, so workers can stream through them quickly
   struct DrawItem
   {
-    bool                solid;
-    int                 materialIndex;
-    int                 geometryIndex;
-    int                 matrixIndex;
-    int                 objectIndex;
-    CadScene::DrawRange range;
+    uint32_t firstIndex;
+    uint32_t count;
+    uint64_t solid : 1;
+    uint64_t materialIndex : 15;
+    uint64_t geometryIndex : 24;
+    uint64_t matrixIndex : 24;
+  };
+
+  // STRATEGY_INSTANCED: DrawItem::matrixIndex refers to an InstanceGroup,
+  // the instances fetch their matrix index from DrawList::instanceMatrices
+  struct InstanceGroup
+  {
+    uint32_t firstInstance;
+    uint32_t numInstances;
+  };
+
+  // state a drawitem has to bind, relative to the drawitem recorded before it
+  enum DrawBindBits
+  {
+    DRAWBIND_PIPELINE = 1,  // solid <-> wire
+    DRAWBIND_GEOMETRY = 2,
+    DRAWBIND_MATERIAL = 4,
+    DRAWBIND_MATRIX   = 8,
+    DRAWBIND_ALL      = 15,
   };
 
+  struct ShadeDrawItems
+  {
+    const DrawItem* items;
+    const uint8_t*  binds;    // DrawBindBits per item
+    const uint32_t* objects;  // ascending object per item, only with DrawList::objectOrdered
+    size_t          num;
+  };
+
+  static const uint32_t DRAWITEM_MAX_MATERIALS  = 1 << 15;
+  static const uint32_t DRAWITEM_MAX_GEOMETRIES = 1 << 24;
+  static const uint32_t DRAWITEM_MAX_MATRICES   = 1 << 24;
+
   static inline bool DrawItem_compare_groups(const DrawItem& a, const DrawItem& b)
   {
-    int diff = 0;
-    diff     = diff != 0 ? diff : (a.solid == b.solid ? 0 : (a.solid ? -1 : 1));
-    diff     = diff != 0 ? diff : (a.materialIndex - b.materialIndex);
-    diff     = diff != 0 ? diff : (a.geometryIndex - b.geometryIndex);
-    diff     = diff != 0 ? diff : (a.matrixIndex - b.matrixIndex);
+    if(a.solid != b.solid)
+      return a.solid;
+    if(a.materialIndex != b.materialIndex)
+      return a.materialIndex < b.materialIndex;
+    if(a.geometryIndex != b.geometryIndex)
+      return a.geometryIndex < b.geometryIndex;
 
-    return diff < 0;
+    return a.matrixIndex < b.matrixIndex;
   }
 
+  // ascending key order matches DrawItem_compare_groups
+  static inline uint64_t DrawItem_sortKey(const DrawItem& di)
+  {
+    return (uint64_t(di.solid ? 0 : 1) << 63) | (uint64_t(di.materialIndex) << 48) | (uint64_t(di.geometryIndex) << 24)
+           | uint64_t(di.matrixIndex);
+  }
+
+  // stable parallel LSD radix sort on s_threadpool, same order as
+  // std::stable_sort with DrawItem_compare_groups
+  static void sortDrawItems(std::vector<DrawItem>& drawItems);
+  // compares std::sort against sortDrawItems at 1M, 10M and 50M items
+  static void benchmarkSortDrawItems();
+  // back to front DepthSorter over 1K to 1M drawitems of the scene's objects, for 1 to all threads
+  static void benchmarkDepthSort(const CadScene* NV_RESTRICT scene);
+  // FrustumCuller along an orbit and a fly-through of the scene, with and without temporal coherence
+  static void benchmarkCulling(const CadScene* NV_RESTRICT scene);
+
+  // predicted cost of submitting drawItems in this order, state changes are
+  // counted like the redundancy filters of the renderers do
+  static double computeStateCost(const std::vector<DrawItem>& drawItems, const StateCost& cost);
+  // reorders drawItems to lower computeStateCost. Greedy clustering sorts by every
+  // priority of material, geometry and matrix and keeps the cheapest, local search then
+  // flips and swaps neighbouring clusters. Solid items stay in front like in sortDrawItems.
+  static void optimizeDrawItems(std::vector<DrawItem>& drawItems, const StateCost& cost);
+
+  // DrawBindBits of every drawitem compared to its predecessor, the first one binds everything.
+  // solidOnly skips wire items (left 0), like SHADE_SOLID does when walking the entire list.
+  // recording loops test these bits instead of tracking the last state themselves,
+  // they only have to force DRAWBIND_ALL where they start a new command buffer.
+  static void annotateDrawBinds(std::vector<uint8_t>& binds, const DrawItem* drawItems, size_t num, bool solidOnly);
+
+  // drawitems after fill, order, merge and peephole for one configuration.
+  // Immutable once built, renderers borrow it from s_drawLists, so switching
+  // between renderers with the same settings (e.g. GL and Vulkan) skips the rebuild.
+  struct DrawList
+  {
+    std::vector<DrawItem>      drawItems;
+    std::vector<uint32_t>      drawObjects;  // only perObject or objectOrdered
+    std::vector<InstanceGroup> instanceGroups;
+    std::vector<uint32_t>      instanceMatrices;
+    double                     orderCostFixed = 0;
+    double                     orderCost      = 0;
+    bool                       objectOrdered  = false;  // all objects in fill order, cut per frame
+
+    // translucent parts, one solid drawitem each in object order. Never sorted or merged
+    // across objects, as they are ordered by view depth every frame
+    std::vector<DrawItem> translucentItems;
+    std::vector<uint32_t> translucentObjects;  // ascending object per item
+
+    size_t getMemoryUsage() const;
+  };
+
+  // contiguous drawitems per ShadeType, so workers never get items they would skip.
+  // SHADE_SOLIDWIRE uses all drawitems, SHADE_SOLID the solid front of a sorted list
+  // or otherwise a compacted copy stored in solidItems and solidObjects. binds stores the annotations.
+  static void partitionShadeDrawItems(ShadeDrawItems         shades[NUM_SHADES],
+                                      std::vector<DrawItem>& solidItems,
+                                      std::vector<uint32_t>& solidObjects,
+                                      std::vector<uint8_t>   binds[NUM_SHADES],
+                                      const DrawList&        drawList,
+                                      bool                   sorted);
+
+  // number of leading drawitems that belong to objects below visibleObjects,
+  // binary search over the ascending objects. Without objects all num are visible
+  static size_t findObjectCutoff(const uint32_t* objects, size_t num, uint32_t visibleObjects);
+
+  struct DrawListKey
+  {
+    Strategy         strategy;
+    uint32_t         objectFrom;
+    uint32_t         objectNum;
+    bool             sorted;
+    bool             optimized;
+    bool             perObject;
+    StateCost        stateCost;  // only used with optimized
+    const Resources* placement;  // chunk layouts differ per api, only set with contiguous geometry
+
+    bool operator==(const DrawListKey& other) const;
+  };
+
+  class DrawListCache
+  {
+  public:
+    // disabled every renderer builds its own list
+    bool m_enabled = true;
+
+    // nullptr if not cached, a new sceneVersion drops all entries
+    std::shared_ptr<const DrawList> find(const DrawListKey& key, uint32_t sceneVersion);
+    void add(const DrawListKey& key, uint32_t sceneVersion, const std::shared_ptr<const DrawList>& list);
+    void clear();
+
+    void appendMemoryStats(MemoryStats& stats) const;
+
+  private:
+    struct Entry
+    {
+      DrawListKey                     key;
+      std::shared_ptr<const DrawList> list;
+    };
+
+    // least recently used first
+    std::vector<Entry> m_entries;
+    uint32_t           m_sceneVersion = 0;
+  };
+
+  // coarse per-frame depth order of one ShadeDrawItems list, parallel bucket sort over
+  // the view depth of every drawitem's bbox center. begin is called by the main thread,
+  // then every thread of the threaded renderer runs sortThread before it takes chunks.
+  class DepthSorter
+  {
+  public:
+    // resources give the geometry placement of merged drawitems, may be nullptr
+    void init(const CadScene* NV_RESTRICT scene,
+              const DrawList*             drawList,
+              const Resources*            resources,
+              const ShadeDrawItems&       shade);
+    void deinit();
+
+    // returns the list the threads fill, keepMaterials only reorders within material runs
+    const ShadeDrawItems& begin(const glm::mat4& viewMatrix, size_t num, uint32_t numThreads, bool keepMaterials,
+                                bool backToFront = false);
+    void                  sortThread(uint32_t tid);
+
+    // drawitem of the list given to init for every sorted one, valid after sortThread
+    const uint32_t* getIndices() const { return m_indices.data(); }
+
+    size_t getMemoryUsage() const;
+
+    // cpu time of the last sort in milliseconds
+    double m_sortTime = 0;
+
+  private:
+    static const uint32_t BUCKETS = 256;
+
+    const CadScene* NV_RESTRICT m_scene     = nullptr;
+    const DrawList*             m_drawList  = nullptr;
+    const Resources*            m_resources = nullptr;
+    ShadeDrawItems              m_shade;
+    ShadeDrawItems              m_sorted;
+
+    std::vector<glm::vec3> m_centers;  // world space, filled at first use
+    std::vector<uint32_t>  m_runs;     // first drawitem of every material run, plus the end
+    std::vector<DrawItem>  m_items;
+    std::vector<uint8_t>   m_binds;
+    std::vector<uint32_t>  m_indices;
+    std::vector<uint8_t>   m_keys;
+    std::vector<size_t>    m_histograms;  // [thread][bucket]
+
+    glm::vec4 m_depthPlane;
+    float     m_depthMin;
+    float     m_depthScale;
+    size_t    m_num;
+    uint32_t  m_numThreads;
+    bool      m_keepMaterials;
+    double    m_timeBegin;
+
+    std::mutex              m_barrierMutex;
+    std::condition_variable m_barrierCond;
+    uint32_t                m_barrierCount      = 0;
+    uint32_t                m_barrierGeneration = 0;
+
+    void     barrier();
+    void     updateCenters();
+    uint32_t getKey(size_t i) const;
+    void     sortRun(size_t begin, size_t end, size_t* histogram);
+  };
+
+  // view frustum test of the drawitems of one ShadeDrawItems list. World space bounds are kept
+  // per drawitem as separate min/max arrays, so four drawitems are tested against a plane at once.
+  // begin is called by the main thread, the workers cull every chunk before they record it.
+  //
+  // With a coherence budget every drawitem remembers whether it was inside, outside or on the
+  // boundary of the frustum, and how far its bounds were from the planes. begin sums up how much
+  // the planes turned and moved at the scene center, results stay valid until the movement this
+  // allows at the drawitem's distance from the center exceeds the distance to the planes.
+  // Boundary drawitems are tested every frame, the expired ones share the budget, the remainder
+  // is drawn untested until a later frame gets to it.
+  class FrustumCuller
+  {
+  public:
+    // per thread, the visible drawitems of the last chunk and the counts of the frame
+    struct ThreadOutput
+    {
+      std::vector<DrawItem> items;
+      std::vector<uint8_t>  binds;
+      size_t                numTested   = 0;
+      size_t                numCulled   = 0;
+      size_t                numOccluded = 0;  // part of numCulled
+      size_t                numSmall    = 0;  // part of numCulled
+      size_t                numClipped  = 0;  // part of numCulled
+      size_t                numCoherent = 0;  // part of numTested, decided by their history alone
+      double                time        = 0;
+
+      void resetFrame()
+      {
+        numTested   = 0;
+        numCulled   = 0;
+        numOccluded = 0;
+        numSmall    = 0;
+        numClipped  = 0;
+        numCoherent = 0;
+        time        = 0;
+      }
+    };
+
+    // resources provides the geometry placement, drawitems merged within a chunk get the bounds of all its geometries.
+    // nullptr if the drawitems are never merged
+    void init(const CadScene* NV_RESTRICT scene,
+              const DrawList*             drawList,
+              const Resources*            resources,
+              const ShadeDrawItems&       shade);
+    void deinit();
+
+    // bounds use the cpu matrices, so culling must be off while the gpu animates them.
+    // drawitems within the frustum are dropped if they are entirely on the cut away side of one of
+    // the SceneData::wClipPlanes in clipPlanes, or if their projected bounds are below minPixels
+    // of viewport in width and height, the rest is tested against occlusion unless it is nullptr.
+    // coherentBudget is the number of frustum tests per frame for drawitems off the boundary,
+    // 0 tests all of them without keeping a history
+    void begin(const glm::mat4&       viewProjMatrix,
+               const OcclusionBuffer* occlusion      = nullptr,
+               float                  minPixels      = 0,
+               const glm::vec2&       viewport       = glm::vec2(0),
+               size_t                 coherentBudget = 0,
+               const glm::vec4*       clipPlanes     = nullptr,
+               uint32_t               numClipPlanes  = 0);
+    // visible drawitems of list [begin, begin + num), the binds of culled drawitems are carried over to the next
+    // visible one. indices maps list to the one given to init, e.g. DepthSorter::getIndices, nullptr if it is the same
+    ShadeDrawItems cull(const ShadeDrawItems& list, const uint32_t* indices, size_t begin, size_t num, ThreadOutput& output) const;
+
+    size_t getMemoryUsage() const;
+
+  private:
+    enum BoundsComponent
+    {
+      BOUNDS_MINX,
+      BOUNDS_MINY,
+      BOUNDS_MINZ,
+      BOUNDS_MAXX,
+      BOUNDS_MAXY,
+      BOUNDS_MAXZ,
+      NUM_BOUNDS,
+    };
+
+    enum CoherentState : uint8_t
+    {
+      COHERENT_UNKNOWN,
+      COHERENT_INSIDE,
+      COHERENT_OUTSIDE,
+      COHERENT_BOUNDARY,
+    };
+
+    const CadScene* NV_RESTRICT m_scene     = nullptr;
+    const DrawList*             m_drawList  = nullptr;
+    const Resources*            m_resources = nullptr;
+    ShadeDrawItems              m_shade;
+
+    std::vector<float>     m_bounds[NUM_BOUNDS];  // world space, filled at first use
+    std::vector<float>     m_boundsReach;         // furthest corner from m_boundsCenter
+    glm::vec3              m_boundsCenter;
+    glm::vec4              m_planes[6];  // normalized, inside if dot(plane, pos) >= 0
+    glm::mat4              m_viewProjMatrix;
+    const OcclusionBuffer* m_occlusion = nullptr;
+    float                  m_minPixels = 0;
+    glm::vec2              m_pixelScale;  // ndc to pixels
+    glm::vec4              m_clipPlanes[MAX_CLIPPLANES];
+    uint32_t               m_numClipPlanes = 0;
+
+    // per drawitem of init, each one is only written by the thread that culls its chunk
+    mutable std::vector<uint8_t> m_coherentStates;
+    mutable std::vector<double>  m_coherentUntil;  // movement at the drawitem up to which the state holds
+    // summed over the frames, the change of the plane normals and of the plane distances at m_boundsCenter
+    double m_coherentTurn   = 0;
+    double m_coherentShift  = 0;
+    size_t m_coherentBudget = 0;
+
+    void          updateBounds();
+    bool          isSmall(size_t idx) const;
+    bool          isClipped(size_t idx) const;
+    CoherentState classify(size_t idx, float& distance) const;
+  };
+
   class Type
   {
   public:
@@ -93,6 +424,8 @@ public:
     virtual const char*  name() const        = 0;
     virtual Renderer*    create() const      = 0;
     virtual unsigned int priority() const { return 0xFF; }
+    // default weights for Config::stateCost
+    virtual StateCost    stateCost() const { return {8.0f, 2.0f, 1.0f, 1.0f, 1.0f}; }
 
     virtual Resources* resources() = 0;
   };
@@ -105,19 +438,92 @@ public:
     return s_registry;
   }
 
-  static ThreadPool s_threadpool;
+  static ThreadPool    s_threadpool;
+  static DrawListCache s_drawLists;
 
 public:
   virtual void init(const CadScene* NV_RESTRICT scene, Resources* resources, const Config& config) {}
   virtual void deinit() {}
   virtual void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global) {}
 
+  virtual void appendMemoryStats(MemoryStats& stats) const {}
+
   virtual ~Renderer() {}
 
-  void fillDrawItems(std::vector<DrawItem>& drawItems, const Config& config, bool solid, bool wire);
+  // optional drawObjects receives the object index of every drawitem
+  void fillDrawItems(std::vector<DrawItem>& drawItems, const Config& config, bool solid, bool wire, std::vector<uint32_t>* drawObjects = nullptr);
+  // merges drawitems that only differ in matrix into m_instanceGroups
+  void buildInstanceGroups(std::vector<DrawItem>& drawItems, std::vector<uint32_t>* drawObjects);
+  // call after sorting. With Resources::m_contiguousGeometry ranges are moved into their chunk's index space,
+  // STRATEGY_MERGED then combines consecutive drawitems with equal state whose ranges touch.
+  // optional drawObjects prevents merging across objects.
+  void mergeDrawItems(std::vector<DrawItem>& drawItems, const Resources* resources, std::vector<uint32_t>* drawObjects = nullptr);
+  // sortDrawItems, or optimizeDrawItems with Config::optimized. Fills the predicted costs
+  void orderDrawItems(std::vector<DrawItem>& drawItems);
+  // one drawitem per translucent part of the objects in config, appends instance groups with STRATEGY_INSTANCED.
+  // Ranges are moved into the chunk index space with Resources::m_contiguousGeometry
+  void fillTranslucentDrawItems(std::vector<DrawItem>& drawItems, std::vector<uint32_t>& drawObjects, const Config& config, const Resources* resources);
+  // last pass before recording: drops empty drawitems and merges neighbours with equal state
+  // whose index ranges touch. drawObjects is compacted alongside and prevents merging across objects
+  void peepholeDrawItems(std::vector<DrawItem>& drawItems, std::vector<uint32_t>* drawObjects = nullptr);
+  // sets m_config and m_drawList, borrowed from s_drawLists or built with the passes above.
+  // perObject keeps the fill order and the object of every drawitem
+  void acquireDrawList(const Resources* resources, const Config& config, bool perObject = false);
+  // m_drawList counts as drawitems unless the cache owns it
+  void appendDrawListMemoryStats(MemoryStats& stats) const;
+
+  // the renderer follows Config::frontToBack and fills m_depthSortTime
+  virtual bool supportsFrontToBack() const { return false; }
+  // the renderer follows Config::translucency and fills m_translucentSortTime
+  virtual bool supportsTranslucency() const { return false; }
+  // the renderer follows Resources::Global::frustumCulling and fills the m_cull counters
+  virtual bool supportsFrustumCulling() const { return false; }
+  // the renderer draws Resources::Global::numShadowViews and fills the m_shadow counters
+  virtual bool supportsShadowViews() const { return false; }
+
+  // the renderer follows Resources::Global::visibleObjects without init
+  bool hasObjectCutoff() const { return m_drawList && m_drawList->objectOrdered; }
+  // visible part of m_drawList->drawItems
+  size_t getDrawItemCutoff(uint32_t visibleObjects) const;
 
   Config          m_config;
   const CadScene* NV_RESTRICT m_scene;
+
+  std::shared_ptr<const DrawList> m_drawList;
+  bool                            m_drawListShared = false;
+
+  // computeStateCost of the sorted drawitems, for the fixed priority and the order in use
+  double m_orderCostFixed = 0;
+  double m_orderCost      = 0;
+  // cpu milliseconds of the last per-frame depth sort
+  double m_depthSortTime = 0;
+  // cpu milliseconds of the last back to front sort and the translucent drawitems it drew
+  double m_translucentSortTime = 0;
+  size_t m_numTranslucentDrawn = 0;
+  // frustum culling of the last frame, cpu milliseconds are summed over all threads
+  size_t m_cullTested = 0;
+  size_t m_cullCulled = 0;
+  double m_cullTime   = 0;
+  // occlusion culling of the last frame, the drawitems are part of m_cullCulled
+  size_t m_cullOccluded  = 0;
+  double m_occlusionTime = 0;
+  // drawitems below the minimum pixel size in the last frame, also part of m_cullCulled,
+  // and the cpu milliseconds recording them would have taken at the frame's average
+  size_t m_cullSmall      = 0;
+  double m_cullSmallSaved = 0;
+  // drawitems within the frustum but cut away by the clipping planes in the last frame, part of m_cullCulled
+  size_t m_cullClipped = 0;
+  // drawitems of m_cullTested whose frustum test was skipped by temporal coherence
+  size_t m_cullCoherent = 0;
+  // shadow views of the last frame, the drawitems recorded for them and the cpu milliseconds
+  // of culling and recording, summed over all threads
+  uint32_t m_shadowViews = 0;
+  size_t   m_shadowDrawn = 0;
+  double   m_shadowTime  = 0;
+
+  // filled by fillDrawItems, moved into the DrawList afterwards
+  std::vector<InstanceGroup> m_instanceGroups;
+  std::vector<uint32_t>      m_instanceMatrices;
 };
 }  // namespace csfthreaded
 
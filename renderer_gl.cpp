@@ -49,6 +49,7 @@ public:
     Resources* resources() { return ResourcesGL::get(); }
 
     unsigned int priority() const { return 0; }
+    StateCost    stateCost() const { return {10.0f, 3.0f, 1.0f, 1.0f, 1.0f}; }
   };
   class TypeVbum : public Renderer::Type
   {
@@ -61,6 +62,8 @@ public:
       return renderer;
     }
     unsigned int priority() const { return 0; }
+    // address updates are cheaper than binds
+    StateCost stateCost() const { return {10.0f, 1.5f, 0.5f, 0.5f, 1.0f}; }
 
     Resources* resources() { return ResourcesGL::get(); }
   };
@@ -70,6 +73,12 @@ public:
   void deinit();
   void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global);
 
+  void appendMemoryStats(MemoryStats& stats) const
+  {
+    appendDrawListMemoryStats(stats);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawBinds[SHADE_SOLID].capacity() + m_drawBinds[SHADE_SOLIDWIRE].capacity();
+  }
+
   bool m_vbum;
   bool m_bindless_ubo;
 
@@ -80,11 +89,18 @@ public:
   }
 
 private:
-  std::vector<DrawItem> m_drawItems;
+  std::vector<uint8_t> m_drawBinds[NUM_SHADES];
 
   void SetWireMode(bool state, const ResourcesGL* res, ShadeType shadeType)
   {
-    glUseProgram(state ? res->m_programs.draw_line : res->m_programs.draw_solid);
+    if(m_config.strategy == STRATEGY_INSTANCED)
+    {
+      glUseProgram(state ? res->m_programs.draw_line_instanced : res->m_programs.draw_solid_instanced);
+    }
+    else
+    {
+      glUseProgram(state ? res->m_programs.draw_line : res->m_programs.draw_solid);
+    }
   }
 };
 
@@ -96,15 +112,21 @@ void RendererGL::init(const CadScene* NV_RESTRICT scene, Resources* resources, c
   m_scene        = scene;
   m_bindless_ubo = ((ResourcesGL*)resources)->m_bindless_ubo;
 
-  fillDrawItems(m_drawItems, config, true, true);
+  acquireDrawList(resources, config);
 
-  if(config.sorted)
+  const std::vector<DrawItem>& drawItems = m_drawList->drawItems;
+  for(int i = 0; i < NUM_SHADES; i++)
   {
-    std::sort(m_drawItems.begin(), m_drawItems.end(), DrawItem_compare_groups);
+    annotateDrawBinds(m_drawBinds[i], drawItems.data(), drawItems.size(), i == SHADE_SOLID);
   }
+
+  ((ResourcesGL*)resources)->initInstances(m_drawList->instanceMatrices);
 }
 
-void RendererGL::deinit() {}
+void RendererGL::deinit()
+{
+  ResourcesGL::get()->deinitInstances();
+}
 
 void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global)
 {
@@ -113,7 +135,8 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
 
   const nvgl::ProfilerGL::Section profile(res->m_profilerGL, "Render");
 
-  bool vbum = m_vbum;
+  bool vbum      = m_vbum;
+  bool instanced = m_config.strategy == STRATEGY_INSTANCED;
 
   // generic state setup
   glViewport(0, 0, global.winWidth, global.winHeight);
@@ -131,6 +154,7 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
   glNamedBufferSubData(res->m_common.view.buffer, 0, sizeof(SceneData), &global.sceneUbo);
 
   res->enableVertexFormat();
+  res->enableClipDistances();
 
   if(shadetype == SHADE_SOLIDWIRE)
   {
@@ -144,6 +168,7 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
     glEnableClientState(GL_ELEMENT_ARRAY_UNIFIED_NV);
 
     glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0, 0, 0);
+    glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 1, 0, 0);
     glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV, 0, 0, 0);
 
     if(m_bindless_ubo)
@@ -164,11 +189,27 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
     glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_UBO_SCENE, res->m_common.view.buffer);
   }
 
+  if(instanced)
+  {
+    // all matrices as storage buffer, the index comes per instance
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, sceneGL.m_buffers.matrices.buffer);
+    if(vbum)
+    {
+      glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 2, res->m_instances.instances.bufferADDR,
+                             res->m_instances.instances.size);
+    }
+    else
+    {
+      glBindVertexBuffer(2, res->m_instances.instances.buffer, 0, sizeof(uint32_t));
+    }
+  }
+
   {
-    int  lastMaterial = -1;
-    int  lastGeometry = -1;
-    int  lastMatrix   = -1;
-    bool lastSolid    = true;
+    const DrawItem* NV_RESTRICT drawItems = m_drawList->drawItems.data();
+    const uint8_t* NV_RESTRICT  binds     = m_drawBinds[shadetype].data();
+    size_t                      numItems  = getDrawItemCutoff(global.visibleObjects);
+
+    bool lastSolid = true;
 
     int statsGeometry = 0;
     int statsMatrix   = 0;
@@ -178,9 +219,9 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
 
     GLenum mode = GL_TRIANGLES;
 
-    for(int i = 0; i < m_drawItems.size(); i++)
+    for(size_t i = 0; i < numItems; i++)
     {
-      const DrawItem& di = m_drawItems[i];
+      const DrawItem& di = drawItems[i];
 
       if(shadetype == SHADE_SOLID && !di.solid)
       {
@@ -198,25 +239,33 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
       const CadSceneGL::Geometry& geo = sceneGL.m_geometry[di.geometryIndex];
       size_t iboOffset = vbum ? 0 : geo.ibo.offset;
 
-      if(lastGeometry != di.geometryIndex)
+      uint32_t bind = binds[i];
+
+      if(bind & DRAWBIND_GEOMETRY)
       {
         if(vbum)
         {
           glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0, geo.vbo.bufferADDR, geo.vbo.size);
+          if(shadetype == SHADE_SOLIDWIRE)
+          {
+            glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 1, geo.vboPos.bufferADDR, geo.vboPos.size);
+          }
           glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV, 0, geo.ibo.bufferADDR, geo.ibo.size);
         }
         else
         {
           glBindVertexBuffer(0, geo.vbo.buffer, geo.vbo.offset, sizeof(CadScene::Vertex));
+          if(shadetype == SHADE_SOLIDWIRE)
+          {
+            glBindVertexBuffer(1, geo.vboPos.buffer, geo.vboPos.offset, sceneGL.getPositionStride());
+          }
           glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.ibo.buffer);
         }
 
-        lastGeometry = di.geometryIndex;
-
         statsGeometry++;
       }
 
-      if(lastMatrix != di.matrixIndex)
+      if(!instanced && (bind & DRAWBIND_MATRIX))
       {
 
         if(vbum && m_bindless_ubo)
@@ -231,12 +280,10 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
                             res->m_alignedMatrixSize * di.matrixIndex, sizeof(CadScene::MatrixNode));
         }
 
-        lastMatrix = di.matrixIndex;
-
         statsMatrix++;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
 
         if(m_vbum && m_bindless_ubo)
@@ -251,12 +298,20 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
                             res->m_alignedMaterialSize * di.materialIndex, sizeof(CadScene::Material));
         }
 
-        lastMaterial = di.materialIndex;
-
         statsMaterial++;
       }
 
-      glDrawElements(di.solid ? GL_TRIANGLES : GL_LINES, di.range.count, GL_UNSIGNED_INT, (void*)(di.range.offset + iboOffset));
+      if(instanced)
+      {
+        const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+        glDrawElementsInstancedBaseInstance(di.solid ? GL_TRIANGLES : GL_LINES, di.count, GL_UNSIGNED_INT,
+                                            (void*)(di.firstIndex * sizeof(GLuint) + iboOffset), group.numInstances,
+                                            group.firstInstance);
+      }
+      else
+      {
+        glDrawElements(di.solid ? GL_TRIANGLES : GL_LINES, di.count, GL_UNSIGNED_INT, (void*)(di.firstIndex * sizeof(GLuint) + iboOffset));
+      }
 
       lastSolid = di.solid;
 
@@ -273,6 +328,7 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
   glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_UBO_SCENE, 0);
   glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_UBO_MATRIX, 0);
   glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_UBO_MATERIAL, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, 0);
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glBindVertexBuffer(0, 0, 0, 0);
@@ -294,6 +350,7 @@ void RendererGL::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
   }
 
   res->disableVertexFormat();
+  res->disableClipDistances();
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
@@ -57,6 +57,7 @@ public:
     Resources* resources() { return ResourcesGL::get(); }
 
     unsigned int priority() const { return 4; }
+    StateCost    stateCost() const { return ResourcesGL::getStateCostCommandList(); }
   };
   class TypeVbum : public Renderer::Type
   {
@@ -69,6 +70,7 @@ public:
       return renderer;
     }
     unsigned int priority() const { return 4; }
+    StateCost    stateCost() const { return ResourcesGL::getStateCostCommandList(); }
 
     Resources* resources() { return ResourcesGL::get(); }
   };
@@ -83,6 +85,7 @@ public:
       return renderer;
     }
     unsigned int priority() const { return 4; }
+    StateCost    stateCost() const { return ResourcesGL::getStateCostCommandList(); }
 
     Resources* resources() { return ResourcesGL::get(); }
   };
@@ -92,6 +95,8 @@ public:
   void deinit();
   void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global);
 
+  void appendMemoryStats(MemoryStats& stats) const;
+
   Mode m_mode;
 
   RendererGLCMD()
@@ -108,11 +113,18 @@ private:
     std::vector<GLuint>   fbos;
     std::vector<void*>    ptrs;
 
+    // token offset of every drawitem, only with hasObjectCutoff
+    std::vector<GLsizei> itemOffsets;
+    // sequences and their sizes up to the visible drawitems
+    std::vector<GLsizei> cutSizes;
+    size_t               numCutSequences;
+    size_t               numItems;
+
     std::string                   tokens;
     ResourcesGL::StateChangeID state;
   };
 
-  std::vector<DrawItem> m_drawItems;
+  std::vector<uint8_t> m_drawBinds[NUM_SHADES];
 
   ResourcesGL::StateChangeID m_state;
   ShadeCommand                  m_shades[NUM_SHADES];
@@ -120,14 +132,18 @@ private:
   GLuint                        m_tokenBuffers[NUM_SHADES];
 
 
-  void GenerateTokens(std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const ResourcesGL* NV_RESTRICT res)
+  void GenerateTokens(const std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const ResourcesGL* NV_RESTRICT res)
   {
-    const CadSceneGL& sceneGL = res->m_scene;
+    const CadSceneGL& sceneGL   = res->m_scene;
+    bool              instanced = m_config.strategy == STRATEGY_INSTANCED;
+
+    GLuint stateTris     = instanced ? res->m_stateobjects.draw_tris_instanced : res->m_stateobjects.draw_tris;
+    GLuint stateLineTris = instanced ? res->m_stateobjects.draw_line_tris_instanced : res->m_stateobjects.draw_line_tris;
+    GLuint stateLine     = instanced ? res->m_stateobjects.draw_line_instanced : res->m_stateobjects.draw_line;
+
+    const uint8_t* NV_RESTRICT binds = m_drawBinds[shade].data();
 
-    int  lastMaterial = -1;
-    int  lastGeometry = -1;
-    int  lastMatrix   = -1;
-    bool lastSolid    = true;
+    bool lastSolid = true;
 
     ShadeCommand& sc = m_shades[shade];
     sc.fbos.clear();
@@ -135,6 +151,9 @@ private:
     sc.sizes.clear();
     sc.states.clear();
     sc.tokens.clear();
+    sc.itemOffsets.clear();
+
+    bool cuttable = hasObjectCutoff();
 
     size_t begin = 0;
 
@@ -152,12 +171,25 @@ private:
       offset.cmd.bias  = 1;
       offset.cmd.scale = 1;
       offset.enqueue(sc.tokens);
+
+      if(instanced)
+      {
+        ResourcesGL::tokenVbo vbo;
+        vbo.cmd.index = 2;
+        ResourcesGL::encodeAddress(&vbo.cmd.addressLo, res->m_instances.instances.bufferADDR);
+        vbo.enqueue(sc.tokens);
+      }
     }
 
     for(int i = 0; i < drawItems.size(); i++)
     {
       const DrawItem& di = drawItems[i];
 
+      if(cuttable)
+      {
+        sc.itemOffsets.push_back(GLsizei(sc.tokens.size()));
+      }
+
       if(shade == SHADE_SOLID && !di.solid)
       {
         if(m_config.sorted)
@@ -169,13 +201,15 @@ private:
       {
         sc.offsets.push_back(begin);
         sc.sizes.push_back(GLsizei((sc.tokens.size() - begin)));
-        sc.states.push_back(lastSolid ? res->m_stateobjects.draw_line_tris : res->m_stateobjects.draw_line);
+        sc.states.push_back(lastSolid ? stateLineTris : stateLine);
         sc.fbos.push_back(res->m_framebuffer.fboScene);
 
         begin = sc.tokens.size();
       }
 
-      if(lastGeometry != di.geometryIndex)
+      uint32_t bind = binds[i];
+
+      if(bind & DRAWBIND_GEOMETRY)
       {
         const CadSceneGL::Geometry& geo = sceneGL.m_geometry[di.geometryIndex];
 
@@ -184,15 +218,20 @@ private:
         ResourcesGL::encodeAddress(&vbo.cmd.addressLo, geo.vbo.bufferADDR);
         vbo.enqueue(sc.tokens);
 
+        if(shade == SHADE_SOLIDWIRE)
+        {
+          vbo.cmd.index = 1;
+          ResourcesGL::encodeAddress(&vbo.cmd.addressLo, geo.vboPos.bufferADDR);
+          vbo.enqueue(sc.tokens);
+        }
+
         ResourcesGL::tokenIbo ibo;
         ResourcesGL::encodeAddress(&ibo.cmd.addressLo, geo.ibo.bufferADDR);
         ibo.cmd.typeSizeInByte = 4;
         ibo.enqueue(sc.tokens);
-
-        lastGeometry = di.geometryIndex;
       }
 
-      if(lastMatrix != di.matrixIndex)
+      if(!instanced && (bind & DRAWBIND_MATRIX))
       {
 
         ResourcesGL::tokenUbo ubo;
@@ -201,11 +240,9 @@ private:
         ResourcesGL::encodeAddress(&ubo.cmd.addressLo,
                                    sceneGL.m_buffers.matrices.bufferADDR + res->m_alignedMatrixSize * di.matrixIndex);
         ubo.enqueue(sc.tokens);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
 
         ResourcesGL::tokenUbo ubo;
@@ -214,15 +251,29 @@ private:
         ResourcesGL::encodeAddress(&ubo.cmd.addressLo,
                                    sceneGL.m_buffers.materials.bufferADDR + res->m_alignedMaterialSize * di.materialIndex);
         ubo.enqueue(sc.tokens);
-
-        lastMaterial = di.materialIndex;
       }
 
-      ResourcesGL::tokenDrawElems drawelems;
-      drawelems.cmd.baseVertex = 0;
-      drawelems.cmd.count      = di.range.count;
-      drawelems.cmd.firstIndex = GLuint((di.range.offset) / sizeof(GLuint));
-      drawelems.enqueue(sc.tokens);
+      if(instanced)
+      {
+        const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+
+        ResourcesGL::tokenDrawElemsInstanced drawelems;
+        drawelems.cmd.mode          = di.solid ? GL_TRIANGLES : GL_LINES;
+        drawelems.cmd.count         = di.count;
+        drawelems.cmd.instanceCount = group.numInstances;
+        drawelems.cmd.firstIndex    = di.firstIndex;
+        drawelems.cmd.baseVertex    = 0;
+        drawelems.cmd.baseInstance  = group.firstInstance;
+        drawelems.enqueue(sc.tokens);
+      }
+      else
+      {
+        ResourcesGL::tokenDrawElems drawelems;
+        drawelems.cmd.baseVertex = 0;
+        drawelems.cmd.count      = di.count;
+        drawelems.cmd.firstIndex = di.firstIndex;
+        drawelems.enqueue(sc.tokens);
+      }
 
       lastSolid = di.solid;
     }
@@ -231,11 +282,11 @@ private:
     sc.sizes.push_back(GLsizei((sc.tokens.size() - begin)));
     if(shade == SHADE_SOLID)
     {
-      sc.states.push_back(res->m_stateobjects.draw_tris);
+      sc.states.push_back(stateTris);
     }
     else
     {
-      sc.states.push_back(lastSolid ? res->m_stateobjects.draw_line_tris : res->m_stateobjects.draw_line);
+      sc.states.push_back(lastSolid ? stateLineTris : stateLine);
     }
     sc.fbos.push_back(res->m_framebuffer.fboScene);
 
@@ -246,14 +297,34 @@ private:
     }
   }
 
+  // drops the tokens after the first numItems drawitems by shortening the sequences, the stream stays as is
+  void CutTokens(ShadeType shadetype, size_t numItems)
+  {
+    ShadeCommand& sc   = m_shades[shadetype];
+    sc.numItems        = numItems;
+    sc.cutSizes        = sc.sizes;
+    sc.numCutSequences = sc.sizes.size();
+
+    if(numItems < sc.itemOffsets.size())
+    {
+      GLintptr end       = sc.itemOffsets[numItems];
+      sc.numCutSequences = 0;
+      while(sc.numCutSequences < sc.offsets.size() && sc.offsets[sc.numCutSequences] < end)
+      {
+        size_t s       = sc.numCutSequences++;
+        sc.cutSizes[s] = GLsizei(std::min(GLintptr(sc.sizes[s]), end - sc.offsets[s]));
+      }
+    }
+  }
+
   void GenerateCommandLists(ShadeType shadetype)
   {
     ShadeCommand& shade = m_shades[shadetype];
     shade.state         = m_state;
 
     glCommandListSegmentsNV(m_commandLists[shadetype], 1);
-    glListDrawCommandsStatesClientNV(m_commandLists[shadetype], 0, (const void**)&shade.ptrs[0], &shade.sizes[0],
-                                     &shade.states[0], &shade.fbos[0], int(shade.states.size()));
+    glListDrawCommandsStatesClientNV(m_commandLists[shadetype], 0, (const void**)&shade.ptrs[0], &shade.cutSizes[0],
+                                     &shade.states[0], &shade.fbos[0], int(shade.numCutSequences));
     glCompileCommandListNV(m_commandLists[shadetype]);
   }
 };
@@ -268,16 +339,21 @@ void RendererGLCMD::init(const CadScene* NV_RESTRICT scene, Resources* resources
   m_scene                            = scene;
   const ResourcesGL* NV_RESTRICT res = (const ResourcesGL*)resources;
 
-  fillDrawItems(m_drawItems, config, true, true);
+  acquireDrawList(resources, config);
 
-  if(config.sorted)
+  const std::vector<DrawItem>& drawItems = m_drawList->drawItems;
+  for(int i = 0; i < NUM_SHADES; i++)
   {
-    std::sort(m_drawItems.begin(), m_drawItems.end(), DrawItem_compare_groups);
+    annotateDrawBinds(m_drawBinds[i], drawItems.data(), drawItems.size(), i == SHADE_SOLID);
   }
 
+  // instance buffer address is baked into the tokens
+  ((ResourcesGL*)resources)->initInstances(m_drawList->instanceMatrices);
+
   for(int i = 0; i < NUM_SHADES; i++)
   {
-    GenerateTokens(m_drawItems, (ShadeType)i, scene, res);
+    GenerateTokens(drawItems, (ShadeType)i, scene, res);
+    CutTokens((ShadeType)i, getDrawItemCutoff(config.objectNum));
 
     LOGI("stats: %s\n", toString((ShadeType)i));
     int stats[ResourcesGL::GL_TOKENS] = {0};
@@ -323,6 +399,29 @@ void RendererGLCMD::deinit()
   {
     glDeleteBuffers(NUM_SHADES, m_tokenBuffers);
   }
+
+  ResourcesGL::get()->deinitInstances();
+}
+
+void RendererGLCMD::appendMemoryStats(MemoryStats& stats) const
+{
+  appendDrawListMemoryStats(stats);
+  stats.cpu[MemoryStats::DRAWITEMS] += m_drawBinds[SHADE_SOLID].capacity() + m_drawBinds[SHADE_SOLIDWIRE].capacity();
+
+  for(int i = 0; i < NUM_SHADES; i++)
+  {
+    const ShadeCommand& sc = m_shades[i];
+    stats.cpu[MemoryStats::COMMANDS] += sc.tokens.capacity();
+    stats.cpu[MemoryStats::COMMANDS] += sc.offsets.capacity() * sizeof(GLintptr) + sc.sizes.capacity() * sizeof(GLsizei)
+                                        + (sc.states.capacity() + sc.fbos.capacity()) * sizeof(GLuint)
+                                        + sc.ptrs.capacity() * sizeof(void*)
+                                        + (sc.itemOffsets.capacity() + sc.cutSizes.capacity()) * sizeof(GLsizei);
+    // compiled lists are driver-owned
+    if(m_mode == MODE_BUFFER)
+    {
+      stats.gpu[MemoryStats::COMMANDS] += sc.tokens.size();
+    }
+  }
 }
 
 void RendererGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global)
@@ -348,9 +447,23 @@ void RendererGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT resources,
 
   glNamedBufferSubData(res->m_common.view.buffer, 0, sizeof(SceneData), &global.sceneUbo);
 
+  if(m_config.strategy == STRATEGY_INSTANCED)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, res->m_scene.m_buffers.matrices.buffer);
+  }
+
+  bool   cut      = false;
+  size_t numItems = getDrawItemCutoff(global.visibleObjects);
+  if(numItems != m_shades[shadetype].numItems)
+  {
+    CutTokens(shadetype, numItems);
+    cut = true;
+  }
+
   if(m_mode == MODE_LIST || m_mode == MODE_LIST_RECOMPILE)
   {
-    if(m_shades[shadetype].state.programs != m_state.programs || m_shades[shadetype].state.fbos != m_state.fbos || m_mode == MODE_LIST_RECOMPILE)
+    if(m_shades[shadetype].state.programs != m_state.programs || m_shades[shadetype].state.fbos != m_state.fbos
+       || m_mode == MODE_LIST_RECOMPILE || cut)
     {
       GenerateCommandLists(shadetype);
     }
@@ -360,8 +473,8 @@ void RendererGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT resources,
   {
     ShadeCommand& shade = m_shades[shadetype];
 #if 1
-    glDrawCommandsStatesNV(m_tokenBuffers[shadetype], &shade.offsets[0], &shade.sizes[0], &shade.states[0],
-                           &shade.fbos[0], int(shade.states.size()));
+    glDrawCommandsStatesNV(m_tokenBuffers[shadetype], &shade.offsets[0], &shade.cutSizes[0], &shade.states[0],
+                           &shade.fbos[0], int(shade.numCutSequences));
 #else
     // bug behavior test for "shaded & edges"
     for(size_t i = 0; i < shade.states.size() / 16; i++)
@@ -371,6 +484,11 @@ void RendererGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT resources,
 #endif
   }
 
+  if(m_config.strategy == STRATEGY_INSTANCED)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, 0);
+  }
+
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
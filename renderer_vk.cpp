@@ -64,6 +64,7 @@ public:
     unsigned int priority() const { return 8; }
 
     Resources* resources() { return ResourcesVK::get(); }
+    StateCost  stateCost() const { return ResourcesVK::getStateCost(); }
   };
 
   class TypeCmdMany : public Renderer::Type
@@ -79,6 +80,7 @@ public:
     unsigned int priority() const { return 8; }
 
     Resources* resources() { return ResourcesVK::get(); }
+    StateCost  stateCost() const { return ResourcesVK::getStateCost(); }
   };
 
 public:
@@ -86,6 +88,18 @@ public:
   void deinit();
   void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global);
 
+  void appendMemoryStats(MemoryStats& stats) const
+  {
+    appendDrawListMemoryStats(stats);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawBinds[SHADE_SOLID].capacity() + m_drawBinds[SHADE_SOLIDWIRE].capacity();
+    for(int i = 0; i < NUM_SHADES; i++)
+    {
+      stats.cpu[MemoryStats::COMMANDS] += m_shades[i].cmdbuffers.capacity() * sizeof(VkCommandBuffer);
+      stats.cpu[MemoryStats::COMMANDS] += m_shades[i].objects.capacity() * sizeof(uint32_t);
+      stats.numCommandBuffers += uint32_t(m_shades[i].cmdbuffers.size());
+    }
+  }
+
 
   Mode m_mode;
 
@@ -98,31 +112,41 @@ private:
   struct ShadeCommand
   {
     std::vector<VkCommandBuffer> cmdbuffers;
+    std::vector<uint32_t>        objects;  // MODE_CMD_MANY: object of every cmdbuffer
+    size_t                       numItems;
     size_t                       fboChangeID;
     size_t                       pipeChangeID;
   };
 
-  std::vector<DrawItem> m_drawItems;
-  VkCommandPool         m_cmdPool;
+  std::vector<uint8_t> m_drawBinds[NUM_SHADES];
+  VkCommandPool        m_cmdPool;
 
   // used for token or cmdbuffer
   ShadeCommand       m_shades[NUM_SHADES];
   const ResourcesVK* NV_RESTRICT m_resources;
 
-  void GenerateCmdBuffers(ShadeCommand& sc, ShadeType shadetype, const DrawItem* NV_RESTRICT drawItems, size_t num, const ResourcesVK* NV_RESTRICT res)
+  void GenerateCmdBuffers(ShadeCommand&               sc,
+                          ShadeType                   shadetype,
+                          const DrawItem* NV_RESTRICT drawItems,
+                          const uint8_t* NV_RESTRICT  binds,
+                          size_t                      num,
+                          const ResourcesVK* NV_RESTRICT res)
   {
     const CadScene* NV_RESTRICT scene   = m_scene;
     const CadSceneVK&           sceneVK = res->m_scene;
 
     bool solidwire = (shadetype == SHADE_SOLIDWIRE);
+    bool instanced = (m_config.strategy == STRATEGY_INSTANCED);
 
-    int  lastMaterial = -1;
-    int  lastGeometry = -1;
-    int  lastMatrix   = -1;
-    int  lastObject   = -1;
-    bool lastSolid    = true;
+    const ResourcesVK::Pipelines& pipes = instanced ? res->m_pipesInstanced : res->m_pipes;
+
+    const uint32_t* drawObjects = m_drawList->drawObjects.data();
+
+    int  lastObject = -1;
+    bool lastSolid  = true;
 
     sc.cmdbuffers.clear();
+    sc.objects.clear();
 
     VkCommandBuffer cmd  = NULL;
     VkRenderPass    pass = NULL;
@@ -139,7 +163,7 @@ private:
         continue;
       }
 
-      if(!cmd || (m_mode == MODE_CMD_MANY && di.objectIndex != lastObject))
+      if(!cmd || (m_mode == MODE_CMD_MANY && int(drawObjects[i]) != lastObject))
       {
 
         if(cmd)
@@ -152,20 +176,28 @@ private:
         cmd = res->createCmdBuffer(m_cmdPool, false, false, true);
         res->cmdDynamicState(cmd);
 
-        lastMaterial = -1;
-        lastGeometry = -1;
-        lastMatrix   = -1;
-        first        = true;
-
-        lastObject = di.objectIndex;
+        first      = true;
+        lastObject = m_mode == MODE_CMD_MANY ? int(drawObjects[i]) : -1;
+        if(m_mode == MODE_CMD_MANY)
+        {
+          sc.objects.push_back(drawObjects[i]);
+        }
       }
 
+      // new command buffers start without state
+      uint32_t bind = first ? uint32_t(DRAWBIND_ALL) : binds[i];
+
       if(first || (di.solid != lastSolid))
       {
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          di.solid ? (solidwire ? res->m_pipes.line_tris : res->m_pipes.tris) : res->m_pipes.line);
+                          di.solid ? (solidwire ? pipes.line_tris : pipes.tris) : pipes.line);
 
-        if(first)
+        if(first && instanced)
+        {
+          VkDeviceSize offset = 0;
+          vkCmdBindVertexBuffers(cmd, 2, 1, &res->m_instances.instancesBuffer, &offset);
+        }
+        else if(first)
         {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
           vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_SCENE,
@@ -180,19 +212,43 @@ private:
         first = false;
       }
 
-      if(lastGeometry != di.geometryIndex)
+      if(bind & DRAWBIND_GEOMETRY)
       {
         const CadSceneVK::Geometry& vkgeo = sceneVK.m_geometry[di.geometryIndex];
 
-        vkCmdBindVertexBuffers(cmd, 0, 1, &vkgeo.vbo.buffer, &vkgeo.vbo.offset);
+        if(solidwire)
+        {
+          VkBuffer     buffers[2] = {vkgeo.vbo.buffer, vkgeo.vboPos.buffer};
+          VkDeviceSize offsets[2] = {vkgeo.vbo.offset, vkgeo.vboPos.offset};
+          vkCmdBindVertexBuffers(cmd, 0, 2, buffers, offsets);
+        }
+        else
+        {
+          vkCmdBindVertexBuffers(cmd, 0, 1, &vkgeo.vbo.buffer, &vkgeo.vbo.offset);
+        }
         vkCmdBindIndexBuffer(cmd, vkgeo.ibo.buffer, vkgeo.ibo.offset, VK_INDEX_TYPE_UINT32);
+      }
 
-        lastGeometry = di.geometryIndex;
+      if(instanced)
+      {
+        // single set, matrices are fetched per instance
+        if(bind & DRAWBIND_MATERIAL)
+        {
+          uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
+          vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawInstanced.getPipeLayout(), 0, 1,
+                                  res->m_drawInstanced.getSets(), 1, &offset);
+        }
+
+        const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+        vkCmdDrawIndexed(cmd, di.count, group.numInstances, di.firstIndex, 0, group.firstInstance);
+
+        lastSolid = di.solid;
+        continue;
       }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
         uint32_t offset = di.matrixIndex * res->m_alignedMatrixSize;
@@ -202,10 +258,9 @@ private:
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_MATRIX,
                                 1, res->m_drawing.at(DRAW_UBO_MATRIX).getSets() + di.matrixIndex, 0, NULL);
 #endif
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
         uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
@@ -215,12 +270,11 @@ private:
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_MATERIAL,
                                 1, res->m_drawing.at(DRAW_UBO_MATERIAL).getSets() + di.materialIndex, 0, NULL);
 #endif
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC
 
-      if(lastMaterial != di.materialIndex || lastMatrix != di.matrixIndex)
+      if(bind & (DRAWBIND_MATERIAL | DRAWBIND_MATRIX))
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC
         uint32_t offsets[DRAW_UBOS_NUM];
@@ -235,47 +289,36 @@ private:
 #endif
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), 0, 1,
                                 res->m_drawing.getSets(), sizeof(offsets) / sizeof(offsets[0]), offsets);
-
-        lastMaterial = di.materialIndex;
-        lastMatrix   = di.matrixIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectData),
                            &scene->m_matrices[di.matrixIndex]);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(ObjectData),
                            sizeof(MaterialData), &scene->m_materials[di.materialIndex]);
-
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_INDEX
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(int), &di.matrixIndex);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(int), sizeof(int),
                            &di.materialIndex);
-
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #endif
       // drawcall
-      vkCmdDrawIndexed(cmd, di.range.count, 1, uint32_t(di.range.offset / sizeof(uint32_t)), 0, 0);
+      vkCmdDrawIndexed(cmd, di.count, 1, di.firstIndex, 0, 0);
 
       lastSolid = di.solid;
     }
@@ -287,6 +330,7 @@ private:
       sc.cmdbuffers.push_back(cmd);
     }
 
+    sc.numItems     = num;
     sc.fboChangeID  = res->m_fboChangeID;
     sc.pipeChangeID = res->m_pipeChangeID;
   }
@@ -315,18 +359,21 @@ void RendererVK::init(const CadScene* NV_RESTRICT scene, Resources* resources, c
   result                              = vkCreateCommandPool(res->m_device, &cmdPoolInfo, NULL, &m_cmdPool);
   assert(result == VK_SUCCESS);
 
-  fillDrawItems(m_drawItems, config, true, true);
-
-  LOGI("drawitems: %d\n", uint32_t(m_drawItems.size()));
+  // MODE_CMD_MANY keeps the fill order, every object gets its own command buffer
+  acquireDrawList(resources, config, m_mode == MODE_CMD_MANY);
 
-  if(config.sorted && m_mode != MODE_CMD_MANY)
+  const std::vector<DrawItem>& drawItems = m_drawList->drawItems;
+  for(int i = 0; i < NUM_SHADES; i++)
   {
-    std::sort(m_drawItems.begin(), m_drawItems.end(), DrawItem_compare_groups);
+    annotateDrawBinds(m_drawBinds[i], drawItems.data(), drawItems.size(), i == SHADE_SOLID);
   }
 
+  resources->initInstances(m_drawList->instanceMatrices);
+
+  size_t numItems = m_mode == MODE_CMD_MANY ? drawItems.size() : getDrawItemCutoff(config.objectNum);
   for(int i = 0; i < NUM_SHADES; i++)
   {
-    GenerateCmdBuffers(m_shades[i], (ShadeType)i, m_drawItems.data(), m_drawItems.size(), res);
+    GenerateCmdBuffers(m_shades[i], (ShadeType)i, drawItems.data(), m_drawBinds[i].data(), numItems, res);
     LOGI("cmdbuffers %s: %9d\n", toString((ShadeType)i), uint32_t(m_shades[i].cmdbuffers.size()));
   }
 }
@@ -338,6 +385,8 @@ void RendererVK::deinit()
     DeleteCmdbuffers((ShadeType)i);
   }
   vkDestroyCommandPool(m_resources->m_device, m_cmdPool, NULL);
+
+  ((ResourcesVK*)m_resources)->deinitInstances();
 }
 
 void RendererVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global)
@@ -347,10 +396,20 @@ void RendererVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
 
   ShadeCommand& sc = m_shades[shadetype];
 
-  if(sc.pipeChangeID != res->m_pipeChangeID || sc.fboChangeID != res->m_fboChangeID)
+  // MODE_CMD_MANY skips the cmdbuffers of hidden objects, the single cmdbuffer is recorded again
+  const std::vector<DrawItem>& drawItems = m_drawList->drawItems;
+  size_t numItems = m_mode == MODE_CMD_MANY ? drawItems.size() : getDrawItemCutoff(global.visibleObjects);
+
+  if(sc.pipeChangeID != res->m_pipeChangeID || sc.fboChangeID != res->m_fboChangeID || sc.numItems != numItems)
   {
     DeleteCmdbuffers(shadetype);
-    GenerateCmdBuffers(sc, shadetype, m_drawItems.data(), m_drawItems.size(), res);
+    GenerateCmdBuffers(sc, shadetype, drawItems.data(), m_drawBinds[shadetype].data(), numItems, res);
+  }
+
+  size_t numCmdBuffers = sc.cmdbuffers.size();
+  if(m_mode == MODE_CMD_MANY && hasObjectCutoff())
+  {
+    numCmdBuffers = findObjectCutoff(sc.objects.data(), sc.objects.size(), global.visibleObjects);
   }
 
 
@@ -364,9 +423,9 @@ void RendererVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resources, con
 
     // clear via pass
     res->cmdBeginRenderPass(primary, true, true);
-    if(!sc.cmdbuffers.empty())
+    if(numCmdBuffers)
     {
-      vkCmdExecuteCommands(primary, uint32_t(sc.cmdbuffers.size()), sc.cmdbuffers.data());
+      vkCmdExecuteCommands(primary, uint32_t(numCmdBuffers), sc.cmdbuffers.data());
     }
     vkCmdEndRenderPass(primary);
   }
@@ -30,6 +30,7 @@
 #include <nvgl/contextwindow_gl.hpp>
 #include <nvpwindow.hpp>
 
+#include "occlusionbuffer.hpp"
 #include "renderer.hpp"
 #include "resources_gl.hpp"
 
@@ -63,6 +64,7 @@ public:
     Resources* resources() { return ResourcesGL::get(); }
 
     unsigned int priority() const { return 5; }
+    StateCost    stateCost() const { return ResourcesGL::getStateCostCommandList(); }
   };
 
 public:
@@ -70,6 +72,23 @@ public:
   void deinit();
   void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global);
 
+  bool supportsFrontToBack() const { return true; }
+  bool supportsTranslucency() const { return true; }
+  bool supportsFrustumCulling() const { return true; }
+
+  void appendMemoryStats(MemoryStats& stats) const
+  {
+    appendDrawListMemoryStats(stats);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawItemsSolid.capacity() * sizeof(DrawItem);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawObjectsSolid.capacity() * sizeof(uint32_t);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_shadeBinds[SHADE_SOLID].capacity() + m_shadeBinds[SHADE_SOLIDWIRE].capacity();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_depthSorters[SHADE_SOLID].getMemoryUsage() + m_depthSorters[SHADE_SOLIDWIRE].getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_translucentSorter.getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_cullers[SHADE_SOLID].getMemoryUsage() + m_cullers[SHADE_SOLIDWIRE].getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_translucentCuller.getMemoryUsage();
+    stats.gpu[MemoryStats::COMMANDS] += m_bufferSize * NUM_FRAMES * m_numThreads;
+  }
+
 
   Mode m_mode;
 
@@ -109,11 +128,30 @@ private:
     std::mutex              m_hasWorkMutex;
     volatile int            m_hasWork;
 
+    // drawitems processed in the last frame
+    size_t m_numItems;
+    // visible drawitems of the current chunk
+    FrustumCuller::ThreadOutput m_cull;
+    // drawitems recorded in the last frame and the time it took
+    size_t m_numRecorded;
+    double m_recordTime;
+
     size_t                     m_scIdx;
     std::vector<ShadeCommand*> m_scs;
 
 
-    void resetFrame() { m_scIdx = 0; }
+    void resetFrame()
+    {
+      m_scIdx       = 0;
+      m_numRecorded = 0;
+      m_recordTime  = 0;
+    }
+
+    void addRecorded(size_t num, double timeBegin)
+    {
+      m_numRecorded += num;
+      m_recordTime += NVPSystem::getTime() - timeBegin;
+    }
 
     ShadeCommand* getFrameCommand()
     {
@@ -131,7 +169,14 @@ private:
     }
   };
 
-  std::vector<DrawItem> m_drawItems;
+  std::vector<DrawItem> m_drawItemsSolid;
+  std::vector<uint32_t> m_drawObjectsSolid;
+  std::vector<uint8_t>  m_shadeBinds[NUM_SHADES];
+  ShadeDrawItems        m_shadeDrawItems[NUM_SHADES];
+  DepthSorter           m_depthSorters[NUM_SHADES];
+  DepthSorter           m_translucentSorter;
+  FrustumCuller         m_cullers[NUM_SHADES];
+  FrustumCuller         m_translucentCuller;
   const ResourcesGL* NV_RESTRICT m_resources;
   int                            m_numThreads;
   ResourcesGL::StateChangeID     m_state;
@@ -140,6 +185,7 @@ private:
   ShadeType m_shade;
   int       m_frame;
   GLsync    m_syncs[NUM_FRAMES];
+  size_t    m_bufferSize;
 
   ThreadJob* m_jobs;
 
@@ -147,6 +193,18 @@ private:
   volatile int    m_ready;
   volatile int    m_stopThreads;
   volatile size_t m_numCurItems;
+  // visible part of m_shadeDrawItems[m_shade] or its depth sorted copy
+  ShadeDrawItems m_frameDrawItems;
+  // visible translucent drawitems back to front, handed out after the opaque ones
+  ShadeDrawItems  m_frameTranslucent;
+  volatile size_t m_numCurTranslucent;
+  // one per translucent chunk, draw() executes them in order
+  std::vector<ShadeCommand> m_translucentCommands;
+  // frustum culling this frame, the indices map the sorted lists back to the ones the cullers know
+  bool             m_frameCulling;
+  const uint32_t*  m_frameIndices;
+  const uint32_t*  m_frameTranslucentIndices;
+  OcclusionBuffer* m_frameOcclusion;
 
   std::condition_variable m_readyCond;
   std::mutex              m_readyMutex;
@@ -169,7 +227,7 @@ private:
     bool                        hasWork = false;
 
     const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
+    size_t       total     = m_frameDrawItems.num;
 
     if(m_numCurItems < total)
     {
@@ -189,22 +247,72 @@ private:
     return hasWork;
   }
 
+  // like getWork_ts for the translucent drawitems, chunk is the index into m_translucentCommands
+  bool getTranslucentWork_ts(size_t& chunk, size_t& start, size_t& num)
+  {
+    std::lock_guard<std::mutex> lock(m_workMutex);
+
+    const size_t chunkSize = m_workingSet;
+    size_t       total     = m_frameTranslucent.num;
+
+    if(m_numCurTranslucent < total)
+    {
+      chunk = m_numCurTranslucent / chunkSize;
+      start = m_numCurTranslucent;
+      num   = std::min(total - m_numCurTranslucent, chunkSize);
+      m_numCurTranslucent += num;
+      return true;
+    }
+
+    return false;
+  }
+
   void         RunThread(int index);
   unsigned int RunThreadFrame(ShadeType shadetype, ThreadJob& job);
 
+  // drawitems of a chunk to record, only the visible ones with frustum culling
+  ShadeDrawItems getChunk(ThreadJob&            job,
+                          const FrustumCuller&  culler,
+                          const ShadeDrawItems& list,
+                          const uint32_t*       indices,
+                          size_t                begin,
+                          size_t                num)
+  {
+    if(m_frameCulling)
+    {
+      return culler.cull(list, indices, begin, num, job.m_cull);
+    }
+
+    ShadeDrawItems chunk;
+    chunk.items   = list.items + begin;
+    chunk.binds   = list.binds + begin;
+    chunk.objects = nullptr;
+    chunk.num     = num;
+    return chunk;
+  }
+
   void enqueueShadeCommand_ts(ShadeCommand* sc);
 
 
-  template <class T, ShadeType shade, bool sorted>
-  void GenerateTokens(T& stream, ShadeCommand& sc, const DrawItem* NV_RESTRICT drawItems, size_t numItems, const ResourcesGL* NV_RESTRICT res)
+  template <class T, ShadeType shade>
+  void GenerateTokens(T&                          stream,
+                      ShadeCommand&               sc,
+                      const DrawItem* NV_RESTRICT drawItems,
+                      const uint8_t* NV_RESTRICT  binds,
+                      size_t                      numItems,
+                      const ResourcesGL* NV_RESTRICT res,
+                      bool                           translucent = false)
   {
-    const CadScene* NV_RESTRICT scene   = m_scene;
-    const CadSceneGL&           sceneGL = res->m_scene;
+    const CadScene* NV_RESTRICT scene     = m_scene;
+    const CadSceneGL&           sceneGL   = res->m_scene;
+    bool                        instanced = m_config.strategy == STRATEGY_INSTANCED;
+
+    GLuint stateTris     = instanced ? res->m_stateobjects.draw_tris_instanced : res->m_stateobjects.draw_tris;
+    GLuint stateBlend    = instanced ? res->m_stateobjects.draw_tris_blend_instanced : res->m_stateobjects.draw_tris_blend;
+    GLuint stateLineTris = instanced ? res->m_stateobjects.draw_line_tris_instanced : res->m_stateobjects.draw_line_tris;
+    GLuint stateLine     = instanced ? res->m_stateobjects.draw_line_instanced : res->m_stateobjects.draw_line;
 
-    int  lastMaterial = -1;
-    int  lastGeometry = -1;
-    int  lastMatrix   = -1;
-    bool lastSolid    = true;
+    bool lastSolid = true;
 
     sc.fbos.clear();
     sc.offsets.clear();
@@ -226,24 +334,25 @@ private:
       offset.cmd.bias  = 1;
       offset.cmd.scale = 1;
       offset.enqueue(stream);
+
+      if(instanced)
+      {
+        ResourcesGL::tokenVbo vbo;
+        vbo.cmd.index = 2;
+        ResourcesGL::encodeAddress(&vbo.cmd.addressLo, res->m_instances.instances.bufferADDR);
+        vbo.enqueue(stream);
+      }
     }
 
     for(int i = 0; i < numItems; i++)
     {
       const DrawItem& di = drawItems[i];
 
-      if(shade == SHADE_SOLID && !di.solid)
-      {
-        if(sorted)
-          break;
-        continue;
-      }
-
       if(shade == SHADE_SOLIDWIRE && di.solid != lastSolid)
       {
         sc.offsets.push_back(begin);
         sc.sizes.push_back(GLsizei((stream.size() - begin)));
-        sc.states.push_back(lastSolid ? res->m_stateobjects.draw_line_tris : res->m_stateobjects.draw_line);
+        sc.states.push_back(lastSolid ? stateLineTris : stateLine);
         sc.fbos.push_back(res->m_framebuffer.fboScene);
 
         begin = stream.size();
@@ -251,7 +360,10 @@ private:
         lastSolid = di.solid;
       }
 
-      if(lastGeometry != di.geometryIndex)
+      // every chunk is its own token sequence
+      uint32_t bind = i == 0 ? uint32_t(DRAWBIND_ALL) : binds[i];
+
+      if(bind & DRAWBIND_GEOMETRY)
       {
         const CadScene::Geometry&   geo   = scene->m_geometry[di.geometryIndex];
         const CadSceneGL::Geometry& geogl = sceneGL.m_geometry[di.geometryIndex];
@@ -261,15 +373,20 @@ private:
         ResourcesGL::encodeAddress(&vbo.cmd.addressLo, geogl.vbo.bufferADDR);
         vbo.enqueue(stream);
 
+        if(shade == SHADE_SOLIDWIRE)
+        {
+          vbo.cmd.index = 1;
+          ResourcesGL::encodeAddress(&vbo.cmd.addressLo, geogl.vboPos.bufferADDR);
+          vbo.enqueue(stream);
+        }
+
         ResourcesGL::tokenIbo ibo;
         ResourcesGL::encodeAddress(&ibo.cmd.addressLo, geogl.ibo.bufferADDR);
         ibo.cmd.typeSizeInByte = 4;
         ibo.enqueue(stream);
-
-        lastGeometry = di.geometryIndex;
       }
 
-      if(lastMatrix != di.matrixIndex)
+      if(!instanced && (bind & DRAWBIND_MATRIX))
       {
 
         ResourcesGL::tokenUbo ubo;
@@ -278,11 +395,9 @@ private:
         ResourcesGL::encodeAddress(&ubo.cmd.addressLo,
                                    sceneGL.m_buffers.matrices.bufferADDR + res->m_alignedMatrixSize * di.matrixIndex);
         ubo.enqueue(stream);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
 
         ResourcesGL::tokenUbo ubo;
@@ -291,26 +406,40 @@ private:
         ResourcesGL::encodeAddress(&ubo.cmd.addressLo,
                                    sceneGL.m_buffers.materials.bufferADDR + res->m_alignedMaterialSize * di.materialIndex);
         ubo.enqueue(stream);
-
-        lastMaterial = di.materialIndex;
       }
 
-      ResourcesGL::tokenDrawElems drawelems;
-      drawelems.cmd.baseVertex = 0;
-      drawelems.cmd.count      = di.range.count;
-      drawelems.cmd.firstIndex = GLuint((di.range.offset) / sizeof(GLuint));
-      drawelems.enqueue(stream);
+      if(instanced)
+      {
+        const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+
+        ResourcesGL::tokenDrawElemsInstanced drawelems;
+        drawelems.cmd.mode          = di.solid ? GL_TRIANGLES : GL_LINES;
+        drawelems.cmd.count         = di.count;
+        drawelems.cmd.instanceCount = group.numInstances;
+        drawelems.cmd.firstIndex    = di.firstIndex;
+        drawelems.cmd.baseVertex    = 0;
+        drawelems.cmd.baseInstance  = group.firstInstance;
+        drawelems.enqueue(stream);
+      }
+      else
+      {
+        ResourcesGL::tokenDrawElems drawelems;
+        drawelems.cmd.baseVertex = 0;
+        drawelems.cmd.count      = di.count;
+        drawelems.cmd.firstIndex = di.firstIndex;
+        drawelems.enqueue(stream);
+      }
     }
 
     sc.offsets.push_back(begin);
     sc.sizes.push_back(GLsizei((stream.size() - begin)));
     if(shade == SHADE_SOLID)
     {
-      sc.states.push_back(res->m_stateobjects.draw_tris);
+      sc.states.push_back(translucent ? stateBlend : stateTris);
     }
     else
     {
-      sc.states.push_back(lastSolid ? res->m_stateobjects.draw_line_tris : res->m_stateobjects.draw_line);
+      sc.states.push_back(lastSolid ? stateLineTris : stateLine);
     }
     sc.fbos.push_back(res->m_framebuffer.fboScene);
   }
@@ -320,33 +449,18 @@ private:
                       ShadeCommand&   sc,
                       ShadeType       shade,
                       const DrawItem* NV_RESTRICT drawItems,
+                      const uint8_t* NV_RESTRICT  binds,
                       size_t                      numItems,
-                      const ResourcesGL* NV_RESTRICT res,
-                      bool                           sorted)
+                      const ResourcesGL* NV_RESTRICT res)
   {
-    if(sorted)
-    {
-      switch(shade)
-      {
-        case SHADE_SOLID:
-          GenerateTokens<T, SHADE_SOLID, true>(stream, sc, drawItems, numItems, res);
-          break;
-        case SHADE_SOLIDWIRE:
-          GenerateTokens<T, SHADE_SOLIDWIRE, true>(stream, sc, drawItems, numItems, res);
-          break;
-      }
-    }
-    else
+    switch(shade)
     {
-      switch(shade)
-      {
-        case SHADE_SOLID:
-          GenerateTokens<T, SHADE_SOLID, false>(stream, sc, drawItems, numItems, res);
-          break;
-        case SHADE_SOLIDWIRE:
-          GenerateTokens<T, SHADE_SOLIDWIRE, false>(stream, sc, drawItems, numItems, res);
-          break;
-      }
+      case SHADE_SOLID:
+        GenerateTokens<T, SHADE_SOLID>(stream, sc, drawItems, binds, numItems, res);
+        break;
+      case SHADE_SOLIDWIRE:
+        GenerateTokens<T, SHADE_SOLIDWIRE>(stream, sc, drawItems, binds, numItems, res);
+        break;
     }
   }
 };
@@ -358,25 +472,56 @@ void RendererThreadedGLCMD::init(const CadScene* NV_RESTRICT scene, Resources* r
   m_scene                            = scene;
   const ResourcesGL* NV_RESTRICT res = (const ResourcesGL*)resources;
 
-  fillDrawItems(m_drawItems, config, true, true);
+  acquireDrawList(resources, config);
 
-  if(config.sorted)
+  partitionShadeDrawItems(m_shadeDrawItems, m_drawItemsSolid, m_drawObjectsSolid, m_shadeBinds, *m_drawList, config.sorted);
+  LOGI("drawitems solid: %d\n", uint32_t(m_shadeDrawItems[SHADE_SOLID].num));
+
+  for(int i = 0; i < NUM_SHADES; i++)
   {
-    std::sort(m_drawItems.begin(), m_drawItems.end(), DrawItem_compare_groups);
+    m_depthSorters[i].init(scene, m_drawList.get(), resources, m_shadeDrawItems[i]);
   }
 
+  ShadeDrawItems translucent;
+  translucent.items   = m_drawList->translucentItems.data();
+  translucent.binds   = nullptr;
+  translucent.objects = m_drawList->translucentObjects.data();
+  translucent.num     = m_drawList->translucentItems.size();
+  m_translucentSorter.init(scene, m_drawList.get(), resources, translucent);
+
+  for(int i = 0; i < NUM_SHADES; i++)
+  {
+    m_cullers[i].init(scene, m_drawList.get(), resources, m_shadeDrawItems[i]);
+  }
+  m_translucentCuller.init(scene, m_drawList.get(), resources, translucent);
+
+  // instance buffer address is baked into the tokens
+  ((ResourcesGL*)resources)->initInstances(m_drawList->instanceMatrices);
 
   size_t worstCaseSize;
 
   {
     std::string  dummy;
     ShadeCommand sc;
-    GenerateTokens<std::string>(dummy, sc, SHADE_SOLIDWIRE, &m_drawItems[0], m_drawItems.size(), res, config.sorted);
+    // any depth order may rebind everything on every drawitem
+    std::vector<uint8_t> allBinds(std::max(m_drawList->drawItems.size(), m_drawList->translucentItems.size()),
+                                  uint8_t(DRAWBIND_ALL));
+    const uint8_t*       binds = config.frontToBack != FRONTTOBACK_OFF ? allBinds.data() : m_shadeBinds[SHADE_SOLIDWIRE].data();
+    GenerateTokens<std::string>(dummy, sc, SHADE_SOLIDWIRE, m_drawList->drawItems.data(), binds,
+                                m_drawList->drawItems.size(), res);
+    if(config.translucency)
+    {
+      // a single thread may get all translucent chunks
+      GenerateTokens<std::string, SHADE_SOLID>(dummy, sc, m_drawList->translucentItems.data(), allBinds.data(),
+                                               m_drawList->translucentItems.size(), res, true);
+    }
     worstCaseSize = (dummy.size() * 4) / 3;
 
     LOGI("buffer size: %d\n", uint32_t(worstCaseSize));
   }
 
+  m_bufferSize = worstCaseSize;
+
   res->rebuildStateObjects();
   m_state = res->m_state;
 
@@ -470,7 +615,20 @@ void RendererThreadedGLCMD::deinit()
 
   delete[] m_jobs;
 
-  m_drawItems.clear();
+  ResourcesGL::get()->deinitInstances();
+
+  m_depthSorters[SHADE_SOLID].deinit();
+  m_depthSorters[SHADE_SOLIDWIRE].deinit();
+  m_translucentSorter.deinit();
+  m_translucentCommands.clear();
+  m_cullers[SHADE_SOLID].deinit();
+  m_cullers[SHADE_SOLIDWIRE].deinit();
+  m_translucentCuller.deinit();
+  m_drawList.reset();
+  m_drawItemsSolid.clear();
+  m_drawObjectsSolid.clear();
+  m_shadeBinds[SHADE_SOLID].clear();
+  m_shadeBinds[SHADE_SOLIDWIRE].clear();
 }
 
 void RendererThreadedGLCMD::enqueueShadeCommand_ts(ShadeCommand* sc)
@@ -491,11 +649,33 @@ unsigned int RendererThreadedGLCMD::RunThreadFrame(ShadeType shadetype, ThreadJo
   size_t offset = 0;
   job.resetFrame();
 
+  if(m_config.frontToBack != FRONTTOBACK_OFF)
+  {
+    m_depthSorters[shadetype].sortThread(job.index);
+  }
+  if(m_config.translucency)
+  {
+    m_translucentSorter.sortThread(job.index);
+  }
+  if(m_frameOcclusion)
+  {
+    // all threads rasterize their rows, tests start once the buffer is complete
+    m_frameOcclusion->rasterizeThread(job.index);
+  }
+  job.m_cull.resetFrame();
+
   int subframe = job.m_frame % NUM_FRAMES;
   job.m_streams[subframe].clear();
 
   while(getWork_ts(begin, num))
   {
+    ShadeDrawItems chunk = getChunk(job, m_cullers[shadetype], m_frameDrawItems, m_frameIndices, begin, num);
+    tnum += num;
+    if(!chunk.num)
+    {
+      continue;
+    }
+
     ShadeCommand* sc = job.getFrameCommand();
     sc->bufferData   = job.m_streams[subframe].dataptr;
 
@@ -504,8 +684,9 @@ unsigned int RendererThreadedGLCMD::RunThreadFrame(ShadeType shadetype, ThreadJo
       sc->bufferOffset = job.m_streams[subframe].size();
     }
 
-    GenerateTokens<PointerStream>(job.m_streams[subframe], *sc, shadetype, &m_drawItems[begin], num, m_resources,
-                                  m_config.sorted);
+    double timeBegin = NVPSystem::getTime();
+    GenerateTokens<PointerStream>(job.m_streams[subframe], *sc, shadetype, chunk.items, chunk.binds, chunk.num, m_resources);
+    job.addRecorded(chunk.num, timeBegin);
     sc->bufferSize = job.m_streams[subframe].size() - sc->bufferOffset;
 
     if(m_mode == MODE_BUFFER_PERS)
@@ -515,13 +696,46 @@ unsigned int RendererThreadedGLCMD::RunThreadFrame(ShadeType shadetype, ThreadJo
 
     enqueueShadeCommand_ts(sc);
     dispatches += 1;
+  }
 
+  // the translucent chunks are only recorded here, draw() executes them in back to front order
+  size_t chunk;
+  while(getTranslucentWork_ts(chunk, begin, num))
+  {
+    ShadeCommand*  sc      = &m_translucentCommands[chunk];
+    ShadeDrawItems visible = getChunk(job, m_translucentCuller, m_frameTranslucent, m_frameTranslucentIndices, begin, num);
     tnum += num;
+    if(!visible.num)
+    {
+      // entirely culled, draw() skips it
+      sc->sizes.clear();
+      continue;
+    }
+
+    sc->bufferData = job.m_streams[subframe].dataptr;
+
+    if(m_mode == MODE_BUFFER_PERS)
+    {
+      sc->bufferOffset = job.m_streams[subframe].size();
+    }
+
+    double timeBegin = NVPSystem::getTime();
+    GenerateTokens<PointerStream, SHADE_SOLID>(job.m_streams[subframe], *sc, visible.items, visible.binds, visible.num,
+                                               m_resources, true);
+    job.addRecorded(visible.num, timeBegin);
+    sc->bufferSize = job.m_streams[subframe].size() - sc->bufferOffset;
+
+    if(m_mode == MODE_BUFFER_PERS)
+    {
+      sc->buffer = job.m_buffers[subframe];
+    }
   }
 
   // NULL signals we are done
   enqueueShadeCommand_ts(NULL);
 
+  job.m_numItems = tnum;
+
   return dispatches;
 }
 
@@ -534,6 +748,7 @@ void RendererThreadedGLCMD::RunThread(int tid)
   double timeFrame   = 0;
   int    timerFrames = 0;
   size_t dispatches  = 0;
+  size_t items       = 0;
 
   double timePrint = NVPSystem::getTime();
 
@@ -563,6 +778,7 @@ void RendererThreadedGLCMD::RunThread(int tid)
     timeWork -= NVPSystem::getTime();
 
     dispatches += RunThreadFrame(shadetype, job);
+    items += job.m_numItems;
 
     job.m_frame++;
 
@@ -575,6 +791,8 @@ void RendererThreadedGLCMD::RunThread(int tid)
 
     if(timerFrames && (currentTime - timePrint) > 2.0)
     {
+      double itemsRate = timeWork > 0 ? double(items) / timeWork : 0.0;
+
       timeFrame /= double(timerFrames);
       timeWork /= double(timerFrames);
 
@@ -585,13 +803,14 @@ void RendererThreadedGLCMD::RunThread(int tid)
 
       GLuint avgdispatch = GLuint(double(dispatches) / double(timerFrames));
 #if PRINT_TIMER_STATS
-      LOGI("thread %d: work %6d [us] dispatches %5d\n", tid, GLuint(timeWork), GLuint(avgdispatch));
+      LOGI("thread %d: work %6d [us] dispatches %5d drawitems %6.2f M/s\n", tid, GLuint(timeWork), GLuint(avgdispatch), itemsRate / 1000000.0);
 #endif
       timeFrame = 0;
       timeWork  = 0;
 
       timerFrames = 0;
       dispatches  = 0;
+      items       = 0;
     }
   }
 
@@ -628,10 +847,59 @@ void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT res
 
   glNamedBufferSubData(res->m_common.view, 0, sizeof(SceneData), &global.sceneUbo);
 
-  m_workingSet  = global.workingSet;
-  m_shade       = shadetype;
-  m_numCurItems = 0;
-  m_numEnqueues = 0;
+  if(m_config.strategy == STRATEGY_INSTANCED)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, res->m_scene.m_buffers.matrices.buffer);
+  }
+
+  m_workingSet    = global.workingSet;
+  m_shade         = shadetype;
+  m_numCurItems   = 0;
+  m_numEnqueues   = 0;
+
+  m_frameDrawItems     = m_shadeDrawItems[shadetype];
+  m_frameDrawItems.num = findObjectCutoff(m_frameDrawItems.objects, m_frameDrawItems.num, global.visibleObjects);
+  if(m_config.frontToBack != FRONTTOBACK_OFF)
+  {
+    // the workers sort first, then take their chunks from the sorted copy
+    m_frameDrawItems = m_depthSorters[shadetype].begin(global.sceneUbo.viewMatrix, m_frameDrawItems.num, m_numThreads,
+                                                       m_config.frontToBack == FRONTTOBACK_MATERIALS);
+  }
+
+  m_frameTranslucent.num = 0;
+  m_numCurTranslucent    = 0;
+  if(m_config.translucency)
+  {
+    size_t numTranslucent = findObjectCutoff(m_drawList->translucentObjects.data(), m_drawList->translucentItems.size(),
+                                             global.visibleObjects);
+    m_frameTranslucent = m_translucentSorter.begin(global.sceneUbo.viewMatrix, numTranslucent, m_numThreads, false, true);
+    m_translucentCommands.resize((numTranslucent + m_workingSet - 1) / m_workingSet);
+  }
+
+  m_frameCulling            = global.frustumCulling;
+  m_frameIndices            = m_config.frontToBack != FRONTTOBACK_OFF ? m_depthSorters[shadetype].getIndices() : nullptr;
+  m_frameTranslucentIndices = m_translucentSorter.getIndices();
+  m_frameOcclusion          = m_frameCulling ? global.occlusion : nullptr;
+
+  // the shaders cut the geometry behind these planes, culling drops what is entirely cut away
+  const glm::vec4* clipPlanes    = global.sceneUbo.wClipPlanes;
+  uint32_t         numClipPlanes = uint32_t(global.sceneUbo.numClipPlanes);
+  if(m_frameOcclusion)
+  {
+    m_frameOcclusion->begin(global.sceneUbo.viewProjMatrix, float(global.winWidth) / float(std::max(global.winHeight, 1)),
+                            uint32_t(m_numThreads), clipPlanes, numClipPlanes);
+  }
+  if(m_frameCulling)
+  {
+    glm::vec2 viewport = glm::vec2(global.winWidth, global.winHeight);
+    m_cullers[shadetype].begin(global.sceneUbo.viewProjMatrix, m_frameOcclusion, global.minPixels, viewport,
+                               global.coherentBudget, clipPlanes, numClipPlanes);
+    if(m_config.translucency)
+    {
+      m_translucentCuller.begin(global.sceneUbo.viewProjMatrix, m_frameOcclusion, global.minPixels, viewport,
+                                global.coherentBudget, clipPlanes, numClipPlanes);
+    }
+  }
 
   // generate & tokens/cmdbuffers in parallel
 
@@ -703,6 +971,20 @@ void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT res
     }
   }
 
+  // translucent parts last, back to front
+  for(size_t c = 0; c < m_translucentCommands.size() && m_frameTranslucent.num; c++)
+  {
+    ShadeCommand* sc = &m_translucentCommands[c];
+    if(sc->sizes.empty())
+    {
+      continue;
+    }
+    m_numEnqueues++;
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    glDrawCommandsStatesNV(sc->buffer, &sc->offsets[0], &sc->sizes[0], &sc->states[0], &sc->fbos[0],
+                           (uint32_t)sc->sizes.size());
+  }
+
   if(m_mode == MODE_BUFFER_PERS)
   {
     m_syncs[subframe] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
@@ -710,10 +992,42 @@ void RendererThreadedGLCMD::draw(ShadeType shadetype, Resources* NV_RESTRICT res
 
 
   m_frame++;
+  m_depthSortTime       = m_config.frontToBack != FRONTTOBACK_OFF ? m_depthSorters[shadetype].m_sortTime : 0;
+  m_translucentSortTime = m_config.translucency ? m_translucentSorter.m_sortTime : 0;
+  m_numTranslucentDrawn = m_frameTranslucent.num;
+
+  m_cullTested    = 0;
+  m_cullCulled    = 0;
+  m_cullOccluded  = 0;
+  m_cullTime      = 0;
+  m_cullSmall     = 0;
+  m_cullClipped   = 0;
+  m_cullCoherent  = 0;
+  m_occlusionTime = m_frameOcclusion ? m_frameOcclusion->getRasterTime() : 0;
+  size_t numRecorded = 0;
+  double recordTime  = 0;
+  for(int i = 0; i < m_numThreads && m_frameCulling; i++)
+  {
+    m_cullTested += m_jobs[i].m_cull.numTested;
+    m_cullCulled += m_jobs[i].m_cull.numCulled;
+    m_cullOccluded += m_jobs[i].m_cull.numOccluded;
+    m_cullSmall += m_jobs[i].m_cull.numSmall;
+    m_cullClipped += m_jobs[i].m_cull.numClipped;
+    m_cullCoherent += m_jobs[i].m_cull.numCoherent;
+    m_cullTime += m_jobs[i].m_cull.time * 1000.0;
+    numRecorded += m_jobs[i].m_numRecorded;
+    recordTime += m_jobs[i].m_recordTime * 1000.0;
+  }
+  m_cullSmallSaved = numRecorded ? recordTime * double(m_cullSmall) / double(numRecorded) : 0;
 
   glDisableClientState(GL_VERTEX_ATTRIB_ARRAY_UNIFIED_NV);
   glDisableClientState(GL_UNIFORM_BUFFER_UNIFIED_NV);
 
+  if(m_config.strategy == STRATEGY_INSTANCED)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_UBO_MATRIX, 0);
+  }
+
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
   m_state = res->m_state;
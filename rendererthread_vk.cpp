@@ -26,6 +26,7 @@
 #include <mutex>
 #include <queue>
 
+#include "occlusionbuffer.hpp"
 #include "renderer.hpp"
 #include "resources_vk.hpp"
 #include <nvh/nvprint.hpp>
@@ -62,6 +63,7 @@ public:
     unsigned int priority() const { return 10; }
 
     Resources* resources() { return ResourcesVK::get(); }
+    StateCost  stateCost() const { return ResourcesVK::getStateCost(); }
   };
 
   class TypeCmdSlave : public Renderer::Type
@@ -77,6 +79,7 @@ public:
     unsigned int priority() const { return 10; }
 
     Resources* resources() { return ResourcesVK::get(); }
+    StateCost  stateCost() const { return ResourcesVK::getStateCost(); }
   };
 
 public:
@@ -84,6 +87,28 @@ public:
   void deinit();
   void draw(ShadeType shadetype, Resources* NV_RESTRICT resources, const Resources::Global& global);
 
+  bool supportsFrontToBack() const { return true; }
+  bool supportsTranslucency() const { return true; }
+  bool supportsFrustumCulling() const { return true; }
+  bool supportsShadowViews() const { return true; }
+
+  void appendMemoryStats(MemoryStats& stats) const
+  {
+    appendDrawListMemoryStats(stats);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawItemsSolid.capacity() * sizeof(DrawItem);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_drawObjectsSolid.capacity() * sizeof(uint32_t);
+    stats.cpu[MemoryStats::DRAWITEMS] += m_shadeBinds[SHADE_SOLID].capacity() + m_shadeBinds[SHADE_SOLIDWIRE].capacity();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_depthSorters[SHADE_SOLID].getMemoryUsage() + m_depthSorters[SHADE_SOLIDWIRE].getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_translucentSorter.getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_cullers[SHADE_SOLID].getMemoryUsage() + m_cullers[SHADE_SOLIDWIRE].getMemoryUsage();
+    stats.cpu[MemoryStats::DRAWITEMS] += m_translucentCuller.getMemoryUsage();
+    for(uint32_t v = 0; v < Resources::MAX_SHADOWVIEWS; v++)
+    {
+      stats.cpu[MemoryStats::DRAWITEMS] += m_shadowCullers[v].getMemoryUsage();
+    }
+    stats.numCommandBuffers += m_numCommandBuffers;
+  }
+
 
   Mode m_mode;
 
@@ -96,6 +121,7 @@ private:
   struct ShadeCommand
   {
     std::vector<VkCommandBuffer> cmdbuffers;
+    uint32_t                     view = 0;  // 0 main view, 1 + layer for the shadow views
   };
 
 
@@ -111,13 +137,47 @@ private:
     std::mutex              m_hasWorkMutex;
     volatile int            m_hasWork;
 
+    // drawitems processed in the last frame
+    size_t m_numItems;
+    // visible drawitems of the current chunk
+    FrustumCuller::ThreadOutput m_cull;
+    // drawitems recorded in the last frame and the time it took
+    size_t m_numRecorded;
+    double m_recordTime;
+    // same for all shadow views together
+    FrustumCuller::ThreadOutput m_shadowCull;
+    size_t                      m_numShadowRecorded;
+    double                      m_shadowRecordTime;
+
     size_t                     m_scIdx;
     std::vector<ShadeCommand*> m_scs;
 
 
-    void resetFrame() { m_scIdx = 0; }
+    void resetFrame()
+    {
+      m_scIdx             = 0;
+      m_numRecorded       = 0;
+      m_recordTime        = 0;
+      m_numShadowRecorded = 0;
+      m_shadowRecordTime  = 0;
+    }
 
-    ShadeCommand* getFrameCommand()
+    void addRecorded(uint32_t view, size_t num, double timeBegin)
+    {
+      double time = NVPSystem::getTime() - timeBegin;
+      if(view)
+      {
+        m_numShadowRecorded += num;
+        m_shadowRecordTime += time;
+      }
+      else
+      {
+        m_numRecorded += num;
+        m_recordTime += time;
+      }
+    }
+
+    ShadeCommand* getFrameCommand(uint32_t view = 0)
     {
       ShadeCommand* sc;
       if(m_scIdx + 1 > m_scs.size())
@@ -132,12 +192,21 @@ private:
       }
 
       sc->cmdbuffers.clear();
+      sc->view = view;
       return sc;
     }
   };
 
 
-  std::vector<DrawItem> m_drawItems;
+  std::vector<DrawItem> m_drawItemsSolid;
+  std::vector<uint32_t> m_drawObjectsSolid;
+  std::vector<uint8_t>  m_shadeBinds[NUM_SHADES];
+  ShadeDrawItems        m_shadeDrawItems[NUM_SHADES];
+  DepthSorter           m_depthSorters[NUM_SHADES];
+  DepthSorter           m_translucentSorter;
+  FrustumCuller         m_cullers[NUM_SHADES];
+  FrustumCuller         m_translucentCuller;
+  FrustumCuller         m_shadowCullers[Resources::MAX_SHADOWVIEWS];
   ResourcesVK* NV_RESTRICT m_resources;
   int                      m_numThreads;
 
@@ -152,11 +221,31 @@ private:
   volatile int    m_ready;
   volatile int    m_stopThreads;
   volatile size_t m_numCurItems;
+  // view m_numCurItems belongs to, all views share one queue of chunks
+  volatile uint32_t m_numCurView;
+  uint32_t          m_frameViews;
+  // visible part of m_shadeDrawItems[m_shade] or its depth sorted copy
+  ShadeDrawItems m_frameDrawItems;
+  // visible part of m_shadeDrawItems[SHADE_SOLID] in its original order, drawn by every shadow view
+  ShadeDrawItems m_frameShadowItems;
+  // chunks of each shadow view, executed into their layer after all threads are done
+  std::vector<ShadeCommand*> m_shadowCommands[Resources::MAX_SHADOWVIEWS];
+  // visible translucent drawitems back to front, handed out after the opaque ones
+  ShadeDrawItems  m_frameTranslucent;
+  volatile size_t m_numCurTranslucent;
+  // one per translucent chunk, draw() executes them in order
+  std::vector<ShadeCommand> m_translucentCommands;
+  // frustum culling this frame, the indices map the sorted lists back to the ones the cullers know
+  bool             m_frameCulling;
+  const uint32_t*  m_frameIndices;
+  const uint32_t*  m_frameTranslucentIndices;
+  OcclusionBuffer* m_frameOcclusion;
 
   std::condition_variable m_readyCond;
   std::mutex              m_readyMutex;
 
   size_t                    m_numEnqueues;
+  uint32_t                  m_numCommandBuffers;
   std::queue<ShadeCommand*> m_drawQueue;
 
   std::mutex              m_workMutex;
@@ -171,49 +260,109 @@ private:
     job->renderer->RunThread(job->index);
   }
 
-  bool getWork_ts(size_t& start, size_t& num)
+  // chunks of the main view first, then of each shadow view
+  bool getWork_ts(uint32_t& view, size_t& start, size_t& num)
   {
     std::lock_guard<std::mutex> lock(m_workMutex);
-    bool                        hasWork = false;
 
     const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
 
-    if(m_numCurItems < total)
+    while(m_numCurView < m_frameViews)
     {
-      size_t batch = std::min(total - m_numCurItems, chunkSize);
-      start        = m_numCurItems;
-      num          = batch;
-      m_numCurItems += batch;
-      hasWork = true;
+      size_t total = m_numCurView ? m_frameShadowItems.num : m_frameDrawItems.num;
+      if(m_numCurItems < total)
+      {
+        size_t batch = std::min(total - m_numCurItems, chunkSize);
+        view         = m_numCurView;
+        start        = m_numCurItems;
+        num          = batch;
+        m_numCurItems += batch;
+        return true;
+      }
+
+      m_numCurView++;
+      m_numCurItems = 0;
     }
-    else
+
+    view  = 0;
+    start = 0;
+    num   = 0;
+    return false;
+  }
+
+  // like getWork_ts for the translucent drawitems, chunk is the index into m_translucentCommands
+  bool getTranslucentWork_ts(size_t& chunk, size_t& start, size_t& num)
+  {
+    std::lock_guard<std::mutex> lock(m_workMutex);
+
+    const size_t chunkSize = m_workingSet;
+    size_t       total     = m_frameTranslucent.num;
+
+    if(m_numCurTranslucent < total)
     {
-      hasWork = false;
-      start   = 0;
-      num     = 0;
+      chunk = m_numCurTranslucent / chunkSize;
+      start = m_numCurTranslucent;
+      num   = std::min(total - m_numCurTranslucent, chunkSize);
+      m_numCurTranslucent += num;
+      return true;
     }
 
-    return hasWork;
+    return false;
   }
 
   void         RunThread(int index);
   unsigned int RunThreadFrame(ShadeType shadetype, ThreadJob& job);
 
+  // drawitems of a chunk to record, only the visible ones with frustum culling
+  ShadeDrawItems getChunk(FrustumCuller::ThreadOutput& output,
+                          const FrustumCuller&         culler,
+                          const ShadeDrawItems&        list,
+                          const uint32_t*              indices,
+                          size_t                       begin,
+                          size_t                       num)
+  {
+    if(m_frameCulling)
+    {
+      return culler.cull(list, indices, begin, num, output);
+    }
+
+    ShadeDrawItems chunk;
+    chunk.items   = list.items + begin;
+    chunk.binds   = list.binds + begin;
+    chunk.objects = nullptr;
+    chunk.num     = num;
+    return chunk;
+  }
+
+  ShadeDrawItems getViewChunk(ThreadJob& job, ShadeType shadetype, uint32_t view, size_t begin, size_t num)
+  {
+    if(view)
+    {
+      return getChunk(job.m_shadowCull, m_shadowCullers[view - 1], m_frameShadowItems, nullptr, begin, num);
+    }
+    return getChunk(job.m_cull, m_cullers[shadetype], m_frameDrawItems, m_frameIndices, begin, num);
+  }
+
   void enqueueShadeCommand_ts(ShadeCommand* sc);
   void submitShadeCommand_ts(ShadeCommand* sc);
+  // enqueued or submitted depending on m_mode, returns the dispatches
+  unsigned int dispatchShadeCommand_ts(ShadeCommand* sc);
 
-  template <ShadeType shadetype, bool sorted>
-  void GenerateCmdBuffers(ShadeCommand& sc, nvvk::RingCommandPool& pool, const DrawItem* NV_RESTRICT drawItems, size_t num, const ResourcesVK* NV_RESTRICT res)
+  template <ShadeType shadetype>
+  void GenerateCmdBuffers(ShadeCommand&               sc,
+                          nvvk::RingCommandPool&      pool,
+                          const DrawItem* NV_RESTRICT drawItems,
+                          const uint8_t* NV_RESTRICT  binds,
+                          size_t                      num,
+                          const ResourcesVK* NV_RESTRICT res,
+                          bool                           translucent = false)
   {
     const CadScene* NV_RESTRICT scene     = m_scene;
     const CadSceneVK&           sceneVK   = res->m_scene;
     bool                        solidwire = (shadetype == SHADE_SOLIDWIRE);
+    uint32_t                    view      = sc.view;
 
-    int  lastMaterial = -1;
-    int  lastGeometry = -1;
-    int  lastMatrix   = -1;
-    bool lastSolid    = true;
+    bool lastSolid = true;
 
     // TODO could recycle pool's allocated commandbuffers and not free them
     VkCommandBuffer cmd;
@@ -221,31 +370,62 @@ private:
     if(m_mode == MODE_CMD_MAINSUBMIT)
     {
       cmd = pool.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, false);
-      res->cmdBegin(cmd, true, false, true);
+      res->cmdBegin(cmd, true, false, true, int(view) - 1);
     }
     else
     {
       cmd = pool.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
       res->cmdBegin(cmd, true, true, false);
       //res->cmdPipelineBarrier(cmd, true);
-      res->cmdBeginRenderPass(cmd, false);
+      if(view)
+      {
+        res->cmdBeginShadowPass(cmd, view - 1, false);
+      }
+      else
+      {
+        res->cmdBeginRenderPass(cmd, false);
+      }
+    }
+    if(view)
+    {
+      res->cmdShadowDynamicState(cmd);
+    }
+    else
+    {
+      res->cmdDynamicState(cmd);
     }
-    res->cmdDynamicState(cmd);
 
-    VkPipeline solidPipeline    = solidwire ? res->m_pipes.line_tris : res->m_pipes.tris;
-    VkPipeline nonSolidPipeline = res->m_pipes.line;
+    bool                          instanced = m_config.strategy == STRATEGY_INSTANCED;
+    const ResourcesVK::Pipelines& pipes     = instanced ? res->m_pipesInstanced : res->m_pipes;
 
-    if(num)
+    VkPipeline solidPipeline    = translucent ? pipes.tris_blend : solidwire ? pipes.line_tris : pipes.tris;
+    VkPipeline nonSolidPipeline = pipes.line;
+    if(view)
+    {
+      // shadow views only draw the solid list, depth only
+      solidPipeline = pipes.tris_depth;
+    }
+
+    if(num && instanced)
+    {
+      bool solid = shadetype == SHADE_SOLID ? true : drawItems[0].solid;
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, solid ? solidPipeline : nonSolidPipeline);
+
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(cmd, 2, 1, &res->m_instances.instancesBuffer, &offset);
+      lastSolid = solid;
+    }
+    else if(num)
     {
       bool solid = shadetype == SHADE_SOLID ? true : drawItems[0].solid;
       vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, solid ? solidPipeline : nonSolidPipeline);
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
       vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_SCENE, 1,
-                              res->m_drawing.at(DRAW_UBO_SCENE).getSets(), 0, NULL);
+                              res->m_drawing.at(DRAW_UBO_SCENE).getSets() + view, 0, NULL);
 #endif
 #if UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW || UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_INDEX
       vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_SCENE, 1,
-                              res->m_drawing.getSets(), 0, NULL);
+                              res->m_drawing.getSets() + view, 0, NULL);
 #endif
       lastSolid = solid;
     }
@@ -256,12 +436,10 @@ private:
     {
       const DrawItem& di = *drawItems++;
 
-      if(shadetype == SHADE_SOLID && !di.solid)
-      {
-        if(sorted)
-          break;
-        continue;
-      }
+      // every chunk is its own command buffer
+      uint32_t bind = first ? uint32_t(DRAWBIND_ALL) : *binds;
+      binds++;
+      first = false;
 
       if(shadetype == SHADE_SOLIDWIRE && di.solid != lastSolid)
       {
@@ -270,19 +448,46 @@ private:
         lastSolid = di.solid;
       }
 
-      if(lastGeometry != di.geometryIndex)
+      if(bind & DRAWBIND_GEOMETRY)
       {
         const CadSceneVK::Geometry& vkgeo = sceneVK.m_geometry[di.geometryIndex];
 
-        vkCmdBindVertexBuffers(cmd, 0, 1, &vkgeo.vbo.buffer, &vkgeo.vbo.offset);
+        if(view)
+        {
+          // depth only reads the position stream
+          vkCmdBindVertexBuffers(cmd, 1, 1, &vkgeo.vboPos.buffer, &vkgeo.vboPos.offset);
+        }
+        else if(shadetype == SHADE_SOLIDWIRE)
+        {
+          VkBuffer     buffers[2] = {vkgeo.vbo.buffer, vkgeo.vboPos.buffer};
+          VkDeviceSize offsets[2] = {vkgeo.vbo.offset, vkgeo.vboPos.offset};
+          vkCmdBindVertexBuffers(cmd, 0, 2, buffers, offsets);
+        }
+        else
+        {
+          vkCmdBindVertexBuffers(cmd, 0, 1, &vkgeo.vbo.buffer, &vkgeo.vbo.offset);
+        }
         vkCmdBindIndexBuffer(cmd, vkgeo.ibo.buffer, vkgeo.ibo.offset, VK_INDEX_TYPE_UINT32);
+      }
+
+      if(instanced)
+      {
+        // single set, matrices are fetched per instance
+        if(bind & DRAWBIND_MATERIAL)
+        {
+          uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
+          vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawInstanced.getPipeLayout(), 0, 1,
+                                  res->m_drawInstanced.getSets() + view, 1, &offset);
+        }
 
-        lastGeometry = di.geometryIndex;
+        const InstanceGroup& group = m_drawList->instanceGroups[di.matrixIndex];
+        vkCmdDrawIndexed(cmd, di.count, group.numInstances, di.firstIndex, 0, group.firstInstance);
+        continue;
       }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
         uint32_t offset = di.matrixIndex * res->m_alignedMatrixSize;
@@ -292,10 +497,9 @@ private:
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_MATRIX,
                                 1, res->m_drawing.at(DRAW_UBO_MATRIX).getSets() + di.matrixIndex, 0, NULL);
 #endif
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
         uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
@@ -305,12 +509,11 @@ private:
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), DRAW_UBO_MATERIAL,
                                 1, res->m_drawing.at(DRAW_UBO_MATERIAL).getSets() + di.materialIndex, 0, NULL);
 #endif
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC
 
-      if(lastMaterial != di.materialIndex || lastMatrix != di.matrixIndex)
+      if(bind & (DRAWBIND_MATERIAL | DRAWBIND_MATRIX))
       {
 #if UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC
         uint32_t offsets[DRAW_UBOS_NUM];
@@ -324,49 +527,38 @@ private:
         offsets[DRAW_UBO_MATERIAL - 1] = di.materialIndex * res->m_alignedMaterialSize;
 #endif
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawing.getPipeLayout(), 0, 1,
-                                res->m_drawing.getSets(), sizeof(offsets) / sizeof(offsets[0]), offsets);
-
-        lastMaterial = di.materialIndex;
-        lastMatrix   = di.matrixIndex;
+                                res->m_drawing.getSets() + view, sizeof(offsets) / sizeof(offsets[0]), offsets);
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectData),
                            &scene->m_matrices[di.matrixIndex]);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(ObjectData),
                            sizeof(MaterialData), &scene->m_materials[di.materialIndex]);
-
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_INDEX
-      if(lastMatrix != di.matrixIndex)
+      if(bind & DRAWBIND_MATRIX)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(int), &di.matrixIndex);
-
-        lastMatrix = di.matrixIndex;
       }
 
-      if(lastMaterial != di.materialIndex)
+      if(bind & DRAWBIND_MATERIAL)
       {
         vkCmdPushConstants(cmd, res->m_drawing.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(int), sizeof(int),
                            &di.materialIndex);
-
-        lastMaterial = di.materialIndex;
       }
 ///////////////////////////////////////////////////////////////////////////////////////////
 #endif
 
       // drawcall
-      vkCmdDrawIndexed(cmd, di.range.count, 1, (uint32_t)(di.range.offset / sizeof(uint32_t)), 0, 0);
+      vkCmdDrawIndexed(cmd, di.count, 1, di.firstIndex, 0, 0);
     }
 
     if(m_mode == MODE_CMD_WORKERSUBMIT)
@@ -381,32 +573,18 @@ private:
                           ShadeType              shadeType,
                           nvvk::RingCommandPool& pool,
                           const DrawItem* NV_RESTRICT drawItems,
+                          const uint8_t* NV_RESTRICT  binds,
                           size_t                      num,
                           const ResourcesVK* NV_RESTRICT res)
   {
-    if(m_config.sorted)
+    switch(shadeType)
     {
-      switch(shadeType)
-      {
-        case SHADE_SOLID:
-          GenerateCmdBuffers<SHADE_SOLID, true>(sc, pool, drawItems, num, res);
-          break;
-        case SHADE_SOLIDWIRE:
-          GenerateCmdBuffers<SHADE_SOLIDWIRE, true>(sc, pool, drawItems, num, res);
-          break;
-      }
-    }
-    else
-    {
-      switch(shadeType)
-      {
-        case SHADE_SOLID:
-          GenerateCmdBuffers<SHADE_SOLID, false>(sc, pool, drawItems, num, res);
-          break;
-        case SHADE_SOLIDWIRE:
-          GenerateCmdBuffers<SHADE_SOLIDWIRE, false>(sc, pool, drawItems, num, res);
-          break;
-      }
+      case SHADE_SOLID:
+        GenerateCmdBuffers<SHADE_SOLID>(sc, pool, drawItems, binds, num, res);
+        break;
+      case SHADE_SOLIDWIRE:
+        GenerateCmdBuffers<SHADE_SOLIDWIRE>(sc, pool, drawItems, binds, num, res);
+        break;
     }
   }
 };
@@ -420,18 +598,39 @@ void RendererThreadedVK::init(const CadScene* NV_RESTRICT scene, Resources* reso
   const ResourcesVK* res = (const ResourcesVK*)resources;
   m_scene                = scene;
 
-  fillDrawItems(m_drawItems, config, true, true);
+  acquireDrawList(resources, config);
+
+  partitionShadeDrawItems(m_shadeDrawItems, m_drawItemsSolid, m_drawObjectsSolid, m_shadeBinds, *m_drawList, config.sorted);
+  LOGI("drawitems solid: %d\n", uint32_t(m_shadeDrawItems[SHADE_SOLID].num));
+
+  for(int i = 0; i < NUM_SHADES; i++)
+  {
+    m_depthSorters[i].init(scene, m_drawList.get(), resources, m_shadeDrawItems[i]);
+  }
 
-  LOGI("drawitems: %d\n", uint32_t(m_drawItems.size()));
+  ShadeDrawItems translucent;
+  translucent.items   = m_drawList->translucentItems.data();
+  translucent.binds   = nullptr;
+  translucent.objects = m_drawList->translucentObjects.data();
+  translucent.num     = m_drawList->translucentItems.size();
+  m_translucentSorter.init(scene, m_drawList.get(), resources, translucent);
 
-  if(config.sorted)
+  for(int i = 0; i < NUM_SHADES; i++)
+  {
+    m_cullers[i].init(scene, m_drawList.get(), resources, m_shadeDrawItems[i]);
+  }
+  m_translucentCuller.init(scene, m_drawList.get(), resources, translucent);
+  for(uint32_t v = 0; v < Resources::MAX_SHADOWVIEWS; v++)
   {
-    std::sort(m_drawItems.begin(), m_drawItems.end(), DrawItem_compare_groups);
+    m_shadowCullers[v].init(scene, m_drawList.get(), resources, m_shadeDrawItems[SHADE_SOLID]);
   }
 
   m_resources  = (ResourcesVK*)resources;
+  m_resources->initInstances(m_drawList->instanceMatrices);
   m_numThreads = config.threads;
 
+  m_numCommandBuffers = 0;
+
   // make jobs
   m_ready       = 0;
   m_jobs        = new ThreadJob[m_numThreads];
@@ -490,7 +689,25 @@ void RendererThreadedVK::deinit()
 
   delete[] m_jobs;
 
-  m_drawItems.clear();
+  m_resources->deinitInstances();
+
+  m_depthSorters[SHADE_SOLID].deinit();
+  m_depthSorters[SHADE_SOLIDWIRE].deinit();
+  m_translucentSorter.deinit();
+  m_translucentCommands.clear();
+  m_cullers[SHADE_SOLID].deinit();
+  m_cullers[SHADE_SOLIDWIRE].deinit();
+  m_translucentCuller.deinit();
+  for(uint32_t v = 0; v < Resources::MAX_SHADOWVIEWS; v++)
+  {
+    m_shadowCullers[v].deinit();
+    m_shadowCommands[v].clear();
+  }
+  m_drawList.reset();
+  m_drawItemsSolid.clear();
+  m_drawObjectsSolid.clear();
+  m_shadeBinds[SHADE_SOLID].clear();
+  m_shadeBinds[SHADE_SOLIDWIRE].clear();
 }
 
 void RendererThreadedVK::enqueueShadeCommand_ts(ShadeCommand* sc)
@@ -511,12 +728,31 @@ void RendererThreadedVK::submitShadeCommand_ts(ShadeCommand* sc)
     submitInfo.commandBufferCount = (uint32_t)sc->cmdbuffers.size();
     submitInfo.pCommandBuffers    = sc->cmdbuffers.data();
     vkQueueSubmit(m_resources->m_submission.getQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+    m_numCommandBuffers += (uint32_t)sc->cmdbuffers.size();
     NV_BARRIER();
   }
 
   sc->cmdbuffers.clear();
 }
 
+unsigned int RendererThreadedVK::dispatchShadeCommand_ts(ShadeCommand* sc)
+{
+  if(sc->cmdbuffers.empty())
+  {
+    return 0;
+  }
+
+  if(m_mode == MODE_CMD_MAINSUBMIT)
+  {
+    enqueueShadeCommand_ts(sc);
+  }
+  else if(m_mode == MODE_CMD_WORKERSUBMIT)
+  {
+    submitShadeCommand_ts(sc);
+  }
+  return 1;
+}
+
 unsigned int RendererThreadedVK::RunThreadFrame(ShadeType shadetype, ThreadJob& job)
 {
   unsigned int dispatches = 0;
@@ -529,56 +765,92 @@ unsigned int RendererThreadedVK::RunThreadFrame(ShadeType shadetype, ThreadJob&
   size_t offset = 0;
 
   job.resetFrame();
+
+  if(m_config.frontToBack != FRONTTOBACK_OFF)
+  {
+    m_depthSorters[shadetype].sortThread(job.index);
+  }
+  if(m_config.translucency)
+  {
+    m_translucentSorter.sortThread(job.index);
+  }
+  if(m_frameOcclusion)
+  {
+    // all threads rasterize their rows, tests start once the buffer is complete
+    m_frameOcclusion->rasterizeThread(job.index);
+  }
+  job.m_cull.resetFrame();
+  job.m_shadowCull.resetFrame();
   job.m_pool.setCycle(m_cycleCurrent);
 
+  uint32_t view;
   if(m_batchedSubmit)
   {
-    // batched helps performance when workersubmit is chosen, as we make less vkQueueSubmits
+    // batched helps performance when workersubmit is chosen, as we make less vkQueueSubmits.
+    // one batch per view, they go into different passes
     ShadeCommand* sc = job.getFrameCommand();
-    while(getWork_ts(begin, num))
+    while(getWork_ts(view, begin, num))
     {
-      GenerateCmdBuffers(*sc, shadetype, job.m_pool, &m_drawItems[begin], num, m_resources);
-      tnum += num;
-    }
-    if(!sc->cmdbuffers.empty())
-    {
-      if(m_mode == MODE_CMD_MAINSUBMIT)
+      ShadeDrawItems chunk = getViewChunk(job, shadetype, view, begin, num);
+      if(chunk.num)
       {
-        enqueueShadeCommand_ts(sc);
-      }
-      else if(m_mode == MODE_CMD_WORKERSUBMIT)
-      {
-        submitShadeCommand_ts(sc);
+        if(sc->view != view && !sc->cmdbuffers.empty())
+        {
+          dispatches += dispatchShadeCommand_ts(sc);
+          sc = job.getFrameCommand(view);
+        }
+        sc->view = view;
+
+        double timeBegin = NVPSystem::getTime();
+        GenerateCmdBuffers(*sc, view ? SHADE_SOLID : shadetype, job.m_pool, chunk.items, chunk.binds, chunk.num,
+                           m_resources);
+        job.addRecorded(view, chunk.num, timeBegin);
       }
-      dispatches += 1;
+      tnum += num;
     }
+    dispatches += dispatchShadeCommand_ts(sc);
   }
   else
   {
-    while(getWork_ts(begin, num))
+    while(getWork_ts(view, begin, num))
     {
-      ShadeCommand* sc = job.getFrameCommand();
-      GenerateCmdBuffers(*sc, shadetype, job.m_pool, &m_drawItems[begin], num, m_resources);
-
-      if(!sc->cmdbuffers.empty())
+      ShadeDrawItems chunk = getViewChunk(job, shadetype, view, begin, num);
+      tnum += num;
+      if(!chunk.num)
       {
-        if(m_mode == MODE_CMD_MAINSUBMIT)
-        {
-          enqueueShadeCommand_ts(sc);
-        }
-        else if(m_mode == MODE_CMD_WORKERSUBMIT)
-        {
-          submitShadeCommand_ts(sc);
-        }
-        dispatches += 1;
+        continue;
       }
-      tnum += num;
+
+      ShadeCommand* sc        = job.getFrameCommand(view);
+      double        timeBegin = NVPSystem::getTime();
+      GenerateCmdBuffers(*sc, view ? SHADE_SOLID : shadetype, job.m_pool, chunk.items, chunk.binds, chunk.num, m_resources);
+      job.addRecorded(view, chunk.num, timeBegin);
+
+      dispatches += dispatchShadeCommand_ts(sc);
     }
   }
 
+  // the translucent chunks are only recorded here, draw() executes them in back to front order
+  size_t chunk;
+  while(getTranslucentWork_ts(chunk, begin, num))
+  {
+    ShadeCommand&  sc      = m_translucentCommands[chunk];
+    ShadeDrawItems visible =
+        getChunk(job.m_cull, m_translucentCuller, m_frameTranslucent, m_frameTranslucentIndices, begin, num);
+    if(visible.num)
+    {
+      double timeBegin = NVPSystem::getTime();
+      GenerateCmdBuffers<SHADE_SOLID>(sc, job.m_pool, visible.items, visible.binds, visible.num, m_resources, true);
+      job.addRecorded(0, visible.num, timeBegin);
+    }
+    tnum += num;
+  }
+
   // NULL signals we are done
   enqueueShadeCommand_ts(NULL);
 
+  job.m_numItems = tnum;
+
   return dispatches;
 }
 
@@ -591,6 +863,7 @@ void RendererThreadedVK::RunThread(int tid)
   double timeFrame   = 0;
   int    timerFrames = 0;
   size_t dispatches  = 0;
+  size_t items       = 0;
 
   double timePrint = NVPSystem::getTime();
 
@@ -619,6 +892,7 @@ void RendererThreadedVK::RunThread(int tid)
     timeWork -= NVPSystem::getTime();
 
     dispatches += RunThreadFrame(shadetype, job);
+    items += job.m_numItems;
 
     job.m_frame++;
 
@@ -631,6 +905,8 @@ void RendererThreadedVK::RunThread(int tid)
 
     if(timerFrames && (currentTime - timePrint) > 2.0)
     {
+      double itemsRate = timeWork > 0 ? double(items) / timeWork : 0.0;
+
       timeFrame /= double(timerFrames);
       timeWork /= double(timerFrames);
 
@@ -642,13 +918,14 @@ void RendererThreadedVK::RunThread(int tid)
       float avgdispatch = float(double(dispatches) / double(timerFrames));
 
 #if PRINT_TIMER_STATS
-      LOGI("thread %d: work %6d [us] dispatches %5.1f\n", tid, uint32_t(timeWork), avgdispatch);
+      LOGI("thread %d: work %6d [us] dispatches %5.1f drawitems %6.2f M/s\n", tid, uint32_t(timeWork), avgdispatch, itemsRate / 1000000.0);
 #endif
       timeFrame = 0;
       timeWork  = 0;
 
       timerFrames = 0;
       dispatches  = 0;
+      items       = 0;
     }
   }
 
@@ -666,11 +943,39 @@ void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resour
 
   nvh::Profiler::SectionID sec;
 
+  // depth-only views, limited to the layers the resources provide
+  uint32_t numShadowViews = std::min(global.numShadowViews, res->m_shadowMaps.numLayers);
+
   // generic state setup
 
-  VkCommandBuffer primary = res->createTempCmdBuffer();
+  VkCommandBuffer shadowPrimary = numShadowViews ? res->createTempCmdBuffer() : VK_NULL_HANDLE;
+  VkCommandBuffer primary       = res->createTempCmdBuffer();
   {
-    sec = res->m_profilerVK.beginSection("Render", primary);
+    // the shadow views are submitted ahead of the main view
+    sec = res->m_profilerVK.beginSection("Render", shadowPrimary ? shadowPrimary : primary);
+
+    if(shadowPrimary)
+    {
+      for(uint32_t v = 0; v < numShadowViews; v++)
+      {
+        vkCmdUpdateBuffer(shadowPrimary, res->m_common.viewBuffer, res->getViewInfo(1 + v).offset, sizeof(SceneData),
+                          (const uint32_t*)&global.shadowUbos[v]);
+      }
+      res->cmdShadowBarrier(shadowPrimary, numShadowViews);
+
+      if(m_mode == MODE_CMD_WORKERSUBMIT)
+      {
+        // the workers submit their chunks into preserving passes
+        for(uint32_t v = 0; v < numShadowViews; v++)
+        {
+          res->cmdBeginShadowPass(shadowPrimary, v, true);
+          vkCmdEndRenderPass(shadowPrimary);
+        }
+        vkEndCommandBuffer(shadowPrimary);
+
+        res->submissionEnqueue(shadowPrimary);
+      }
+    }
 
     vkCmdUpdateBuffer(primary, res->m_common.viewBuffer, 0, sizeof(SceneData), (const uint32_t*)&global.sceneUbo);
 
@@ -687,12 +992,71 @@ void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resour
     }
   }
 
-  m_batchedSubmit    = global.batchedSubmit;
-  m_workingSet       = global.workingSet;
-  m_shade            = shadetype;
-  m_numCurItems      = 0;
-  m_numEnqueues      = 0;
-  m_cycleCurrent     = res->m_ringFences.getCycleIndex();
+  m_batchedSubmit     = global.batchedSubmit;
+  m_workingSet        = global.workingSet;
+  m_shade             = shadetype;
+  m_numCurItems       = 0;
+  m_numCurView        = 0;
+  m_frameViews        = 1 + numShadowViews;
+  m_numEnqueues       = 0;
+  m_numCommandBuffers = 0;
+  m_cycleCurrent      = res->m_ringFences.getCycleIndex();
+
+  m_frameDrawItems     = m_shadeDrawItems[shadetype];
+  m_frameDrawItems.num = findObjectCutoff(m_frameDrawItems.objects, m_frameDrawItems.num, global.visibleObjects);
+  if(m_config.frontToBack != FRONTTOBACK_OFF)
+  {
+    // the workers sort first, then take their chunks from the sorted copy
+    m_frameDrawItems = m_depthSorters[shadetype].begin(global.sceneUbo.viewMatrix, m_frameDrawItems.num, m_numThreads,
+                                                       m_config.frontToBack == FRONTTOBACK_MATERIALS);
+  }
+
+  m_frameShadowItems     = m_shadeDrawItems[SHADE_SOLID];
+  m_frameShadowItems.num = findObjectCutoff(m_frameShadowItems.objects, m_frameShadowItems.num, global.visibleObjects);
+
+  m_frameTranslucent.num = 0;
+  m_numCurTranslucent    = 0;
+  if(m_config.translucency)
+  {
+    size_t numTranslucent = findObjectCutoff(m_drawList->translucentObjects.data(), m_drawList->translucentItems.size(),
+                                             global.visibleObjects);
+    m_frameTranslucent = m_translucentSorter.begin(global.sceneUbo.viewMatrix, numTranslucent, m_numThreads, false, true);
+    m_translucentCommands.resize((numTranslucent + m_workingSet - 1) / m_workingSet);
+  }
+
+  m_frameCulling            = global.frustumCulling;
+  m_frameIndices            = m_config.frontToBack != FRONTTOBACK_OFF ? m_depthSorters[shadetype].getIndices() : nullptr;
+  m_frameTranslucentIndices = m_translucentSorter.getIndices();
+  m_frameOcclusion          = m_frameCulling ? global.occlusion : nullptr;
+
+  // the shaders cut the geometry behind these planes, culling drops what is entirely cut away
+  const glm::vec4* clipPlanes    = global.sceneUbo.wClipPlanes;
+  uint32_t         numClipPlanes = uint32_t(global.sceneUbo.numClipPlanes);
+  if(m_frameOcclusion)
+  {
+    m_frameOcclusion->begin(global.sceneUbo.viewProjMatrix, float(global.winWidth) / float(std::max(global.winHeight, 1)),
+                            uint32_t(m_numThreads), clipPlanes, numClipPlanes);
+  }
+  if(m_frameCulling)
+  {
+    // one eye with stereo, the passes broadcast the single recording to both.
+    // sceneUbo.viewProjMatrix is then a frustum containing both eyes
+    glm::vec2 viewport = glm::vec2(global.sceneUbo.viewport.x, global.sceneUbo.viewport.y);
+    m_cullers[shadetype].begin(global.sceneUbo.viewProjMatrix, m_frameOcclusion, global.minPixels, viewport,
+                               global.coherentBudget, clipPlanes, numClipPlanes);
+    if(m_config.translucency)
+    {
+      m_translucentCuller.begin(global.sceneUbo.viewProjMatrix, m_frameOcclusion, global.minPixels, viewport,
+                                global.coherentBudget, clipPlanes, numClipPlanes);
+    }
+    // the occlusion buffer only matches the main view
+    glm::vec2 shadowViewport = glm::vec2(float(res->m_shadowMaps.size));
+    for(uint32_t v = 0; v < numShadowViews; v++)
+    {
+      m_shadowCullers[v].begin(global.shadowUbos[v].viewProjMatrix, nullptr, global.minPixels, shadowViewport,
+                               global.coherentBudget, clipPlanes, numClipPlanes);
+    }
+  }
 
   // generate cmdbuffers in parallel
 
@@ -737,8 +1101,17 @@ void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resour
         {
           assert(m_mode == MODE_CMD_MAINSUBMIT);
           m_numEnqueues++;
-          vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
-          sc->cmdbuffers.clear();
+          m_numCommandBuffers += (uint32_t)sc->cmdbuffers.size();
+          if(sc->view)
+          {
+            // executed into their layer once all threads are done
+            m_shadowCommands[sc->view - 1].push_back(sc);
+          }
+          else
+          {
+            vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+            sc->cmdbuffers.clear();
+          }
         }
         else
         {
@@ -754,12 +1127,88 @@ void RendererThreadedVK::draw(ShadeType shadetype, Resources* NV_RESTRICT resour
     }
   }
 
+  // translucent parts last, back to front
+  for(size_t c = 0; c < m_translucentCommands.size() && m_frameTranslucent.num; c++)
+  {
+    ShadeCommand* sc = &m_translucentCommands[c];
+    if(sc->cmdbuffers.empty())
+    {
+      // entirely culled
+      continue;
+    }
+    if(m_mode == MODE_CMD_MAINSUBMIT)
+    {
+      m_numEnqueues++;
+      m_numCommandBuffers += (uint32_t)sc->cmdbuffers.size();
+      vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+      sc->cmdbuffers.clear();
+    }
+    else
+    {
+      submitShadeCommand_ts(sc);
+    }
+  }
+
   m_frame++;
+  m_depthSortTime       = m_config.frontToBack != FRONTTOBACK_OFF ? m_depthSorters[shadetype].m_sortTime : 0;
+  m_translucentSortTime = m_config.translucency ? m_translucentSorter.m_sortTime : 0;
+  m_numTranslucentDrawn = m_frameTranslucent.num;
+
+  m_cullTested    = 0;
+  m_cullCulled    = 0;
+  m_cullOccluded  = 0;
+  m_cullTime      = 0;
+  m_cullSmall     = 0;
+  m_cullClipped   = 0;
+  m_cullCoherent  = 0;
+  m_occlusionTime = m_frameOcclusion ? m_frameOcclusion->getRasterTime() : 0;
+  size_t numRecorded = 0;
+  double recordTime  = 0;
+  for(int i = 0; i < m_numThreads && m_frameCulling; i++)
+  {
+    m_cullTested += m_jobs[i].m_cull.numTested;
+    m_cullCulled += m_jobs[i].m_cull.numCulled;
+    m_cullOccluded += m_jobs[i].m_cull.numOccluded;
+    m_cullSmall += m_jobs[i].m_cull.numSmall;
+    m_cullClipped += m_jobs[i].m_cull.numClipped;
+    m_cullCoherent += m_jobs[i].m_cull.numCoherent;
+    m_cullTime += m_jobs[i].m_cull.time * 1000.0;
+    numRecorded += m_jobs[i].m_numRecorded;
+    recordTime += m_jobs[i].m_recordTime * 1000.0;
+  }
+  m_cullSmallSaved = numRecorded ? recordTime * double(m_cullSmall) / double(numRecorded) : 0;
+
+  m_shadowViews = numShadowViews;
+  m_shadowDrawn = 0;
+  m_shadowTime  = 0;
+  for(int i = 0; i < m_numThreads && numShadowViews; i++)
+  {
+    m_shadowDrawn += m_jobs[i].m_numShadowRecorded;
+    m_shadowTime += (m_jobs[i].m_shadowCull.time + m_jobs[i].m_shadowRecordTime) * 1000.0;
+  }
 
   NV_BARRIER();
 
   if(m_mode == MODE_CMD_MAINSUBMIT)
   {
+    if(shadowPrimary)
+    {
+      for(uint32_t v = 0; v < numShadowViews; v++)
+      {
+        res->cmdBeginShadowPass(shadowPrimary, v, true, true);
+        for(ShadeCommand* sc : m_shadowCommands[v])
+        {
+          vkCmdExecuteCommands(shadowPrimary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+          sc->cmdbuffers.clear();
+        }
+        vkCmdEndRenderPass(shadowPrimary);
+        m_shadowCommands[v].clear();
+      }
+      vkEndCommandBuffer(shadowPrimary);
+
+      res->submissionEnqueue(shadowPrimary);
+    }
+
     vkCmdEndRenderPass(primary);
     res->m_profilerVK.endSection(sec, primary);
     vkEndCommandBuffer(primary);
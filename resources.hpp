@@ -42,6 +42,8 @@ struct ImDrawData;
 
 namespace csfthreaded {
 
+class OcclusionBuffer;
+
 enum ShadeType
 {
   SHADE_SOLID,
@@ -72,22 +74,42 @@ struct PointerStream
   size_t size() { return used; }
 };
 
+// relative cost of the state changes between two consecutive drawcalls,
+// only the ratios matter. used by the draw order optimizer
+struct StateCost
+{
+  float pipeline;  // solid <-> wire
+  float geometry;  // vertex & index buffers
+  float material;
+  float matrix;
+  float draw;  // every drawcall, independent of order
+};
+
 class Resources
 {
 public:
   static uint32_t s_vkDevice;
   static uint32_t s_glDevice;
 
+  // depth-only views drawn in addition to the main view, see Renderer::supportsShadowViews
+  static const uint32_t MAX_SHADOWVIEWS = 4;
 
   struct Global
   {
-    SceneData     sceneUbo;
-    AnimationData animUbo;
-    int           winWidth;
-    int           winHeight;
-    int           workingSet;
-    bool          batchedSubmit;
-    ImDrawData*   imguiDrawData;
+    SceneData        sceneUbo;
+    AnimationData    animUbo;
+    int              winWidth;
+    int              winHeight;
+    int              workingSet;
+    bool             batchedSubmit;
+    uint32_t         visibleObjects;  // objects below are drawn, see Renderer::hasObjectCutoff
+    bool             frustumCulling;  // see Renderer::supportsFrustumCulling
+    float            minPixels;       // frustum culling drops drawitems projected smaller, 0 keeps all
+    uint32_t         coherentBudget;  // frustum tests per frame with temporal coherence, 0 tests every drawitem
+    OcclusionBuffer* occlusion;       // tested after the frustum, nullptr without occlusion culling
+    uint32_t         numShadowViews;  // depth-only views, each drawn into a layer of the shadow maps
+    SceneData        shadowUbos[MAX_SHADOWVIEWS];
+    ImDrawData*      imguiDrawData;
   };
 
   uint32_t m_numMatrices;
@@ -97,6 +119,26 @@ public:
   uint32_t m_alignedMatrixSize;
   uint32_t m_alignedMaterialSize;
 
+  // upload an additional position-only vertex stream for wire drawing
+  // applied at next initScene
+  bool m_positionStream = false;
+
+  // lay out the geometries of a chunk back to back, indices are relative to the chunk,
+  // solid indices come before all wire indices. applied at next initScene
+  bool m_contiguousGeometry = false;
+
+  // both eyes of sceneUbo side by side, drawn at once into two layers. applied at next initFramebuffer
+  bool m_stereo = false;
+
+  // only filled with m_contiguousGeometry, where the index ranges of each geometry start
+  struct GeometryPlacement
+  {
+    uint32_t chunkGeometry;  // first geometry of the chunk, its bindings cover the entire chunk
+    uint32_t firstSolid;
+    uint32_t firstWire;
+  };
+  std::vector<GeometryPlacement> m_geometryPlacement;
+
   Resources()
       : m_frame(0)
   {
@@ -120,12 +162,26 @@ public:
 
   virtual bool initFramebuffer(int width, int height, int msaa, bool vsync) { return true; }
 
+  // m_stereo is honored, SceneData::stereo can be set
+  virtual bool supportsStereo() const { return false; }
+  // the shaders apply SceneData::wClipPlanes, otherwise numClipPlanes must stay 0
+  virtual bool supportsClipPlanes() const { return true; }
+
+  // square depth layers for the shadow views, 0 layers releases them
+  virtual bool initShadowMaps(int size, uint32_t numLayers) { return true; }
+
   virtual bool initScene(const CadScene&) { return true; }
   virtual void deinitScene() {}
 
+  // per-instance matrix indices for STRATEGY_INSTANCED, provided by the renderer
+  virtual void initInstances(const std::vector<uint32_t>& instanceMatrices) {}
+  virtual void deinitInstances() {}
+
   virtual void animation(const Global& global) {}
   virtual void animationReset() {}
 
+  virtual void appendMemoryStats(MemoryStats& stats) const {}
+
   virtual void beginFrame() {}
   virtual void blitFrame(const Global& global) {}
   virtual void endFrame() {}
@@ -135,6 +191,11 @@ public:
     return glm::perspective(glm::radians( fovy), aspect, nearPlane, farPlane);
   }
 
+  virtual glm::mat4 orthographicProjection(float left, float right, float bottom, float top, float nearPlane, float farPlane) const
+  {
+    return glm::ortho(left, right, bottom, top, nearPlane, farPlane);
+  }
+
   inline void initAlignedSizes(unsigned int alignment)
   {
     m_alignedMatrixSize   = (uint32_t)(alignedSize(sizeof(CadScene::MatrixNode), alignment));
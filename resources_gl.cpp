@@ -75,6 +75,7 @@ void ResourcesGL::deinitFramebuffer()
 
 void ResourcesGL::deinit()
 {
+  deinitInstances();
   deinitScene();
   deinitFramebuffer();
   deinitPrograms();
@@ -83,7 +84,12 @@ void ResourcesGL::deinit()
   {
     glDeleteStatesNV(1, &m_stateobjects.draw_line);
     glDeleteStatesNV(1, &m_stateobjects.draw_tris);
+    glDeleteStatesNV(1, &m_stateobjects.draw_tris_blend);
     glDeleteStatesNV(1, &m_stateobjects.draw_line_tris);
+    glDeleteStatesNV(1, &m_stateobjects.draw_line_instanced);
+    glDeleteStatesNV(1, &m_stateobjects.draw_tris_instanced);
+    glDeleteStatesNV(1, &m_stateobjects.draw_tris_blend_instanced);
+    glDeleteStatesNV(1, &m_stateobjects.draw_line_tris_instanced);
   }
 
   glDisable(GL_DEPTH_TEST);
@@ -100,12 +106,36 @@ void ResourcesGL::deinit()
 void ResourcesGL::deinitScene()
 {
   m_scene.deinit();
+  m_geometryPlacement.clear();
   glFinish();
 }
 
 bool ResourcesGL::initScene(const CadScene& cadscene)
 {
-  m_scene.init(cadscene);
+  m_scene.init(cadscene, m_positionStream, m_contiguousGeometry);
+
+  m_geometryPlacement.clear();
+  if(m_contiguousGeometry)
+  {
+    m_geometryPlacement.resize(cadscene.m_geometry.size());
+    uint32_t chunkGeometry = 0;
+    for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
+    {
+      const GeometryMemoryGL::Allocation& allocation = m_scene.m_geometry[g].mem;
+      const GeometryMemoryGL::Chunk&      chunk      = m_scene.m_geometryMem.getChunk(allocation);
+      if(g && allocation.chunkIndex != m_scene.m_geometry[g - 1].mem.chunkIndex)
+      {
+        chunkGeometry = uint32_t(g);
+      }
+
+      // wire ranges in CadScene start after the geometry's solid indices
+      GeometryPlacement& placement = m_geometryPlacement[g];
+      placement.chunkGeometry      = chunkGeometry;
+      placement.firstSolid         = uint32_t(allocation.iboOffset / sizeof(GLuint));
+      placement.firstWire          = uint32_t((chunk.iboWireBase + allocation.iboWireOffset) / sizeof(GLuint))
+                            - cadscene.m_geometry[g].numIndexSolid;
+    }
+  }
 
   m_numMatrices = (int32_t)cadscene.m_matrices.size();
 
@@ -140,6 +170,14 @@ bool ResourcesGL::initPrograms(const std::string& path, const std::string& prepe
       nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "#define WIREMODE 1\n", "scene.vert.glsl"),
       nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "#define WIREMODE 1\n", "scene.frag.glsl"));
 
+  m_programids.draw_object_tris_instanced = m_progManager.createProgram(
+      nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "#define WIREMODE 0\n#define INSTANCED 1\n", "scene.vert.glsl"),
+      nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "#define WIREMODE 0\n#define INSTANCED 1\n", "scene.frag.glsl"));
+
+  m_programids.draw_object_line_instanced = m_progManager.createProgram(
+      nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "#define WIREMODE 1\n#define INSTANCED 1\n", "scene.vert.glsl"),
+      nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "#define WIREMODE 1\n#define INSTANCED 1\n", "scene.frag.glsl"));
+
   m_programids.compute_animation =
       m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_COMPUTE_SHADER, "animation.comp.glsl"));
 
@@ -168,9 +206,11 @@ void ResourcesGL::reloadPrograms(const std::string& prepend)
 
 void ResourcesGL::updatedPrograms()
 {
-  m_programs.draw_line         = m_progManager.get(m_programids.draw_object_line);
-  m_programs.draw_solid        = m_progManager.get(m_programids.draw_object_tris);
-  m_programs.compute_animation = m_progManager.get(m_programids.compute_animation);
+  m_programs.draw_line            = m_progManager.get(m_programids.draw_object_line);
+  m_programs.draw_solid           = m_progManager.get(m_programids.draw_object_tris);
+  m_programs.draw_line_instanced  = m_progManager.get(m_programids.draw_object_line_instanced);
+  m_programs.draw_solid_instanced = m_progManager.get(m_programids.draw_object_tris_instanced);
+  m_programs.compute_animation    = m_progManager.get(m_programids.compute_animation);
 
   // rebuild stateobjects
 
@@ -181,6 +221,8 @@ void ResourcesGL::deinitPrograms()
 {
   m_progManager.destroyProgram(m_programids.draw_object_line);
   m_progManager.destroyProgram(m_programids.draw_object_tris);
+  m_progManager.destroyProgram(m_programids.draw_object_line_instanced);
+  m_progManager.destroyProgram(m_programids.draw_object_tris_instanced);
   m_progManager.destroyProgram(m_programids.compute_animation);
 
   glUseProgram(0);
@@ -243,8 +285,13 @@ bool ResourcesGL::init(nvgl::ContextWindow* contextWindowGL, nvh::Profiler* prof
     s_token_stages[NVTOKEN_STAGE_FRAGMENT]        = glGetStageIndexNV(GL_FRAGMENT_SHADER);
 
     glCreateStatesNV(1, &m_stateobjects.draw_tris);
+    glCreateStatesNV(1, &m_stateobjects.draw_tris_blend);
     glCreateStatesNV(1, &m_stateobjects.draw_line_tris);
     glCreateStatesNV(1, &m_stateobjects.draw_line);
+    glCreateStatesNV(1, &m_stateobjects.draw_tris_instanced);
+    glCreateStatesNV(1, &m_stateobjects.draw_tris_blend_instanced);
+    glCreateStatesNV(1, &m_stateobjects.draw_line_tris_instanced);
+    glCreateStatesNV(1, &m_stateobjects.draw_line_instanced);
   }
 
   glDepthFunc(GL_LESS);
@@ -308,9 +355,12 @@ void ResourcesGL::rebuildStateObjects() const
   glDisable(GL_CULL_FACE);
 
   enableVertexFormat();
+  enableClipDistances();
 
   // temp workaround
   glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0, 0, 0);
+  glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 1, 0, 0);
+  glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 2, 0, 0);
   glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV, 0, 0, 0);
   glBufferAddressRangeNV(GL_UNIFORM_BUFFER_ADDRESS_NV, DRAW_UBO_MATERIAL, 0, 0);
   glBufferAddressRangeNV(GL_UNIFORM_BUFFER_ADDRESS_NV, DRAW_UBO_MATRIX, 0, 0);
@@ -321,20 +371,59 @@ void ResourcesGL::rebuildStateObjects() const
   glUseProgram(m_programs.draw_solid);
   glStateCaptureNV(m_stateobjects.draw_tris, GL_TRIANGLES);
 
+  // translucent parts blend over the opaque ones and leave the depth untouched
+  glEnable(GL_BLEND);
+  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(GL_FALSE);
+  glStateCaptureNV(m_stateobjects.draw_tris_blend, GL_TRIANGLES);
+  glUseProgram(m_programs.draw_solid_instanced);
+  glStateCaptureNV(m_stateobjects.draw_tris_blend_instanced, GL_TRIANGLES);
+  glDisable(GL_BLEND);
+  glDepthMask(GL_TRUE);
+  glUseProgram(m_programs.draw_solid);
+
   glEnable(GL_POLYGON_OFFSET_FILL);
   glStateCaptureNV(m_stateobjects.draw_line_tris, GL_TRIANGLES);
 
   glUseProgram(m_programs.draw_line);
   glStateCaptureNV(m_stateobjects.draw_line, GL_LINES);
 
+  glUseProgram(m_programs.draw_solid_instanced);
+  glStateCaptureNV(m_stateobjects.draw_line_tris_instanced, GL_TRIANGLES);
+
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glStateCaptureNV(m_stateobjects.draw_tris_instanced, GL_TRIANGLES);
+
+  glUseProgram(m_programs.draw_line_instanced);
+  glStateCaptureNV(m_stateobjects.draw_line_instanced, GL_LINES);
+
   disableVertexFormat();
 
   // reset, stored in stateobjects
   glUseProgram(0);
   glDisable(GL_POLYGON_OFFSET_FILL);
+  disableClipDistances();
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void ResourcesGL::initInstances(const std::vector<uint32_t>& instanceMatrices)
+{
+  deinitInstances();
+
+  if(instanceMatrices.empty())
+    return;
+
+  m_instances.instances.create(sizeof(uint32_t) * instanceMatrices.size(), instanceMatrices.data(), 0, 0);
+}
+
+void ResourcesGL::deinitInstances()
+{
+  if(m_instances.instances.buffer)
+  {
+    m_instances.instances.destroy();
+  }
+}
+
 void ResourcesGL::animation(const Global& global)
 {
   glUseProgram(m_programs.compute_animation);
@@ -382,13 +471,48 @@ void ResourcesGL::enableVertexFormat() const
 
   glVertexAttribFormat(VERTEX_POS_OCTNORMAL, 4, GL_FLOAT, GL_FALSE, 0);
   glBindVertexBuffer(0, 0, 0, sizeof(CadScene::Vertex));
+
+  // wire drawing only needs positions, either de-interleaved or from the regular vbo
+  glVertexAttribBinding(VERTEX_POS, 1);
+  glEnableVertexAttribArray(VERTEX_POS);
+
+  glVertexAttribFormat(VERTEX_POS, 3, GL_FLOAT, GL_FALSE, 0);
+  glBindVertexBuffer(1, 0, 0, m_scene.getPositionStride());
+
+  // per-instance matrix index, only fetched by the instanced programs
+  glVertexAttribBinding(VERTEX_MATRIXINDEX, 2);
+  glEnableVertexAttribArray(VERTEX_MATRIXINDEX);
+
+  glVertexAttribIFormat(VERTEX_MATRIXINDEX, 1, GL_UNSIGNED_INT, 0);
+  glVertexBindingDivisor(2, 1);
+  glBindVertexBuffer(2, 0, 0, sizeof(uint32_t));
 }
 
 
 void ResourcesGL::disableVertexFormat() const
 {
   glDisableVertexAttribArray(VERTEX_POS_OCTNORMAL);
+  glDisableVertexAttribArray(VERTEX_POS);
+  glDisableVertexAttribArray(VERTEX_MATRIXINDEX);
   glBindVertexBuffer(0, 0, 0, 16);
   glBindVertexBuffer(1, 0, 0, 16);
+  glBindVertexBuffer(2, 0, 0, 16);
+  glVertexBindingDivisor(2, 0);
+}
+
+void ResourcesGL::enableClipDistances() const
+{
+  for(int i = 0; i < MAX_CLIPPLANES; i++)
+  {
+    glEnable(GL_CLIP_DISTANCE0 + i);
+  }
+}
+
+void ResourcesGL::disableClipDistances() const
+{
+  for(int i = 0; i < MAX_CLIPPLANES; i++)
+  {
+    glDisable(GL_CLIP_DISTANCE0 + i);
+  }
 }
 }  // namespace csfthreaded
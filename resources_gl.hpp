@@ -64,6 +64,7 @@ public:
   typedef Token<GLuint, ElementAddressCommandNV, GL_ELEMENT_ADDRESS_COMMAND_NV, ResourcesGL>     tokenIbo;
   typedef Token<GLuint, PolygonOffsetCommandNV, GL_POLYGON_OFFSET_COMMAND_NV, ResourcesGL>       tokenPolyOffset;
   typedef Token<GLuint, DrawElementsCommandNV, GL_DRAW_ELEMENTS_COMMAND_NV, ResourcesGL>         tokenDrawElems;
+  typedef Token<GLuint, DrawElementsInstancedCommandNV, GL_DRAW_ELEMENTS_INSTANCED_COMMAND_NV, ResourcesGL> tokenDrawElemsInstanced;
 
   enum NVTokenShaderStage
   {
@@ -102,6 +103,10 @@ public:
   static void        nvtokenGetStats(const void* NV_RESTRICT stream, size_t streamSize, int stats[GL_TOKENS]);
   static const char* nvtokenCommandToString(GLenum type);
 
+  // default weights for the draw order optimizer of the nvcmd renderers,
+  // every state object change starts a new token sequence
+  static StateCost getStateCostCommandList() { return {20.0f, 0.75f, 0.25f, 0.25f, 0.25f}; }
+
 #define UBOSTAGE_VERTEX (ResourcesGL::s_token_stages[ResourcesGL::NVTOKEN_STAGE_VERTEX])
 #define UBOSTAGE_FRAGMENT (ResourcesGL::s_token_stages[ResourcesGL::NVTOKEN_STAGE_FRAGMENT])
 
@@ -110,14 +115,18 @@ public:
   {
     nvgl::ProgramID draw_object_tris;
     nvgl::ProgramID draw_object_line;
+    nvgl::ProgramID draw_object_tris_instanced;
+    nvgl::ProgramID draw_object_line_instanced;
     nvgl::ProgramID compute_animation;
   };
 
   struct Programs
   {
-    GLuint draw_solid        = 0;
-    GLuint draw_line         = 0;
-    GLuint compute_animation = 0;
+    GLuint draw_solid           = 0;
+    GLuint draw_line            = 0;
+    GLuint draw_solid_instanced = 0;
+    GLuint draw_line_instanced  = 0;
+    GLuint compute_animation    = 0;
   };
 
   struct FrameBuffer
@@ -138,11 +147,22 @@ public:
     nvgl::Buffer anim;
   };
 
+  struct Instances
+  {
+    nvgl::Buffer instances;
+  };
+
   struct StateObjects
   {
-    GLuint draw_tris      = 0;
-    GLuint draw_line_tris = 0;
-    GLuint draw_line      = 0;
+    GLuint draw_tris       = 0;
+    GLuint draw_tris_blend = 0;  // translucent parts, no depth write
+    GLuint draw_line_tris  = 0;
+    GLuint draw_line       = 0;
+
+    GLuint draw_tris_instanced       = 0;
+    GLuint draw_tris_blend_instanced = 0;
+    GLuint draw_line_tris_instanced  = 0;
+    GLuint draw_line_instanced       = 0;
   };
 
   struct StateChangeID
@@ -157,6 +177,7 @@ public:
 
   FrameBuffer m_framebuffer;
   Common      m_common;
+  Instances   m_instances;
   StateObjects m_stateobjects;
   
   CadSceneGL m_scene;
@@ -183,9 +204,18 @@ public:
   bool initScene(const CadScene&);
   void deinitScene();
 
+  void initInstances(const std::vector<uint32_t>& instanceMatrices);
+  void deinitInstances();
+
   void animation(const Global& global);
   void animationReset();
 
+  void appendMemoryStats(MemoryStats& stats) const
+  {
+    m_scene.appendMemoryStats(stats);
+    stats.gpu[MemoryStats::DRAWITEMS] += m_instances.instances.buffer ? size_t(m_instances.instances.size) : 0;
+  }
+
   void blitFrame(const Global& global);
 
   void rebuildStateObjects() const;
@@ -196,6 +226,11 @@ public:
 
   void disableVertexFormat() const;
 
+  // the scene shaders write all MAX_CLIPPLANES distances, other programs must not run with them enabled
+  void enableClipDistances() const;
+
+  void disableClipDistances() const;
+
   static ResourcesGL* get()
   {
     static ResourcesGL resGL;
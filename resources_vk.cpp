@@ -128,41 +128,57 @@ void ResourcesVK::blitFrame(const Global& global)
     cmdImageTransition(cmd, m_framebuffer.imgColor, VK_IMAGE_ASPECT_COLOR_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
                        VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
+    // with stereo every eye layer goes into its half of the window, left eye first
+    uint32_t numEyes  = m_framebuffer.stereo ? 2 : 1;
+    int32_t  eyeWidth = m_framebuffer.stereo ? std::max(global.winWidth / 2, 1) : global.winWidth;
+
     if(m_framebuffer.msaa)
     {
-      VkImageResolve region            = {0};
-      region.extent.width              = global.winWidth;
-      region.extent.height             = global.winHeight;
-      region.extent.depth              = 1;
-      region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      region.dstSubresource.layerCount = 1;
-      region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      region.srcSubresource.layerCount = 1;
+      VkImageResolve regions[2] = {};
+      for(uint32_t e = 0; e < numEyes; e++)
+      {
+        VkImageResolve& region               = regions[e];
+        region.dstOffset.x                   = eyeWidth * int32_t(e);
+        region.extent.width                  = eyeWidth;
+        region.extent.height                 = global.winHeight;
+        region.extent.depth                  = 1;
+        region.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.layerCount     = 1;
+        region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.baseArrayLayer = e;
+        region.srcSubresource.layerCount     = 1;
+      }
 
       imageBlitRead = m_framebuffer.imgColorResolved;
 
       vkCmdResolveImage(cmd, m_framebuffer.imgColor, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageBlitRead,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, numEyes, regions);
     }
     else
     {
       // downsample to resolved
-      VkImageBlit region               = {0};
-      region.dstOffsets[1].x           = global.winWidth;
-      region.dstOffsets[1].y           = global.winHeight;
-      region.dstOffsets[1].z           = 1;
-      region.srcOffsets[1].x           = m_framebuffer.renderWidth;
-      region.srcOffsets[1].y           = m_framebuffer.renderHeight;
-      region.srcOffsets[1].z           = 1;
-      region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      region.dstSubresource.layerCount = 1;
-      region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      region.srcSubresource.layerCount = 1;
+      VkImageBlit regions[2] = {};
+      for(uint32_t e = 0; e < numEyes; e++)
+      {
+        VkImageBlit& region                  = regions[e];
+        region.dstOffsets[0].x               = eyeWidth * int32_t(e);
+        region.dstOffsets[1].x               = eyeWidth * int32_t(e + 1);
+        region.dstOffsets[1].y               = global.winHeight;
+        region.dstOffsets[1].z               = 1;
+        region.srcOffsets[1].x               = m_framebuffer.renderWidth;
+        region.srcOffsets[1].y               = m_framebuffer.renderHeight;
+        region.srcOffsets[1].z               = 1;
+        region.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.layerCount     = 1;
+        region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.baseArrayLayer = e;
+        region.srcSubresource.layerCount     = 1;
+      }
 
       imageBlitRead = m_framebuffer.imgColorResolved;
 
       vkCmdBlitImage(cmd, m_framebuffer.imgColor, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageBlitRead,
-                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, numEyes, regions, VK_FILTER_LINEAR);
     }
   }
 
@@ -311,9 +327,12 @@ bool ResourcesVK::init(nvvk::Context* context, nvvk::SwapChain* swapChain, nvh::
 
   // Create the render passes
   {
-    m_framebuffer.passClear    = createPass(true, m_framebuffer.msaa);
-    m_framebuffer.passPreserve = createPass(false, m_framebuffer.msaa);
-    m_framebuffer.passUI       = createPassUI(m_framebuffer.msaa);
+    m_framebuffer.passClear    = createPass(true, m_framebuffer.msaa, m_framebuffer.stereo);
+    m_framebuffer.passPreserve = createPass(false, m_framebuffer.msaa, m_framebuffer.stereo);
+    m_framebuffer.passUI       = createPassUI(m_framebuffer.useResolved);
+
+    m_shadowMaps.passClear    = createShadowPass(true);
+    m_shadowMaps.passPreserve = createShadowPass(false);
   }
 
   // device mem allocator
@@ -323,8 +342,13 @@ bool ResourcesVK::init(nvvk::Context* context, nvvk::SwapChain* swapChain, nvh::
     // common
     VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
 
-    m_common.viewBuffer = m_memAllocator.createBuffer(sizeof(SceneData), usageFlags, m_common.viewAID);
-    m_common.viewInfo   = {m_common.viewBuffer, 0, sizeof(SceneData)};
+    // SceneData of all views back to back, each bound by its own descriptor set
+    m_common.alignedViewSize = uint32_t(alignedSize(
+        sizeof(SceneData), m_context->m_physicalInfo.properties10.limits.minUniformBufferOffsetAlignment));
+
+    m_common.viewBuffer = m_memAllocator.createBuffer(VkDeviceSize(m_common.alignedViewSize) * NUM_VIEWS, usageFlags,
+                                                      m_common.viewAID);
+    m_common.viewInfo   = getViewInfo(0);
     m_common.animBuffer = m_memAllocator.createBuffer(sizeof(AnimationData), usageFlags, m_common.animAID);
     m_common.animInfo   = {m_common.animBuffer, 0, sizeof(AnimationData)};
   }
@@ -434,6 +458,18 @@ bool ResourcesVK::init(nvvk::Context* context, nvvk::SwapChain* swapChain, nvh::
 #endif
   }
 
+  {
+    // instanced drawing, independent of UNIFORMS_TECHNIQUE
+    m_drawInstanced.init(m_device);
+    m_drawInstanced.addBinding(DRAW_UBO_SCENE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+                               VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+    m_drawInstanced.addBinding(DRAW_UBO_MATRIX, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0);
+    m_drawInstanced.addBinding(DRAW_UBO_MATERIAL, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+    m_drawInstanced.initLayout();
+    m_drawInstanced.initPool(NUM_VIEWS);
+    m_drawInstanced.initPipeLayout();
+  }
+
 
   {
     ImGui::InitVK(m_context->m_device, m_context->m_physicalDevice, m_context->m_queueGCT.queue,
@@ -459,16 +495,21 @@ void ResourcesVK::deinit()
   m_ringFences.deinit();
   m_ringCmdPool.deinit();
 
+  deinitInstances();
   deinitScene();
   deinitFramebuffer();
+  deinitShadowMaps();
   deinitPipes();
   deinitPrograms();
 
   vkDestroyRenderPass(m_device, m_framebuffer.passClear, NULL);
   vkDestroyRenderPass(m_device, m_framebuffer.passPreserve, NULL);
   vkDestroyRenderPass(m_device, m_framebuffer.passUI, NULL);
+  vkDestroyRenderPass(m_device, m_shadowMaps.passClear, NULL);
+  vkDestroyRenderPass(m_device, m_shadowMaps.passPreserve, NULL);
 
   m_drawing.deinit();
+  m_drawInstanced.deinit();
   m_anim.deinit();
 
   m_profilerVK.deinit();
@@ -503,17 +544,31 @@ bool ResourcesVK::initPrograms(const std::string& path, const std::string& prepe
       + nvh::ShaderFileManager::format("#define UNIFORMS_PUSHCONSTANTS_INDEX %d\n", UNIFORMS_PUSHCONSTANTS_INDEX)
       + nvh::ShaderFileManager::format("#define UNIFORMS_TECHNIQUE %d\n", UNIFORMS_TECHNIQUE);
 
+  // kept with the modules, so it also applies on reload
+  std::string features = nvh::ShaderFileManager::format("#define USE_CLIPPLANES %d\n", supportsClipPlanes() ? 1 : 0)
+                         + nvh::ShaderFileManager::format("#define USE_MULTIVIEW %d\n", supportsStereo() ? 1 : 0);
+
   ///////////////////////////////////////////////////////////////////////////////////////////
-  m_moduleids.vertex_tris =
-      m_shaderManager.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl", "#define WIREMODE 0\n");
+  m_moduleids.vertex_tris = m_shaderManager.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl",
+                                                               "#define WIREMODE 0\n" + features);
   m_moduleids.fragment_tris =
       m_shaderManager.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "scene.frag.glsl", "#define WIREMODE 0\n");
 
-  m_moduleids.vertex_line =
-      m_shaderManager.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl", "#define WIREMODE 1\n");
+  m_moduleids.vertex_line = m_shaderManager.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl",
+                                                               "#define WIREMODE 1\n" + features);
   m_moduleids.fragment_line =
       m_shaderManager.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "scene.frag.glsl", "#define WIREMODE 1\n");
 
+  m_moduleids.vertex_tris_instanced = m_shaderManager.createShaderModule(
+      VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl", "#define WIREMODE 0\n#define INSTANCED 1\n" + features);
+  m_moduleids.fragment_tris_instanced = m_shaderManager.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "scene.frag.glsl",
+                                                                           "#define WIREMODE 0\n#define INSTANCED 1\n");
+
+  m_moduleids.vertex_line_instanced = m_shaderManager.createShaderModule(
+      VK_SHADER_STAGE_VERTEX_BIT, "scene.vert.glsl", "#define WIREMODE 1\n#define INSTANCED 1\n" + features);
+  m_moduleids.fragment_line_instanced = m_shaderManager.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "scene.frag.glsl",
+                                                                           "#define WIREMODE 1\n#define INSTANCED 1\n");
+
   ///////////////////////////////////////////////////////////////////////////////////////////
 #if UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
   assert(sizeof(ObjectData) == 128);  // offset provided to material layout
@@ -548,6 +603,11 @@ void ResourcesVK::updatedPrograms()
   m_shaders.vertex_line       = m_shaderManager.get(m_moduleids.vertex_line);
   m_shaders.compute_animation = m_shaderManager.get(m_moduleids.compute_animation);
 
+  m_shaders.fragment_tris_instanced = m_shaderManager.get(m_moduleids.fragment_tris_instanced);
+  m_shaders.vertex_tris_instanced   = m_shaderManager.get(m_moduleids.vertex_tris_instanced);
+  m_shaders.fragment_line_instanced = m_shaderManager.get(m_moduleids.fragment_line_instanced);
+  m_shaders.vertex_line_instanced   = m_shaderManager.get(m_moduleids.vertex_line_instanced);
+
   initPipes();
 }
 
@@ -571,7 +631,7 @@ static VkSampleCountFlagBits getSampleCountFlagBits(int msaa)
   }
 }
 
-VkRenderPass ResourcesVK::createPass(bool clear, int msaa)
+VkRenderPass ResourcesVK::createPass(bool clear, int msaa, bool stereo)
 {
   VkResult result;
 
@@ -615,6 +675,18 @@ VkRenderPass ResourcesVK::createPass(bool clear, int msaa)
   rpInfo.pSubpasses                  = &subpass;
   rpInfo.dependencyCount             = 0;
 
+  // both eyes see mostly the same, let the implementation render the views concurrently
+  uint32_t                        viewMask      = 0x3;
+  VkRenderPassMultiviewCreateInfo multiviewInfo = {VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO};
+  multiviewInfo.subpassCount                    = 1;
+  multiviewInfo.pViewMasks                      = &viewMask;
+  multiviewInfo.correlationMaskCount            = 1;
+  multiviewInfo.pCorrelationMasks               = &viewMask;
+  if(stereo)
+  {
+    rpInfo.pNext = &multiviewInfo;
+  }
+
   VkRenderPass rp;
   result = vkCreateRenderPass(m_device, &rpInfo, NULL, &rp);
   assert(result == VK_SUCCESS);
@@ -622,13 +694,13 @@ VkRenderPass ResourcesVK::createPass(bool clear, int msaa)
 }
 
 
-VkRenderPass ResourcesVK::createPassUI(int msaa)
+VkRenderPass ResourcesVK::createPassUI(bool resolved)
 {
   // ui related
   // two cases:
-  // if msaa we want to render into scene_color_resolved, which was DST_OPTIMAL
+  // if msaa or stereo we want to render into scene_color_resolved, which was DST_OPTIMAL
   // otherwise render into scene_color, which was VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-  VkImageLayout uiTargetLayout = msaa ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkImageLayout uiTargetLayout = resolved ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   // Create the ui render pass
   VkAttachmentDescription attachments[1] = {};
@@ -660,6 +732,40 @@ VkRenderPass ResourcesVK::createPassUI(int msaa)
   return rp;
 }
 
+VkRenderPass ResourcesVK::createShadowPass(bool clear)
+{
+  // depth only, single sampled independent of the scene's msaa
+  VkAttachmentDescription attachments[1] = {};
+  attachments[0].format                  = VK_FORMAT_D16_UNORM;
+  attachments[0].samples                 = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp                  = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[0].storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout           = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments[0].finalLayout             = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments[0].flags                   = 0;
+
+  VkSubpassDescription subpass       = {};
+  subpass.pipelineBindPoint          = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.inputAttachmentCount       = 0;
+  subpass.colorAttachmentCount       = 0;
+  subpass.pColorAttachments          = nullptr;
+  VkAttachmentReference depthRefs[1] = {{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}};
+  subpass.pDepthStencilAttachment    = depthRefs;
+  VkRenderPassCreateInfo rpInfo      = {VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+  rpInfo.attachmentCount             = NV_ARRAY_SIZE(attachments);
+  rpInfo.pAttachments                = attachments;
+  rpInfo.subpassCount                = 1;
+  rpInfo.pSubpasses                  = &subpass;
+  rpInfo.dependencyCount             = 0;
+
+  VkRenderPass rp;
+  VkResult     result = vkCreateRenderPass(m_device, &rpInfo, NULL, &rp);
+  assert(result == VK_SUCCESS);
+  return rp;
+}
+
 
 bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vsync)
 {
@@ -676,28 +782,37 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   m_framebuffer.memAllocator.init(m_device, m_physical);
 
   int  oldMsaa     = m_framebuffer.msaa;
-  bool oldResolved = m_framebuffer.supersample > 1;
+  bool oldResolved = m_framebuffer.useResolved;
+  bool oldStereo   = m_framebuffer.stereo;
 
-  m_framebuffer.renderWidth  = winWidth * supersample;
+  m_framebuffer.stereo = m_stereo && supportsStereo();
+  // each eye gets its half of the window
+  int eyeWidth = m_framebuffer.stereo ? std::max(winWidth / 2, 1) : winWidth;
+
+  m_framebuffer.renderWidth  = eyeWidth * supersample;
   m_framebuffer.renderHeight = winHeight * supersample;
   m_framebuffer.supersample  = supersample;
   m_framebuffer.msaa         = msaa;
   m_framebuffer.vsync        = vsync;
 
-  LOGI("framebuffer: %d x %d (%d msaa)\n", m_framebuffer.renderWidth, m_framebuffer.renderHeight, m_framebuffer.msaa);
+  LOGI("framebuffer: %d x %d (%d msaa%s)\n", m_framebuffer.renderWidth, m_framebuffer.renderHeight, m_framebuffer.msaa,
+       m_framebuffer.stereo ? ", stereo" : "");
+
+  // the eye layers are copied side by side into the resolved image
+  m_framebuffer.useResolved = supersample > 1 || msaa || m_framebuffer.stereo;
 
-  m_framebuffer.useResolved = supersample > 1 || msaa;
+  uint32_t numLayers = m_framebuffer.stereo ? 2 : 1;
 
-  if(oldMsaa != m_framebuffer.msaa || oldResolved != m_framebuffer.useResolved)
+  if(oldMsaa != m_framebuffer.msaa || oldResolved != m_framebuffer.useResolved || oldStereo != m_framebuffer.stereo)
   {
     vkDestroyRenderPass(m_device, m_framebuffer.passClear, NULL);
     vkDestroyRenderPass(m_device, m_framebuffer.passPreserve, NULL);
     vkDestroyRenderPass(m_device, m_framebuffer.passUI, NULL);
 
-    // recreate the render passes with new msaa setting
-    m_framebuffer.passClear    = createPass(true, m_framebuffer.msaa);
-    m_framebuffer.passPreserve = createPass(false, m_framebuffer.msaa);
-    m_framebuffer.passUI       = createPassUI(m_framebuffer.msaa);
+    // recreate the render passes with new msaa or stereo setting
+    m_framebuffer.passClear    = createPass(true, m_framebuffer.msaa, m_framebuffer.stereo);
+    m_framebuffer.passPreserve = createPass(false, m_framebuffer.msaa, m_framebuffer.stereo);
+    m_framebuffer.passUI       = createPassUI(m_framebuffer.useResolved);
   }
 
   VkSampleCountFlagBits samplesUsed = getSampleCountFlagBits(m_framebuffer.msaa);
@@ -710,7 +825,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   cbImageInfo.extent.height     = m_framebuffer.renderHeight;
   cbImageInfo.extent.depth      = 1;
   cbImageInfo.mipLevels         = 1;
-  cbImageInfo.arrayLayers       = 1;
+  cbImageInfo.arrayLayers       = numLayers;
   cbImageInfo.samples           = samplesUsed;
   cbImageInfo.tiling            = VK_IMAGE_TILING_OPTIMAL;
   cbImageInfo.usage             = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
@@ -729,7 +844,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   dsImageInfo.extent.height     = m_framebuffer.renderHeight;
   dsImageInfo.extent.depth      = 1;
   dsImageInfo.mipLevels         = 1;
-  dsImageInfo.arrayLayers       = 1;
+  dsImageInfo.arrayLayers       = numLayers;
   dsImageInfo.samples           = samplesUsed;
   dsImageInfo.tiling            = VK_IMAGE_TILING_OPTIMAL;
   dsImageInfo.usage             = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
@@ -761,7 +876,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   // views after allocation handling
 
   VkImageViewCreateInfo cbImageViewInfo           = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-  cbImageViewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+  cbImageViewInfo.viewType = m_framebuffer.stereo ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
   cbImageViewInfo.format                          = cbImageInfo.format;
   cbImageViewInfo.components.r                    = VK_COMPONENT_SWIZZLE_R;
   cbImageViewInfo.components.g                    = VK_COMPONENT_SWIZZLE_G;
@@ -770,7 +885,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   cbImageViewInfo.flags                           = 0;
   cbImageViewInfo.subresourceRange.levelCount     = 1;
   cbImageViewInfo.subresourceRange.baseMipLevel   = 0;
-  cbImageViewInfo.subresourceRange.layerCount     = 1;
+  cbImageViewInfo.subresourceRange.layerCount     = numLayers;
   cbImageViewInfo.subresourceRange.baseArrayLayer = 0;
   cbImageViewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
 
@@ -780,13 +895,15 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
 
   if(m_framebuffer.useResolved)
   {
-    cbImageViewInfo.image = m_framebuffer.imgColorResolved;
-    result                = vkCreateImageView(m_device, &cbImageViewInfo, NULL, &m_framebuffer.viewColorResolved);
+    cbImageViewInfo.viewType                    = VK_IMAGE_VIEW_TYPE_2D;
+    cbImageViewInfo.subresourceRange.layerCount = 1;
+    cbImageViewInfo.image                       = m_framebuffer.imgColorResolved;
+    result = vkCreateImageView(m_device, &cbImageViewInfo, NULL, &m_framebuffer.viewColorResolved);
     assert(result == VK_SUCCESS);
   }
 
   VkImageViewCreateInfo dsImageViewInfo           = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-  dsImageViewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+  dsImageViewInfo.viewType = m_framebuffer.stereo ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
   dsImageViewInfo.format                          = dsImageInfo.format;
   dsImageViewInfo.components.r                    = VK_COMPONENT_SWIZZLE_R;
   dsImageViewInfo.components.g                    = VK_COMPONENT_SWIZZLE_G;
@@ -795,7 +912,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   dsImageViewInfo.flags                           = 0;
   dsImageViewInfo.subresourceRange.levelCount     = 1;
   dsImageViewInfo.subresourceRange.baseMipLevel   = 0;
-  dsImageViewInfo.subresourceRange.layerCount     = 1;
+  dsImageViewInfo.subresourceRange.layerCount     = numLayers;
   dsImageViewInfo.subresourceRange.baseArrayLayer = 0;
   dsImageViewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_STENCIL_BIT | VK_IMAGE_ASPECT_DEPTH_BIT;
 
@@ -843,7 +960,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
     fbInfo.pAttachments            = bindInfos;
     fbInfo.width                   = m_framebuffer.renderWidth;
     fbInfo.height                  = m_framebuffer.renderHeight;
-    fbInfo.layers                  = 1;
+    fbInfo.layers                  = 1;  // also with stereo, the view mask addresses the layers
 
     fbInfo.renderPass = m_framebuffer.passClear;
     result            = vkCreateFramebuffer(m_device, &fbInfo, NULL, &fb);
@@ -902,7 +1019,7 @@ bool ResourcesVK::initFramebuffer(int winWidth, int winHeight, int msaa, bool vs
   }
 
 
-  if(m_framebuffer.msaa != oldMsaa && hasPipes())
+  if((m_framebuffer.msaa != oldMsaa || m_framebuffer.stereo != oldStereo) && hasPipes())
   {
     // reinit pipelines
     initPipes();
@@ -944,6 +1061,134 @@ void ResourcesVK::deinitFramebuffer()
   m_framebuffer.memAllocator.deinit();
 }
 
+bool ResourcesVK::initShadowMaps(int size, uint32_t numLayers)
+{
+  VkResult result;
+
+  numLayers = std::min(numLayers, MAX_SHADOWVIEWS);
+  if(numLayers == m_shadowMaps.numLayers && (!numLayers || size == m_shadowMaps.size))
+  {
+    return true;
+  }
+
+  if(m_shadowMaps.image != 0)
+  {
+    deinitShadowMaps();
+  }
+
+  m_shadowMaps.size      = size;
+  m_shadowMaps.numLayers = numLayers;
+  if(!numLayers)
+  {
+    return true;
+  }
+
+  LOGI("shadow maps: %d x %d (%d layers)\n", size, size, numLayers);
+
+  m_shadowMaps.memAllocator.init(m_device, m_physical);
+
+  VkImageCreateInfo imageInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+  imageInfo.imageType         = VK_IMAGE_TYPE_2D;
+  imageInfo.format            = VK_FORMAT_D16_UNORM;
+  imageInfo.extent.width      = size;
+  imageInfo.extent.height     = size;
+  imageInfo.extent.depth      = 1;
+  imageInfo.mipLevels         = 1;
+  imageInfo.arrayLayers       = numLayers;
+  imageInfo.samples           = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling            = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage             = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.flags             = 0;
+  imageInfo.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  m_shadowMaps.image = m_shadowMaps.memAllocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VkImageViewCreateInfo viewInfo           = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format                          = imageInfo.format;
+  viewInfo.image                           = m_shadowMaps.image;
+  viewInfo.flags                           = 0;
+  viewInfo.subresourceRange.levelCount     = 1;
+  viewInfo.subresourceRange.baseMipLevel   = 0;
+  viewInfo.subresourceRange.layerCount     = 1;
+  viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+  for(uint32_t i = 0; i < numLayers; i++)
+  {
+    viewInfo.subresourceRange.baseArrayLayer = i;
+    result = vkCreateImageView(m_device, &viewInfo, NULL, &m_shadowMaps.views[i]);
+    assert(result == VK_SUCCESS);
+
+    VkFramebufferCreateInfo fbInfo = {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+    fbInfo.attachmentCount         = 1;
+    fbInfo.pAttachments            = &m_shadowMaps.views[i];
+    fbInfo.width                   = size;
+    fbInfo.height                  = size;
+    fbInfo.layers                  = 1;
+    fbInfo.renderPass              = m_shadowMaps.passClear;
+    result                         = vkCreateFramebuffer(m_device, &fbInfo, NULL, &m_shadowMaps.fbos[i]);
+    assert(result == VK_SUCCESS);
+  }
+
+  {
+    VkCommandBuffer cmd = createTempCmdBuffer();
+
+    cmdImageTransition(cmd, m_shadowMaps.image, VK_IMAGE_ASPECT_DEPTH_BIT, 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                       VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+    vkEndCommandBuffer(cmd);
+
+    submissionEnqueue(cmd);
+    submissionExecute();
+    synchronize();
+    resetTempResources();
+  }
+
+  {
+    VkViewport vp;
+    vp.x        = 0;
+    vp.y        = 0;
+    vp.width    = float(size);
+    vp.height   = float(size);
+    vp.minDepth = 0.0f;
+    vp.maxDepth = 1.0f;
+
+    VkRect2D sc;
+    sc.offset.x      = 0;
+    sc.offset.y      = 0;
+    sc.extent.width  = size;
+    sc.extent.height = size;
+
+    m_shadowMaps.viewport = vp;
+    m_shadowMaps.scissor  = sc;
+  }
+
+  return true;
+}
+
+void ResourcesVK::deinitShadowMaps()
+{
+  if(!m_shadowMaps.image)
+    return;
+
+  synchronize();
+
+  for(uint32_t i = 0; i < m_shadowMaps.numLayers; i++)
+  {
+    vkDestroyFramebuffer(m_device, m_shadowMaps.fbos[i], nullptr);
+    vkDestroyImageView(m_device, m_shadowMaps.views[i], nullptr);
+    m_shadowMaps.fbos[i]  = VK_NULL_HANDLE;
+    m_shadowMaps.views[i] = VK_NULL_HANDLE;
+  }
+
+  vkDestroyImage(m_device, m_shadowMaps.image, nullptr);
+  m_shadowMaps.image     = VK_NULL_HANDLE;
+  m_shadowMaps.numLayers = 0;
+
+  m_shadowMaps.memAllocator.freeAll();
+  m_shadowMaps.memAllocator.deinit();
+}
+
 void ResourcesVK::initPipes()
 {
   VkResult result;
@@ -973,6 +1218,51 @@ void ResourcesVK::initPipes()
   viStateInfo.vertexAttributeDescriptionCount      = NV_ARRAY_SIZE(attributes);
   viStateInfo.pVertexAttributeDescriptions         = attributes;
 
+  // wire drawing only needs positions, either de-interleaved or from the regular vbo
+  VkVertexInputBindingDescription vertexBindingPos;
+  vertexBindingPos.stride                             = CadSceneVK::getPositionStride(m_positionStream);
+  vertexBindingPos.inputRate                          = VK_VERTEX_INPUT_RATE_VERTEX;
+  vertexBindingPos.binding                            = 1;
+  VkVertexInputAttributeDescription attributesPos[1]  = {};
+  attributesPos[0].location                           = VERTEX_POS;
+  attributesPos[0].binding                            = 1;
+  attributesPos[0].format                             = VK_FORMAT_R32G32B32_SFLOAT;
+  attributesPos[0].offset                             = 0;
+  VkPipelineVertexInputStateCreateInfo viStateInfoPos = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+  viStateInfoPos.vertexBindingDescriptionCount        = 1;
+  viStateInfoPos.pVertexBindingDescriptions           = &vertexBindingPos;
+  viStateInfoPos.vertexAttributeDescriptionCount      = NV_ARRAY_SIZE(attributesPos);
+  viStateInfoPos.pVertexAttributeDescriptions         = attributesPos;
+
+  m_pipesPositionStream = m_positionStream;
+
+  // instanced pipelines additionally fetch the matrix index per instance
+  VkVertexInputBindingDescription instanceBinding;
+  instanceBinding.stride                              = sizeof(uint32_t);
+  instanceBinding.inputRate                           = VK_VERTEX_INPUT_RATE_INSTANCE;
+  instanceBinding.binding                             = 2;
+  VkVertexInputAttributeDescription instanceAttribute = {};
+  instanceAttribute.location                          = VERTEX_MATRIXINDEX;
+  instanceAttribute.binding                           = 2;
+  instanceAttribute.format                            = VK_FORMAT_R32_UINT;
+  instanceAttribute.offset                            = 0;
+
+  VkVertexInputBindingDescription      bindingsInst[2]   = {vertexBinding, instanceBinding};
+  VkVertexInputAttributeDescription    attributesInst[2] = {attributes[0], instanceAttribute};
+  VkPipelineVertexInputStateCreateInfo viStateInfoInst   = viStateInfo;
+  viStateInfoInst.vertexBindingDescriptionCount          = NV_ARRAY_SIZE(bindingsInst);
+  viStateInfoInst.pVertexBindingDescriptions             = bindingsInst;
+  viStateInfoInst.vertexAttributeDescriptionCount        = NV_ARRAY_SIZE(attributesInst);
+  viStateInfoInst.pVertexAttributeDescriptions           = attributesInst;
+
+  VkVertexInputBindingDescription      bindingsPosInst[2]   = {vertexBindingPos, instanceBinding};
+  VkVertexInputAttributeDescription    attributesPosInst[2] = {attributesPos[0], instanceAttribute};
+  VkPipelineVertexInputStateCreateInfo viStateInfoPosInst   = viStateInfoPos;
+  viStateInfoPosInst.vertexBindingDescriptionCount          = NV_ARRAY_SIZE(bindingsPosInst);
+  viStateInfoPosInst.pVertexBindingDescriptions             = bindingsPosInst;
+  viStateInfoPosInst.vertexAttributeDescriptionCount        = NV_ARRAY_SIZE(attributesPosInst);
+  viStateInfoPosInst.pVertexAttributeDescriptions           = attributesPosInst;
+
   VkPipelineInputAssemblyStateCreateInfo iaStateInfo = {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
   iaStateInfo.topology                               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   iaStateInfo.primitiveRestartEnable                 = VK_FALSE;
@@ -1077,6 +1367,23 @@ void ResourcesVK::initPipes()
     assert(result == VK_SUCCESS);
     m_pipes.tris = pipeline;
 
+    // translucent parts blend over the opaque ones and leave the depth untouched
+    cbAttachmentState[0].blendEnable         = VK_TRUE;
+    cbAttachmentState[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    cbAttachmentState[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    cbAttachmentState[0].colorBlendOp        = VK_BLEND_OP_ADD;
+    cbAttachmentState[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    cbAttachmentState[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    cbAttachmentState[0].alphaBlendOp        = VK_BLEND_OP_ADD;
+    dsStateInfo.depthWriteEnable             = VK_FALSE;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipes.tris_blend = pipeline;
+
+    cbAttachmentState[0].blendEnable = VK_FALSE;
+    dsStateInfo.depthWriteEnable     = VK_TRUE;
+
     rsStateInfo.depthBiasEnable         = VK_TRUE;
     rsStateInfo.depthBiasConstantFactor = 1.0f;
     rsStateInfo.depthBiasSlopeFactor    = 1.0;
@@ -1089,12 +1396,85 @@ void ResourcesVK::initPipes()
     assert(result == VK_SUCCESS);
     m_pipes.line_tris = pipeline;
 
-    iaStateInfo.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
-    vsStageInfo.module   = m_shaders.vertex_line;
-    fsStageInfo.module   = m_shaders.fragment_line;
-    result               = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    iaStateInfo.topology             = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    pipelineInfo.pVertexInputState   = &viStateInfoPos;
+    vsStageInfo.module               = m_shaders.vertex_line;
+    fsStageInfo.module               = m_shaders.fragment_line;
+    result                           = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
     assert(result == VK_SUCCESS);
     m_pipes.line = pipeline;
+
+    // same setup for instanced drawing
+    pipelineInfo.layout                 = m_drawInstanced.getPipeLayout();
+    iaStateInfo.topology                = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    pipelineInfo.pVertexInputState      = &viStateInfoInst;
+    rsStateInfo.depthBiasEnable         = VK_FALSE;
+    rsStateInfo.depthBiasConstantFactor = 0.0f;
+    rsStateInfo.depthBiasSlopeFactor    = 0.0f;
+    vsStageInfo.module                  = m_shaders.vertex_tris_instanced;
+    fsStageInfo.module                  = m_shaders.fragment_tris_instanced;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipesInstanced.tris = pipeline;
+
+    cbAttachmentState[0].blendEnable = VK_TRUE;
+    dsStateInfo.depthWriteEnable     = VK_FALSE;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipesInstanced.tris_blend = pipeline;
+
+    cbAttachmentState[0].blendEnable = VK_FALSE;
+    dsStateInfo.depthWriteEnable     = VK_TRUE;
+
+    rsStateInfo.depthBiasEnable         = VK_TRUE;
+    rsStateInfo.depthBiasConstantFactor = 1.0f;
+    rsStateInfo.depthBiasSlopeFactor    = 1.0;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipesInstanced.line_tris = pipeline;
+
+    iaStateInfo.topology           = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    pipelineInfo.pVertexInputState = &viStateInfoPosInst;
+    vsStageInfo.module             = m_shaders.vertex_line_instanced;
+    fsStageInfo.module             = m_shaders.fragment_line_instanced;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipesInstanced.line = pipeline;
+
+    // depth only for the shadow views, the vertex shader alone and biased against self shadowing.
+    // like wire drawing it only fetches the position stream
+    VkPipelineColorBlendStateCreateInfo cbStateInfoDepth = cbStateInfo;
+    cbStateInfoDepth.attachmentCount                     = 0;
+    cbStateInfoDepth.pAttachments                        = nullptr;
+
+    pipelineInfo.renderPass             = m_shadowMaps.passPreserve;
+    pipelineInfo.pColorBlendState       = &cbStateInfoDepth;
+    pipelineInfo.stageCount             = 1;
+    msStateInfo.rasterizationSamples    = VK_SAMPLE_COUNT_1_BIT;
+    iaStateInfo.topology                = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    rsStateInfo.depthBiasEnable         = VK_TRUE;
+    rsStateInfo.depthBiasConstantFactor = 2.0f;
+    rsStateInfo.depthBiasSlopeFactor    = 2.0f;
+
+    pipelineInfo.layout            = m_drawing.getPipeLayout();
+    pipelineInfo.pVertexInputState = &viStateInfoPos;
+    vsStageInfo.module             = m_shaders.vertex_line;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipes.tris_depth = pipeline;
+
+    pipelineInfo.layout            = m_drawInstanced.getPipeLayout();
+    pipelineInfo.pVertexInputState = &viStateInfoPosInst;
+    vsStageInfo.module             = m_shaders.vertex_line_instanced;
+
+    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline);
+    assert(result == VK_SUCCESS);
+    m_pipesInstanced.tris_depth = pipeline;
   }
 
   //////////////////////////////////////////////////////////////////////////
@@ -1120,11 +1500,26 @@ void ResourcesVK::deinitPipes()
   vkDestroyPipeline(m_device, m_pipes.line, NULL);
   vkDestroyPipeline(m_device, m_pipes.line_tris, NULL);
   vkDestroyPipeline(m_device, m_pipes.tris, NULL);
+  vkDestroyPipeline(m_device, m_pipes.tris_blend, NULL);
+  vkDestroyPipeline(m_device, m_pipes.tris_depth, NULL);
   vkDestroyPipeline(m_device, m_pipes.compute_animation, NULL);
   m_pipes.line              = NULL;
   m_pipes.line_tris         = NULL;
   m_pipes.tris              = NULL;
+  m_pipes.tris_blend        = NULL;
+  m_pipes.tris_depth        = NULL;
   m_pipes.compute_animation = NULL;
+
+  vkDestroyPipeline(m_device, m_pipesInstanced.line, NULL);
+  vkDestroyPipeline(m_device, m_pipesInstanced.line_tris, NULL);
+  vkDestroyPipeline(m_device, m_pipesInstanced.tris, NULL);
+  vkDestroyPipeline(m_device, m_pipesInstanced.tris_blend, NULL);
+  vkDestroyPipeline(m_device, m_pipesInstanced.tris_depth, NULL);
+  m_pipesInstanced.line       = NULL;
+  m_pipesInstanced.line_tris  = NULL;
+  m_pipesInstanced.tris       = NULL;
+  m_pipesInstanced.tris_blend = NULL;
+  m_pipesInstanced.tris_depth = NULL;
 }
 
 void ResourcesVK::cmdDynamicState(VkCommandBuffer cmd) const
@@ -1155,6 +1550,58 @@ void ResourcesVK::cmdBeginRenderPass(VkCommandBuffer cmd, bool clear, bool hasSe
                        hasSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 }
 
+void ResourcesVK::cmdShadowDynamicState(VkCommandBuffer cmd) const
+{
+  vkCmdSetViewport(cmd, 0, 1, &m_shadowMaps.viewport);
+  vkCmdSetScissor(cmd, 0, 1, &m_shadowMaps.scissor);
+}
+
+void ResourcesVK::cmdBeginShadowPass(VkCommandBuffer cmd, uint32_t layer, bool clear, bool hasSecondary) const
+{
+  VkClearValue clearValue;
+  clearValue.depthStencil.depth   = 1.0f;
+  clearValue.depthStencil.stencil = 0;
+
+  VkRenderPassBeginInfo renderPassBeginInfo = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+  renderPassBeginInfo.renderPass            = clear ? m_shadowMaps.passClear : m_shadowMaps.passPreserve;
+  renderPassBeginInfo.framebuffer           = m_shadowMaps.fbos[layer];
+  renderPassBeginInfo.renderArea            = m_shadowMaps.scissor;
+  renderPassBeginInfo.clearValueCount       = 1;
+  renderPassBeginInfo.pClearValues          = &clearValue;
+  vkCmdBeginRenderPass(cmd, &renderPassBeginInfo,
+                       hasSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void ResourcesVK::cmdShadowBarrier(VkCommandBuffer cmd, uint32_t numViews) const
+{
+  VkBufferMemoryBarrier bufferBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+  bufferBarrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask         = VK_ACCESS_UNIFORM_READ_BIT;
+  bufferBarrier.buffer                = m_common.viewBuffer;
+  bufferBarrier.offset                = getViewInfo(1).offset;
+  bufferBarrier.size                  = VkDeviceSize(m_common.alignedViewSize) * numViews;
+
+  VkImageSubresourceRange depthRange;
+  memset(&depthRange, 0, sizeof(depthRange));
+  depthRange.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT;
+  depthRange.baseMipLevel   = 0;
+  depthRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+  depthRange.baseArrayLayer = 0;
+  depthRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+  VkImageMemoryBarrier memBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  memBarrier.srcAccessMask        = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  memBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  memBarrier.oldLayout        = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  memBarrier.newLayout        = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  memBarrier.image            = m_shadowMaps.image;
+  memBarrier.subresourceRange = depthRange;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_FALSE, 0,
+                       NULL, 1, &bufferBarrier, 1, &memBarrier);
+}
+
 void ResourcesVK::cmdPipelineBarrier(VkCommandBuffer cmd, bool isOptimal) const
 {
   // color transition
@@ -1165,7 +1612,7 @@ void ResourcesVK::cmdPipelineBarrier(VkCommandBuffer cmd, bool isOptimal) const
     colorRange.baseMipLevel   = 0;
     colorRange.levelCount     = VK_REMAINING_MIP_LEVELS;
     colorRange.baseArrayLayer = 0;
-    colorRange.layerCount     = 1;
+    colorRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
 
     VkImageMemoryBarrier memBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
     memBarrier.srcAccessMask        = isOptimal ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT;
@@ -1186,7 +1633,7 @@ void ResourcesVK::cmdPipelineBarrier(VkCommandBuffer cmd, bool isOptimal) const
     depthStencilRange.baseMipLevel   = 0;
     depthStencilRange.levelCount     = VK_REMAINING_MIP_LEVELS;
     depthStencilRange.baseArrayLayer = 0;
-    depthStencilRange.layerCount     = 1;
+    depthStencilRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
 
     VkImageMemoryBarrier memBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
     memBarrier.sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1262,13 +1709,18 @@ VkCommandBuffer ResourcesVK::createTempCmdBuffer(bool primary /*=true*/, bool se
   return cmd;
 }
 
-void ResourcesVK::cmdBegin(VkCommandBuffer cmd, bool singleshot, bool primary, bool secondaryInClear) const
+void ResourcesVK::cmdBegin(VkCommandBuffer cmd, bool singleshot, bool primary, bool secondaryInClear, int shadowLayer) const
 {
   VkResult result;
   bool     secondary = !primary;
 
   VkCommandBufferInheritanceInfo inheritInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
-  if(secondary)
+  if(secondary && shadowLayer >= 0)
+  {
+    inheritInfo.renderPass  = m_shadowMaps.passPreserve;
+    inheritInfo.framebuffer = m_shadowMaps.fbos[shadowLayer];
+  }
+  else if(secondary)
   {
     inheritInfo.renderPass  = secondaryInClear ? m_framebuffer.passClear : m_framebuffer.passPreserve;
     inheritInfo.framebuffer = m_framebuffer.fboScene;
@@ -1299,7 +1751,36 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
 
   m_numMatrices = uint(cadscene.m_matrices.size());
 
-  m_scene.init(cadscene, m_device, m_physical, m_queue, m_queueFamily);
+  m_scene.init(cadscene, m_device, m_physical, m_queue, m_queueFamily, m_positionStream, m_contiguousGeometry);
+
+  m_geometryPlacement.clear();
+  if(m_contiguousGeometry)
+  {
+    m_geometryPlacement.resize(cadscene.m_geometry.size());
+    uint32_t chunkGeometry = 0;
+    for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
+    {
+      const GeometryMemoryVK::Allocation& allocation = m_scene.m_geometry[g].allocation;
+      const GeometryMemoryVK::Chunk&      chunk      = m_scene.m_geometryMem.getChunk(allocation);
+      if(g && allocation.chunkIndex != m_scene.m_geometry[g - 1].allocation.chunkIndex)
+      {
+        chunkGeometry = uint32_t(g);
+      }
+
+      // wire ranges in CadScene start after the geometry's solid indices
+      GeometryPlacement& placement = m_geometryPlacement[g];
+      placement.chunkGeometry      = chunkGeometry;
+      placement.firstSolid         = uint32_t(allocation.iboOffset / sizeof(uint32_t));
+      placement.firstWire          = uint32_t((chunk.iboWireBase + allocation.iboWireOffset) / sizeof(uint32_t))
+                            - cadscene.m_geometry[g].numIndexSolid;
+    }
+  }
+
+  if(hasPipes() && m_pipesPositionStream != m_positionStream)
+  {
+    // vertex stride of the wire pipeline depends on the stream layout
+    initPipes();
+  }
 
 
   {
@@ -1308,7 +1789,7 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
     //////////////////////////////////////////////////////////////////////////
 
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
-    m_drawing.at(DRAW_UBO_SCENE).initPool(1);
+    m_drawing.at(DRAW_UBO_SCENE).initPool(NUM_VIEWS);
 
 #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
     m_drawing.at(DRAW_UBO_MATRIX).initPool(1);
@@ -1322,15 +1803,15 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC
-    m_drawing.initPool(1);
+    m_drawing.initPool(NUM_VIEWS);
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
-    m_drawing.initPool(1);
+    m_drawing.initPool(NUM_VIEWS);
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_INDEX
-    m_drawing.initPool(1);
+    m_drawing.initPool(NUM_VIEWS);
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #endif
@@ -1366,18 +1847,30 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
     }
     vkUpdateDescriptorSets(m_device, DRAW_UBOS_NUM, updateDescriptors, 0, 0);
 
+    // the other views only differ in the scene set
+    for(uint32_t v = 1; v < NUM_VIEWS; v++)
+    {
+      VkDescriptorBufferInfo viewInfo = getViewInfo(v);
+      VkWriteDescriptorSet   update   = m_drawing.at(DRAW_UBO_SCENE).makeWrite(v, 0, &viewInfo);
+      vkUpdateDescriptorSets(m_device, 1, &update, 0, 0);
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
 
     std::vector<VkWriteDescriptorSet> queuedDescriptors;
+    VkDescriptorBufferInfo            viewsInfo[NUM_VIEWS];
+    for(uint32_t v = 0; v < NUM_VIEWS; v++)
     {
-      VkWriteDescriptorSet updateDescriptor = {};
+      viewsInfo[v] = getViewInfo(v);
+
+      VkWriteDescriptorSet updateDescriptor = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
       updateDescriptor.descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      updateDescriptor.dstSet               = m_drawing.at(DRAW_UBO_SCENE).getSet(0);
+      updateDescriptor.dstSet               = m_drawing.at(DRAW_UBO_SCENE).getSet(v);
       updateDescriptor.dstBinding           = 0;
       updateDescriptor.dstArrayElement      = 0;
       updateDescriptor.descriptorCount      = 1;
-      updateDescriptor.pBufferInfo          = &descriptors[DRAW_UBO_SCENE];
+      updateDescriptor.pBufferInfo          = &viewsInfo[v];
       queuedDescriptors.push_back(updateDescriptor);
     }
 
@@ -1422,39 +1915,51 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC
 
-    VkWriteDescriptorSet updateDescriptors[DRAW_UBOS_NUM] = {};
-    for(int i = 0; i < DRAW_UBOS_NUM; i++)
+    // one complete set per view
+    for(uint32_t v = 0; v < NUM_VIEWS; v++)
     {
-      updateDescriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      updateDescriptors[i].pNext = NULL;
-      updateDescriptors[i].descriptorType =
-          UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC || (UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC && i > DRAW_UBO_SCENE) ?
-              VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC :
-              VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      updateDescriptors[i].dstSet          = m_drawing.getSet(0);
-      updateDescriptors[i].dstBinding      = i;
-      updateDescriptors[i].dstArrayElement = 0;
-      updateDescriptors[i].descriptorCount = 1;
-      updateDescriptors[i].pBufferInfo     = descriptors + i;
+      descriptors[DRAW_UBO_SCENE] = getViewInfo(v);
+
+      VkWriteDescriptorSet updateDescriptors[DRAW_UBOS_NUM] = {};
+      for(int i = 0; i < DRAW_UBOS_NUM; i++)
+      {
+        updateDescriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        updateDescriptors[i].pNext = NULL;
+        updateDescriptors[i].descriptorType =
+            UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC || (UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC && i > DRAW_UBO_SCENE) ?
+                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC :
+                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        updateDescriptors[i].dstSet          = m_drawing.getSet(v);
+        updateDescriptors[i].dstBinding      = i;
+        updateDescriptors[i].dstArrayElement = 0;
+        updateDescriptors[i].descriptorCount = 1;
+        updateDescriptors[i].pBufferInfo     = descriptors + i;
+      }
+      vkUpdateDescriptorSets(m_device, DRAW_UBOS_NUM, updateDescriptors, 0, 0);
     }
-    vkUpdateDescriptorSets(m_device, DRAW_UBOS_NUM, updateDescriptors, 0, 0);
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
 
-    VkWriteDescriptorSet updateDescriptors[1] = {};
-    for(int i = 0; i < 1; i++)
+    // one set per view
+    for(uint32_t v = 0; v < NUM_VIEWS; v++)
     {
-      updateDescriptors[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      updateDescriptors[i].pNext           = NULL;
-      updateDescriptors[i].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      updateDescriptors[i].dstSet          = m_drawing.getSet(0);
-      updateDescriptors[i].dstBinding      = i;
-      updateDescriptors[i].dstArrayElement = 0;
-      updateDescriptors[i].descriptorCount = 1;
-      updateDescriptors[i].pBufferInfo     = descriptors + i;
+      descriptors[DRAW_UBO_SCENE] = getViewInfo(v);
+
+      VkWriteDescriptorSet updateDescriptors[1] = {};
+      for(int i = 0; i < 1; i++)
+      {
+        updateDescriptors[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        updateDescriptors[i].pNext           = NULL;
+        updateDescriptors[i].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        updateDescriptors[i].dstSet          = m_drawing.getSet(v);
+        updateDescriptors[i].dstBinding      = i;
+        updateDescriptors[i].dstArrayElement = 0;
+        updateDescriptors[i].descriptorCount = 1;
+        updateDescriptors[i].pBufferInfo     = descriptors + i;
+      }
+      vkUpdateDescriptorSets(m_device, 1, updateDescriptors, 0, 0);
     }
-    vkUpdateDescriptorSets(m_device, 1, updateDescriptors, 0, 0);
 ///////////////////////////////////////////////////////////////////////////////////////////
 #elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_INDEX
 
@@ -1462,20 +1967,26 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
     descriptors[DRAW_UBO_MATRIX]   = views.matricesFull;
     descriptors[DRAW_UBO_MATERIAL] = views.materialsFull;
 
-    VkWriteDescriptorSet updateDescriptors[DRAW_UBOS_NUM] = {};
-    for(int i = 0; i < DRAW_UBOS_NUM; i++)
+    // one complete set per view
+    for(uint32_t v = 0; v < NUM_VIEWS; v++)
     {
-      updateDescriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      updateDescriptors[i].pNext = NULL;
-      updateDescriptors[i].descriptorType =
-          (i == DRAW_UBO_MATRIX || i == DRAW_UBO_MATERIAL) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      updateDescriptors[i].dstSet          = m_drawing.getSet(0);
-      updateDescriptors[i].dstBinding      = i;
-      updateDescriptors[i].dstArrayElement = 0;
-      updateDescriptors[i].descriptorCount = 1;
-      updateDescriptors[i].pBufferInfo     = descriptors + i;
+      descriptors[DRAW_UBO_SCENE] = getViewInfo(v);
+
+      VkWriteDescriptorSet updateDescriptors[DRAW_UBOS_NUM] = {};
+      for(int i = 0; i < DRAW_UBOS_NUM; i++)
+      {
+        updateDescriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        updateDescriptors[i].pNext = NULL;
+        updateDescriptors[i].descriptorType =
+            (i == DRAW_UBO_MATRIX || i == DRAW_UBO_MATERIAL) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        updateDescriptors[i].dstSet          = m_drawing.getSet(v);
+        updateDescriptors[i].dstBinding      = i;
+        updateDescriptors[i].dstArrayElement = 0;
+        updateDescriptors[i].descriptorCount = 1;
+        updateDescriptors[i].pBufferInfo     = descriptors + i;
+      }
+      vkUpdateDescriptorSets(m_device, DRAW_UBOS_NUM, updateDescriptors, 0, 0);
     }
-    vkUpdateDescriptorSets(m_device, DRAW_UBOS_NUM, updateDescriptors, 0, 0);
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 #endif
@@ -1492,6 +2003,23 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
     vkUpdateDescriptorSets(m_device, NV_ARRAY_SIZE(updateDescriptors), updateDescriptors, 0, 0);
   }
 
+  {
+    // instanced drawing reads all matrices, shader relies on the tight MatrixData stride
+    assert(m_alignedMatrixSize == sizeof(MatrixData));
+
+    for(uint32_t v = 0; v < NUM_VIEWS; v++)
+    {
+      VkDescriptorBufferInfo viewInfo = getViewInfo(v);
+
+      VkWriteDescriptorSet updateDescriptors[] = {
+          m_drawInstanced.makeWrite(v, DRAW_UBO_SCENE, &viewInfo),
+          m_drawInstanced.makeWrite(v, DRAW_UBO_MATRIX, &m_scene.m_infos.matrices),
+          m_drawInstanced.makeWrite(v, DRAW_UBO_MATERIAL, &m_scene.m_infos.materialsSingle),
+      };
+      vkUpdateDescriptorSets(m_device, NV_ARRAY_SIZE(updateDescriptors), updateDescriptors, 0, 0);
+    }
+  }
+
   return true;
 }
 
@@ -1506,6 +2034,38 @@ void ResourcesVK::deinitScene()
   m_drawing.deinitPool();
 #endif
   m_scene.deinit();
+  m_geometryPlacement.clear();
+}
+
+void ResourcesVK::initInstances(const std::vector<uint32_t>& instanceMatrices)
+{
+  deinitInstances();
+
+  if(instanceMatrices.empty())
+    return;
+
+  VkDeviceSize size = sizeof(uint32_t) * instanceMatrices.size();
+
+  m_instances.instancesBuffer = m_memAllocator.createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                            m_instances.instancesAID);
+  m_instances.instancesInfo = {m_instances.instancesBuffer, 0, size};
+
+  ScopeStaging staging(&m_memAllocator, m_queue, m_queueFamily, size);
+  staging.upload(m_instances.instancesInfo, instanceMatrices.data());
+  staging.upload({}, nullptr);
+}
+
+void ResourcesVK::deinitInstances()
+{
+  if(!m_instances.instancesBuffer)
+    return;
+
+  synchronize();
+
+  vkDestroyBuffer(m_device, m_instances.instancesBuffer, NULL);
+  m_memAllocator.free(m_instances.instancesAID);
+  m_instances.instancesBuffer = VK_NULL_HANDLE;
+  m_instances.instancesInfo   = {};
 }
 
 void ResourcesVK::synchronize()
@@ -1520,6 +2080,13 @@ glm::mat4 ResourcesVK::perspectiveProjection(float fovy, float aspect, float nea
   return M;
 }
 
+glm::mat4 ResourcesVK::orthographicProjection(float left, float right, float bottom, float top, float nearPlane, float farPlane) const
+{
+  glm::mat4 M = glm::orthoRH_ZO(left, right, bottom, top, nearPlane, farPlane);
+  M[1][1] *= -1;
+  return M;
+}
+
 void ResourcesVK::animation(const Global& global)
 {
   VkCommandBuffer cmd = createTempCmdBuffer();
@@ -74,6 +74,26 @@ public:
   }
   static bool isAvailable();
 
+  // main view and shadow views, each has its own SceneData in the view buffer and scene descriptor set
+  static const uint32_t NUM_VIEWS = 1 + MAX_SHADOWVIEWS;
+
+  // default weights for the draw order optimizer, the descriptor cost depends on the technique
+  static StateCost getStateCost()
+  {
+#if UNIFORMS_TECHNIQUE == UNIFORMS_ALLDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_SPLITDYNAMIC
+    // matrix and material share one set, either change rebinds it with both offsets
+    return {6.0f, 2.0f, 1.5f, 1.5f, 1.0f};
+#elif UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC
+    return {6.0f, 2.0f, 1.0f, 1.0f, 1.0f};
+#elif UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
+    return {6.0f, 2.0f, 1.25f, 1.25f, 1.0f};
+#elif UNIFORMS_TECHNIQUE == UNIFORMS_PUSHCONSTANTS_RAW
+    return {6.0f, 2.0f, 1.5f, 2.0f, 1.0f};
+#else
+    return {6.0f, 2.0f, 0.25f, 0.25f, 1.0f};
+#endif
+  }
+
 
   struct FrameBuffer
   {
@@ -83,6 +103,7 @@ public:
     bool useResolved  = false;
     bool vsync        = false;
     int  msaa         = 0;
+    bool stereo       = false;  // scene images have a layer per eye, render size is one eye
 
     VkViewport viewport;
     VkViewport viewportUI;
@@ -107,23 +128,54 @@ public:
     nvvk::DeviceMemoryAllocator memAllocator;
   };
 
+  // depth-only layers of the shadow views, one framebuffer per layer
+  struct ShadowMaps
+  {
+    int      size      = 0;
+    uint32_t numLayers = 0;
+
+    VkViewport viewport;
+    VkRect2D   scissor;
+
+    VkRenderPass passClear    = VK_NULL_HANDLE;
+    VkRenderPass passPreserve = VK_NULL_HANDLE;
+
+    VkImage       image                  = VK_NULL_HANDLE;
+    VkImageView   views[MAX_SHADOWVIEWS] = {};
+    VkFramebuffer fbos[MAX_SHADOWVIEWS]  = {};
+
+    nvvk::DeviceMemoryAllocator memAllocator;
+  };
+
   struct Common
   {
     nvvk::AllocationID     viewAID;
     VkBuffer               viewBuffer;
-    VkDescriptorBufferInfo viewInfo;
+    VkDescriptorBufferInfo viewInfo;  // main view, see getViewInfo
+    uint32_t               alignedViewSize;
 
     nvvk::AllocationID     animAID;
     VkBuffer               animBuffer;
     VkDescriptorBufferInfo animInfo;
   };
 
+  struct Instances
+  {
+    nvvk::AllocationID     instancesAID;
+    VkBuffer               instancesBuffer = VK_NULL_HANDLE;
+    VkDescriptorBufferInfo instancesInfo   = {};
+  };
+
   struct ShaderModuleIDs
   {
     nvvk::ShaderModuleID vertex_tris;
     nvvk::ShaderModuleID vertex_line;
     nvvk::ShaderModuleID fragment_tris;
     nvvk::ShaderModuleID fragment_line;
+    nvvk::ShaderModuleID vertex_tris_instanced;
+    nvvk::ShaderModuleID vertex_line_instanced;
+    nvvk::ShaderModuleID fragment_tris_instanced;
+    nvvk::ShaderModuleID fragment_line_instanced;
     nvvk::ShaderModuleID compute_animation;
   };
 
@@ -133,12 +185,18 @@ public:
     VkShaderModule vertex_line;
     VkShaderModule fragment_tris;
     VkShaderModule fragment_line;
+    VkShaderModule vertex_tris_instanced;
+    VkShaderModule vertex_line_instanced;
+    VkShaderModule fragment_tris_instanced;
+    VkShaderModule fragment_line_instanced;
     VkShaderModule compute_animation;
   };
 
   struct Pipelines
   {
     VkPipeline tris              = VK_NULL_HANDLE;
+    VkPipeline tris_blend        = VK_NULL_HANDLE;  // translucent parts, no depth write
+    VkPipeline tris_depth        = VK_NULL_HANDLE;  // shadow views, position stream and no fragment shader
     VkPipeline line_tris         = VK_NULL_HANDLE;
     VkPipeline line              = VK_NULL_HANDLE;
     VkPipeline compute_animation = VK_NULL_HANDLE;
@@ -150,9 +208,13 @@ public:
   ShaderModuleIDs           m_moduleids;
   Shaders                   m_shaders;
   Pipelines                 m_pipes;
+  Pipelines                 m_pipesInstanced;  // no compute_animation
+  bool                      m_pipesPositionStream = false;
 
   FrameBuffer m_framebuffer;
+  ShadowMaps  m_shadowMaps;
   Common      m_common;
+  Instances   m_instances;
 
 #if HAS_OPENGL
   //nvvk::DeviceInstance m_ctxContent;
@@ -181,6 +243,8 @@ public:
   nvvk::DescriptorSetContainer m_drawing;
 #endif
   nvvk::DescriptorSetContainer m_anim;
+  // single set for instanced drawing: scene, all matrices as storage buffer, dynamic material
+  nvvk::DescriptorSetContainer m_drawInstanced;
 
   uint32_t   m_numMatrices;
   CadSceneVK m_scene;
@@ -212,6 +276,17 @@ public:
   bool initFramebuffer(int width, int height, int msaa, bool vsync) override;
   void deinitFramebuffer();
 
+  // without the feature the shaders are built without GL_EXT_multiview
+  bool supportsStereo() const override { return m_context->m_physicalInfo.features11.multiview == VK_TRUE; }
+  // without the feature the shaders are built without gl_ClipDistance
+  bool supportsClipPlanes() const override
+  {
+    return m_context->m_physicalInfo.features10.shaderClipDistance == VK_TRUE;
+  }
+
+  bool initShadowMaps(int size, uint32_t numLayers) override;
+  void deinitShadowMaps();
+
   bool initScene(const CadScene&) override;
   void deinitScene() override;
 
@@ -221,15 +296,33 @@ public:
   void blitFrame(const Global& global) override;
   void endFrame() override;
 
+  void initInstances(const std::vector<uint32_t>& instanceMatrices) override;
+  void deinitInstances() override;
+
   void animation(const Global& global) override;
   void animationReset() override;
 
+  void appendMemoryStats(MemoryStats& stats) const override
+  {
+    m_scene.appendMemoryStats(stats);
+    stats.gpu[MemoryStats::DRAWITEMS] += m_instances.instancesInfo.range;
+  }
+
   glm::mat4 perspectiveProjection(float fovy, float aspect, float nearPlane, float farPlane) const override;
+  glm::mat4 orthographicProjection(float left, float right, float bottom, float top, float nearPlane, float farPlane) const override;
+
+  // view 0 is the main view, view 1 + i draws into layer i of the shadow maps
+  VkDescriptorBufferInfo getViewInfo(uint32_t view) const
+  {
+    return {m_common.viewBuffer, VkDeviceSize(m_common.alignedViewSize) * view, sizeof(SceneData)};
+  }
 
   //////////////////////////////////////////////////////////////////////////
 
-  VkRenderPass createPass(bool clear, int msaa);
-  VkRenderPass createPassUI(int msaa);
+  // stereo broadcasts every draw to two views
+  VkRenderPass createPass(bool clear, int msaa, bool stereo);
+  VkRenderPass createPassUI(bool resolved);
+  VkRenderPass createShadowPass(bool clear);
 
   VkCommandBuffer createCmdBuffer(VkCommandPool pool, bool singleshot, bool primary, bool secondaryInClear) const;
   VkCommandBuffer createTempCmdBuffer(bool primary = true, bool secondaryInClear = false);
@@ -244,6 +337,11 @@ public:
   void resetTempResources();
 
   void cmdBeginRenderPass(VkCommandBuffer cmd, bool clear, bool hasSecondary = false) const;
+  void cmdBeginShadowPass(VkCommandBuffer cmd, uint32_t layer, bool clear, bool hasSecondary = false) const;
+  // orders the uniform updates of numViews shadow views and the previous frame's shadow layers
+  // before the shadow views are drawn
+  void cmdShadowBarrier(VkCommandBuffer cmd, uint32_t numViews) const;
+  void cmdShadowDynamicState(VkCommandBuffer cmd) const;
   void cmdPipelineBarrier(VkCommandBuffer cmd, bool isOptimal = false) const;
   void cmdDynamicState(VkCommandBuffer cmd) const;
   void cmdImageTransition(VkCommandBuffer    cmd,
@@ -253,7 +351,8 @@ public:
                           VkAccessFlags      dst,
                           VkImageLayout      oldLayout,
                           VkImageLayout      newLayout) const;
-  void cmdBegin(VkCommandBuffer cmd, bool singleshot, bool primary, bool secondaryInClear) const;
+  // secondaries inherit the scene pass, or the preserving pass of the shadow layer if not negative
+  void cmdBegin(VkCommandBuffer cmd, bool singleshot, bool primary, bool secondaryInClear, int shadowLayer = -1) const;
 };
 
 }  // namespace csfthreaded
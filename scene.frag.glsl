@@ -26,7 +26,17 @@
 
 #ifdef VULKAN
 
-  #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
+  #if INSTANCED
+  
+    // own single set layout, independent of UNIFORMS_TECHNIQUE
+    layout(set=0, binding=DRAW_UBO_SCENE, std140) uniform sceneBuffer {
+      SceneData       scene;
+    };
+    layout(set=0, binding=DRAW_UBO_MATERIAL, std140) uniform materialBuffer {
+      MaterialData    material;
+    };
+    
+  #elif UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
   
     layout(set=DRAW_UBO_SCENE, binding=0, std140) uniform sceneBuffer {
       SceneData       scene;
@@ -126,6 +136,7 @@ void main()
     color += side.diffuse * ldot;
     color += side.specular * pow(max(0,dot(normal,halfDir)),16);
 
-    out_Color = color;
+    // alpha only matters for the blended translucent parts
+    out_Color = vec4(color.rgb, side.diffuse.a);
   }
 }
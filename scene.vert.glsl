@@ -22,10 +22,39 @@
 #version 440 core
 /**/
 
+// Vulkan defines it by the multiview feature
+#ifndef USE_MULTIVIEW
+#define USE_MULTIVIEW 0
+#endif
+
+#if USE_MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
 //#extension GL_ARB_shading_language_include : enable
 #include "common.h"
 
-#ifdef VULKAN
+#if INSTANCED
+
+  #ifdef VULKAN
+    layout(set=0, binding=DRAW_UBO_SCENE, std140) uniform sceneBuffer {
+      SceneData   scene;
+    };
+    layout(set=0, binding=DRAW_UBO_MATRIX, std430) readonly buffer matrixBuffer {
+      MatrixData  matrices[];
+    };
+  #else
+    layout(binding=DRAW_UBO_SCENE, std140) uniform sceneBuffer {
+      SceneData   scene;
+    };
+    layout(binding=DRAW_UBO_MATRIX, std430) readonly buffer matrixBuffer {
+      MatrixData  matrices[];
+    };
+  #endif
+  
+  in layout(location=VERTEX_MATRIXINDEX) uint inMatrixIndex;
+
+#elif defined(VULKAN)
 
   #if UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSDYNAMIC || UNIFORMS_TECHNIQUE == UNIFORMS_MULTISETSSTATIC
   
@@ -81,13 +110,27 @@
 #endif
 
 
+#if WIREMODE
+// wire and depth-only drawing never need the normal, fetch from the position-only stream
+in layout(location=VERTEX_POS) vec3 inPos;
+#else
 in layout(location=VERTEX_POS_OCTNORMAL) vec4 inPosNormal;
+#endif
 
 layout(location=0) out Interpolants {
   vec3 wPos;
   vec3 wNormal;
 } OUT;
 
+// Vulkan defines it by the shaderClipDistance feature
+#ifndef USE_CLIPPLANES
+#define USE_CLIPPLANES 1
+#endif
+
+#if USE_CLIPPLANES
+out float gl_ClipDistance[MAX_CLIPPLANES];
+#endif
+
 
 // oct functions from http://jcgt.org/published/0003/02/01/paper.pdf
 vec2 oct_signNotZero(vec2 v) {
@@ -107,17 +150,39 @@ vec2 float32x3_to_oct(in vec3 v) {
 
 void main()
 {
-  vec3 inNormal = oct_to_float32x3(unpackSnorm2x16(floatBitsToUint(inPosNormal.w)));
+#if WIREMODE
+  vec3 inPosition = inPos;
+  vec3 inNormal   = vec3(0,0,1);
+#else
+  vec3 inPosition = inPosNormal.xyz;
+  vec3 inNormal   = oct_to_float32x3(unpackSnorm2x16(floatBitsToUint(inPosNormal.w)));
+#endif
 
-#if USE_INDEXING
-  vec3 wPos     = (matrices[matrixIndex].worldMatrix   * vec4(inPosNormal.xyz,1)).xyz;
+#if INSTANCED
+  vec3 wPos     = (matrices[inMatrixIndex].worldMatrix   * vec4(inPosition,1)).xyz;
+  vec3 wNormal  = mat3(matrices[inMatrixIndex].worldMatrixIT) * inNormal;
+#elif USE_INDEXING
+  vec3 wPos     = (matrices[matrixIndex].worldMatrix   * vec4(inPosition,1)).xyz;
   vec3 wNormal  = mat3(matrices[matrixIndex].worldMatrixIT) * inNormal;
 #else
-  vec3 wPos     = (object.worldMatrix   * vec4(inPosNormal.xyz,1)).xyz;
+  vec3 wPos     = (object.worldMatrix   * vec4(inPosition,1)).xyz;
   vec3 wNormal  = mat3(object.worldMatrixIT) * inNormal;
 #endif
 
-  gl_Position   = scene.viewProjMatrix * vec4(wPos,1);
+#if USE_MULTIVIEW
+  // stereo draws both eyes in one pass, gl_ViewIndex is 0 outside of multiview passes
+  mat4 viewProjMatrix = scene.stereo != 0 ? scene.eyeViewProjMatrix[gl_ViewIndex] : scene.viewProjMatrix;
+#else
+  mat4 viewProjMatrix = scene.viewProjMatrix;
+#endif
+
+  gl_Position   = viewProjMatrix * vec4(wPos,1);
+#if USE_CLIPPLANES
+  for (int i = 0; i < MAX_CLIPPLANES; i++){
+    // unused planes keep everything
+    gl_ClipDistance[i] = i < scene.numClipPlanes ? dot(scene.wClipPlanes[i], vec4(wPos,1)) : 1.0;
+  }
+#endif
   OUT.wPos = wPos;
   OUT.wNormal = wNormal;
 }
@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "scenepicker.hpp"
+#include "benchmark.hpp"
+#include <algorithm>
+#include <atomic>
+#include <glm/gtc/matrix_transform.hpp>
+#include <nvh/nvprint.hpp>
+#include <nvpwindow.hpp>
+
+
+namespace csfthreaded {
+
+// distance at which the ray enters bounds, false if it misses them before tmax
+static inline bool IntersectBounds(const ObjectBVH::Bounds& bounds, const glm::vec3& origin, const glm::vec3& invDir, float tmax, float& entry)
+{
+  glm::vec3 t0    = (bounds.min - origin) * invDir;
+  glm::vec3 t1    = (bounds.max - origin) * invDir;
+  glm::vec3 tnear = glm::min(t0, t1);
+  glm::vec3 tfar  = glm::max(t0, t1);
+
+  entry      = std::max(std::max(tnear.x, tnear.y), std::max(tnear.z, 0.0f));
+  float exit = std::min(std::min(tfar.x, tfar.y), std::min(tfar.z, tmax));
+  return entry <= exit;
+}
+
+// two sided, t is updated if the triangle is hit before it
+static inline bool IntersectTriangle(const glm::vec3& origin,
+                                     const glm::vec3& direction,
+                                     const glm::vec3& a,
+                                     const glm::vec3& b,
+                                     const glm::vec3& c,
+                                     float&           t)
+{
+  glm::vec3 edge1 = b - a;
+  glm::vec3 edge2 = c - a;
+  glm::vec3 p     = glm::cross(direction, edge2);
+  float     det   = glm::dot(edge1, p);
+  if(det == 0)
+    return false;
+
+  float     invDet = 1.0f / det;
+  glm::vec3 s      = origin - a;
+  float     u      = glm::dot(s, p) * invDet;
+  if(u < 0 || u > 1)
+    return false;
+
+  glm::vec3 q = glm::cross(s, edge1);
+  float     v = glm::dot(direction, q) * invDet;
+  if(v < 0 || u + v > 1)
+    return false;
+
+  float dist = glm::dot(edge2, q) * invDet;
+  if(dist <= 0 || dist >= t)
+    return false;
+
+  t = dist;
+  return true;
+}
+
+// nearest first through the nodes, leaf is called for every leaf node the ray reaches before tmax.
+// Only pushes above the current top of stack, so leaf may traverse again with the same stack
+template <class Stack, class T>
+static void Traverse(const std::vector<ObjectBVH::Node>& nodes,
+                     const glm::vec3&                    origin,
+                     const glm::vec3&                    invDir,
+                     const float&                        tmax,
+                     Stack&                              stack,
+                     T&&                                 leaf)
+{
+  size_t base = stack.size();
+
+  float entry;
+  if(nodes.empty() || !IntersectBounds(nodes[0].bounds, origin, invDir, tmax, entry))
+    return;
+  stack.push_back({0, entry});
+
+  while(stack.size() > base)
+  {
+    auto current = stack.back();
+    stack.pop_back();
+    // a closer hit may have been found since it was pushed
+    if(current.entry > tmax)
+      continue;
+
+    const ObjectBVH::Node& node = nodes[current.node];
+    if(node.count)
+    {
+      leaf(node);
+      continue;
+    }
+
+    float entries[2];
+    bool  hits[2];
+    for(uint32_t c = 0; c < 2; c++)
+    {
+      hits[c] = IntersectBounds(nodes[node.first + c].bounds, origin, invDir, tmax, entries[c]);
+    }
+    // the nearer child is popped first
+    uint32_t nearer = entries[1] < entries[0] ? 1 : 0;
+    if(hits[nearer ^ 1])
+    {
+      stack.push_back({node.first + (nearer ^ 1), entries[nearer ^ 1]});
+    }
+    if(hits[nearer])
+    {
+      stack.push_back({node.first + nearer, entries[nearer]});
+    }
+  }
+}
+
+// triangles [begin, end) of level in the space of matrixIndex, skips the parts the object doesn't draw
+// and the ones placed by other matrices
+static void IntersectTriangles(const ScenePicker::BottomLevel& level,
+                               const CadScene::Object&         object,
+                               uint32_t                        obj,
+                               int                             matrixIndex,
+                               uint32_t                        begin,
+                               uint32_t                        end,
+                               const glm::vec3&                origin,
+                               const glm::vec3&                direction,
+                               ScenePicker::Hit&               hit)
+{
+  const glm::vec3* positions = level.positions.data();
+  const uint32_t*  indices   = level.indices.data();
+  for(uint32_t t = begin; t < end; t++)
+  {
+    const CadScene::ObjectPart& part = object.parts[level.parts[t]];
+    if((!part.active && !part.translucent) || part.matrixIndex != matrixIndex)
+      continue;
+
+    if(IntersectTriangle(origin, direction, positions[indices[t * 3 + 0]], positions[indices[t * 3 + 1]],
+                         positions[indices[t * 3 + 2]], hit.distance))
+    {
+      hit.object   = obj;
+      hit.part     = level.parts[t];
+      hit.triangle = level.triangles[t];
+    }
+  }
+}
+
+static void BuildBottomLevel(const CadScene::Geometry& geom, ScenePicker::BottomLevel& level)
+{
+  level.positions.resize(geom.numVertices);
+  CadScene::getPositions(geom, level.positions.data());
+
+  std::vector<uint32_t> indices;
+  std::vector<uint32_t> triangles;
+  std::vector<uint32_t> parts;
+  for(size_t p = 0; p < geom.parts.size(); p++)
+  {
+    const CadScene::DrawRange& range = geom.parts[p].indexSolid;
+    size_t                     first = range.offset / sizeof(unsigned int);
+    for(int i = 0; i + 2 < range.count; i += 3)
+    {
+      indices.push_back(geom.iboData[first + i + 0]);
+      indices.push_back(geom.iboData[first + i + 1]);
+      indices.push_back(geom.iboData[first + i + 2]);
+      triangles.push_back(uint32_t((first + i) / 3));
+      parts.push_back(uint32_t(p));
+    }
+  }
+
+  uint32_t                         numTriangles = uint32_t(triangles.size());
+  std::vector<ObjectBVH::Bounds>   bounds(numTriangles);
+  std::vector<glm::vec3>           centroids(numTriangles);
+  std::vector<uint32_t>            order(numTriangles);
+  for(uint32_t t = 0; t < numTriangles; t++)
+  {
+    const glm::vec3& a = level.positions[indices[t * 3 + 0]];
+    const glm::vec3& b = level.positions[indices[t * 3 + 1]];
+    const glm::vec3& c = level.positions[indices[t * 3 + 2]];
+    bounds[t].min      = glm::min(glm::min(a, b), c);
+    bounds[t].max      = glm::max(glm::max(a, b), c);
+    centroids[t]       = (a + b + c) * (1.0f / 3.0f);
+    order[t]           = t;
+  }
+
+  ObjectBVH::buildNodes(bounds.data(), centroids.data(), order.data(), numTriangles, level.nodes);
+
+  // triangles in leaf order, so leaves refer to them directly
+  level.indices.resize(indices.size());
+  level.triangles.resize(numTriangles);
+  level.parts.resize(numTriangles);
+  for(uint32_t t = 0; t < numTriangles; t++)
+  {
+    uint32_t src            = order[t];
+    level.indices[t * 3 + 0] = indices[src * 3 + 0];
+    level.indices[t * 3 + 1] = indices[src * 3 + 1];
+    level.indices[t * 3 + 2] = indices[src * 3 + 2];
+    level.triangles[t]       = triangles[src];
+    level.parts[t]           = parts[src];
+  }
+}
+
+struct PickBuildJob
+{
+  const CadScene*                        scene;
+  const std::vector<uint32_t>*           geometries;
+  std::vector<ScenePicker::BottomLevel>* levels;
+  std::atomic<size_t>*                   next;
+};
+
+static void PickBuildThread(void* arg)
+{
+  PickBuildJob* job = (PickBuildJob*)arg;
+
+  size_t i;
+  while((i = (*job->next)++) < job->geometries->size())
+  {
+    BuildBottomLevel(job->scene->m_geometry[(*job->geometries)[i]], (*job->levels)[i]);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void ScenePicker::build(const CadScene& scene, ThreadPool& pool, uint32_t numThreads)
+{
+  double timeBegin = NVPSystem::getTime();
+
+  deinit();
+
+  // one level per unique geometry, largest first so the threads finish together
+  std::vector<uint32_t> geometries;
+  for(uint32_t g = 0; g < uint32_t(scene.m_geometry.size()); g++)
+  {
+    const CadScene::Geometry& geom = scene.m_geometry[g];
+    if(geom.cloneIdx < 0 && geom.numIndexSolid >= 3 && geom.iboData && geom.vboData)
+    {
+      geometries.push_back(g);
+    }
+  }
+  std::sort(geometries.begin(), geometries.end(), [&](uint32_t a, uint32_t b) {
+    return scene.m_geometry[a].numIndexSolid > scene.m_geometry[b].numIndexSolid;
+  });
+
+  m_levels.resize(geometries.size());
+  m_geometryLevels.assign(scene.m_geometry.size(), ~0u);
+  for(uint32_t i = 0; i < uint32_t(geometries.size()); i++)
+  {
+    m_geometryLevels[geometries[i]] = i;
+  }
+  for(size_t g = 0; g < scene.m_geometry.size(); g++)
+  {
+    int clone = scene.m_geometry[g].cloneIdx;
+    if(clone >= 0)
+    {
+      m_geometryLevels[g] = m_geometryLevels[clone];
+    }
+  }
+
+  std::atomic<size_t>       next(0);
+  std::vector<PickBuildJob> jobs(std::max(1u, std::min(numThreads, uint32_t(geometries.size()))));
+  for(size_t t = 0; t < jobs.size(); t++)
+  {
+    jobs[t].scene      = &scene;
+    jobs[t].geometries = &geometries;
+    jobs[t].levels     = &m_levels;
+    jobs[t].next       = &next;
+  }
+  if(jobs.size() == 1)
+  {
+    PickBuildThread(&jobs[0]);
+  }
+  else
+  {
+    for(uint32_t t = 0; t < uint32_t(jobs.size()); t++)
+    {
+      pool.activateJob(t, PickBuildThread, &jobs[t]);
+    }
+    for(uint32_t t = 0; t < uint32_t(jobs.size()); t++)
+    {
+      pool.waitJob(t);
+    }
+  }
+
+  m_numTriangles = 0;
+  for(const BottomLevel& level : m_levels)
+  {
+    m_numTriangles += level.triangles.size();
+  }
+
+  m_buildTime = (NVPSystem::getTime() - timeBegin) * 1000.0;
+}
+
+void ScenePicker::deinit()
+{
+  m_levels.clear();
+  m_levels.shrink_to_fit();
+  m_geometryLevels.clear();
+  m_geometryLevels.shrink_to_fit();
+  m_numTriangles = 0;
+}
+
+size_t ScenePicker::getMemoryUsage() const
+{
+  size_t size = m_levels.capacity() * sizeof(BottomLevel) + m_geometryLevels.capacity() * sizeof(uint32_t);
+  for(const BottomLevel& level : m_levels)
+  {
+    size += level.nodes.capacity() * sizeof(ObjectBVH::Node) + level.positions.capacity() * sizeof(glm::vec3)
+            + (level.indices.capacity() + level.triangles.capacity() + level.parts.capacity()) * sizeof(uint32_t);
+  }
+  return size;
+}
+
+void ScenePicker::pickObject(const CadScene&          scene,
+                             uint32_t                 obj,
+                             const glm::mat4*         matrices,
+                             const glm::vec3&         origin,
+                             const glm::vec3&         direction,
+                             std::vector<StackEntry>& stack,
+                             Hit&                     hit) const
+{
+  const CadScene::Object& object = scene.m_objects[obj];
+  uint32_t                levelIndex = m_geometryLevels[object.geometryIndex];
+  if(levelIndex == ~0u)
+    return;
+
+  const BottomLevel& level = m_levels[levelIndex];
+
+  // parts may be placed by other matrices than the object, the ray is transformed once per matrix
+  int lastMatrix = -1;
+  for(const CadScene::ObjectPart& part : object.parts)
+  {
+    int matrixIndex = part.matrixIndex;
+    if(matrixIndex == lastMatrix)
+      continue;
+    lastMatrix = matrixIndex;
+
+    // same ray parameter in object space, the direction is not normalized
+    glm::mat4 inverse     = glm::inverse(matrices ? matrices[matrixIndex] : scene.m_matrices[matrixIndex].worldMatrix);
+    glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+    glm::vec3 localDir    = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+    glm::vec3 invDir      = glm::vec3(1.0f) / localDir;
+
+    Traverse(level.nodes, localOrigin, invDir, hit.distance, stack, [&](const ObjectBVH::Node& node) {
+      IntersectTriangles(level, object, obj, matrixIndex, node.first, node.first + node.count, localOrigin, localDir,
+                         hit);
+    });
+  }
+}
+
+ScenePicker::Hit ScenePicker::pick(const CadScene&  scene,
+                                   const ObjectBVH& bvh,
+                                   const glm::mat4* matrices,
+                                   const glm::vec3& origin,
+                                   const glm::vec3& direction) const
+{
+  Hit hit;
+  if(bvh.empty() || m_levels.empty())
+    return hit;
+
+  // one allocation per pick, the bottom levels continue on top of the top level's entries
+  std::vector<StackEntry> stack;
+  stack.reserve(128);
+
+  glm::vec3 invDir = glm::vec3(1.0f) / direction;
+  Traverse(bvh.m_nodes, origin, invDir, hit.distance, stack, [&](const ObjectBVH::Node& node) {
+    for(uint32_t i = node.first; i < node.first + node.count; i++)
+    {
+      uint32_t obj = bvh.m_leafObjects[i];
+      float    entry;
+      if(IntersectBounds(bvh.m_objectBounds[obj], origin, invDir, hit.distance, entry))
+      {
+        pickObject(scene, obj, matrices, origin, direction, stack, hit);
+      }
+    }
+  });
+
+  if(hit.valid())
+  {
+    hit.position = origin + direction * hit.distance;
+  }
+  return hit;
+}
+
+void ScenePicker::getPixelRay(const glm::mat4& viewMatrix,
+                              float            fovy,
+                              const glm::vec2& pixel,
+                              const glm::vec2& viewport,
+                              glm::vec3&       origin,
+                              glm::vec3&       direction)
+{
+  // independent of the api's clip space conventions
+  float     tanHalf = tanf(glm::radians(fovy) * 0.5f);
+  glm::vec2 ndc     = (pixel + 0.5f) / viewport * 2.0f - 1.0f;
+  glm::vec3 viewDir = glm::vec3(ndc.x * tanHalf * viewport.x / viewport.y, -ndc.y * tanHalf, -1.0f);
+
+  glm::mat4 viewInverse = glm::inverse(viewMatrix);
+  origin                = glm::vec3(viewInverse[3]);
+  direction             = glm::vec3(viewInverse * glm::vec4(viewDir, 0.0f));
+}
+
+void ScenePicker::benchmark(const CadScene& scene, const ObjectBVH& bvh, ThreadPool& pool)
+{
+  static const uint32_t RAYS_X      = 64;
+  static const uint32_t RAYS_Y      = 36;
+  static const uint32_t BRUTE_FORCE = 16;  // rays per view that also test every triangle
+
+  if(scene.m_objects.empty() || bvh.empty() || scene.isGeometryReleased())
+    return;
+
+  ScenePicker picker;
+
+  LOGI("picking benchmark\n");
+  benchmarkThreads(pool, "build [ms]:", [&](uint32_t numThreads) {
+    picker.build(scene, pool, numThreads);
+    return picker.m_buildTime;
+  });
+
+  size_t uniqueGeometries = picker.m_levels.size();
+  size_t sharedGeometries = 0;
+  for(uint32_t level : picker.m_geometryLevels)
+  {
+    sharedGeometries += level != ~0u ? 1 : 0;
+  }
+  size_t sceneTriangles = 0;
+  for(const CadScene::Object& object : scene.m_objects)
+  {
+    sceneTriangles += scene.m_geometry[object.geometryIndex].numIndexSolid / 3;
+  }
+  LOGI("bottom levels: %d for %d geometries, %d of %d scene triangles, memory: %d KB\n", uint32_t(uniqueGeometries),
+       uint32_t(sharedGeometries), uint32_t(picker.m_numTriangles), uint32_t(sceneTriangles),
+       uint32_t(picker.getMemoryUsage() / 1024));
+
+  std::vector<BenchmarkView> views;
+  getBenchmarkViews(scene, views);
+
+  glm::vec2        viewport = glm::vec2(1280, 720);
+  std::vector<int> partMatrices;
+  for(const BenchmarkView& view : views)
+  {
+    const glm::mat4& viewMatrix = view.viewMatrix;
+
+    uint32_t numHits    = 0;
+    uint32_t numSame    = 0;
+    double   timeSum    = 0;
+    double   timeMax    = 0;
+    double   timeBrute  = 0;
+    for(uint32_t y = 0; y < RAYS_Y; y++)
+    {
+      for(uint32_t x = 0; x < RAYS_X; x++)
+      {
+        glm::vec2 pixel = glm::vec2((float(x) + 0.5f) / float(RAYS_X), (float(y) + 0.5f) / float(RAYS_Y)) * viewport;
+        glm::vec3 origin;
+        glm::vec3 direction;
+        getPixelRay(viewMatrix, BENCHMARK_FOV, pixel, viewport, origin, direction);
+
+        double time = -NVPSystem::getTime();
+        Hit    hit  = picker.pick(scene, bvh, nullptr, origin, direction);
+        time += NVPSystem::getTime();
+
+        timeSum += time;
+        timeMax = std::max(timeMax, time);
+        numHits += hit.valid() ? 1 : 0;
+
+        uint32_t r = y * RAYS_X + x;
+        if(r % (RAYS_X * RAYS_Y / BRUTE_FORCE))
+          continue;
+
+        // every triangle of every object
+        Hit brute;
+        timeBrute -= NVPSystem::getTime();
+        for(uint32_t obj = 0; obj < uint32_t(scene.m_objects.size()); obj++)
+        {
+          const CadScene::Object& object     = scene.m_objects[obj];
+          uint32_t                levelIndex = picker.m_geometryLevels[object.geometryIndex];
+          if(levelIndex == ~0u)
+            continue;
+
+          // every distinct part matrix
+          const BottomLevel& level = picker.m_levels[levelIndex];
+          partMatrices.clear();
+          for(const CadScene::ObjectPart& part : object.parts)
+          {
+            if(std::find(partMatrices.begin(), partMatrices.end(), part.matrixIndex) != partMatrices.end())
+              continue;
+            partMatrices.push_back(part.matrixIndex);
+
+            glm::mat4 inverse     = glm::inverse(scene.m_matrices[part.matrixIndex].worldMatrix);
+            glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+            glm::vec3 localDir    = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+            IntersectTriangles(level, object, obj, part.matrixIndex, 0, uint32_t(level.triangles.size()), localOrigin,
+                               localDir, brute);
+          }
+        }
+        timeBrute += NVPSystem::getTime();
+
+        numSame += hit.object == brute.object && hit.triangle == brute.triangle ? 1 : 0;
+      }
+    }
+
+    uint32_t numRays = RAYS_X * RAYS_Y;
+    LOGI("pick %-8s: %4d of %4d rays hit, avg %7.4f max %7.4f [ms], every triangle %9.3f [ms], %d of %d same\n", view.name,
+         numHits, numRays, timeSum * 1000.0 / double(numRays), timeMax * 1000.0, timeBrute * 1000.0 / double(BRUTE_FORCE),
+         numSame, BRUTE_FORCE);
+  }
+  LOGI("\n");
+}
+}  // namespace csfthreaded
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include "cadscene.hpp"
+#include "objectbvh.hpp"
+#include "threadpool.hpp"
+
+#include <float.h>
+#include <vector>
+
+namespace csfthreaded {
+
+// ray picking against the solid triangles of a CadScene. Two levels: the ObjectBVH over the
+// objects in world space, and one triangle bvh per unique geometry in object space, which
+// clones share through CadScene::Geometry::cloneIdx. The triangles are copied at build time,
+// so picking keeps working when the cpu geometry is released.
+class ScenePicker
+{
+public:
+  struct Hit
+  {
+    float     distance = FLT_MAX;  // along the ray, in units of its direction
+    uint32_t  object   = ~0u;
+    uint32_t  part     = ~0u;
+    uint32_t  triangle = ~0u;  // within the solid indices of the object's geometry
+    glm::vec3 position;        // world space
+
+    bool valid() const { return object != ~0u; }
+  };
+
+  // triangle bvh in object space, nodes refer to ranges of triangles
+  struct BottomLevel
+  {
+    std::vector<ObjectBVH::Node> nodes;
+    std::vector<glm::vec3>       positions;
+    std::vector<uint32_t>        indices;    // three per triangle, in leaf order
+    std::vector<uint32_t>        triangles;  // Hit::triangle per leaf order triangle
+    std::vector<uint32_t>        parts;      // per leaf order triangle
+  };
+
+  // bottom levels of all unique geometries, distributed over numThreads of pool,
+  // which must not be occupied by a renderer. Needs the cpu geometry
+  void build(const CadScene& scene, ThreadPool& pool, uint32_t numThreads);
+  void deinit();
+
+  // nearest hit of the parts that are drawn. bvh is the top level, matrices must be the ones
+  // it was last built or refit with, nullptr for the scene's own
+  Hit pick(const CadScene&  scene,
+           const ObjectBVH& bvh,
+           const glm::mat4* matrices,
+           const glm::vec3& origin,
+           const glm::vec3& direction) const;
+
+  // world space ray through the center of a pixel, counted from the top left. fovy in degrees
+  static void getPixelRay(const glm::mat4& viewMatrix,
+                          float            fovy,
+                          const glm::vec2& pixel,
+                          const glm::vec2& viewport,
+                          glm::vec3&       origin,
+                          glm::vec3&       direction);
+
+  // build times for 1 to all threads, pick times for rays across a few views against testing every triangle
+  static void benchmark(const CadScene& scene, const ObjectBVH& bvh, ThreadPool& pool);
+
+  size_t getMemoryUsage() const;
+  bool   empty() const { return m_levels.empty(); }
+
+  // triangles of the unique geometries, and milliseconds of the last build
+  size_t m_numTriangles = 0;
+  double m_buildTime    = 0;
+
+private:
+  // pending node of a traversal and where the ray enters it
+  struct StackEntry
+  {
+    uint32_t node;
+    float    entry;
+  };
+
+  std::vector<BottomLevel> m_levels;
+  std::vector<uint32_t>    m_geometryLevels;  // per geometry, ~0 without solid triangles
+
+  // stack is shared with the top level traversal, entries above its current size are ours
+  // matrices as in pick
+  void pickObject(const CadScene&          scene,
+                  uint32_t                 obj,
+                  const glm::mat4*         matrices,
+                  const glm::vec3&         origin,
+                  const glm::vec3&         direction,
+                  std::vector<StackEntry>& stack,
+                  Hit&                     hit) const;
+};
+}  // namespace csfthreaded
@@ -224,8 +224,12 @@ void ThreadPool::threadProcess( ThreadEntry& entry )
     LOGI("%d started job\n", entry.m_id);
 
     entry.m_fn(entry.m_fnArg);
-    entry.m_fn = 0;
-    
+    {
+      std::unique_lock<std::mutex> lock(entry.m_commMutex);
+      entry.m_fn = 0;
+      entry.m_commCond.notify_all();
+    }
+
     LOGI("%d finished job\n", entry.m_id);
   }
 
@@ -303,10 +307,12 @@ void ThreadPool::activateJob( unsigned int tid, WorkerFunc fn, void* arg )
 
   ThreadEntry& entry = m_pool[tid];
 
-  assert( entry.m_fn == 0 );
-
   {
     std::unique_lock<std::mutex> lock(entry.m_commMutex);
+    // previous job may still be returning
+    while (entry.m_fn){
+      entry.m_commCond.wait(lock);
+    }
     entry.m_fn = fn;
     entry.m_fnArg = arg;
     entry.m_commCond.notify_all();
@@ -314,3 +320,14 @@ void ThreadPool::activateJob( unsigned int tid, WorkerFunc fn, void* arg )
 
 }
 
+void ThreadPool::waitJob( unsigned int tid )
+{
+  assert( tid < m_numThreads);
+
+  ThreadEntry& entry = m_pool[tid];
+
+  std::unique_lock<std::mutex> lock(entry.m_commMutex);
+  while (entry.m_fn){
+    entry.m_commCond.wait(lock);
+  }
+}
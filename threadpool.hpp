@@ -36,6 +36,8 @@ public:
   void  deinit();
 
   void  activateJob( unsigned int thread, WorkerFunc fn, void* arg );
+  // blocks until the job of the thread has returned
+  void  waitJob( unsigned int thread );
 
   static unsigned int sysGetNumCores();
 